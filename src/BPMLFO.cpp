@@ -2,9 +2,13 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "dsp-lfo/oscillator.hpp"
+#include "dsp-clock/clock.hpp"
+#include "ui/expander.hpp"
+#include "ui/messages.hpp"
+#include "ui/footprint.hpp"
 
 
-#define PASSTHROUGH_RIGHT_VARIABLE_COUNT 13
 
 struct BPMLFO : Module {
 	enum ParamIds {
@@ -85,14 +89,7 @@ struct BPMLFO : Module {
 				phase -= 1.0;
 		}
 		float sin() {
-			double phaseToUse = phase - 0.25; //Sin is out of ohase of other waveforms
-			if (phaseToUse >= 1.0)
-				phaseToUse -= 1.0;
-
-			if (offset)
-				return 1.0 - cosf(2*M_PI * phaseToUse);
-			else
-				return sinf(2*M_PI * phaseToUse);
+			return frozenwasteland::dsp::lfoSine(phase, offset);
 		}
 		float tri(float x) {
 			return 4.0 * fabsf(x - roundf(x));
@@ -121,22 +118,18 @@ struct BPMLFO : Module {
 		}
 	};
 
-	// // Expander
-	// float consumerMessage[PASSTHROUGH_RIGHT_VARIABLE_COUNT] = {};// this module must read from here
-	// float producerMessage[PASSTHROUGH_RIGHT_VARIABLE_COUNT] = {};// mother will write into here
+	// Expander, read by any phase expanders chained on the right
+	frozenwasteland::ExpanderPublisher<frozenwasteland::BPMLFOMessage> toPhaseExpanders;
 
 
 	LowFrequencyOscillator oscillator;
-	dsp::SchmittTrigger clockTrigger,resetTrigger,holdTrigger,quantizePhaseTrigger;
+	dsp::SchmittTrigger resetTrigger,holdTrigger,quantizePhaseTrigger;
 	
 	float multiplier = 1;
 	float division = 1;
-	double timeElapsed = 0.0;
-	double duration = 0;
+	frozenwasteland::dsp::ClockTracker clock;
 	float initialPhase = 0.0;
 	bool holding = false;
-	bool firstClockReceived = false;
-	bool secondClockReceived = false;
 	bool phase_quantized = false;
 
 	
@@ -155,28 +148,15 @@ struct BPMLFO : Module {
 		configParam(HOLD_CLOCK_BEHAVIOR_PARAM, 0.0, 1.0, 1.0);
 		configParam(HOLD_MODE_PARAM, 0.0, 1.0, 1.0);
 
-		// leftExpander.producerMessage = producerMessage;
-		// leftExpander.consumerMessage = consumerMessage;
+		toPhaseExpanders.attach(rightExpander);
 	}
 
 	void process(const ProcessArgs &args) override {
 
-		timeElapsed += 1.0 / args.sampleRate;
 		if(inputs[CLOCK_INPUT].isConnected()) {
-			if(clockTrigger.process(inputs[CLOCK_INPUT].getVoltage())) {
-				if(firstClockReceived) {
-					duration = timeElapsed;
-					secondClockReceived = true;
-				}
-				timeElapsed = 0;
-				firstClockReceived = true;			
-			} else if(secondClockReceived && timeElapsed > duration) {  //allow absense of second clock to affect duration
-				duration = timeElapsed;				
-			}		
+			clock.process(inputs[CLOCK_INPUT].getVoltage(), args.sampleTime);
 		} else {
-			duration = 0.0f;
-			firstClockReceived = false;
-			secondClockReceived = false;
+			clock.reset();
 		}
 		
 		
@@ -193,8 +173,8 @@ struct BPMLFO : Module {
 		}
 		division = clamp(division,1.0f,128.0f);
 
-		if(duration != 0) {
-			oscillator.setFrequency(1.0 / (duration / multiplier * division));
+		if(clock.period != 0) {
+			oscillator.setFrequency(1.0 / (clock.period / multiplier * division));
 		}
 		else {
 			oscillator.setFrequency(0);
@@ -253,23 +233,21 @@ struct BPMLFO : Module {
 		}
 
 
-		// bool rightExpanderPresent = (rightExpander.module && (rightExpander.module->model == modelBPMLFOPhaseExpander));
-		// if(rightExpanderPresent) {
-		// 	float *messageToSlave = (float*)(rightExpander.module->leftExpander.producerMessage);	
-		// 	messageToSlave[0] = inputs[CLOCK_INPUT].isConnected(); 	
-		// 	messageToSlave[1] = inputs[CLOCK_INPUT].getVoltage();
-		// 	messageToSlave[2] = inputs[RESET_INPUT].getVoltage();
-		// 	messageToSlave[3] = inputs[HOLD_INPUT].getVoltage();
-		// 	messageToSlave[4] = multiplier;
-		// 	messageToSlave[5] = division;
-		// 	messageToSlave[6] = initialPhase;
-		// 	messageToSlave[7] = params[OFFSET_PARAM].getValue();
-		// 	messageToSlave[8] = params[HOLD_MODE_PARAM].getValue();
-		// 	messageToSlave[9] = params[HOLD_CLOCK_BEHAVIOR_PARAM].getValue();
-		// 	messageToSlave[10] = 0.0f	;
-		// 	messageToSlave[11] = 1.0f;
-		// 	messageToSlave[12] = 0.5f;
-		// }
+		//Phase expanders read this directly, only what changed is sent
+		toPhaseExpanders.set(toPhaseExpanders.message.clockConnected, inputs[CLOCK_INPUT].isConnected());
+		toPhaseExpanders.set(toPhaseExpanders.message.clock, inputs[CLOCK_INPUT].getVoltage());
+		toPhaseExpanders.set(toPhaseExpanders.message.reset, inputs[RESET_INPUT].getVoltage());
+		toPhaseExpanders.set(toPhaseExpanders.message.hold, inputs[HOLD_INPUT].getVoltage());
+		toPhaseExpanders.set(toPhaseExpanders.message.multiplier, multiplier);
+		toPhaseExpanders.set(toPhaseExpanders.message.division, division);
+		toPhaseExpanders.set(toPhaseExpanders.message.initialPhase, initialPhase);
+		toPhaseExpanders.set(toPhaseExpanders.message.offset, params[OFFSET_PARAM].getValue());
+		toPhaseExpanders.set(toPhaseExpanders.message.holdMode, params[HOLD_MODE_PARAM].getValue());
+		toPhaseExpanders.set(toPhaseExpanders.message.holdClockMode, params[HOLD_CLOCK_BEHAVIOR_PARAM].getValue());
+		toPhaseExpanders.set(toPhaseExpanders.message.waveshape, 0.0f);
+		toPhaseExpanders.set(toPhaseExpanders.message.waveSlope, 1.0f);
+		toPhaseExpanders.set(toPhaseExpanders.message.skew, 0.5f);
+		toPhaseExpanders.send();
 			
 	}
 
@@ -404,4 +382,5 @@ struct BPMLFOWidget : ModuleWidget {
 
 
 
+static frozenwasteland::FootprintReport footprint("BPMLFO", sizeof(BPMLFO));
 Model *modelBPMLFO = createModel<BPMLFO, BPMLFOWidget>("BPMLFO");
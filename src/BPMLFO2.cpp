@@ -4,9 +4,15 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "dsp-lfo/oscillator.hpp"
+#include "dsp-clock/clock.hpp"
+#include "ui/expander.hpp"
+#include "ui/messages.hpp"
+#include "ui/snapshot.hpp"
+#include "ui/footprint.hpp"
 
 #define DISPLAY_SIZE 50
-#define PASSTHROUGH_RIGHT_VARIABLE_COUNT 13
+#define DISPLAY_DECIMATION 128
 
 struct BPMLFO2 : Module {
 	enum ParamIds {
@@ -66,10 +72,6 @@ struct BPMLFO2 : Module {
 		float waveSlope = 0.0; //Original (1 is sin)
 		bool offset = false;
 
-		float lerp(float v0, float v1, float t) {
-			return (1 - t) * v0 + t * v1;
-		}
-
 		void setPitch(float pitch) {
 			pitch = fminf(pitch, 8.0);
 			freq = powf(2.0, pitch);
@@ -106,54 +108,36 @@ struct BPMLFO2 : Module {
 				phase -= 1.0;
 		}
 
-		float skewsawInternal(float x) {
-			//x = dsp::eucmod(x,1.0);
-			x = std::fabs(std::fmod(x ,1.0f));
-
-			float inverseSkew = 1 - skew;
-			float originalWave;
-			if (skew == 0 && x == 0) //Avoid /0 error
-				originalWave = 2;
-			if (x <= skew)
-				originalWave = 2.0 * (1- (-1 / skew * x + 1));
-			else
-				originalWave = 2.0 * (1-(1 / inverseSkew * (x - skew)));
-			return originalWave;
-		}
-		
-		float skewsaw(double phaseOffset) {
+		float wrappedPhase(double phaseOffset) {
 			double phaseToUse = phase + phaseOffset;
 			if (phaseToUse >= 1.0)
 				phaseToUse -= 1.0;
-
-			if (offset)
-				return lerp(skewsawInternal(phaseToUse),sin(phaseOffset),waveSlope);
-			
-			return lerp(skewsawInternal(phaseToUse) - 1 ,sin(phaseOffset),waveSlope); //Going to keep same phase for now				
+			return phaseToUse;
 		}
 
-
-		float sin(double phaseOffset) {
-			double phaseToUse = phase + phaseOffset - 0.25; //Sin is out of ohase of other waveforms
-			if (phaseToUse >= 1.0)
-				phaseToUse -= 1.0;
-
-			if (offset)
-				return 1.0 - cosf(2*M_PI * (phaseToUse-skew*0));
-			
-			return sinf(2*M_PI * (phaseToUse-skew*0));
+		float skewsaw(double phaseOffset) {
+			return frozenwasteland::dsp::lfoSkewsaw(wrappedPhase(phaseOffset), skew, waveSlope, offset);
 		}
 
 		float sqr(double phaseOffset) {
-			double phaseToUse = phase + phaseOffset;
-			if (phaseToUse >= 1.0)
-				phaseToUse -= 1.0;
-
-			float sqr = (phaseToUse < pw) ? 1.0 : -1.0;
-			sqr = offset ? sqr + 1.0 : sqr;
+			return frozenwasteland::dsp::lfoSquare(wrappedPhase(phaseOffset), pw, waveSlope, offset);
+		}
 
-			float result = lerp(sqr,sin(phaseOffset),waveSlope);
-			return result;
+		// The four phased outputs (0, 45, 90 and 180 degrees) evaluated as one lane group
+		void phasedOutputs(bool square, float *out) {
+			const double phaseOffsets[frozenwasteland::dsp::LFO_LANES] = {0.0, 0.125, 0.25, 0.5};
+			alignas(16) float phases[frozenwasteland::dsp::LFO_LANES];
+			alignas(16) float shapes[frozenwasteland::dsp::LFO_LANES];
+			alignas(16) float slopes[frozenwasteland::dsp::LFO_LANES];
+			for (int i = 0; i < frozenwasteland::dsp::LFO_LANES; i++) {
+				phases[i] = wrappedPhase(phaseOffsets[i]);
+				shapes[i] = square ? pw : skew;
+				slopes[i] = waveSlope;
+			}
+			if (square)
+				frozenwasteland::dsp::lfoSquare4(phases, shapes, slopes, offset, out);
+			else
+				frozenwasteland::dsp::lfoSkewsaw4(phases, shapes, slopes, offset, out);
 		}
 		
 		float progress() {
@@ -161,25 +145,21 @@ struct BPMLFO2 : Module {
 		}
 	};
 
-	// // Expander
-	// float consumerMessage[PASSTHROUGH_RIGHT_VARIABLE_COUNT] = {};// this module must read from here
-	// float producerMessage[PASSTHROUGH_RIGHT_VARIABLE_COUNT] = {};// mother will write into here
+	// Expander, read by any phase expanders chained on the right
+	frozenwasteland::ExpanderPublisher<frozenwasteland::BPMLFOMessage> toPhaseExpanders;
 
 
 
-	LowFrequencyOscillator oscillator,displayOscillator;
-	dsp::SchmittTrigger clockTrigger,resetTrigger,holdTrigger;
+	LowFrequencyOscillator oscillator;
+	dsp::SchmittTrigger resetTrigger,holdTrigger;
 	float multiplier = 1;
 	float division = 1;
-	double timeElapsed = 0.0;
-	double duration = 0;
+	frozenwasteland::dsp::ClockTracker clock;
 	float waveshape = 0;
 	float waveSlope = 0.0;
 	float skew = 0.5;
 	float initialPhase = 0.0;
 	bool holding = false;
-	bool firstClockReceived = false;
-	bool secondClockReceived = false;
 	bool phase_quantized = false;
 
 	float lfoOutputValue = 0.0;
@@ -187,10 +167,17 @@ struct BPMLFO2 : Module {
 	float lfo90OutputValue = 0.0;
 	float lfo180OutputValue = 0.0;
 
-	float lastWaveShape = -1;
-	float lastWaveSlope = -1;
-	float lastSkew = -1;
-	float waveValues[DISPLAY_SIZE] = {};
+	// Raw values published for BPMLFO2ProgressDisplay, which builds the wave shape itself on the UI thread
+	struct DisplayState {
+		float waveshape;
+		float waveSlope;
+		float skew;
+		float phase;
+		float multiplier;
+		float division;
+	};
+	frozenwasteland::SnapshotChannel<DisplayState> displayChannel;
+	int displayCounter = 0;
 
 	dsp::SchmittTrigger quantizePhaseTrigger;
 
@@ -213,8 +200,7 @@ struct BPMLFO2 : Module {
 		configParam(HOLD_CLOCK_BEHAVIOR_PARAM, 0.0, 1.0, 1.0);
 		configParam(HOLD_MODE_PARAM, 0.0, 1.0, 1.0);
 
-		// leftExpander.producerMessage = producerMessage;
-		// leftExpander.consumerMessage = consumerMessage;
+		toPhaseExpanders.attach(rightExpander);
 	}
 	void process(const ProcessArgs &args) override;
 
@@ -231,22 +217,10 @@ struct BPMLFO2 : Module {
 
 void BPMLFO2::process(const ProcessArgs &args) {
 
-    timeElapsed += 1.0 / args.sampleRate;
 	if(inputs[CLOCK_INPUT].isConnected()) {
-		if(clockTrigger.process(inputs[CLOCK_INPUT].getVoltage())) {
-			if(firstClockReceived) {
-				duration = timeElapsed;
-				secondClockReceived = true;
-			}
-			timeElapsed = 0;
-			firstClockReceived = true;			
-		} else if(secondClockReceived && timeElapsed > duration) {  //allow absense of second clock to affect duration
-			duration = timeElapsed;				
-		}	
+		clock.process(inputs[CLOCK_INPUT].getVoltage(), args.sampleTime);
 	} else {
-		duration = 0.0f;
-		firstClockReceived = false;
-		secondClockReceived = false;
+		clock.reset();
 	}
 	
 	
@@ -300,24 +274,8 @@ void BPMLFO2::process(const ProcessArgs &args) {
 	oscillator.skew = skew;
 	oscillator.setPulseWidth(skew);
 
-	//Recalcluate display waveform if something changed
-	if(lastWaveShape != waveshape || lastWaveSlope != waveSlope || lastSkew != skew) {
-		displayOscillator.waveSlope = waveSlope;
-		displayOscillator.skew = skew;
-		displayOscillator.setPulseWidth(skew);
-		displayOscillator.setFrequency(1.0);
-		displayOscillator.phase = 0;
-		for(int i=0;i<DISPLAY_SIZE;i++) {
-			waveValues[i] = (waveshape == SKEWSAW_WAV ? displayOscillator.skewsaw(0.0) : displayOscillator.sqr(0.0)) * DISPLAY_SIZE / 2;
-			displayOscillator.step(1.0 / DISPLAY_SIZE);			
-		}
-		lastWaveShape = waveshape;
-		lastWaveSlope = waveSlope;
-		lastSkew = skew;
-	}
-
-	if(duration != 0) {
-		oscillator.setFrequency(1.0 / (duration / multiplier * division));
+	if(clock.period != 0) {
+		oscillator.setFrequency(1.0 / (clock.period / multiplier * division));
 	}
 	else {
 		oscillator.setFrequency(0);
@@ -345,18 +303,12 @@ void BPMLFO2::process(const ProcessArgs &args) {
     }
 
 	if(!holding) {
-		if(waveshape == SKEWSAW_WAV) {
-			lfoOutputValue = 5.0 * oscillator.skewsaw(0.0);
-			lfo45OutputValue = 5.0 * oscillator.skewsaw(0.125);
-			lfo90OutputValue = 5.0 * oscillator.skewsaw(0.25);
-			lfo180OutputValue = 5.0 * oscillator.skewsaw(0.5);
-		}
-		else {
-			lfoOutputValue = 5.0 * oscillator.sqr(0.0);
-			lfo45OutputValue = 5.0 * oscillator.sqr(0.125);
-			lfo90OutputValue = 5.0 * oscillator.sqr(0.25);
-			lfo180OutputValue = 5.0 * oscillator.sqr(0.5);
-		}		
+		alignas(16) float lfoValues[4];
+		oscillator.phasedOutputs(waveshape != SKEWSAW_WAV, lfoValues);
+		lfoOutputValue = 5.0 * lfoValues[0];
+		lfo45OutputValue = 5.0 * lfoValues[1];
+		lfo90OutputValue = 5.0 * lfoValues[2];
+		lfo180OutputValue = 5.0 * lfoValues[3];
 	}
 	
 
@@ -365,23 +317,33 @@ void BPMLFO2::process(const ProcessArgs &args) {
 	outputs[LFO_90_OUTPUT].setVoltage(lfo90OutputValue);
 	outputs[LFO_180_OUTPUT].setVoltage(lfo180OutputValue);
 
-	// bool rightExpanderPresent = (rightExpander.module && (rightExpander.module->model == modelBPMLFOPhaseExpander));
-	// if(rightExpanderPresent) {
-	// 	float *messageToSlave = (float*)(rightExpander.module->leftExpander.producerMessage);	
-	// 	messageToSlave[0] = inputs[CLOCK_INPUT].isConnected(); 	
-	// 	messageToSlave[1] = inputs[CLOCK_INPUT].getVoltage();
-	// 	messageToSlave[2] = inputs[RESET_INPUT].getVoltage();
-	// 	messageToSlave[3] = inputs[HOLD_INPUT].getVoltage();
-	// 	messageToSlave[4] = multiplier;
-	// 	messageToSlave[5] = division;
-	// 	messageToSlave[6] = initialPhase;
-	// 	messageToSlave[7] = params[OFFSET_PARAM].getValue();
-	// 	messageToSlave[8] = params[HOLD_MODE_PARAM].getValue();
-	// 	messageToSlave[9] = params[HOLD_CLOCK_BEHAVIOR_PARAM].getValue();
-	// 	messageToSlave[10] = waveshape;
-	// 	messageToSlave[11] = waveSlope;
-	// 	messageToSlave[12] = skew;
-	// }
+	if (++displayCounter >= DISPLAY_DECIMATION) {
+		displayCounter = 0;
+		DisplayState &state = displayChannel.write();
+		state.waveshape = waveshape;
+		state.waveSlope = waveSlope;
+		state.skew = skew;
+		state.phase = oscillator.progress();
+		state.multiplier = multiplier;
+		state.division = division;
+		displayChannel.publish();
+	}
+
+	//Phase expanders read this directly, only what changed is sent
+	toPhaseExpanders.set(toPhaseExpanders.message.clockConnected, inputs[CLOCK_INPUT].isConnected());
+	toPhaseExpanders.set(toPhaseExpanders.message.clock, inputs[CLOCK_INPUT].getVoltage());
+	toPhaseExpanders.set(toPhaseExpanders.message.reset, inputs[RESET_INPUT].getVoltage());
+	toPhaseExpanders.set(toPhaseExpanders.message.hold, inputs[HOLD_INPUT].getVoltage());
+	toPhaseExpanders.set(toPhaseExpanders.message.multiplier, multiplier);
+	toPhaseExpanders.set(toPhaseExpanders.message.division, division);
+	toPhaseExpanders.set(toPhaseExpanders.message.initialPhase, initialPhase);
+	toPhaseExpanders.set(toPhaseExpanders.message.offset, params[OFFSET_PARAM].getValue());
+	toPhaseExpanders.set(toPhaseExpanders.message.holdMode, params[HOLD_MODE_PARAM].getValue());
+	toPhaseExpanders.set(toPhaseExpanders.message.holdClockMode, params[HOLD_CLOCK_BEHAVIOR_PARAM].getValue());
+	toPhaseExpanders.set(toPhaseExpanders.message.waveshape, waveshape);
+	toPhaseExpanders.set(toPhaseExpanders.message.waveSlope, waveSlope);
+	toPhaseExpanders.set(toPhaseExpanders.message.skew, skew);
+	toPhaseExpanders.send();
 
 }
 
@@ -392,10 +354,32 @@ struct BPMLFO2ProgressDisplay : TransparentWidget {
 
 	
 
+	BPMLFO2::DisplayState state = {};
+	float lastWaveShape = -1;
+	float lastWaveSlope = -1;
+	float lastSkew = -1;
+	float waveValues[DISPLAY_SIZE] = {};
+
 	BPMLFO2ProgressDisplay() {
 		font = APP->window->loadFont(asset::plugin(pluginInstance, "res/fonts/01 Digit.ttf"));
 	}
 
+	//Recalcluate display waveform if something changed
+	void updateWaveValues() {
+		if(lastWaveShape == state.waveshape && lastWaveSlope == state.waveSlope && lastSkew == state.skew)
+			return;
+
+		float pw = clamp(state.skew, 0.01f, 0.99f);
+		for(int i=0;i<DISPLAY_SIZE;i++) {
+			float phase = (float)i / DISPLAY_SIZE;
+			float value = state.waveshape == BPMLFO2::SKEWSAW_WAV ? frozenwasteland::dsp::lfoSkewsaw(phase, state.skew, state.waveSlope, false) : frozenwasteland::dsp::lfoSquare(phase, pw, state.waveSlope, false);
+			waveValues[i] = value * DISPLAY_SIZE / 2;
+		}
+		lastWaveShape = state.waveshape;
+		lastWaveSlope = state.waveSlope;
+		lastSkew = state.skew;
+	}
+
 
 	void drawWaveShape(const DrawArgs &args, int waveshape, float skew, float waveslope) 
 	{
@@ -404,9 +388,9 @@ struct BPMLFO2ProgressDisplay : TransparentWidget {
 		nvgStrokeWidth(args.vg, 1.0);
 
 		nvgBeginPath(args.vg);
-		nvgMoveTo(args.vg,34,125 - module->waveValues[0]);
+		nvgMoveTo(args.vg,34,125 - waveValues[0]);
 		for(int i=1;i<DISPLAY_SIZE;i++) {
-			nvgLineTo(args.vg,34 + i,125 - module->waveValues[i]);
+			nvgLineTo(args.vg,34 + i,125 - waveValues[i]);
 		}
 		
 		nvgStroke(args.vg);		
@@ -419,9 +403,9 @@ struct BPMLFO2ProgressDisplay : TransparentWidget {
 		nvgStrokeWidth(args.vg, 1.0);
 
 		nvgBeginPath(args.vg);
-		//nvgMoveTo(args.vg,140,177 - module->waveValues[0]);
+		//nvgMoveTo(args.vg,140,177 - waveValues[0]);
 		for(int i=0;i<phase * DISPLAY_SIZE;i++) {
-			nvgMoveTo(args.vg,34 + i,125-module->waveValues[i]);
+			nvgMoveTo(args.vg,34 + i,125-waveValues[i]);
 			nvgLineTo(args.vg,34 + i, 151 );
 			
 		}
@@ -455,10 +439,12 @@ struct BPMLFO2ProgressDisplay : TransparentWidget {
 	void draw(const DrawArgs &args) override {
 		if (!module)
 			return;	
-		drawWaveShape(args,module->waveshape, module->skew, module->waveSlope);
-		drawProgress(args,module->waveshape, module->skew, module->waveSlope, module->oscillator.progress());
-		drawMultiplier(args, Vec(2, 48), module->multiplier);
-		drawDivision(args, Vec(68, 48), module->division);
+		module->displayChannel.read(state);
+		updateWaveValues();
+		drawWaveShape(args,state.waveshape, state.skew, state.waveSlope);
+		drawProgress(args,state.waveshape, state.skew, state.waveSlope, state.phase);
+		drawMultiplier(args, Vec(2, 48), state.multiplier);
+		drawDivision(args, Vec(68, 48), state.division);
 	}
 };
 
@@ -525,4 +511,5 @@ struct BPMLFO2Widget : ModuleWidget {
 
 
 
+static frozenwasteland::FootprintReport footprint("BPMLFO2", sizeof(BPMLFO2));
 Model *modelBPMLFO2 = createModel<BPMLFO2, BPMLFO2Widget>("BPMLFO2");
@@ -4,11 +4,12 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/expander.hpp"
+#include "ui/messages.hpp"
+#include "ui/footprint.hpp"
 
 #define MAX_OUTPUTS 12
 
-#define PASSTHROUGH_RIGHT_VARIABLE_COUNT 13
-
 
 struct BPMLFOPhaseExpander : Module {
 	enum ParamIds {
@@ -141,10 +142,6 @@ struct BPMLFOPhaseExpander : Module {
 		}
 	};
 
-	// Expander
-	float consumerMessage[PASSTHROUGH_RIGHT_VARIABLE_COUNT] = {};// this module must read from here
-	float producerMessage[PASSTHROUGH_RIGHT_VARIABLE_COUNT] = {};// mother will write into here
-
 
 	LowFrequencyOscillator oscillator;
 	dsp::SchmittTrigger clockTrigger,resetTrigger,holdTrigger,forceIntegerTrigger;
@@ -175,9 +172,6 @@ struct BPMLFOPhaseExpander : Module {
 		configParam(PHASE_DIVISION_PARAM, 3.0, 12.0, 3.0,"Phase Division");
 		configParam(PHASE_DIVISION_CV_ATTENUVERTER_PARAM, -1.0, 1.0, 0.0,"Phase Division CV Attenuation","%",0,100);
 		configParam(WAVESHAPE_PARAM, 1.0, 5.0, 1.0,"Wave Shape");
-
-		leftExpander.producerMessage = producerMessage;
-		leftExpander.consumerMessage = consumerMessage;
 	}
 	void process(const ProcessArgs &args) override;
 
@@ -194,45 +188,27 @@ struct BPMLFOPhaseExpander : Module {
 
 void BPMLFOPhaseExpander::process(const ProcessArgs &args) {
 
-	bool motherPresent = (leftExpander.module && (leftExpander.module->model == modelBPMLFO || leftExpander.module->model == modelBPMLFO2 || leftExpander.module->model == modelBPMLFOPhaseExpander));
-	//lights[CONNECTED_LIGHT].value = motherPresent;
-	if (!motherPresent) {
+	//The BPM LFO at the head of the chain, read directly rather than handed along by each expander
+	Module *mother = frozenwasteland::pastExpanders(leftExpander.module, true, {modelBPMLFOPhaseExpander});
+	const frozenwasteland::ExpanderPacket<frozenwasteland::BPMLFOMessage> *fromMother = frozenwasteland::readExpander<frozenwasteland::BPMLFOMessage>(mother, false);
+	if (!fromMother) {
 		return;
 	}
 
-											
-	// From Mother	
-	float *messagesFromMother = (float*)leftExpander.consumerMessage;
-	float clockConnected = messagesFromMother[0];
-	float clockInput = messagesFromMother[1];
-	float resetInput = messagesFromMother[2];
-	float holdInput = messagesFromMother[3];
-	multiplier = messagesFromMother[4];
-	division = messagesFromMother[5];
-	initialPhase = messagesFromMother[6];
-	float offset = messagesFromMother[7];
-	float holdMode = messagesFromMother[8];
-	float holdClockMode = messagesFromMother[9];
-	waveshape = messagesFromMother[10];
-	waveSlope = messagesFromMother[11];
-	skew = messagesFromMother[12]; 
-
-	
-
-	//If another expander is present, pass values on to it
-	bool anotherExpanderPresent = (rightExpander.module && (rightExpander.module->model == modelBPMLFOPhaseExpander));
-	if(anotherExpanderPresent)
-	{					
-		//QAR Pass through right
-		float *messageToSlave = (float*)(rightExpander.module->leftExpander.producerMessage);	
-		for(int i = 0; i < PASSTHROUGH_RIGHT_VARIABLE_COUNT;i++) {
-			messageToSlave[i] = messagesFromMother[i];
-		}	
-	}
-	
-	leftExpander.messageFlipRequested = true;
-
-	
+	const frozenwasteland::BPMLFOMessage &message = fromMother->payload;
+	bool clockConnected = message.clockConnected;
+	float clockInput = message.clock;
+	float resetInput = message.reset;
+	float holdInput = message.hold;
+	multiplier = message.multiplier;
+	division = message.division;
+	initialPhase = message.initialPhase;
+	float offset = message.offset;
+	float holdMode = message.holdMode;
+	float holdClockMode = message.holdClockMode;
+	waveshape = message.waveshape;
+	waveSlope = message.waveSlope;
+	skew = message.skew; 
 
     timeElapsed += 1.0 / args.sampleRate;
 	if(clockConnected) {
@@ -381,4 +357,5 @@ struct BPMLFOPhaseExpanderWidget : ModuleWidget {
 
 
 
+static frozenwasteland::FootprintReport footprint("BPMLFOPhaseExpander", sizeof(BPMLFOPhaseExpander));
 Model *modelBPMLFOPhaseExpander = createModel<BPMLFOPhaseExpander, BPMLFOPhaseExpanderWidget>("BPMLFOPhaseExpander");
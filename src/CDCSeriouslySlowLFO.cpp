@@ -1,4 +1,5 @@
 #include "FrozenWasteland.hpp"
+#include "ui/footprint.hpp"
 
 
 
@@ -287,4 +288,5 @@ struct CDCSeriouslySlowLFOWidget : ModuleWidget {
 };
 
 
+static frozenwasteland::FootprintReport footprint("CDCSeriouslySlowLFO", sizeof(CDCSeriouslySlowLFO));
 Model *modelCDCSeriouslySlowLFO = createModel<CDCSeriouslySlowLFO, CDCSeriouslySlowLFOWidget>("CDCSeriouslySlowLFO");
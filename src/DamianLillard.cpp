@@ -1,5 +1,8 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
+#include "ui/sleep.hpp"
+#include "ui/denormal.hpp"
+#include "ui/footprint.hpp"
 #include "StateVariableFilter.h"
 
 using namespace std;
@@ -50,6 +53,8 @@ struct DamianLillard : Module {
     StateVariableFilterState<T> filterStates[numFilters];
     StateVariableFilterParams<T> filterParams[numFilters];
 
+	frozenwasteland::SleepDetector sleepDetector;
+	frozenwasteland::DenormalMonitor denormals{"DamianLillard"};
 
 	int bandOffset = 0;
 
@@ -80,6 +85,7 @@ struct DamianLillard : Module {
 };
 
 void DamianLillard::process(const ProcessArgs &args) {
+	frozenwasteland::DenormalGuard denormalGuard;
 	
 	float signalIn = inputs[SIGNAL_IN].getVoltage()/5;
 	float out = 0.0;
@@ -108,6 +114,21 @@ void DamianLillard::process(const ProcessArgs &args) {
 		}
 	}
 
+	// Everything that can make sound: the signal and the band returns
+	float inputLevel = fabsf(inputs[SIGNAL_IN].getVoltage());
+	for(int i=0; i<BANDS; i++) {
+		if(inputs[BAND_1_RETURN_INPUT+i].isConnected()) {
+			inputLevel = std::max(inputLevel, fabsf(inputs[BAND_1_RETURN_INPUT+i].getVoltage()));
+		}
+	}
+	if(sleepDetector.sleeping(inputLevel)) {
+		for(int i=0; i<BANDS; i++) {
+			outputs[BAND_1_OUTPUT+i].setVoltage(0.0f);
+		}
+		outputs[MIX_OUTPUT].setVoltage(0.0f);
+		return;
+	}
+
 	output[0] = StateVariableFilter<T>::run(signalIn, filterStates[0], filterParams[0]) * 5;
 	output[1] = StateVariableFilter<T>::run(StateVariableFilter<T>::run(signalIn, filterStates[1], filterParams[1]), filterStates[2], filterParams[2]) * 5;
 	output[2] = StateVariableFilter<T>::run(StateVariableFilter<T>::run(signalIn, filterStates[3], filterParams[3]), filterStates[4], filterParams[4]) * 5;
@@ -124,6 +145,17 @@ void DamianLillard::process(const ProcessArgs &args) {
 	}
 
 	outputs[MIX_OUTPUT].setVoltage(out / 2.0); 
+
+	float tail = fabsf(out);
+	for(int i=0; i<BANDS; i++) {
+		tail = std::max(tail, fabsf(output[i]));
+	}
+	for(int i=0; i<numFilters; i++) {
+		filterStates[i].flushDenormals(denormals);
+		tail = std::max(tail, std::max(fabsf(filterStates[i].z1), fabsf(filterStates[i].z2)) * 5.0f);
+	}
+	sleepDetector.track(inputLevel, tail, args.sampleTime);
+	denormals.tick(args.sampleTime);
 	
 }
 
@@ -209,4 +241,5 @@ struct DamianLillardWidget : ModuleWidget {
 };
 
 
+static frozenwasteland::FootprintReport footprint("DamianLillard", sizeof(DamianLillard));
 Model *modelDamianLillard = createModel<DamianLillard, DamianLillardWidget>("DamianLillard");
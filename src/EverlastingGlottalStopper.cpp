@@ -1,5 +1,6 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
+#include "ui/footprint.hpp"
 #include "dsp-noise/noise.hpp"
 #include "filters/biquad.h"
 
@@ -162,4 +163,5 @@ struct EverlastingGlottalStopperWidget : ModuleWidget {
 };
 
 
+static frozenwasteland::FootprintReport footprint("EverlastingGlottalStopper", sizeof(EverlastingGlottalStopper));
 Model *modelEverlastingGlottalStopper = createModel<EverlastingGlottalStopper, EverlastingGlottalStopperWidget>("EverlastingGlottalStopper");
@@ -5,6 +5,14 @@
 #include "samplerate.h"
 #include <iostream>
 #include "ui/knobs.hpp"
+#include "ui/framebuffer.hpp"
+#include "ui/storage.hpp"
+#include "ui/sleep.hpp"
+#include "ui/denormal.hpp"
+#include "ui/footprint.hpp"
+#include "ui/block.hpp"
+#include "ui/quality.hpp"
+#include "dsp-clock/clock.hpp"
 
 #define HISTORY_SIZE (1<<22)
 #define NUM_TAPS 64
@@ -12,6 +20,33 @@
 #define DIVISIONS 21
 #define NUM_PATTERNS 16
 #define NUM_FEEDBACK_TYPES 4
+#define MAX_VOICES 8
+#define VOICE_LANES 4
+#define VOICE_GROUPS (MAX_VOICES / VOICE_LANES)
+#define VOICE_HISTORY_SIZE (1<<16)
+
+// Quality tiers. Only the polyphonic mode's control rate changes: how often the shared tap tables are rebuilt. Mono sounds and costs the same in every tier.
+static const frozenwasteland::QualityProfile hairPickQuality[frozenwasteland::NUM_QUALITY_TIERS] = {
+	// interpolation, oversample, grain cap, filter stages, control interval, estimated cost
+	{frozenwasteland::INTERPOLATION_LINEAR, 1, 1, 1, 64, 0.9f},
+	{frozenwasteland::INTERPOLATION_LINEAR, 1, 1, 1, 16, 1.0f},
+	{frozenwasteland::INTERPOLATION_LINEAR, 1, 1, 1, 1, 1.6f},
+};
+
+// The 32 MB history, and 4 MB for the polyphonic voices, built off the engine thread once the module exists
+struct HairPickBuffers {
+	FrozenWasteland::MirroredMultiTapRingBuffer<FloatFrame, HISTORY_SIZE,NUM_TAPS+1> historyBuffer;
+	// Each voice's own short history, four voices side by side in each frame
+	alignas(16) float voiceHistory[VOICE_GROUPS][CHANNELS][VOICE_HISTORY_SIZE][VOICE_LANES];
+
+	HairPickBuffers() {
+		memset(voiceHistory, 0, sizeof(voiceHistory));
+	}
+
+	bool allocated() const {
+		return historyBuffer.allocated;
+	}
+};
 
 
 struct HairPick : Module {
@@ -61,8 +96,8 @@ struct HairPick : Module {
 		FEEDBACK_RAW,
 	};
 
-	const char* combPatternNames[NUM_PATTERNS] = {"Uniform","Flat Middle","Early Comb","Fibonacci","Flat Comb","Late Comb","Rev. Fibonacci","Ess Comb","Rand Uniform","Rand Middle","Rand Early","Rand Fibonacci","Rand Flat","Rand Late","Rand Rev Fib","Rand Ess"};
-	const float combPatterns[NUM_PATTERNS][NUM_TAPS] = {
+	static constexpr const char* combPatternNames[NUM_PATTERNS] = {"Uniform","Flat Middle","Early Comb","Fibonacci","Flat Comb","Late Comb","Rev. Fibonacci","Ess Comb","Rand Uniform","Rand Middle","Rand Early","Rand Fibonacci","Rand Flat","Rand Late","Rand Rev Fib","Rand Ess"};
+	static constexpr float combPatterns[NUM_PATTERNS][NUM_TAPS] = {
 		{1.0f,2.0f,3.0,4.0,5.0,6.0,7.0,8.0,9.0,10.0,11.0,12.0,13.0,14.0,15.0,16.0,17.0,18.0,19.0,20.0,21.0,22.0,23.0,24.0,25.0,26.0,27.0,28.0,29.0,30.0,31.0,32.0,33.0,34.0,35.0,36.0,37.0,38.0,39.0,40.0,41.0,42.0,43.0,44.0,45.0,46.0,47.0,48.0,49.0,50.0,51.0,52.0,53.0,54.0,55.0,56.0,57.0,58.0,59.0,60.0,61.0,62.0,63.0,64.0}, // Uniform
 		{1.0f,2.0f,3.0,4.0,5.0,6.0,7.0,8.0,9.0,10.0,11.0,12.0,13.0,14.0,15.0,16.0,24.5,25.0,25.5,26.0,26.5,27.0,27.5,28.0,28.5,29.0,29.5,30.0,30.5,31.5,32.0,32.5,33.0,33.5,34.0,34.5,35.0,35.5,36.0,36.5,37.0,37.5,38.0,38.5,39.0,39.5,40.0,48.0,49.0,50.0,51.0,52.0,53.0,54.0,55.0,56.0,57.0,58.0,59.0,60.0,61.0,62.0,63.0,64.0}, // Flat Middle
 		{0.25f,0.5f,0.75f,1.0f,1.25f,1.5f,1.75f,2.0f,2.25f,2.5f,2.75f,3.0f,3.25f,3.5f,3.75f,4.0f,4.5f,5.0f,5.5f,6.0f,6.5f,7.0f,7.5f,8.0f,8.5f,9.0f,9.5f,10.0f,10.5f,11.0f,11.5f,12.0f,13.0f,14.0f,15.0f,16.0f,17.0f,18.0f,19.0f,20.0f,21.0f,22.0f,23.0f,24.0f,25.0f,26.0f,27.0f,28.0f,30.0f,32.0f,34.0f,36.0f,38.0f,40.0f,42.0f,44.0f,46.0f,48.0f,50.0f,52.0f,55.0f,58.0f,61.0f,64.0f}, // Early Comb
@@ -81,7 +116,7 @@ struct HairPick : Module {
 		{1.227f,1.69f,2.356f,2.925f,3.035f,3.53f,4.379f,4.581f,4.872f,5.614f,6.15f,6.629f,6.876f,7.199f,8.111f,8.855f,9.744f,10.338f,11.417f,12.745f,13.09f,14.512f,15.197f,16.068f,18.112f,20.342f,22.943f,24.92f,26.793f,30.707f,32.794f,34.89f,36.117f,38.542f,40.327f,42.95f,44.243f,46.082f,48.205f,49.592f,50.992f,51.408f,52.914f,53.784f,53.947f,54.299f,55.104f,55.65f,56.713f,57.184f,58.025f,58.193f,59.061f,59.281f,59.715f,60.494f,61.289f,61.693f,61.813f,62.587f,63.459f,63.58f,63.868f,64.0f} //Random Ess Comb
 	};
 
-	const char* feedbackTypeNames[NUM_FEEDBACK_TYPES] = {"Guitar","Sitar","Clarinet","Raw"};
+	static constexpr const char* feedbackTypeNames[NUM_FEEDBACK_TYPES] = {"Guitar","Sitar","Clarinet","Raw"};
 
 
 	int combPattern = 0;
@@ -90,23 +125,44 @@ struct HairPick : Module {
 	float tentLevel = 1.0f;
 	int tentTap = 32;
 	
-	dsp::SchmittTrigger clockTrigger;
-	float divisions[DIVISIONS] = {1/256.0,1/192.0,1/128.0,1/96.0,1/64.0,1/48.0,1/32.0,1/24.0,1/16.0,1/13.0,1/12.0,1/11.0,1/8.0,1/7.0,1/6.0,1/5.0,1/4.0,1/3.0,1/2.0,1/1.5,1};
-	const char* divisionNames[DIVISIONS] = {"/256","/192","/128","/96","/64","/48","/32","/24","/16","/13","/12","/11","/8","/7","/6","/5","/4","/3","/2","/1.5","x 1"};
+	frozenwasteland::dsp::ClockTracker clock;
+	static constexpr float divisions[DIVISIONS] = {1/256.0,1/192.0,1/128.0,1/96.0,1/64.0,1/48.0,1/32.0,1/24.0,1/16.0,1/13.0,1/12.0,1/11.0,1/8.0,1/7.0,1/6.0,1/5.0,1/4.0,1/3.0,1/2.0,1/1.5,1};
+	static constexpr const char* divisionNames[DIVISIONS] = {"/256","/192","/128","/96","/64","/48","/32","/24","/16","/13","/12","/11","/8","/7","/6","/5","/4","/3","/2","/1.5","x 1"};
 	int division;
-	float timeElapsed= 0.0;
-	float duration = 0;
 	float baseDelay;
-	bool firstClockReceived = false;
-	bool secondClockReceived = false;
+	int tapCount = NUM_TAPS;
+	float feedbackAmount = 0.0f;
+
+	// Last values shown by the status display, in display resolution
+	frozenwasteland::DisplayVersion displayVersion;
+	int displayedDivision = -1;
+	int displayedDelay = -1;
+	int displayedPattern = -1;
+	int displayedFeedbackType = -1;
+	int displayedEnvelope = -1;
+	int displayedDelayLimited = -1;
 
 
 	bool combActive[NUM_TAPS];
 	float combLevel[NUM_TAPS];
-
-
-	FrozenWasteland::MultiTapDoubleRingBuffer<FloatFrame, HISTORY_SIZE,NUM_TAPS+1> historyBuffer;
+	// Where each tap sits, as a fraction of the delay, and its level after muting and the envelope. Shared by every voice.
+	float tapPosition[NUM_TAPS];
+	float tapGain[NUM_TAPS];
+
+	// Polyphonic mode, when V/Oct carries more than one channel
+	alignas(16) float voiceFeedback[VOICE_GROUPS][CHANNELS][VOICE_LANES] = {};
+	size_t voiceWrite = 0;
+	// Set while a voice's delay is longer than its history can hold, so the display can show it is cut short
+	bool voiceDelayLimited = false;
+	int controlCountdown = 0;
+	frozenwasteland::QualitySetting quality{hairPickQuality};
+
+
+	frozenwasteland::DeferredStorage<HairPickBuffers> storage;
+	frozenwasteland::SleepDetector sleepDetector;
+	frozenwasteland::DenormalMonitor denormals{"HairPick"};
 	FrozenWasteland::DoubleRingBuffer<FloatFrame, 16> outBuffer[NUM_TAPS+1]; 
+	frozenwasteland::BlockProcessor<FloatFrame, FloatFrame> block;
 	
 	SRC_STATE *src[NUM_TAPS + 1];
 	FloatFrame lastFeedback = {0.0f,0.0f};
@@ -159,8 +215,8 @@ struct HairPick : Module {
 		for(int i=0;i<=NUM_TAPS; i++) {
 			src[i] = src_new(SRC_LINEAR, 2, NULL);	
 		}
+		storage.request();
 
-		srand(time(NULL));
 		//src = src_new(SRC_LINEAR, 1, NULL);		
 		//src = src_new(SRC_ZERO_ORDER_HOLD, 1, NULL);
 	}
@@ -170,16 +226,100 @@ struct HairPick : Module {
 			src_delete(src[i]);
 		}
 	}
+
+	json_t *dataToJson() override {
+		json_t *rootJ = json_object();
+		json_object_set_new(rootJ, "blockSize", json_integer(block.requestedSize));
+		json_object_set_new(rootJ, "quality", json_integer(quality.requested));
+		return rootJ;
+	}
+
+	void dataFromJson(json_t *rootJ) override {
+		json_t *blockSizeJ = json_object_get(rootJ, "blockSize");
+		if (blockSizeJ) {
+			block.request(json_integer_value(blockSizeJ));
+		}
+		json_t *qualityJ = json_object_get(rootJ, "quality");
+		if (qualityJ) {
+			quality.request(json_integer_value(qualityJ));
+		}
+	}
 	
 
 
 
+	// One frame from a tap's resampler, refilled from the history when it runs dry.
+	// ahead is how many frames were pushed after the one being played, when a block pushes all of its frames first.
+	FloatFrame readTap(HairPickBuffers *buffers, int tap, float index, int ahead) {
+		auto &history = buffers->historyBuffer;
+		if(index > 0 && outBuffer[tap].empty()) {
+			int available = std::max((int) history.size(tap) - ahead, 0);
+
+			// How many samples do we need consume to catch up?
+			float consume = index - available;
+			double ratio = 1.f;
+			if (std::fabs(consume) >= 16.f) {
+				ratio = std::pow(10.f, clamp(consume / 10000.f, -1.f, 1.f));
+			}
+
+			SRC_DATA srcData;
+			srcData.data_in = (const float*) history.startData(tap);
+			srcData.data_out = (float*) outBuffer[tap].endData();
+			srcData.input_frames = std::min(available, 16);
+			srcData.output_frames = outBuffer[tap].capacity();
+			srcData.end_of_input = false;
+			srcData.src_ratio = ratio;
+			src_process(src[tap], &srcData);
+			history.startIncr(tap,srcData.input_frames_used);
+			outBuffer[tap].endIncr(srcData.output_frames_gen);
+		}
+
+		FloatFrame frame = {0.0f, 0.0f};
+		if (!outBuffer[tap].empty()) {
+			frame = outBuffer[tap].shift();
+		}
+		return frame;
+	}
+
 	void process(const ProcessArgs &args) override {
+		frozenwasteland::DenormalGuard denormalGuard;
+		if(quality.update()) {
+			controlCountdown = 0;
+		}
 
+		// The clock has to see every sample to catch its edges
+		if(inputs[CLOCK_INPUT].isConnected()) {
+			clock.process(inputs[CLOCK_INPUT].getVoltage(), args.sampleTime);
+		} else {
+			clock.reset();
+		}
+
+		int voices = std::min(inputs[VOLT_OCTAVE_INPUT].getChannels(), MAX_VOICES);
+		if(voices > 1) {
+			processPoly(args, voices);
+			return;
+		}
+		outputs[OUT_L_OUTPUT].setChannels(1);
+		outputs[OUT_R_OUTPUT].setChannels(1);
+		outputs[DELAY_LENGTH_OUTPUT].setChannels(1);
+		voiceDelayLimited = false;
+
+		FloatFrame in;
+		in.l = inputs[IN_L_INPUT].getVoltage();
+		in.r = inputs[IN_R_INPUT].isConnected() ? inputs[IN_R_INPUT].getVoltage() : in.l;
+		FloatFrame out = block.step(in, [&](int frames) {
+			processBlock(args, frames);
+		});
+		outputs[OUT_L_OUTPUT].setVoltage(out.l);
+		outputs[OUT_R_OUTPUT].setVoltage(out.r);
+	}
+
+	// Controls shared by every voice: the pattern, muting and envelope as per-tap tables, the feedback settings, and the delay before V/Oct
+	void processControls() {
 		combPattern = (int)clamp(params[PATTERN_TYPE_PARAM].getValue() + (inputs[PATTERN_TYPE_CV_INPUT].getVoltage() * 1.5f),0.0f,15.0);
 		feedbackType = (int)clamp(params[FEEDBACK_TYPE_PARAM].getValue() + (inputs[FEEDBACK_TYPE_CV_INPUT].getVoltage() / 10.0f),0.0f,3.0);
 
-		int tapCount = (int)clamp(params[NUMBER_TAPS_PARAM].getValue() + (inputs[NUMBER_TAPS_CV_INPUT].getVoltage() * 6.4f),1.0f,64.0);
+		tapCount = (int)clamp(params[NUMBER_TAPS_PARAM].getValue() + (inputs[NUMBER_TAPS_CV_INPUT].getVoltage() * 6.4f),1.0f,64.0);
 
 
 		edgeLevel = clamp(params[EDGE_LEVEL_PARAM].getValue() + (inputs[EDGE_LEVEL_CV_INPUT].getVoltage() / 10.0f),0.0f,1.0);
@@ -197,6 +337,10 @@ struct HairPick : Module {
 			int tapNumber = muteTap(tapIndex);
 			combActive[tapNumber] = false;
 		}
+		for(int tap = 0; tap < NUM_TAPS;tap++) {
+			tapPosition[tap] = combPatterns[combPattern][tap] / NUM_TAPS;
+			tapGain[tap] = combActive[tap] ? envelope(tap,edgeLevel,tentLevel,tentTap) : 0.0f;
+		}
 
 		float divisionf = params[CLOCK_DIV_PARAM].getValue();
 		if(inputs[CLOCK_DIVISION_CV_INPUT].isConnected()) {
@@ -205,149 +349,269 @@ struct HairPick : Module {
 		divisionf = clamp(divisionf,0.0f,20.0f);
 		division = (DIVISIONS-1) - int(divisionf); //TODO: Reverse Division Order
 
-		timeElapsed+= 1.0 / args.sampleRate;
 		if(inputs[CLOCK_INPUT].isConnected()) {
-			if(clockTrigger.process(inputs[CLOCK_INPUT].getVoltage())) {
-				if(firstClockReceived) {
-					duration = timeElapsed;
-					secondClockReceived = true;
-				}
-				timeElapsed= 0;
-				firstClockReceived = true;								
-			} else if(secondClockReceived && timeElapsed > duration) {  //allow absense of second clock to affect duration
-				duration = timeElapsed;				
-			}	
-			baseDelay = clamp(duration / divisions[division],0.001f,10.0f);		
+			baseDelay = clamp((float)clock.period / divisions[division],0.001f,10.0f);		
 		} else {
 			baseDelay = clamp(params[SIZE_PARAM].getValue(), 0.001f, 10.0f);
-			duration = 0.0f;
-			firstClockReceived = false;		
-			secondClockReceived = false;	
 		}
 
+		feedbackAmount = clamp(params[FEEDBACK_AMOUNT_PARAM].getValue() + (inputs[FEEDBACK_CV_INPUT].getVoltage() / 10.0f), 0.0f, 1.0f);
+	}
+
+	// The display shows baseDelay: after V/Oct with one voice, and before it with several, since each voice has its own
+	void trackDisplay() {
+		displayVersion.track(displayedDivision, division);
+		displayVersion.track(displayedDelay, (int)std::round(baseDelay * 1000.0f));
+		displayVersion.track(displayedPattern, combPattern);
+		displayVersion.track(displayedFeedbackType, feedbackType);
+		displayVersion.track(displayedEnvelope, ((int)(edgeLevel * 40.0f) * 64 + (int)(tentLevel * 40.0f)) * 64 + tentTap); // half pixel steps
+		displayVersion.track(displayedDelayLimited, (int) voiceDelayLimited);
+	}
+
+	// Controls are read once per block, then the feedback path and each comb tap run over all of its frames
+	void processBlock(const ProcessArgs &args, int frames) {
+		processControls();
+
 		float pitchShift = powf(2.0f,inputs[VOLT_OCTAVE_INPUT].getVoltage());
 		baseDelay = baseDelay / pitchShift;
 		outputs[DELAY_LENGTH_OUTPUT].setVoltage(baseDelay);  
-		
-		FloatFrame dryFrame;
-		float feedbackAmount = clamp(params[FEEDBACK_AMOUNT_PARAM].getValue() + (inputs[FEEDBACK_CV_INPUT].getVoltage() / 10.0f), 0.0f, 1.0f);
-		float in = 0.0f;				
-		for(int channel = 0;channel < CHANNELS;channel++) {	
-			if(channel == 0) {
-				in = inputs[IN_L_INPUT].getVoltage();	
-				dryFrame.l = in + lastFeedback.l * feedbackAmount;
-			} else {
-				in = inputs[IN_R_INPUT].isConnected() ? inputs[IN_R_INPUT].getVoltage() : inputs[IN_L_INPUT].getVoltage();	
-				dryFrame.r = in + lastFeedback.r * feedbackAmount;
-			}	
+		trackDisplay();
+
+		HairPickBuffers *buffers = storage.get();
+		if(!buffers) {
+			// History still being built, or no memory for it: nothing has been heard yet, so there is nothing to comb
+			std::fill(block.output, block.output + frames, FloatFrame{0.0f, 0.0f});
+			return;
 		}
 
-		// Push dry sample into history buffer
-		if (!historyBuffer.full(NUM_TAPS-1)) {
-			historyBuffer.push(dryFrame);
+		float inputLevel = 0.0f;
+		for(int n = 0; n < frames; n++) {
+			inputLevel = std::max(inputLevel, std::max(fabsf(block.input[n].l), fabsf(block.input[n].r)));
+		}
+		if(sleepDetector.sleeping(inputLevel)) {
+			std::fill(block.output, block.output + frames, FloatFrame{0.0f, 0.0f});
+			return;
 		}
 
-		float delayNonlinearity = 1.0f;
-		float percentChange = 10.0f;
-		//Apply non-linearity
-		if(feedbackType == FEEDBACK_SITAR) {
-			if(in > 0) {
-				delayNonlinearity = 1 + ((in/10.0f) * (percentChange/100.0f)); //Test sitar will change length by up tp 10%
+		float tail = 0.0f;
+
+		// The feedback tap goes a frame at a time, since each pushed frame carries the feedback from the one before
+		for(int n = 0; n < frames; n++) {
+			float in = block.input[n].r;
+			FloatFrame dryFrame;
+			dryFrame.l = block.input[n].l + lastFeedback.l * feedbackAmount;
+			dryFrame.r = in + lastFeedback.r * feedbackAmount;
+
+			// Push dry sample into history buffer
+			if (!buffers->historyBuffer.full(NUM_TAPS-1)) {
+				buffers->historyBuffer.push(dryFrame);
 			}
-		}
 
+			float delayNonlinearity = 1.0f;
+			float percentChange = 10.0f;
+			//Apply non-linearity
+			if(feedbackType == FEEDBACK_SITAR) {
+				if(in > 0) {
+					delayNonlinearity = 1 + ((in/10.0f) * (percentChange/100.0f)); //Test sitar will change length by up tp 10%
+				}
+			}
 
-		FloatFrame wet = {0.0f, 0.0f}; // This is the mix of delays and input that is outputed
-		FloatFrame feedbackValue = {0.0f,0.0f}; // This is the output of a tap that gets sent back to input
-		for(int tap = 0; tap <= NUM_TAPS;tap++) { 
+			FloatFrame feedbackValue = readTap(buffers, NUM_TAPS, baseDelay * delayNonlinearity * args.sampleRate, 0); // This is the output of a tap that gets sent back to input
+
+			float feedbackWeight = 0.5;
+			switch(feedbackType) {
+				case FEEDBACK_GUITAR :
+					feedbackValue.l = (feedbackWeight * feedbackValue.l) + ((1-feedbackWeight) * lastFeedback.l);
+					feedbackValue.r = (feedbackWeight * feedbackValue.r) + ((1-feedbackWeight) * lastFeedback.r);
+					break;
+				case FEEDBACK_SITAR :
+					feedbackValue.l = (feedbackWeight * feedbackValue.l) + ((1-feedbackWeight) * lastFeedback.l);
+					feedbackValue.r = (feedbackWeight * feedbackValue.r) + ((1-feedbackWeight) * lastFeedback.r);
+					break;
+				case FEEDBACK_CLARINET :
+					feedbackValue.l = (feedbackWeight * feedbackValue.l) + ((1-feedbackWeight) * lastFeedback.l);
+					feedbackValue.r = (feedbackWeight * feedbackValue.r) + ((1-feedbackWeight) * lastFeedback.r);
+					break;
+				case FEEDBACK_RAW :
+					break;
+			}
 			
-			float delay	= 0.0f;
+			//feedbackValue = clamp(feedbackValue,-10.0f,10.0f);
+
+
+			lastFeedback = feedbackValue;
+			denormals.flush(lastFeedback.l);
+			denormals.flush(lastFeedback.r);
+			tail = std::max(tail, std::max(fabsf(feedbackValue.l), fabsf(feedbackValue.r)));
+		}
+
+		// The comb taps are only heard, never fed back, so each one runs over the whole block while its resampler is hot.
+		// A tap reads as if only the frames up to the one it is playing had been pushed.
+		FloatFrame wet[decltype(block)::MAX_SIZE]; // This is the mix of delays and input that is outputed
+		std::fill(wet, wet + frames, FloatFrame{0.0f, 0.0f});
+		for(int tap = 0; tap < NUM_TAPS;tap++) { 
 			// Compute delay time in seconds
-			if(tap <NUM_TAPS) {
-				delay = baseDelay * combPatterns[combPattern][tap] / NUM_TAPS; 
-			} else { // delay tap
-				delay = baseDelay * delayNonlinearity;
-			}
+			float delay = baseDelay * tapPosition[tap]; 
 			// Number of delay samples
 			float index = delay * args.sampleRate;
+			float level = tapGain[tap];
 
-			// How many samples do we need consume to catch up?
-			float consume = index - historyBuffer.size(tap);
-			if(index > 0)
-			{
-				if (outBuffer[tap].empty()) {
-								
-					double ratio = 1.f;
-					if (std::fabs(consume) >= 16.f) {
-						ratio = std::pow(10.f, clamp(consume / 10000.f, -1.f, 1.f));
-					}
+			for(int n = 0; n < frames; n++) {
+				FloatFrame wetTap = readTap(buffers, tap, index, frames - 1 - n);
+				wet[n].l += wetTap.l * level;
+				wet[n].r += wetTap.r * level;
+			}
+		}
 
-					SRC_DATA srcData;
-					srcData.data_in = (const float*) historyBuffer.startData(tap);
-					srcData.data_out = (float*) outBuffer[tap].endData();
-					srcData.input_frames = std::min((int) historyBuffer.size(tap), 16);
-					srcData.output_frames = outBuffer[tap].capacity();
-					srcData.end_of_input = false;
-					srcData.src_ratio = ratio;
-					src_process(src[tap], &srcData);
-					historyBuffer.startIncr(tap,srcData.input_frames_used);
-					outBuffer[tap].endIncr(srcData.output_frames_gen);
-				}			
+		float scale = sqrt((float)tapCount) / ((float)tapCount);
+		for(int n = 0; n < frames; n++) {
+			FloatFrame out = {wet[n].l * scale, wet[n].r * scale};
+			block.output[n] = out;
+			tail = std::max(tail, std::max(fabsf(out.l), fabsf(out.r)));
+		}
+
+		// Once output and feedback have been silent for the longest delay, so is every sample the taps can still reach
+		sleepDetector.holdTime = baseDelay * 1.1f + 0.1f;
+		sleepDetector.track(inputLevel, tail, args.sampleTime * frames);
+		denormals.tick(args.sampleTime * frames);
+
+	}
+
+	// Linear interpolation into one group's history, each voice at its own delay in samples, for both channels.
+	// Delays are limited to the voice history, about 1.4 s at 48 kHz.
+	void readVoices(HairPickBuffers *buffers, int group, const float *delay, float (*out)[VOICE_LANES]) {
+		for(int k = 0; k < VOICE_LANES; k++) {
+			float position = clamp(delay[k], 1.0f, (float) (VOICE_HISTORY_SIZE - 2));
+			size_t whole = (size_t) position;
+			float fraction = position - whole;
+			size_t newer = (voiceWrite - whole) & (VOICE_HISTORY_SIZE - 1);
+			size_t older = (newer - 1) & (VOICE_HISTORY_SIZE - 1);
+			for(int channel = 0; channel < CHANNELS; channel++) {
+				const float (*history)[VOICE_LANES] = buffers->voiceHistory[group][channel];
+				out[channel][k] = history[newer][k] + (history[older][k] - history[newer][k]) * fraction;
 			}
+		}
+	}
 
-			FloatFrame wetTap = {0.0f, 0.0f};
-			if (!outBuffer[tap].empty()) {
-				if(tap == NUM_TAPS) {
-					feedbackValue = outBuffer[tap].shift();
-				} else {
-					wetTap = outBuffer[tap].shift();
-					if(!combActive[tap]) {
-						wetTap = {0.0f, 0.0f};
-					} else {
-						wetTap.l = wetTap.l * envelope(tap,edgeLevel,tentLevel,tentTap);
-						wetTap.r = wetTap.r * envelope(tap,edgeLevel,tentLevel,tentTap);
-					}
+	// One comb resonator per V/Oct channel, up to MAX_VOICES, in groups of VOICE_LANES.
+	// Each voice has its own short history and feedback, and all of them read the shared tap tables, so a chord costs one module rather than one per note.
+	// The history is short and stateless to read, so a voice reads it directly at its own pitch rather than through a resampler, and muted taps are skipped.
+	void processPoly(const ProcessArgs &args, int voices) {
+		// The tables are the expensive part of the controls; V/Oct is still read every sample
+		if(--controlCountdown <= 0) {
+			processControls();
+			trackDisplay();
+			controlCountdown = quality.profile().controlInterval;
+		}
+		outputs[OUT_L_OUTPUT].setChannels(voices);
+		outputs[OUT_R_OUTPUT].setChannels(voices);
+		outputs[DELAY_LENGTH_OUTPUT].setChannels(voices);
+
+		HairPickBuffers *buffers = storage.get();
+		int groups = (voices + VOICE_LANES - 1) / VOICE_LANES;
+		alignas(16) float in[VOICE_GROUPS][CHANNELS][VOICE_LANES];
+		// Delay in samples, for each voice
+		alignas(16) float index[VOICE_GROUPS][VOICE_LANES];
+		float inputLevel = 0.0f;
+		bool limited = false;
+		for(int g = 0; g < groups; g++) {
+			for(int k = 0; k < VOICE_LANES; k++) {
+				int c = g * VOICE_LANES + k;
+				bool active = c < voices;
+				in[g][0][k] = active ? inputs[IN_L_INPUT].getPolyVoltage(c) : 0.0f;
+				in[g][1][k] = active ? (inputs[IN_R_INPUT].isConnected() ? inputs[IN_R_INPUT].getPolyVoltage(c) : in[g][0][k]) : 0.0f;
+				float voltage = active ? inputs[VOLT_OCTAVE_INPUT].getVoltage(c) : 0.0f;
+				index[g][k] = baseDelay / powf(2.0f, voltage) * args.sampleRate;
+				inputLevel = std::max(inputLevel, std::max(fabsf(in[g][0][k]), fabsf(in[g][1][k])));
+				if(active) {
+					limited = limited || index[g][k] > VOICE_HISTORY_SIZE - 2;
+					// The delay each voice actually plays, after the history limit
+					outputs[DELAY_LENGTH_OUTPUT].setVoltage(clamp(index[g][k], 1.0f, (float) (VOICE_HISTORY_SIZE - 2)) / args.sampleRate, c);
 				}
 			}
-
-			wet.l += wetTap.l;
-			wet.r += wetTap.r;
+		}
+		if(limited != voiceDelayLimited) {
+			voiceDelayLimited = limited;
+			trackDisplay();
 		}
 
-		wet.l = wet.l / ((float)tapCount) * sqrt((float)tapCount);
-		wet.r = wet.r / ((float)tapCount) * sqrt((float)tapCount);
-
-		float feedbackWeight = 0.5;
-		switch(feedbackType) {
-			case FEEDBACK_GUITAR :
-				feedbackValue.l = (feedbackWeight * feedbackValue.l) + ((1-feedbackWeight) * lastFeedback.l);
-				feedbackValue.r = (feedbackWeight * feedbackValue.r) + ((1-feedbackWeight) * lastFeedback.r);
-				break;
-			case FEEDBACK_SITAR :
-				feedbackValue.l = (feedbackWeight * feedbackValue.l) + ((1-feedbackWeight) * lastFeedback.l);
-				feedbackValue.r = (feedbackWeight * feedbackValue.r) + ((1-feedbackWeight) * lastFeedback.r);
-				break;
-			case FEEDBACK_CLARINET :
-				feedbackValue.l = (feedbackWeight * feedbackValue.l) + ((1-feedbackWeight) * lastFeedback.l);
-				feedbackValue.r = (feedbackWeight * feedbackValue.r) + ((1-feedbackWeight) * lastFeedback.r);
-				break;
-			case FEEDBACK_RAW :
-				break;
+		if(!buffers || sleepDetector.sleeping(inputLevel)) {
+			for(int c = 0; c < voices; c++) {
+				outputs[OUT_L_OUTPUT].setVoltage(0.0f, c);
+				outputs[OUT_R_OUTPUT].setVoltage(0.0f, c);
+			}
+			return;
 		}
-		
-		//feedbackValue = clamp(feedbackValue,-10.0f,10.0f);
 
+		voiceWrite++;
+		float scale = sqrt((float)tapCount) / ((float)tapCount);
+		float tail = 0.0f;
+		float longestDelay = 0.0f;
+		for(int g = 0; g < groups; g++) {
+			for(int channel = 0; channel < CHANNELS; channel++) {
+				float *frame = buffers->voiceHistory[g][channel][voiceWrite & (VOICE_HISTORY_SIZE - 1)];
+				for(int k = 0; k < VOICE_LANES; k++) {
+					frame[k] = in[g][channel][k] + voiceFeedback[g][channel][k] * feedbackAmount;
+				}
+			}
 
-		lastFeedback = feedbackValue;
+			//Apply non-linearity: sitar will change length by up to 10%
+			alignas(16) float delay[VOICE_LANES];
+			for(int k = 0; k < VOICE_LANES; k++) {
+				float delayNonlinearity = feedbackType == FEEDBACK_SITAR ? 1.0f + std::max(in[g][1][k], 0.0f) * 0.01f : 1.0f;
+				delay[k] = index[g][k] * delayNonlinearity;
+			}
+			alignas(16) float feedbackValue[CHANNELS][VOICE_LANES];
+			readVoices(buffers, g, delay, feedbackValue);
+			for(int channel = 0; channel < CHANNELS; channel++) {
+				for(int k = 0; k < VOICE_LANES; k++) {
+					if(feedbackType != FEEDBACK_RAW) {
+						float feedbackWeight = 0.5;
+						feedbackValue[channel][k] = (feedbackWeight * feedbackValue[channel][k]) + ((1-feedbackWeight) * voiceFeedback[g][channel][k]);
+					}
+					voiceFeedback[g][channel][k] = feedbackValue[channel][k];
+					denormals.flush(voiceFeedback[g][channel][k]);
+				}
+			}
 
-		FloatFrame out = wet; 
-		
-		outputs[OUT_L_OUTPUT].setVoltage(out.l);
-		outputs[OUT_R_OUTPUT].setVoltage(out.r);
+			alignas(16) float wet[CHANNELS][VOICE_LANES] = {};
+			for(int tap = 0; tap < NUM_TAPS;tap++) {
+				if(tapGain[tap] == 0.0f) {
+					continue;
+				}
+				for(int k = 0; k < VOICE_LANES; k++) {
+					delay[k] = index[g][k] * tapPosition[tap];
+				}
+				alignas(16) float wetTap[CHANNELS][VOICE_LANES];
+				readVoices(buffers, g, delay, wetTap);
+				for(int channel = 0; channel < CHANNELS; channel++) {
+					for(int k = 0; k < VOICE_LANES; k++) {
+						wet[channel][k] += wetTap[channel][k] * tapGain[tap];
+					}
+				}
+			}
+
+			for(int k = 0; k < VOICE_LANES && g * VOICE_LANES + k < voices; k++) {
+				int c = g * VOICE_LANES + k;
+				outputs[OUT_L_OUTPUT].setVoltage(wet[0][k] * scale, c);
+				outputs[OUT_R_OUTPUT].setVoltage(wet[1][k] * scale, c);
+				tail = std::max(tail, std::max(std::max(fabsf(wet[0][k] * scale), fabsf(wet[1][k] * scale)), std::max(fabsf(feedbackValue[0][k]), fabsf(feedbackValue[1][k]))));
+				longestDelay = std::max(longestDelay, index[g][k] / args.sampleRate);
+			}
+		}
 
+		sleepDetector.holdTime = std::min(longestDelay, (float) VOICE_HISTORY_SIZE / args.sampleRate) * 1.1f + 0.1f;
+		sleepDetector.track(inputLevel, tail, args.sampleTime);
+		denormals.tick(args.sampleTime);
 	}
 };
 
+constexpr const char* HairPick::combPatternNames[NUM_PATTERNS];
+constexpr float HairPick::combPatterns[NUM_PATTERNS][NUM_TAPS];
+constexpr const char* HairPick::feedbackTypeNames[NUM_FEEDBACK_TYPES];
+constexpr float HairPick::divisions[DIVISIONS];
+constexpr const char* HairPick::divisionNames[DIVISIONS];
+
 
 struct HPStatusDisplay : TransparentWidget {
 	HairPick *module;
@@ -380,7 +644,12 @@ struct HPStatusDisplay : TransparentWidget {
 		nvgFontFaceId(args.vg, fontNumbers->handle);
 		nvgTextLetterSpacing(args.vg, -2);
 
-		nvgFillColor(args.vg, nvgRGBA(0x00, 0xff, 0x00, 0xff));
+		// Amber while some poly voice's delay is cut short by its history
+		if(module->voiceDelayLimited) {
+			nvgFillColor(args.vg, nvgRGBA(0xff, 0xb0, 0x00, 0xff));
+		} else {
+			nvgFillColor(args.vg, nvgRGBA(0x00, 0xff, 0x00, 0xff));
+		}
 		char text[128];
 		snprintf(text, sizeof(text), "%6.0f", delayTime*1000);	
 		nvgText(args.vg, pos.x, pos.y, text, NULL);
@@ -450,8 +719,8 @@ struct HairPickWidget : ModuleWidget {
 			HPStatusDisplay *display = new HPStatusDisplay();
 			display->module = module;
 			display->box.pos = Vec(0, 0);
-			display->box.size = Vec(box.size.x, 200);
-			addChild(display);
+			display->box.size = Vec(box.size.x, 320); // Feedback type is drawn at y 305
+			addChild(frozenwasteland::createVersionedDisplay(display, module));
 		}
 
 		addParam(createParam<RoundLargeFWSnapKnob>(Vec(45, 33), module, HairPick::CLOCK_DIV_PARAM));
@@ -501,7 +770,16 @@ struct HairPickWidget : ModuleWidget {
 
 		addOutput(createOutput<PJ301MPort>(Vec(130, 74), module, HairPick::DELAY_LENGTH_OUTPUT));
 	}
+
+	void appendContextMenu(Menu *menu) override {
+		HairPick *module = dynamic_cast<HairPick*>(this->module);
+		assert(module);
+
+		frozenwasteland::appendBlockMenu(menu, module->block);
+		frozenwasteland::appendQualityMenu(menu, module->quality, "Quality (polyphonic mode)");
+	}
 };
 
 
+static frozenwasteland::FootprintReport footprint("HairPick", sizeof(HairPick), sizeof(HairPickBuffers) + sizeof(FloatFrame) * HISTORY_SIZE);
 Model *modelHairPick = createModel<HairPick, HairPickWidget>("HairPick");
@@ -1,6 +1,7 @@
 //#include <string.h>
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
+#include "ui/footprint.hpp"
 
 
 #define NUM_RHYTHMS 4
@@ -203,4 +204,5 @@ struct HyperMeasuresWidget : ModuleWidget {
 
 
 
+static frozenwasteland::FootprintReport footprint("HyperMeasures", sizeof(HyperMeasures));
 Model *modelHyperMeasures = createModel<HyperMeasures, HyperMeasuresWidget>("HyperMeasures");
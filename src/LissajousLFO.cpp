@@ -2,6 +2,9 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "dsp-lfo/oscillator.hpp"
+#include "ui/snapshot.hpp"
+#include "ui/footprint.hpp"
 
 #define BUFFER_SIZE 512
 
@@ -79,83 +82,23 @@ struct LissajousLFO : Module {
 		NUM_LIGHTS
 	};
 
-	struct LowFrequencyOscillator {
-		float basePhase = 0.0;
-		float phase = 0.0;
-		float freq = 1.0;
-		float skew = 0.5; // Triangle
-		float waveSlope = 1.0; //Original (1 is sin)
-		bool offset = false;
-		
-		float lerp(float v0, float v1, float t) {
-			return (1 - t) * v0 + t * v1;
-		}
-		
-		void setPitch(float pitch) {
-			pitch = fminf(pitch, 8.0);
-			freq = powf(2.0, pitch);
-		}
-
-		void setBasePhase(float initialPhase) {
-			//Apply change, then remember
-			phase += initialPhase - basePhase;
-			if (phase >= 1.0)
-				phase -= 1.0;
-			else if (phase < 0)
-				phase += 1.0;	
-			basePhase = initialPhase;
-		}
-		
-
-		void step(float dt) {
-			float deltaPhase = fminf(freq * dt, 0.5);
-			phase += deltaPhase;
-			if (phase >= 1.0)
-				phase -= 1.0;
-		}
-
-		float skewsaw(float x) {
-			
-			x = std::fabs(std::fmod(x ,1.0f));
-
-			float inverseSkew = 1 - skew;
-			float originalWave;
-			if (skew == 0 && x == 0) //Avoid /0 error
-				originalWave = 2;
-			if (x <= skew)
-				originalWave = 2.0 * (1- (-1 / skew * x + 1));
-			else
-				originalWave = 2.0 * (1-(1 / inverseSkew * (x - skew)));
-			return originalWave;
-		}
-		
-		float skewsaw() {
-			if (offset)
-				return lerp(skewsaw(phase),sin(),waveSlope);
-			
-			return lerp(skewsaw(phase) - 1 ,sin(),waveSlope);skewsaw(phase) ; //Going to keep same phase for now				
-		}
-
-		float sin() {
-			if (offset) // Sin wave is 90 degrees out of phase with other waves
-				return 1.0 - cosf(2*M_PI * (phase - 0.25)) ;
-			else
-				return sinf(2*M_PI * (phase - 0.25)) ;
-		}
-
+	enum OscillatorLanes {
+		X1_LANE,
+		Y1_LANE,
+		X2_LANE,
+		Y2_LANE
 	};
 
-	
-
 	float phase = 0.0;
 
-	LowFrequencyOscillator oscillatorX1,oscillatorY1,oscillatorX2,oscillatorY2;
+	// X1, Y1, X2 and Y2 share one lane group so shape evaluation runs once for all four
+	frozenwasteland::dsp::LowFrequencyOscillator4 oscillators;
 
-	float bufferX1[BUFFER_SIZE] = {};
-	float bufferY1[BUFFER_SIZE] = {};
-	float bufferX2[BUFFER_SIZE] = {};
-	float bufferY2[BUFFER_SIZE] = {};
-	int bufferIndex = 0;
+	// Decimated scope points, drained by ScopeDisplay on the UI thread
+	struct ScopePoint {
+		float x1, y1, x2, y2;
+	};
+	frozenwasteland::SampleChannel<ScopePoint, BUFFER_SIZE> scopeChannel;
 	float frameIndex = 0;
 	float deltaTime = powf(2.0, -8);
 
@@ -222,79 +165,76 @@ void LissajousLFO::process(const ProcessArgs &args) {
 	float amplitude2 = clamp(params[AMPLITUDE2_PARAM].getValue() + (inputs[AMPLITUDE2_INPUT].getVoltage() * params[AMPLITUDE2_CV_ATTENUVERTER_PARAM].getValue() / 2.0f),0.0f,5.0f);
 
 	// Implement 4 oscillators
-	oscillatorX1.setPitch(params[FREQX1_PARAM].getValue() + (inputs[FREQX1_INPUT].getVoltage() * params[FREQX1_CV_ATTENUVERTER_PARAM].getValue()));
+	oscillators.setPitch(X1_LANE, params[FREQX1_PARAM].getValue() + (inputs[FREQX1_INPUT].getVoltage() * params[FREQX1_CV_ATTENUVERTER_PARAM].getValue()));
 	initialPhase = params[PHASEX1_PARAM].getValue() + (inputs[PHASEX1_INPUT].getVoltage() * params[PHASEX1_CV_ATTENUVERTER_PARAM].getValue() / 10.0);
 	if (initialPhase >= 1.0)
 		initialPhase -= 1.0;
 	else if (initialPhase < 0)
 		initialPhase += 1.0;
-	oscillatorX1.setBasePhase(initialPhase);
-	oscillatorX1.waveSlope = clamp(params[WAVESHAPEX1_PARAM].getValue() + (inputs[WAVESHAPEX1_INPUT].getVoltage() * params[WAVESHAPEX1_CV_ATTENUVERTER_PARAM].getValue() / 10.0),0.0f,1.0f);
-	oscillatorX1.skew = clamp(params[SKEWX1_PARAM].getValue() + (inputs[SKEWX1_INPUT].getVoltage() * params[SKEWX1_CV_ATTENUVERTER_PARAM].getValue() / 10.0 ),0.0f,1.0f);
+	oscillators.setBasePhase(X1_LANE, initialPhase);
+	oscillators.waveSlope[X1_LANE] = clamp(params[WAVESHAPEX1_PARAM].getValue() + (inputs[WAVESHAPEX1_INPUT].getVoltage() * params[WAVESHAPEX1_CV_ATTENUVERTER_PARAM].getValue() / 10.0),0.0f,1.0f);
+	oscillators.skew[X1_LANE] = clamp(params[SKEWX1_PARAM].getValue() + (inputs[SKEWX1_INPUT].getVoltage() * params[SKEWX1_CV_ATTENUVERTER_PARAM].getValue() / 10.0 ),0.0f,1.0f);
 	
-	oscillatorY1.setPitch(params[FREQY1_PARAM].getValue() + (inputs[FREQY1_INPUT].getVoltage() * params[FREQY1_CV_ATTENUVERTER_PARAM].getValue()));
-	oscillatorY1.waveSlope = clamp(params[WAVESHAPEY1_PARAM].getValue() + (inputs[WAVESHAPEY1_INPUT].getVoltage() * params[WAVESHAPEY1_CV_ATTENUVERTER_PARAM].getValue() / 10.0),0.0f,1.0f);
-	oscillatorY1.skew = clamp(params[SKEWY1_PARAM].getValue() + (inputs[SKEWY1_INPUT].getVoltage() * params[SKEWY1_CV_ATTENUVERTER_PARAM].getValue() / 10.0),0.0f,1.0f);
+	oscillators.setPitch(Y1_LANE, params[FREQY1_PARAM].getValue() + (inputs[FREQY1_INPUT].getVoltage() * params[FREQY1_CV_ATTENUVERTER_PARAM].getValue()));
+	oscillators.waveSlope[Y1_LANE] = clamp(params[WAVESHAPEY1_PARAM].getValue() + (inputs[WAVESHAPEY1_INPUT].getVoltage() * params[WAVESHAPEY1_CV_ATTENUVERTER_PARAM].getValue() / 10.0),0.0f,1.0f);
+	oscillators.skew[Y1_LANE] = clamp(params[SKEWY1_PARAM].getValue() + (inputs[SKEWY1_INPUT].getVoltage() * params[SKEWY1_CV_ATTENUVERTER_PARAM].getValue() / 10.0),0.0f,1.0f);
 	
-	oscillatorX2.setPitch(params[FREQX2_PARAM].getValue() + (inputs[FREQX2_INPUT].getVoltage() * params[FREQX2_CV_ATTENUVERTER_PARAM].getValue()));
+	oscillators.setPitch(X2_LANE, params[FREQX2_PARAM].getValue() + (inputs[FREQX2_INPUT].getVoltage() * params[FREQX2_CV_ATTENUVERTER_PARAM].getValue()));
 	initialPhase = params[PHASEX2_PARAM].getValue() + (inputs[PHASEX2_INPUT].getVoltage() * params[PHASEX2_CV_ATTENUVERTER_PARAM].getValue() / 10.0);
 	if (initialPhase >= 1.0)
 		initialPhase -= 1.0;
 	else if (initialPhase < 0)
 		initialPhase += 1.0;
-	oscillatorX2.setBasePhase(initialPhase);
-	oscillatorX2.waveSlope = clamp(params[WAVESHAPEX2_PARAM].getValue() + (inputs[WAVESHAPEX2_INPUT].getVoltage() * params[WAVESHAPEX2_CV_ATTENUVERTER_PARAM].getValue() / 10.0),0.0f,1.0f);
-	oscillatorX2.skew = clamp(params[SKEWX2_PARAM].getValue() + (inputs[SKEWX2_INPUT].getVoltage() * params[SKEWX2_CV_ATTENUVERTER_PARAM].getValue() / 10.0),0.0f,1.0f);
+	oscillators.setBasePhase(X2_LANE, initialPhase);
+	oscillators.waveSlope[X2_LANE] = clamp(params[WAVESHAPEX2_PARAM].getValue() + (inputs[WAVESHAPEX2_INPUT].getVoltage() * params[WAVESHAPEX2_CV_ATTENUVERTER_PARAM].getValue() / 10.0),0.0f,1.0f);
+	oscillators.skew[X2_LANE] = clamp(params[SKEWX2_PARAM].getValue() + (inputs[SKEWX2_INPUT].getVoltage() * params[SKEWX2_CV_ATTENUVERTER_PARAM].getValue() / 10.0),0.0f,1.0f);
 	
-	oscillatorY2.setPitch(params[FREQY2_PARAM].getValue() + (inputs[FREQY2_INPUT].getVoltage() * params[FREQY2_CV_ATTENUVERTER_PARAM].getValue()));
-	oscillatorY2.waveSlope = clamp(params[WAVESHAPEY2_PARAM].getValue() + (inputs[WAVESHAPEY2_INPUT].getVoltage() * params[WAVESHAPEY2_CV_ATTENUVERTER_PARAM].getValue() / 10.0),0.0f,1.0f);
-	oscillatorY2.skew = clamp(params[SKEWY2_PARAM].getValue() + (inputs[SKEWY2_INPUT].getVoltage() * params[SKEWY2_CV_ATTENUVERTER_PARAM].getValue() / 10.0),0.0f,1.0f);
+	oscillators.setPitch(Y2_LANE, params[FREQY2_PARAM].getValue() + (inputs[FREQY2_INPUT].getVoltage() * params[FREQY2_CV_ATTENUVERTER_PARAM].getValue()));
+	oscillators.waveSlope[Y2_LANE] = clamp(params[WAVESHAPEY2_PARAM].getValue() + (inputs[WAVESHAPEY2_INPUT].getVoltage() * params[WAVESHAPEY2_CV_ATTENUVERTER_PARAM].getValue() / 10.0),0.0f,1.0f);
+	oscillators.skew[Y2_LANE] = clamp(params[SKEWY2_PARAM].getValue() + (inputs[SKEWY2_INPUT].getVoltage() * params[SKEWY2_CV_ATTENUVERTER_PARAM].getValue() / 10.0),0.0f,1.0f);
 
 
-	oscillatorX1.step(1.0 / args.sampleRate);
-	oscillatorY1.step(1.0 / args.sampleRate);
-	oscillatorX2.step(1.0 / args.sampleRate);
-	oscillatorY2.step(1.0 / args.sampleRate);
+	oscillators.step(args.sampleTime);
 
-	
-	float x1 = amplitude1 * oscillatorX1.skewsaw();
-	float y1 = amplitude1 * oscillatorY1.skewsaw();
-	float x2 = amplitude2 * oscillatorX2.skewsaw();
-	float y2 = amplitude2 * oscillatorY2.skewsaw();
+	alignas(16) float wave[4];
+	oscillators.skewsaw(wave);
+	const float amplitude[4] = {amplitude1, amplitude1, amplitude2, amplitude2};
+	for (int i = 0; i < 4; i++) {
+		wave[i] *= amplitude[i];
+	}
+
+	float x1 = wave[X1_LANE];
+	float y1 = wave[Y1_LANE];
+	float x2 = wave[X2_LANE];
+	float y2 = wave[Y2_LANE];
 
 	outputs[OUTPUT_1].setVoltage((x1 + x2) / 2);
 	outputs[OUTPUT_2].setVoltage((y1 + y2) / 2);
 	outputs[OUTPUT_3].setVoltage((x1 + x2 + y1 + y2) / 4);
-	float out4 = (x1/x2);
-	outputs[OUTPUT_4].setVoltage(std::isfinite(out4) ? clamp(out4,-5.0f,5.0f) : 0.f);
-	float out5 = (y1/y2);
-	outputs[OUTPUT_5].setVoltage(std::isfinite(out5) ? clamp(out5,-5.0f,5.0f) : 0.f);
-	float out6 = (x1*x2);
-	outputs[OUTPUT_6].setVoltage(clamp(out6,-5.0f,5.0f) );
-	float out7 = (y1*y2);
-	outputs[OUTPUT_7].setVoltage(clamp(out7,-5.0f,5.0f) );
+
+	// Ratios and products in one pass: {x1/x2, y1/y2, x1*x2, y1*y2}. A zero divisor outputs 0 instead of inf/nan
+	const float numerator[4] = {x1, y1, x1, y1};
+	const float other[4] = {x2, y2, x2, y2};
+	const bool isRatio[4] = {true, true, false, false};
+	float combined[4];
+	for (int i = 0; i < 4; i++) {
+		bool zeroDivisor = isRatio[i] && other[i] == 0.0f;
+		float divisor = zeroDivisor ? 1.0f : other[i];
+		float v = isRatio[i] ? numerator[i] / divisor : numerator[i] * other[i];
+		combined[i] = zeroDivisor ? 0.0f : clamp(v, -5.0f, 5.0f);
+	}
+	outputs[OUTPUT_4].setVoltage(combined[0]);
+	outputs[OUTPUT_5].setVoltage(combined[1]);
+	outputs[OUTPUT_6].setVoltage(combined[2]);
+	outputs[OUTPUT_7].setVoltage(combined[3]);
 	float out8 = (x1*x2*y1*y2);
 	outputs[OUTPUT_8].setVoltage(clamp(out8,-5.0f,5.0f) );
 
 	//Update scope.
 	int frameCount = (int)ceilf(deltaTime * args.sampleRate);
-
-	// Add frame to buffers
-	if (bufferIndex < BUFFER_SIZE) {
-		if (++frameIndex > frameCount) {
-			frameIndex = 0;
-			bufferX1[bufferIndex] = x1;
-			bufferY1[bufferIndex] = y1;
-			bufferX2[bufferIndex] = x2;
-			bufferY2[bufferIndex] = y2;
-			bufferIndex++;
-		}
-	}
-
-	// Are we waiting on the next trigger?
-	if (bufferIndex >= BUFFER_SIZE) {
-		bufferIndex = 0;
+	if (++frameIndex > frameCount) {
 		frameIndex = 0;
+		scopeChannel.push({x1, y1, x2, y2});
 	}
 }
 
@@ -325,6 +265,12 @@ struct ScopeDisplay : TransparentWidget {
 	};
 	Stats statsX, statsY;
 
+	float bufferX1[BUFFER_SIZE] = {};
+	float bufferY1[BUFFER_SIZE] = {};
+	float bufferX2[BUFFER_SIZE] = {};
+	float bufferY2[BUFFER_SIZE] = {};
+	int bufferIndex = 0;
+
 	ScopeDisplay() {
 		font = APP->window->loadFont(asset::plugin(pluginInstance, "res/fonts/Sudo.ttf"));
 	}
@@ -363,6 +309,15 @@ struct ScopeDisplay : TransparentWidget {
 		if (!module)
 			return;
 
+		LissajousLFO::ScopePoint point;
+		while (module->scopeChannel.shift(point)) {
+			bufferX1[bufferIndex] = point.x1;
+			bufferY1[bufferIndex] = point.y1;
+			bufferX2[bufferIndex] = point.x2;
+			bufferY2[bufferIndex] = point.y2;
+			bufferIndex = (bufferIndex + 1) % BUFFER_SIZE;
+		}
+
 		float gainX = powf(2.0, 1);
 		float gainY = powf(2.0, 1);
 		//float offsetX = module->x1;
@@ -373,9 +328,9 @@ struct ScopeDisplay : TransparentWidget {
 		for (int i = 0; i < BUFFER_SIZE; i++) {
 			int j = i;
 			// Lock display to buffer if buffer update deltaTime <= 2^-11
-			j = (i + module->bufferIndex) % BUFFER_SIZE;
-			valuesX[i] = (module->bufferX1[j]) * gainX / 10.0;
-			valuesY[i] = (module->bufferY1[j]) * gainY / 10.0;
+			j = (i + bufferIndex) % BUFFER_SIZE;
+			valuesX[i] = bufferX1[j] * gainX / 10.0;
+			valuesY[i] = bufferY1[j] * gainY / 10.0;
 		}
 
 		// Draw waveforms for LFO 1
@@ -387,9 +342,9 @@ struct ScopeDisplay : TransparentWidget {
 		for (int i = 0; i < BUFFER_SIZE; i++) {
 			int j = i;
 			// Lock display to buffer if buffer update deltaTime <= 2^-11
-			j = (i + module->bufferIndex) % BUFFER_SIZE;
-			valuesX[i] = (module->bufferX2[j]) * gainX / 10.0;
-			valuesY[i] = (module->bufferY2[j]) * gainY / 10.0;
+			j = (i + bufferIndex) % BUFFER_SIZE;
+			valuesX[i] = bufferX2[j] * gainX / 10.0;
+			valuesY[i] = bufferY2[j] * gainY / 10.0;
 		}
 
 		// Draw waveforms for LFO 2
@@ -486,4 +441,5 @@ struct LissajousLFOWidget : ModuleWidget {
 	}
 };
 
+static frozenwasteland::FootprintReport footprint("LissajousLFO", sizeof(LissajousLFO));
 Model *modelLissajousLFO = createModel<LissajousLFO, LissajousLFOWidget>("LissajousLFO2");
@@ -1,12 +1,24 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/sleep.hpp"
+#include "ui/denormal.hpp"
+#include "ui/footprint.hpp"
+#include "ui/quality.hpp"
 #include "filters/biquad.h"
 
 using namespace std;
 
 #define BANDS 16
 
+// Quality tiers. The band filters are most of the work; eco runs one section per band instead of a cascade of two, for wider bands, and reads the envelope and Q controls every 16 samples.
+// There is nothing more for high to add, so it isn't offered.
+static const frozenwasteland::QualityProfile mrBlueSkyQuality[] = {
+	// interpolation, oversample, grain cap, filter stages, control interval, estimated cost
+	{frozenwasteland::INTERPOLATION_LINEAR, 1, 1, 1, 16, 0.55f},
+	{frozenwasteland::INTERPOLATION_LINEAR, 1, 1, 2, 1, 1.0f},
+};
+
 struct MrBlueSky : Module {
 	enum ParamIds {
 		BG_PARAM,
@@ -60,6 +72,13 @@ struct MrBlueSky : Module {
 	int shiftIndex = 0;
 	int lastBandOffset = 0;
 	dsp::SchmittTrigger shiftLeftTrigger,shiftRightTrigger;
+	frozenwasteland::SleepDetector sleepDetector;
+	frozenwasteland::DenormalMonitor denormals{"MrBlueSky"};
+	frozenwasteland::QualitySetting quality{mrBlueSkyQuality};
+	int filterStages = 2;
+	int controlCountdown = 0;
+	float slewAttack = 0.0f;
+	float slewDecay = 0.0f;
 
 	MrBlueSky() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -92,6 +111,32 @@ struct MrBlueSky : Module {
 
 	void process(const ProcessArgs &args) override;
 
+	json_t *dataToJson() override {
+		json_t *rootJ = json_object();
+		json_object_set_new(rootJ, "quality", json_integer(quality.requested));
+		return rootJ;
+	}
+
+	void dataFromJson(json_t *rootJ) override {
+		json_t *qualityJ = json_object_get(rootJ, "quality");
+		if (qualityJ) {
+			quality.request(json_integer_value(qualityJ));
+		}
+	}
+
+	// Switches the cascade length and control rate. Second sections that were idle start from silence rather than from wherever they stopped.
+	void applyQuality() {
+		const frozenwasteland::QualityProfile &profile = quality.profile();
+		if (profile.filterStages > filterStages) {
+			for(int i=BANDS; i<2*BANDS; i++) {
+				iFilter[i]->reset();
+				cFilter[i]->reset();
+			}
+		}
+		filterStages = profile.filterStages;
+		controlCountdown = 0;
+	}
+
 	// void reset() override {
 	// 	bandOffset =0;
 	// }
@@ -99,6 +144,11 @@ struct MrBlueSky : Module {
 };
 
 void MrBlueSky::process(const ProcessArgs &args) {
+	frozenwasteland::DenormalGuard denormalGuard;
+	if (quality.update()) {
+		applyQuality();
+	}
+
 	// Band Offset Processing
 	bandOffset = params[BAND_OFFSET_PARAM].getValue();
 	if(inputs[SHIFT_BAND_OFFSET_INPUT].isConnected()) {
@@ -140,56 +190,76 @@ void MrBlueSky::process(const ProcessArgs &args) {
 	//So some vocoding!
 	float inM = inputs[IN_MOD].getVoltage()/5;
 	float inC = inputs[IN_CARR].getVoltage()/5;
-	const float slewMin = 0.001;
-	const float slewMax = 500.0;
 	const float shapeScale = 1/10.0;
-	const float qEpsilon = 0.1;
-	float attack = params[ATTACK_PARAM].getValue();
-	float decay = params[DECAY_PARAM].getValue();
-	if(inputs[ATTACK_INPUT].isConnected()) {
-		attack += clamp(inputs[ATTACK_INPUT].getVoltage() * params[ATTACK_CV_ATTENUVERTER_PARAM].getValue() / 20.0f,-0.25f,.25f);
-	}
-	if(inputs[DECAY_INPUT].isConnected()) {
-		decay += clamp(inputs[DECAY_INPUT].getVoltage() * params[DECAY_CV_ATTENUVERTER_PARAM].getValue() / 20.0f,-0.25f,.25f);
-	}
-	float slewAttack = slewMax * powf(slewMin / slewMax, attack);
-	float slewDecay = slewMax * powf(slewMin / slewMax, decay);
 	float out = 0.0;
 
-	//Check Mod Q
-	float currentQ = params[MOD_Q_PARAM].getValue();
-	if(inputs[MOD_Q_PARAM].isConnected()) {
-		currentQ += inputs[MOD_Q_INPUT].getVoltage() * params[MODIFER_Q_CV_ATTENUVERTER_PARAM].getValue();
-	}
+	// Envelope times and filter Q, at the quality tier's control rate
+	if (--controlCountdown <= 0) {
+		controlCountdown = quality.profile().controlInterval;
+
+		const float slewMin = 0.001;
+		const float slewMax = 500.0;
+		const float qEpsilon = 0.1;
+		float attack = params[ATTACK_PARAM].getValue();
+		float decay = params[DECAY_PARAM].getValue();
+		if(inputs[ATTACK_INPUT].isConnected()) {
+			attack += clamp(inputs[ATTACK_INPUT].getVoltage() * params[ATTACK_CV_ATTENUVERTER_PARAM].getValue() / 20.0f,-0.25f,.25f);
+		}
+		if(inputs[DECAY_INPUT].isConnected()) {
+			decay += clamp(inputs[DECAY_INPUT].getVoltage() * params[DECAY_CV_ATTENUVERTER_PARAM].getValue() / 20.0f,-0.25f,.25f);
+		}
+		slewAttack = slewMax * powf(slewMin / slewMax, attack);
+		slewDecay = slewMax * powf(slewMin / slewMax, decay);
 
-	currentQ = clamp(currentQ,1.0f,15.0f);
-	if (abs(currentQ - lastModQ) >= qEpsilon ) {
-		for(int i=0; i<2*BANDS; i++) {
-			iFilter[i]->setQ(currentQ);
-			}
-		lastModQ = currentQ;
-	}
+		//Check Mod Q
+		float currentQ = params[MOD_Q_PARAM].getValue();
+		if(inputs[MOD_Q_PARAM].isConnected()) {
+			currentQ += inputs[MOD_Q_INPUT].getVoltage() * params[MODIFER_Q_CV_ATTENUVERTER_PARAM].getValue();
+		}
 
-	//Check Carrier Q
-	currentQ = params[CARRIER_Q_PARAM].getValue();
-	if(inputs[CARRIER_Q_INPUT].isConnected()) {
-		currentQ += inputs[CARRIER_Q_INPUT].getVoltage() * params[CARRIER_Q_CV_ATTENUVERTER_PARAM].getValue();
-	}
+		currentQ = clamp(currentQ,1.0f,15.0f);
+		if (abs(currentQ - lastModQ) >= qEpsilon ) {
+			for(int i=0; i<2*BANDS; i++) {
+				iFilter[i]->setQ(currentQ);
+				}
+			lastModQ = currentQ;
+		}
 
-	currentQ = clamp(currentQ,1.0f,15.0f);
-	if (abs(currentQ - lastCarrierQ) >= qEpsilon ) {
-		for(int i=0; i<2*BANDS; i++) {
-			cFilter[i]->setQ(currentQ);
-			}
-		lastCarrierQ = currentQ;
+		//Check Carrier Q
+		currentQ = params[CARRIER_Q_PARAM].getValue();
+		if(inputs[CARRIER_Q_INPUT].isConnected()) {
+			currentQ += inputs[CARRIER_Q_INPUT].getVoltage() * params[CARRIER_Q_CV_ATTENUVERTER_PARAM].getValue();
+		}
+
+		currentQ = clamp(currentQ,1.0f,15.0f);
+		if (abs(currentQ - lastCarrierQ) >= qEpsilon ) {
+			for(int i=0; i<2*BANDS; i++) {
+				cFilter[i]->setQ(currentQ);
+				}
+			lastCarrierQ = currentQ;
+		}
 	}
 
 
 
+	// With neither modulator nor carrier there is nothing to vocode
+	float inputLevel = std::max(fabsf(inputs[IN_MOD].getVoltage()), fabsf(inputs[IN_CARR].getVoltage()));
+	if(sleepDetector.sleeping(inputLevel)) {
+		for(int i=0; i<BANDS; i++) {
+			outputs[MOD_OUT+i].setVoltage(0.0f);
+		}
+		outputs[OUT].setVoltage(0.0f);
+		return;
+	}
+
 	//First process all the modifier bands
 	for(int i=0; i<BANDS; i++) {
 		float coeff = mem[i];
-		float peak = abs(iFilter[i+BANDS]->process(iFilter[i]->process(inM*params[GMOD_PARAM].getValue())));
+		float modBand = iFilter[i]->process(inM*params[GMOD_PARAM].getValue());
+		if (filterStages > 1) {
+			modBand = iFilter[i+BANDS]->process(modBand);
+		}
+		float peak = abs(modBand);
 		if (peak>coeff) {
 			coeff += slewAttack * shapeScale * (peak - coeff) / args.sampleRate;
 			if (coeff > peak)
@@ -214,11 +284,28 @@ void MrBlueSky::process(const ProcessArgs &args) {
 			coeff = mem[(i+bandOffset) % BANDS];
 		}
 
-		float bandOut = cFilter[i+BANDS]->process(cFilter[i]->process(inC*params[GCARR_PARAM].getValue())) * coeff * params[BG_PARAM+i].getValue();
+		float carrierBand = cFilter[i]->process(inC*params[GCARR_PARAM].getValue());
+		if (filterStages > 1) {
+			carrierBand = cFilter[i+BANDS]->process(carrierBand);
+		}
+		float bandOut = carrierBand * coeff * params[BG_PARAM+i].getValue();
 		out += bandOut;
 	}
 	outputs[OUT].setVoltage(out * 5 * params[G_PARAM].getValue());
 
+	// The envelopes can outlast the output while they decay
+	float tail = fabsf(out * 5 * params[G_PARAM].getValue());
+	for(int i=0; i<BANDS; i++) {
+		denormals.flush(mem[i]);
+		tail = std::max(tail, mem[i] * 5.0f);
+	}
+	for(int i=0; i<2*BANDS; i++) {
+		iFilter[i]->flushDenormals(denormals);
+		cFilter[i]->flushDenormals(denormals);
+	}
+	sleepDetector.track(inputLevel, tail, args.sampleTime);
+	denormals.tick(args.sampleTime);
+
 }
 
 struct MrBlueSkyBandDisplay : TransparentWidget {
@@ -337,6 +424,14 @@ struct MrBlueSkyWidget : ModuleWidget {
 		addChild(createWidget<ScrewSilver>(Vec(RACK_GRID_WIDTH - 12, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
 		addChild(createWidget<ScrewSilver>(Vec(box.size.x - 2 * RACK_GRID_WIDTH + 12, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
 	}
+
+	void appendContextMenu(Menu *menu) override {
+		MrBlueSky *module = dynamic_cast<MrBlueSky*>(this->module);
+		assert(module);
+
+		frozenwasteland::appendQualityMenu(menu, module->quality);
+	}
 };
 
+static frozenwasteland::FootprintReport footprint("MrBlueSky", sizeof(MrBlueSky), sizeof(Biquad) * 4 * BANDS);
 Model *modelMrBlueSky = createModel<MrBlueSky, MrBlueSkyWidget>("MrBlueSky");
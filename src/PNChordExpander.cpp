@@ -1,6 +1,9 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/expander.hpp"
+#include "ui/messages.hpp"
+#include "ui/footprint.hpp"
 
 struct PNChordExpander : Module {
 	enum ParamIds {
@@ -46,9 +49,8 @@ struct PNChordExpander : Module {
 
 	float dissonance5Probability,dissonance7Probability,suspensionProbability;
 	
-	// Expander
-	float consumerMessage[12] = {};// this module must read from here
-	float producerMessage[12] = {};// mother will write into here
+	// Expander, read by the Probably Note on the left
+	frozenwasteland::ExpanderPublisher<frozenwasteland::PNChordMessage> toMother;
 
 
 	float thirdOffset,fifthOffset,seventhOffset;
@@ -70,8 +72,7 @@ struct PNChordExpander : Module {
 		configParam(INVERSION_PROBABILITY_PARAM, 0.0f, 1.0f, 0.0f,"Inversions Probability","%",0,100);
 		configParam(INVERSION_PROBABILITY_CV_ATTENUVERTER_PARAM, -1.0, 1.0, 0.0,"Inverions Probability CV Attenuation","%",0,100);
 
-		leftExpander.producerMessage = producerMessage;
-		leftExpander.consumerMessage = consumerMessage;
+		toMother.attach(leftExpander);
 
 
     }
@@ -80,38 +81,25 @@ struct PNChordExpander : Module {
 
 	void process(const ProcessArgs &args) override {
 		
-		bool motherPresent = (leftExpander.module && leftExpander.module->model == modelProbablyNote);
-		if (motherPresent) {
-			// To Mother
-			//float *producerMessage = (float*) leftExpander.producerMessage;
-			float *messagesToMother = (float*)leftExpander.module->rightExpander.producerMessage;
-
-			dissonance5Probability = clamp(params[DISSONANCE5_PROBABILITY_PARAM].getValue() + (inputs[DISSONANCE5_PROBABILITY_INPUT].isConnected() ? inputs[DISSONANCE5_PROBABILITY_INPUT].getVoltage() / 10 * params[DISSONANCE5_PROBABILITY_CV_ATTENUVERTER_PARAM].getValue() : 0.0f),0.0,1.0f);
-			dissonance7Probability = clamp(params[DISSONANCE7_PROBABILITY_PARAM].getValue() + (inputs[DISSONANCE7_PROBABILITY_INPUT].isConnected() ? inputs[DISSONANCE7_PROBABILITY_INPUT].getVoltage() / 10 * params[DISSONANCE7_PROBABILITY_CV_ATTENUVERTER_PARAM].getValue() : 0.0f),0.0,1.0f);
-			suspensionProbability = clamp(params[SUSPENSIONS_PROBABILITY_PARAM].getValue() + (inputs[SUSPENSIONS_PROBABILITY_INPUT].isConnected() ? inputs[SUSPENSIONS_PROBABILITY_INPUT].getVoltage() / 10 * params[SUSPENSIONS_PROBABILITY_CV_ATTENUVERTER_PARAM].getValue() : 0.0f),0.0,1.0f);
-
-			messagesToMother[0] = dissonance5Probability;
-			messagesToMother[1] = dissonance7Probability;
-			messagesToMother[2] = suspensionProbability;
-			//messagesToMother[3] = clamp(params[INVERSION_PROBABILITY_PARAM].getValue() + (inputs[INVERSION_PROBABILITY_INPUT].isConnected() ? inputs[INVERSION_PROBABILITY_INPUT].getVoltage() / 10 * params[INVERSION_PROBABILITY_CV_ATTENUVERTER_PARAM].getValue() : 0.0f),0.0,1.0f);
-			messagesToMother[4] = inputs[DISSONANCE5_EXTERNAL_RANDOM_INPUT].isConnected() ? inputs[DISSONANCE5_EXTERNAL_RANDOM_INPUT].getVoltage() / 10.0f : -1;
-			messagesToMother[5] = inputs[DISSONANCE7_EXTERNAL_RANDOM_INPUT].isConnected() ? inputs[DISSONANCE7_EXTERNAL_RANDOM_INPUT].getVoltage() / 10.0f : -1;
-			messagesToMother[6] = inputs[SUSPENSIONS_EXTERNAL_RANDOM_INPUT].isConnected() ? inputs[SUSPENSIONS_EXTERNAL_RANDOM_INPUT].getVoltage() / 10.0f : -1;
-
-			leftExpander.module->rightExpander.messageFlipRequested = true;
-
-
-			// From Mother	
-			float *messagesFromMother = (float*)leftExpander.consumerMessage;		
-			thirdOffset = messagesFromMother[0]; 
-			fifthOffset = messagesFromMother[1]; 
-			seventhOffset = messagesFromMother[2]; 
-
-			//thirdOffset = 1;
-			
-			//leftExpander.messageFlipRequested = true;
-			
-					
+		// To Mother
+		dissonance5Probability = clamp(params[DISSONANCE5_PROBABILITY_PARAM].getValue() + (inputs[DISSONANCE5_PROBABILITY_INPUT].isConnected() ? inputs[DISSONANCE5_PROBABILITY_INPUT].getVoltage() / 10 * params[DISSONANCE5_PROBABILITY_CV_ATTENUVERTER_PARAM].getValue() : 0.0f),0.0,1.0f);
+		dissonance7Probability = clamp(params[DISSONANCE7_PROBABILITY_PARAM].getValue() + (inputs[DISSONANCE7_PROBABILITY_INPUT].isConnected() ? inputs[DISSONANCE7_PROBABILITY_INPUT].getVoltage() / 10 * params[DISSONANCE7_PROBABILITY_CV_ATTENUVERTER_PARAM].getValue() : 0.0f),0.0,1.0f);
+		suspensionProbability = clamp(params[SUSPENSIONS_PROBABILITY_PARAM].getValue() + (inputs[SUSPENSIONS_PROBABILITY_INPUT].isConnected() ? inputs[SUSPENSIONS_PROBABILITY_INPUT].getVoltage() / 10 * params[SUSPENSIONS_PROBABILITY_CV_ATTENUVERTER_PARAM].getValue() : 0.0f),0.0,1.0f);
+
+		toMother.set(toMother.message.dissonance5Probability, dissonance5Probability);
+		toMother.set(toMother.message.dissonance7Probability, dissonance7Probability);
+		toMother.set(toMother.message.suspensionProbability, suspensionProbability);
+		toMother.set(toMother.message.dissonance5Random, inputs[DISSONANCE5_EXTERNAL_RANDOM_INPUT].isConnected() ? inputs[DISSONANCE5_EXTERNAL_RANDOM_INPUT].getVoltage() / 10.0f : -1);
+		toMother.set(toMother.message.dissonance7Random, inputs[DISSONANCE7_EXTERNAL_RANDOM_INPUT].isConnected() ? inputs[DISSONANCE7_EXTERNAL_RANDOM_INPUT].getVoltage() / 10.0f : -1);
+		toMother.set(toMother.message.suspensionRandom, inputs[SUSPENSIONS_EXTERNAL_RANDOM_INPUT].isConnected() ? inputs[SUSPENSIONS_EXTERNAL_RANDOM_INPUT].getVoltage() / 10.0f : -1);
+		toMother.send();
+
+		// From Mother
+		const frozenwasteland::ExpanderPacket<frozenwasteland::PNChordFeedbackMessage> *fromMother = frozenwasteland::readExpander<frozenwasteland::PNChordFeedbackMessage>(leftExpander.module, false);
+		if (fromMother) {
+			thirdOffset = fromMother->payload.thirdOffset; 
+			fifthOffset = fromMother->payload.fifthOffset; 
+			seventhOffset = fromMother->payload.seventhOffset; 
 		} else {
 			thirdOffset = 2.0f;
 			fifthOffset = 2.0f;
@@ -259,4 +247,5 @@ struct PNChordExpanderWidget : ModuleWidget {
 	}
 };
 
+static frozenwasteland::FootprintReport footprint("PNChordExpander", sizeof(PNChordExpander));
 Model *modelPNChordExpander = createModel<PNChordExpander, PNChordExpanderWidget>("PNChordExpander");
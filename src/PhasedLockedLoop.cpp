@@ -30,6 +30,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
+#include "ui/denormal.hpp"
+#include "ui/footprint.hpp"
+#include "ui/quality.hpp"
 
 // The clipping function of a transistor pair is approximately tanh(x)
 // TODO: Put this in a lookup table. 5th order approx doesn't seem to cut it
@@ -186,9 +189,24 @@ struct LadderFilter {
 			state[i] = 0.0;
 		}
 	}
+	template <typename M>
+	void flushDenormals(M &monitor) {
+		for (int i = 0; i < 4; i++) {
+			monitor.flush(state[i]);
+		}
+	}
 };
 
 
+// Quality tiers. Most of the cost is the oscillator's oversampled square and its decimator; eco also works out pitch and cutoff every 4 samples.
+// The oscillators are declared from this table, so it has to be constexpr.
+static constexpr frozenwasteland::QualityProfile phasedLockedLoopQuality[frozenwasteland::NUM_QUALITY_TIERS] = {
+	// interpolation, oversample, grain cap, filter stages, control interval, estimated cost
+	{frozenwasteland::INTERPOLATION_LINEAR, 4, 1, 1, 4, 0.4f},
+	{frozenwasteland::INTERPOLATION_LINEAR, 16, 1, 1, 1, 1.0f},
+	{frozenwasteland::INTERPOLATION_LINEAR, 32, 1, 1, 1, 1.8f},
+};
+
 struct PhasedLockedLoop : Module {
 	enum ParamIds {
 		VCO_FREQ_PARAM,
@@ -228,9 +246,16 @@ struct PhasedLockedLoop : Module {
 		NUM_COMPARATORS
 	};
 
-	VoltageControlledOscillator<16,16> oscillator;
+	// One oscillator per quality tier, since oversampling is a template parameter. Only the tier's own one runs.
+	VoltageControlledOscillator<phasedLockedLoopQuality[frozenwasteland::QUALITY_ECO].oversample,8> ecoOscillator;
+	VoltageControlledOscillator<phasedLockedLoopQuality[frozenwasteland::QUALITY_STANDARD].oversample,16> oscillator;
+	VoltageControlledOscillator<phasedLockedLoopQuality[frozenwasteland::QUALITY_HIGH].oversample,16> highOscillator;
+	frozenwasteland::QualitySetting quality{phasedLockedLoopQuality};
+	int oscillatorTier = frozenwasteland::QUALITY_STANDARD;
+	int controlCountdown = 0;
 	PhaseComparator comparator;
 	LadderFilter filter;
+	frozenwasteland::DenormalMonitor denormals{"PhasedLockedLoop"};
 
 	dsp::SchmittTrigger modeTrigger;
 	float filterOutput = 0;
@@ -252,6 +277,7 @@ struct PhasedLockedLoop : Module {
 	json_t *dataToJson() override {
 		json_t *rootJ = json_object();
 		json_object_set_new(rootJ, "comparatorType", json_integer((int) currentComparatorType));
+		json_object_set_new(rootJ, "quality", json_integer(quality.requested));
 		return rootJ;
 	}
 
@@ -260,8 +286,42 @@ struct PhasedLockedLoop : Module {
 		if (sumJ)
 			currentComparatorType = json_integer_value(sumJ);
 
+		json_t *qualityJ = json_object_get(rootJ, "quality");
+		if (qualityJ)
+			quality.request(json_integer_value(qualityJ));
+
+	}
+
+
+	float &oscillatorPhase(int tier) {
+		switch (tier) {
+			case frozenwasteland::QUALITY_ECO :
+				return ecoOscillator.phase;
+			case frozenwasteland::QUALITY_HIGH :
+				return highOscillator.phase;
+			default:
+				return oscillator.phase;
+		}
 	}
 
+	// Hands the phase over to the quality tier's oscillator, so the loop stays locked through the switch
+	void applyQuality() {
+		float phase = oscillatorPhase(oscillatorTier);
+		oscillatorTier = quality.tier;
+		oscillatorPhase(oscillatorTier) = phase;
+		controlCountdown = 0;
+	}
+
+	// One sample of an oscillator. Its pitch is only worked out on control samples.
+	template <typename O>
+	float runOscillator(O &vco, bool control, float pitchCv, float pulseWidth, float deltaTime) {
+		if (control) {
+			vco.setPitch(params[VCO_FREQ_PARAM].getValue(), pitchCv);
+		}
+		vco.setPulseWidth(pulseWidth);
+		vco.process(deltaTime);
+		return vco.sqr();
+	}
 
 	// For more advanced Module features, read Rack's engine.hpp header file
 	// - dataToJson, dataFromJson: serialization of internal data
@@ -271,6 +331,15 @@ struct PhasedLockedLoop : Module {
 
 
 void PhasedLockedLoop::process(const ProcessArgs &args) {
+	frozenwasteland::DenormalGuard denormalGuard;
+	if (quality.update()) {
+		applyQuality();
+	}
+	bool control = --controlCountdown <= 0;
+	if (control) {
+		controlCountdown = quality.profile().controlInterval;
+	}
+
 	// Modes
 	if (modeTrigger.process(params[COMPARATOR_TYPE_PARAM].getValue())) {
 		currentComparatorType = (currentComparatorType + 1) % NUM_COMPARATORS; //only 4...for now!!!
@@ -292,13 +361,21 @@ void PhasedLockedLoop::process(const ProcessArgs &args) {
 	}
 	//pitchCv = 0.0;// Test
 
-	oscillator.setPitch(params[VCO_FREQ_PARAM].getValue(), pitchCv);
-	oscillator.setPulseWidth(pulseWidth);
-
-	oscillator.process(1.0 / args.sampleRate);
+	float square;
+	switch (oscillatorTier) {
+		case frozenwasteland::QUALITY_ECO :
+			square = runOscillator(ecoOscillator, control, pitchCv, pulseWidth, 1.0 / args.sampleRate);
+			break;
+		case frozenwasteland::QUALITY_HIGH :
+			square = runOscillator(highOscillator, control, pitchCv, pulseWidth, 1.0 / args.sampleRate);
+			break;
+		default:
+			square = runOscillator(oscillator, control, pitchCv, pulseWidth, 1.0 / args.sampleRate);
+			break;
+	}
 
 
-	float squareOutput = 5.0 * oscillator.sqr(); //Used a lot :)
+	float squareOutput = 5.0 * square; //Used a lot :)
 	outputs[SQUARE_OUTPUT].setVoltage(squareOutput);
 
 	//normally use internally genrated square wave, unless the input is being used
@@ -341,17 +418,21 @@ void PhasedLockedLoop::process(const ProcessArgs &args) {
 
 	
 	// Set cutoff frequency
-	float cutoffExp = params[LPF_FREQ_PARAM].getValue();
-	if (inputs[LPF_FREQ_INPUT].isConnected()) {
-		cutoffExp += (inputs[LPF_FREQ_INPUT].getVoltage() / 5);
+	if (control) {
+		float cutoffExp = params[LPF_FREQ_PARAM].getValue();
+		if (inputs[LPF_FREQ_INPUT].isConnected()) {
+			cutoffExp += (inputs[LPF_FREQ_INPUT].getVoltage() / 5);
+		}
+		cutoffExp = clamp(cutoffExp, 0.0f, 1.0f);
+		const float minCutoff = 15.0;
+		const float maxCutoff = 8400.0;
+		filter.cutoff = minCutoff * powf(maxCutoff / minCutoff, cutoffExp);
 	}
-	cutoffExp = clamp(cutoffExp, 0.0f, 1.0f);
-	const float minCutoff = 15.0;
-	const float maxCutoff = 8400.0;
-	filter.cutoff = minCutoff * powf(maxCutoff / minCutoff, cutoffExp);
 
 	// Push a sample to the state filter
 	filter.process(filterInput, 1.0/args.sampleRate);
+	filter.flushDenormals(denormals);
+	denormals.tick(args.sampleTime);
 
 	// Set outputs
 	filterOutput = 5.0 * filter.state[3];
@@ -393,7 +474,15 @@ struct PhasedLockedLoopWidget : ModuleWidget {
 		addChild(createLight<SmallLight<BlueLight>>(Vec(55, 224), module, PhasedLockedLoop::FUZZY_XOR_COMPARATOR_LIGHT));
 		addChild(createLight<SmallLight<BlueLight>>(Vec(55, 234), module, PhasedLockedLoop::FUZZY_HYPERBOLIC_XOR_COMPARATOR_LIGHT));
 	}
+
+	void appendContextMenu(Menu *menu) override {
+		PhasedLockedLoop *module = dynamic_cast<PhasedLockedLoop*>(this->module);
+		assert(module);
+
+		frozenwasteland::appendQualityMenu(menu, module->quality);
+	}
 };
 
 
+static frozenwasteland::FootprintReport footprint("PhasedLockedLoop", sizeof(PhasedLockedLoop));
 Model *modelPhasedLockedLoop = createModel<PhasedLockedLoop, PhasedLockedLoopWidget>("PhasedLockedLoop");
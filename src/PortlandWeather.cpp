@@ -1,10 +1,20 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/framebuffer.hpp"
+#include "ui/storage.hpp"
+#include "ui/sleep.hpp"
+#include "ui/denormal.hpp"
+#include "ui/footprint.hpp"
+#include "ui/block.hpp"
+#include "ui/workers.hpp"
+#include "ui/quality.hpp"
+#include "dsp-clock/clock.hpp"
 #include "frame.h"
 #include "granular_delay.h"
 #include "samplerate.h"
 #include "ringbuffer.hpp"
+#include "reverse.hpp"
 #include "StateVariableFilter.h"
 #include <iostream>
 
@@ -16,6 +26,40 @@
 #define DIVISIONS 36
 #define NUM_GROOVES 16
 
+// Quality tiers. The grains and the resamplers are most of each tap's work; eco runs only the grains that are heard, at most two, and high reads the history through a sinc.
+static const frozenwasteland::QualityProfile portlandWeatherQuality[frozenwasteland::NUM_QUALITY_TIERS] = {
+	// interpolation, oversample, grain cap, filter stages, control interval, estimated cost
+	{frozenwasteland::INTERPOLATION_HOLD, 1, 2, 1, 1, 0.6f},
+	{frozenwasteland::INTERPOLATION_LINEAR, 1, MAX_GRAINS, 1, 1, 1.0f},
+	{frozenwasteland::INTERPOLATION_SINC, 1, MAX_GRAINS, 1, 1, 2.5f},
+};
+
+// The history and grain buffers, around 70 MB, built off the engine thread once the module exists
+struct PortlandWeatherBuffers {
+	FrozenWasteland::MirroredMultiTapRingBuffer<FloatFrame, HISTORY_SIZE,NUM_TAPS+CHANNELS> historyBuffer;
+	FloatFrame pitchShiftBuffer[NUM_TAPS+CHANNELS][MAX_GRAINS][MAX_GRAIN_SIZE];
+	GranularDelayPitchShift granularPitchShift[NUM_TAPS + CHANNELS][MAX_GRAINS]; // Each tap, plus each channel gets up to 4 grains
+
+	PortlandWeatherBuffers() {
+		memset(pitchShiftBuffer, 0, sizeof(pitchShiftBuffer));
+		for(int i=0;i<NUM_TAPS+CHANNELS;i++) {
+			for(int j=0;j<MAX_GRAINS;j++) {
+				granularPitchShift[i][j].Init((float*) pitchShiftBuffer[i][j],((float)j)/MAX_GRAINS);
+			}
+		}
+	}
+
+	bool allocated() const {
+		return historyBuffer.allocated;
+	}
+};
+
+// One sample of the audio path: the input (or output) and the feedback return (or send)
+struct PortlandWeatherFrame {
+	FloatFrame main;
+	FloatFrame feedback;
+};
+
 
 struct PortlandWeather : Module {
 	
@@ -118,8 +162,8 @@ struct PortlandWeather : Module {
 
 
 
-	const char* grooveNames[NUM_GROOVES] = {"Straight","Swing","Hard Swing","Reverse Swing","Alternate Swing","Accelerando","Ritardando","Waltz Time","Half Swing","Roller Coaster","Quintuple","Random 1","Random 2","Random 3","Early Reflection","Late Reflection"};
-	const float tapGroovePatterns[NUM_GROOVES][NUM_TAPS] = {
+	static constexpr const char* grooveNames[NUM_GROOVES] = {"Straight","Swing","Hard Swing","Reverse Swing","Alternate Swing","Accelerando","Ritardando","Waltz Time","Half Swing","Roller Coaster","Quintuple","Random 1","Random 2","Random 3","Early Reflection","Late Reflection"};
+	static constexpr float tapGroovePatterns[NUM_GROOVES][NUM_TAPS] = {
 		{1.0f,2.0f,3.0,4.0,5.0,6.0,7.0,8.0,9.0,10.0,11.0,12.0,13.0,14.0,15.0,16.0f}, // Straight time
 		{1.25,2.0,3.25,4.0,5.25,6.0,7.25,8.0,9.25,10.0,11.25,12.0,13.25,14.0,15.25,16.0}, // Swing
 		{1.75,2.0,3.75,4.0,5.75,6.0,7.75,8.0,9.75,10.0,11.75,12.0,13.75,14.0,15.75,16.0}, // Hard Swing
@@ -138,8 +182,8 @@ struct PortlandWeather : Module {
 		{7.0,7.25,9.0,9.25,10.25,12.5,13.0,13.75,14.0,15.0,15.25,15.5,15.75,16.0,16.0,16.0} // Late Reflection
 	};
 
-	const float minCutoff = 15.0;
-	const float maxCutoff = 8400.0;
+	static constexpr float minCutoff = 15.0;
+	static constexpr float maxCutoff = 8400.0;
 
 	int tapGroovePattern = 0;
 	float grooveAmount = 1.0f;
@@ -161,6 +205,8 @@ struct PortlandWeather : Module {
 	float feedbackPitch[CHANNELS] = {0.0f,0.0f};
 	float feedbackDetune[CHANNELS] = {0.0f,0.0f};
 	float delayTime[NUM_TAPS+CHANNELS];
+	float tapIndex[NUM_TAPS+CHANNELS] = {};
+	FloatFrame tapLevel[NUM_TAPS] = {};
 	
 
 	float testDelay = 0.0f;
@@ -172,37 +218,73 @@ struct PortlandWeather : Module {
 	dsp::RCFilter highpassFilter[CHANNELS];
 	float lastColor = 0.0f;
 
-	const char* filterNames[5] = {"OFF","LP","HP","BP","NOTCH"};
+	static constexpr const char* filterNames[5] = {"OFF","LP","HP","BP","NOTCH"};
 
-	const char* tapNames[NUM_TAPS+2] {"1","2","3","4","5","6","7","8","9","10","11","12","13","14","15","16","ALL","EXT"};
+	static constexpr const char* tapNames[NUM_TAPS+2] = {"1","2","3","4","5","6","7","8","9","10","11","12","13","14","15","16","ALL","EXT"};
 	
 
 	
-	dsp::SchmittTrigger clockTrigger,pingPongTrigger,reverseTrigger,clearBufferTrigger,mutingTrigger[NUM_TAPS],stackingTrigger[NUM_TAPS];
-	double divisions[DIVISIONS] = {1/256.0,1/192.0,1/128.0,1/96.0,1/64.0,1/48.0,1/32.0,1/24.0,1/16.0,1/13.0,1/12.0,1/11.0,1/8.0,1/7.0,1/6.0,1/5.0,1/4.0,1/3.0,1/2.0,1/1.5,1,1/1.5,2.0,3.0,4.0,5.0,6.0,7.0,8.0,9.0,10.0,11.0,12.0,13.0,16.0,24.0};
-	const char* divisionNames[DIVISIONS] = {"/256","/192","/128","/96","/64","/48","/32","/24","/16","/13","/12","/11","/8","/7","/6","/5","/4","/3","/2","/1.5","x 1","x 1.5","x 2","x 3","x 4","x 5","x 6","x 7","x 8","x 9","x 10","x 11","x 12","x 13","x 16","x 24"};
+	dsp::SchmittTrigger pingPongTrigger,reverseTrigger,clearBufferTrigger,mutingTrigger[NUM_TAPS],stackingTrigger[NUM_TAPS];
+	static constexpr double divisions[DIVISIONS] = {1/256.0,1/192.0,1/128.0,1/96.0,1/64.0,1/48.0,1/32.0,1/24.0,1/16.0,1/13.0,1/12.0,1/11.0,1/8.0,1/7.0,1/6.0,1/5.0,1/4.0,1/3.0,1/2.0,1/1.5,1,1/1.5,2.0,3.0,4.0,5.0,6.0,7.0,8.0,9.0,10.0,11.0,12.0,13.0,16.0,24.0};
+	static constexpr const char* divisionNames[DIVISIONS] = {"/256","/192","/128","/96","/64","/48","/32","/24","/16","/13","/12","/11","/8","/7","/6","/5","/4","/3","/2","/1.5","x 1","x 1.5","x 2","x 3","x 4","x 5","x 6","x 7","x 8","x 9","x 10","x 11","x 12","x 13","x 16","x 24"};
 	int division = 0;
-	double timeElapsed = 0.0;
-	double duration = 0;
+	frozenwasteland::dsp::ClockTracker clock;
 	double baseDelay = 0.0;
-	
-	bool firstClockReceived = false;
-	bool secondClockReceived = false;
 
 	
 	
-	FrozenWasteland::MultiTapDoubleRingBuffer<FloatFrame, HISTORY_SIZE,NUM_TAPS+CHANNELS> historyBuffer;
-	FrozenWasteland::ReverseRingBuffer<float, HISTORY_SIZE> reverseHistoryBuffer[CHANNELS];
+	frozenwasteland::DeferredStorage<PortlandWeatherBuffers> storage;
+	FrozenWasteland::ReverseHead reverseHead[CHANNELS];
+	frozenwasteland::SleepDetector sleepDetector;
+	frozenwasteland::DenormalMonitor denormals{"PortlandWeather"};
 	FrozenWasteland::DoubleRingBuffer<FloatFrame, 16> outBuffer[NUM_TAPS+CHANNELS]; 
-	FloatFrame pitchShiftBuffer[NUM_TAPS+CHANNELS][MAX_GRAINS][MAX_GRAIN_SIZE];
-	
-	SRC_STATE *src[NUM_TAPS+CHANNELS];
-
-	GranularDelayPitchShift granularPitchShift[NUM_TAPS + CHANNELS][MAX_GRAINS]; // Each tap, plus each channel gets up to 4 grains
+	frozenwasteland::BlockProcessor<PortlandWeatherFrame, PortlandWeatherFrame> block;
+
+	// Threaded taps: with block processing on, each block's taps run on the worker pool while the next block is gathered.
+	// Their output is mixed in at the start of that next block, so everything plays one block later than it would otherwise.
+	struct TapBatch : frozenwasteland::WorkerBatch {
+		PortlandWeather *module = NULL;
+		PortlandWeatherBuffers *buffers = NULL;
+		int frames = 0;
+
+		TapBatch() : WorkerBatch(NUM_TAPS) {}
+		void run(int tap) override {
+			module->runTap(buffers, tap, frames, false, module->tapWet[tap]);
+		}
+	};
+	bool threadedTaps = false;
+	TapBatch tapBatch;
+	int workerSlot = -1;
+	FloatFrame tapWet[NUM_TAPS][decltype(block)::MAX_SIZE];
+	// The block waiting for its taps, and what it sent to the feedback outputs
+	FloatFrame pipeIn[decltype(block)::MAX_SIZE];
+	FloatFrame pipeWet[decltype(block)::MAX_SIZE];
+	FloatFrame pipeSends[decltype(block)::MAX_SIZE];
+	float pipeMix = 0.0f;
+	int pipeFrames = 0;
+	bool pipeTapsPending = false;
+	bool clearRequested = false;
 	
+	// The resamplers in use, or NULL until the first tier's are built
+	SRC_STATE **src = NULL;
+	// Each interpolation order's resamplers, built off the engine thread when a tier that reads through it is first asked for
+	frozenwasteland::TierResamplers<NUM_TAPS+CHANNELS, 2> resamplers;
+	int interpolation = frozenwasteland::INTERPOLATION_LINEAR;
+	frozenwasteland::QualitySetting quality{portlandWeatherQuality};
+	int grainCap = MAX_GRAINS;
 	
 	FloatFrame lastFeedback = {0.0f,0.0f};
 
+	// Last values shown by the status display, in display resolution
+	frozenwasteland::DisplayVersion displayVersion;
+	int displayedDivision = -1;
+	int displayedDelay = -1;
+	int displayedGroove = -1;
+	uint64_t displayedFilterTypes = 0;
+	int displayedFeedbackTap[CHANNELS] = {-1,-1};
+	float displayedFeedbackPitch[CHANNELS] = {0.0f,0.0f};
+	float displayedFeedbackDetune[CHANNELS] = {0.0f,0.0f};
+
 	float lerp(float v0, float v1, float t) {
 	  return (1 - t) * v0 + t * v1;
 	}
@@ -211,6 +293,42 @@ struct PortlandWeather : Module {
 		return powf(2,semiTone/12.0f);
 	}
 
+	// A tap played backwards: its delay read by each channel's reverse head straight from the history.
+	// The tap's forward position is kept at its delay, so it carries on from there when reverse is switched off.
+	FloatFrame reverseRead(PortlandWeatherBuffers *buffers, int tap, float index) {
+		auto &history = buffers->historyBuffer;
+		size_t target = index > 0 ? (size_t) index : 0;
+		if(history.size(tap) > target) {
+			history.startIncr(tap, history.size(tap) - target);
+		}
+		outBuffer[tap].clear();
+
+		FloatFrame output = {0.0f, 0.0f};
+		float lastLag = (float) history.stored() - 2.0f;
+		if(lastLag < 0.0f) {
+			return output;
+		}
+		for(int channel = 0;channel < CHANNELS;channel++) {
+			float lag[2], gain[2];
+			reverseHead[channel].heads(std::max(index, 0.0f), lag, gain);
+			float value = 0.0f;
+			for(int k=0;k<2;k++) {
+				float position = clamp(lag[k], 0.0f, lastLag);
+				size_t i = (size_t) position;
+				const FloatFrame &newer = history.past(i);
+				const FloatFrame &older = history.past(i + 1);
+				float fraction = position - i;
+				value += gain[k] * (channel == 0 ? crossfade(newer.l, older.l, fraction) : crossfade(newer.r, older.r, fraction));
+			}
+			if(channel == 0) {
+				output.l = value;
+			} else {
+				output.r = value;
+			}
+		}
+		return output;
+	}
+
 	PortlandWeather() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
@@ -284,25 +402,42 @@ struct PortlandWeather : Module {
 			filterParams[i].setQ(5); 	
 	        filterParams[i].setFreq(T(800.0f / sampleRate));
 			delayTime[i] = 0.0f;
-
-			src[i] = src_new(SRC_LINEAR, 2, NULL);
-
-			for(int j=0;j<MAX_GRAINS;j++) {
-	    	 	granularPitchShift[i][j].Init((float*) pitchShiftBuffer[i][j],((float)j)/MAX_GRAINS);
-			}
 	    }	
-		for(int i=0;i<CHANNELS;i++) {
-			src[NUM_TAPS+i] = src_new(SRC_LINEAR, 2, NULL);
-
-			for(int j=0;j<MAX_GRAINS;j++) {
-				granularPitchShift[i+NUM_TAPS][j].Init((float*) pitchShiftBuffer[i+NUM_TAPS][j],((float)j)/MAX_GRAINS);
-			}
-		}
+		quality.prepare = [this](const frozenwasteland::QualityProfile &profile) {
+			resamplers.request(profile.interpolation);
+		};
+		quality.prepare(quality.profile());
+		quality.update();
+		applyQuality();
+
+		storage.request();
+		tapBatch.module = this;
+
+		//A late clock doesn't stretch the delay time
+		clock.lateMode = frozenwasteland::dsp::CLOCK_HOLD_WHEN_LATE;
 	}
 
 	~PortlandWeather() {
-		for(int i=0;i<NUM_TAPS;i++) {
-			src_delete(src[i]);
+		tapBatch.wait();
+		frozenwasteland::WorkerPool::shared().detach(workerSlot);
+	}
+
+	// Switches to the quality tier's grain cap, and to its resamplers once useResamplers() finds them built
+	void applyQuality() {
+		const frozenwasteland::QualityProfile &profile = quality.profile();
+		interpolation = profile.interpolation;
+		grainCap = profile.grainCap;
+	}
+
+	// Until the tier's resamplers are built the old ones carry on. The ones it switches to start empty, so each tap loses a few samples at most.
+	void useResamplers() {
+		SRC_STATE **ready = resamplers.get(interpolation);
+		if(!ready || ready == src) {
+			return;
+		}
+		src = ready;
+		for(int i=0;i<NUM_TAPS+CHANNELS;i++) {
+			src_reset(src[i]);
 		}
 	}
 
@@ -317,6 +452,12 @@ struct PortlandWeather : Module {
 
 		json_object_set_new(rootJ, "grainSize", json_real((float) grainSize));
 
+		json_object_set_new(rootJ, "blockSize", json_integer(block.requestedSize));
+
+		json_object_set_new(rootJ, "threadedTaps", json_integer((int) threadedTaps));
+
+		json_object_set_new(rootJ, "quality", json_integer(quality.requested));
+
 		for(int i=0;i<NUM_TAPS;i++) {
 			//This is so stupid!!! why did he not use strings?
 			char buf[100];
@@ -352,6 +493,21 @@ struct PortlandWeather : Module {
 		if (sumGs) {
 			grainSize = json_real_value(sumGs);			
 		}
+
+		json_t *blockSizeJ = json_object_get(rootJ, "blockSize");
+		if (blockSizeJ) {
+			block.request(json_integer_value(blockSizeJ));
+		}
+
+		json_t *threadedTapsJ = json_object_get(rootJ, "threadedTaps");
+		if (threadedTapsJ) {
+			setThreadedTaps(json_integer_value(threadedTapsJ));
+		}
+
+		json_t *qualityJ = json_object_get(rootJ, "quality");
+		if (qualityJ) {
+			quality.request(json_integer_value(qualityJ));
+		}
 		
 		char buf[100];			
 		for(int i=0;i<NUM_TAPS;i++) {
@@ -377,53 +533,194 @@ struct PortlandWeather : Module {
 	}
 
 
-	void process(const ProcessArgs &args) override {
+	// Stacking and muting follow their buttons and gates even while asleep
+	void processTapControls(int tap) {
+		// Stacking
+		if(params[STACK_TRIGGER_MODE_PARAM].getValue() == GATE_TRIGGE_MODE && inputs[TAP_STACK_CV_INPUT+tap].isConnected()) {
+			tapStacked[tap] = inputs[TAP_STACK_CV_INPUT+tap].getVoltage() > 0.0f;
+		}
+		//Button (or trigger) can override input
+		if (tap < NUM_TAPS -1 && stackingTrigger[tap].process(params[TAP_STACKED_PARAM+tap].getValue() + (params[STACK_TRIGGER_MODE_PARAM].getValue() == TRIGGER_TRIGGER_MODE ? inputs[TAP_STACK_CV_INPUT+tap].getVoltage() : 0.0f))) {
+			tapStacked[tap] = !tapStacked[tap];
+		}
 
-		if (clearBufferTrigger.process(params[CLEAR_BUFFER_PARAM].getValue())) {
-			historyBuffer.clear();
+		// Muting
+		if(params[MUTE_TRIGGER_MODE_PARAM].getValue() == GATE_TRIGGE_MODE && inputs[TAP_MUTE_CV_INPUT+tap].isConnected()) {
+			tapMuted[tap] = inputs[TAP_MUTE_CV_INPUT+tap].getVoltage() > 0.0f;
+		}
+		//Button (or trigger) can override input
+		if (mutingTrigger[tap].process(params[TAP_MUTE_PARAM+tap].getValue() + (inputs[TAP_MUTE_CV_INPUT+tap].isConnected() && params[MUTE_TRIGGER_MODE_PARAM].getValue() == TRIGGER_TRIGGER_MODE ? inputs[TAP_MUTE_CV_INPUT+tap].getVoltage() : 0))) {
+			tapMuted[tap] = !tapMuted[tap];
+			// if(!tapMuted[tap]) {
+			// 	activeTapCount +=1.0f;
+			// }
 		}
- 
 
-		tapGroovePattern = (int)clamp(params[GROOVE_TYPE_PARAM].getValue() + (inputs[GROOVE_TYPE_CV_INPUT].isConnected() ?  inputs[GROOVE_TYPE_CV_INPUT].getVoltage() / 10.0f : 0.0f),0.0f,15.0);
-		grooveAmount = clamp(params[GROOVE_AMOUNT_PARAM].getValue() + (inputs[GROOVE_AMOUNT_CV_INPUT].isConnected() ? inputs[GROOVE_AMOUNT_CV_INPUT].getVoltage() / 10.0f : 0.0f),0.0f,1.0f);
+		lights[TAP_STACKED_LIGHT+tap].value = tapStacked[tap];
+		lights[TAP_MUTED_LIGHT+tap].value = (tapMuted[tap]);
+	}
 
-		float divisionf = params[CLOCK_DIV_PARAM].getValue();
-		if(inputs[CLOCK_DIVISION_CV_INPUT].isConnected()) {
-			divisionf +=(inputs[CLOCK_DIVISION_CV_INPUT].getVoltage() * (DIVISIONS / 10.0));
+	// One frame from a tap's resampler, refilled from the history when it runs dry.
+	// ahead is how many frames were pushed after the one being played, when a block pushes all of its frames first.
+	FloatFrame readTap(PortlandWeatherBuffers *buffers, int tap, float index, int ahead) {
+		auto &history = buffers->historyBuffer;
+		if(index > 0 && outBuffer[tap].empty()) {
+			int available = std::max((int) history.size(tap) - ahead, 0);
+
+			// How many samples do we need consume to catch up?
+			float consume = index - available;
+			double ratio = 1.f;
+			if (std::fabs(consume) >= 16.f) {
+				ratio = std::pow(10.f, clamp(consume / 10000.f, -1.f, 1.f)) ;
+			}
+
+			SRC_DATA srcData;
+			srcData.data_in = (const float*) history.startData(tap);
+			srcData.data_out = (float*) outBuffer[tap].endData();
+			srcData.input_frames = std::min(available, 16);
+			srcData.output_frames = outBuffer[tap].capacity();
+			srcData.end_of_input = false;
+			srcData.src_ratio = ratio;
+			src_process(src[tap], &srcData);
+			history.startIncr(tap,srcData.input_frames_used);
+			outBuffer[tap].endIncr(srcData.output_frames_gen);
 		}
-		divisionf = clamp(divisionf,0.0f,35.0f);
-		division = (DIVISIONS-1) - int(divisionf); //TODO: Reverse Division Order
 
-		timeElapsed += 1.0 / args.sampleRate;
-		if(inputs[CLOCK_INPUT].isConnected()) {
-			if(clockTrigger.process(inputs[CLOCK_INPUT].getVoltage())) {
-				if(firstClockReceived) {
-					duration = timeElapsed;	
-					secondClockReceived = true;
+		FloatFrame frame = {0.0f, 0.0f};
+		if (!outBuffer[tap].empty()) {
+			frame = outBuffer[tap].shift();
+		}
+		return frame;
+	}
+
+	// Which of a tap's grains are heard at the current grain count, keeping to the quality tier's cap.
+	// They join in the order 0, then 2 opposite it, then 1 and 3 between, so a capped tap keeps its grains evenly spaced.
+	bool grainHeard(int k) {
+		static const int joins[MAX_GRAINS] = {0, 2, 1, 3};
+		bool counted = k == 0 || (k == 2 && grainCount >= 2) || (k != 2 && grainCount == 3);
+		return counted && joins[k] < grainCap;
+	}
+
+	// Without a cap every grain runs, heard or not, so changing the count doesn't restart any. Under one, only the heard grains run.
+	bool grainRuns(int k) {
+		return grainCap >= MAX_GRAINS || grainHeard(k);
+	}
+
+	// Plays frames of a tap, pitch shifted, filtered and at its level, into out[].
+	// The history holds every frame up to the last one, so frame n reads as if the frames after it had not been pushed yet.
+	// It touches only this tap's own state, so the worker threads can run different taps at once.
+	void runTap(PortlandWeatherBuffers *buffers, int tap, int frames, bool backwards, FloatFrame *out) {
+		FloatFrame initialOutput[decltype(block)::MAX_SIZE];
+		for(int n = 0; n < frames; n++) {
+			initialOutput[n] = backwards ? reverseRead(buffers, tap, tapIndex[tap]) : readTap(buffers, tap, tapIndex[tap], frames - 1 - n);
+		}
+
+		FloatFrame wetTap[decltype(block)::MAX_SIZE];
+		std::fill(wetTap, wetTap + frames, FloatFrame{0.0f, 0.0f});
+		bool useTriangleWindow = grainCount != 4;
+		for(int k=0;k<MAX_GRAINS;k++) {
+			if(!grainRuns(k)) {
+				continue;
+			}
+			FloatFrame pitchShiftOut[decltype(block)::MAX_SIZE];
+			std::copy(initialOutput, initialOutput + frames, pitchShiftOut);
+			buffers->granularPitchShift[tap][k].Process(pitchShiftOut, frames, useTriangleWindow); 
+			if(grainHeard(k)) {
+				for(int n = 0; n < frames; n++) {
+					wetTap[n].l += pitchShiftOut[n].l;
+					wetTap[n].r += pitchShiftOut[n].r;
 				}
-				timeElapsed = 0;
-				firstClockReceived = true;								
-			} else if(secondClockReceived && timeElapsed > duration) {  //allow absense of second clock to affect duration
-				//duration = timeElapsed;
-				//duration = 1;
-			}	
-			baseDelay = duration / divisions[division];
-			if(baseDelay > 30000.0f) {
-				baseDelay = 30000.0f;
 			}
-				
-		} else {
-			baseDelay = clamp(params[TIME_PARAM].getValue() + inputs[TIME_CV_INPUT].getVoltage(), 0.001f, HISTORY_SIZE / args.sampleRate);	
-			duration = 0.0f;
-			firstClockReceived = false;
-			secondClockReceived = false;			
 		}
 
-		float delayMod = 0.0f;
-		if(inputs[TIME_CV_INPUT].isConnected() && inputs[CLOCK_INPUT].isConnected()) { //The CV can change either clocked or set delay by 10MS
-			delayMod = (0.001f * inputs[TIME_CV_INPUT].getVoltage()); 
+		//Each tap - channel has its own filter
+		if(tapFilterType[tap] != FILTER_NONE) {
+			for(int n = 0; n < frames; n++) {
+				wetTap[n].l = StateVariableFilter<T>::run(wetTap[n].l, filterStates[tap][0], filterParams[tap]);
+				wetTap[n].r = StateVariableFilter<T>::run(wetTap[n].r, filterStates[tap][1], filterParams[tap]);
+			}
+		}
+
+		for(int n = 0; n < frames; n++) {
+			out[n].l = wetTap[n].l * tapLevel[tap].l;
+			out[n].r = wetTap[n].r * tapLevel[tap].r;
+		}
+	}
+
+	// Adds what each tap played to wet[], always in tap order, so it comes out the same whichever thread ran each tap (`make check-workers`)
+	void mixTaps(int frames, FloatFrame *wet) {
+		for(int tap = 0; tap < NUM_TAPS;tap++) {
+			for(int n = 0; n < frames; n++) {
+				wet[n].l += tapWet[tap][n].l;
+				wet[n].r += tapWet[tap][n].r;
+			}
 		}
+	}
+
+	// One frame of both feedback paths, from their own taps (or the wet mix, for ALL) through pitch shifting and the tone filters.
+	// This is what goes to the feedback sends.
+	FloatFrame runFeedback(PortlandWeatherBuffers *buffers, FloatFrame wet) {
+		FloatFrame feedbackValue = {0.0f, 0.0f};
+		for(int channel = 0;channel < CHANNELS;channel ++) {
+			FloatFrame initialFBOutput = {0.0f, 0.0f};
+			if(feedbackTap[channel] == NUM_TAPS) { //This would be the All Taps setting
+				initialFBOutput = wet;
+			} else if(reverse) {
+				initialFBOutput = reverseRead(buffers, NUM_TAPS+channel, tapIndex[NUM_TAPS+channel]);
+			} else {
+				initialFBOutput = readTap(buffers, NUM_TAPS+channel, tapIndex[NUM_TAPS+channel], 0);
+			}
+			reverseHead[channel].advance();
 
+			FloatFrame pitchShiftedFB = {0.0f,0.0f};
+			bool useTriangleWindow = grainCount != 4;
+			for(int k=0;k<MAX_GRAINS;k++) {
+				if(!grainRuns(k)) {
+					continue;
+				}
+				FloatFrame pitchShiftOut = initialFBOutput;
+				buffers->granularPitchShift[NUM_TAPS+channel][k].Process(&pitchShiftOut,useTriangleWindow); 
+				if(grainHeard(k)) {
+					pitchShiftedFB.l +=pitchShiftOut.l;
+					pitchShiftedFB.r +=pitchShiftOut.r;
+				}
+			}
+
+			if(channel == 0) {
+				feedbackValue.l = pitchShiftedFB.l; 
+			} else {
+				feedbackValue.r = pitchShiftedFB.r;
+			}
+		}
+
+		//Apply global filtering
+		lowpassFilter[0].process(feedbackValue.l);
+		feedbackValue.l = lowpassFilter[0].lowpass();
+		lowpassFilter[1].process(feedbackValue.r);
+		feedbackValue.r = lowpassFilter[1].lowpass();
+		
+		highpassFilter[0].process(feedbackValue.l);
+		feedbackValue.l = highpassFilter[0].highpass();
+		highpassFilter[1].process(feedbackValue.r);
+		feedbackValue.r = highpassFilter[1].highpass();
+
+		return feedbackValue;
+	}
+
+	void process(const ProcessArgs &args) override {
+		frozenwasteland::DenormalGuard denormalGuard;
+
+		if (clearBufferTrigger.process(params[CLEAR_BUFFER_PARAM].getValue())) {
+			// Cleared at the next block, when no worker can be reading the history
+			clearRequested = true;
+		}
+
+		// The clock and the triggers have to see every sample to catch their edges
+		if(inputs[CLOCK_INPUT].isConnected()) {
+			clock.process(inputs[CLOCK_INPUT].getVoltage(), args.sampleTime);
+		} else {
+			clock.reset();
+		}
 
 		// Ping Pong
 		if(params[PING_PONG_TRIGGER_MODE_PARAM].getValue() == GATE_TRIGGE_MODE && inputs[PING_PONG_INPUT].isConnected()) {
@@ -445,69 +742,130 @@ struct PortlandWeather : Module {
 		}
 		lights[REVERSE_LIGHT].value = reverse;
 		if(reverse && reverse != reversePrevious) {
-			reverseHistoryBuffer[0].clear();
-			reverseHistoryBuffer[1].clear();		
+			reverseHead[0].reset();
+			reverseHead[1].reset();
 		}
 
-		
+		for(int tap = 0; tap < NUM_TAPS;tap++) {
+			processTapControls(tap);
+		}
 
-		FloatFrame dryFrame;
-		FloatFrame inFrame;
-		for(int channel = 0;channel < CHANNELS;channel++) {
-			// Get input to delay block
-			feedbackTap[channel] = (int)clamp(params[FEEDBACK_TAP_L_PARAM+channel].getValue() + (inputs[FEEDBACK_TAP_L_INPUT+channel].isConnected() ? (inputs[FEEDBACK_TAP_L_INPUT+channel].getVoltage() / 10.0f) : 0),0.0f,17.0);
-			feedbackSlip[channel] = clamp(params[FEEDBACK_L_SLIP_PARAM+channel].getValue() + (inputs[FEEDBACK_L_SLIP_CV_INPUT+channel].isConnected() ? (inputs[FEEDBACK_L_SLIP_CV_INPUT+channel].getVoltage() / 10.0f) : 0),-0.5f,0.5);
-			float feedbackAmount = clamp(params[FEEDBACK_PARAM].getValue() + (inputs[FEEDBACK_INPUT].isConnected() ? (inputs[FEEDBACK_INPUT].getVoltage() / 10.0f) : 0), 0.0f, 1.0f);
-			
-			float in = 0.0f;
-					
-			if(channel == 0) {
-				in = inputs[IN_L_INPUT].getVoltage();	
-				inFrame.l = in;
-				dryFrame.l = in + lastFeedback.l * feedbackAmount;
-			} else {
-				in = inputs[IN_R_INPUT].isConnected() ? inputs[IN_R_INPUT].getVoltage() : inputs[IN_L_INPUT].getVoltage();	
-				inFrame.r = in;
-				dryFrame.r = in + lastFeedback.r * feedbackAmount;
-			}				
+		PortlandWeatherFrame frame;
+		frame.main.l = inputs[IN_L_INPUT].getVoltage();
+		frame.main.r = inputs[IN_R_INPUT].isConnected() ? inputs[IN_R_INPUT].getVoltage() : frame.main.l;
+		frame.feedback.l = inputs[FEEDBACK_L_RETURN].getVoltage();
+		frame.feedback.r = inputs[FEEDBACK_R_RETURN].getVoltage();
+		PortlandWeatherFrame out = block.step(frame, [&](int frames) {
+			processBlock(args, frames);
+		});
+		outputs[OUT_L_OUTPUT].setVoltage(out.main.l);
+		outputs[OUT_R_OUTPUT].setVoltage(out.main.r);
+		outputs[FEEDBACK_L_OUTPUT].setVoltage(out.feedback.l);
+		outputs[FEEDBACK_R_OUTPUT].setVoltage(out.feedback.r);
+	}
 
-			feedbackPitch[channel] = floor(params[FEEDBACK_L_PITCH_SHIFT_PARAM+channel].getValue() + (inputs[FEEDBACK_L_PITCH_SHIFT_CV_INPUT+channel].isConnected() ? (inputs[FEEDBACK_L_PITCH_SHIFT_CV_INPUT+channel].getVoltage()*2.4f) : 0));
-			feedbackDetune[channel] = floor(params[FEEDBACK_L_DETUNE_PARAM+channel].getValue() + (inputs[FEEDBACK_L_DETUNE_CV_INPUT+channel].isConnected() ? (inputs[FEEDBACK_L_DETUNE_CV_INPUT+channel].getVoltage()*10.0f) : 0));		
+	// The workers only watch this module's taps while it has them threaded. This starts the pool and takes or gives back a slot, so call it off the engine thread.
+	// A block already submitted when threading goes off is finished by tapBatch.wait() on the engine thread.
+	void setThreadedTaps(bool enabled) {
+		if(enabled && workerSlot < 0) {
+			frozenwasteland::WorkerPool::shared().start();
+			workerSlot = frozenwasteland::WorkerPool::shared().attach(&tapBatch);
+		}
+		threadedTaps = enabled;
+		if(!enabled && workerSlot >= 0) {
+			frozenwasteland::WorkerPool::shared().detach(workerSlot);
+			workerSlot = -1;
+		}
+	}
+
+	// Controls, filter coefficients and grain settings are worked out once per block.
+	// Unless something in the block feeds back what the taps have just played (the ALL feedback tap, or reverse heads that share the feedback windows),
+	// the feedback path then runs a frame at a time and each tap runs over the whole block while its resampler and grains are hot.
+	void processBlock(const ProcessArgs &args, int frames) {
+		// The workers have had a whole block to play the last one's taps
+		tapBatch.wait();
+		if(quality.update()) {
+			applyQuality();
 		}
-		FloatFrame dryToUse = dryFrame; //Normally the same as dry unless in reverse mode
+		useResamplers();
+		bool threaded = threadedTaps && block.size > 1;
+		if(!threaded || pipeFrames != frames) {
+			pipeFrames = 0;
+		} else if(pipeTapsPending) {
+			mixTaps(frames, pipeWet);
+		}
+		pipeTapsPending = false;
 
-		// Push dry sample into reverse history buffers
-		reverseHistoryBuffer[0].push(dryFrame.l);
-		reverseHistoryBuffer[1].push(dryFrame.r);
-		if(reverse) {
-			FloatFrame reverseDry;
-			reverseDry.l = reverseHistoryBuffer[0].shift();
-			reverseDry.r = reverseHistoryBuffer[1].shift();
-			dryToUse = reverseDry;
-		}	
+		float mix = clamp(params[MIX_PARAM].getValue() + inputs[MIX_INPUT].getVoltage() / 10.0f, 0.0f, 1.0f);
 
-		// Push dry sample into history buffer
-		if (!historyBuffer.full(NUM_TAPS-1)) {
-			historyBuffer.push(dryToUse);
+		PortlandWeatherBuffers *buffers = storage.get();
+		if(!buffers || !src) {
+			// Buffers or resamplers still being built, or no memory for them, so sound like an empty delay: just the dry side of the mix
+			for(int n = 0; n < frames; n++) {
+				block.output[n].main.l = crossfade(block.input[n].main.l, 0.0f, mix);
+				block.output[n].main.r = crossfade(block.input[n].main.r, 0.0f, mix);
+				block.output[n].feedback = {0.0f, 0.0f};
+			}
+			return;
 		}
 
+		if(clearRequested) {
+			buffers->historyBuffer.clear();
+			clearRequested = false;
+		}
 
-		
+		tapGroovePattern = (int)clamp(params[GROOVE_TYPE_PARAM].getValue() + (inputs[GROOVE_TYPE_CV_INPUT].isConnected() ?  inputs[GROOVE_TYPE_CV_INPUT].getVoltage() / 10.0f : 0.0f),0.0f,15.0);
+		grooveAmount = clamp(params[GROOVE_AMOUNT_PARAM].getValue() + (inputs[GROOVE_AMOUNT_CV_INPUT].isConnected() ? inputs[GROOVE_AMOUNT_CV_INPUT].getVoltage() / 10.0f : 0.0f),0.0f,1.0f);
 
-		FloatFrame wet = {0.0f, 0.0f}; // This is the mix of delays and input that is outputed
-		FloatFrame feedbackValue = {0.0f, 0.0f}; // This is the output of a tap that gets sent back to input
-		float activeTapCount = 0.0f; // This will be used to normalize output
-		
-		for(int tap = 0; tap < NUM_TAPS;tap++) { 
+		float divisionf = params[CLOCK_DIV_PARAM].getValue();
+		if(inputs[CLOCK_DIVISION_CV_INPUT].isConnected()) {
+			divisionf +=(inputs[CLOCK_DIVISION_CV_INPUT].getVoltage() * (DIVISIONS / 10.0));
+		}
+		divisionf = clamp(divisionf,0.0f,35.0f);
+		division = (DIVISIONS-1) - int(divisionf); //TODO: Reverse Division Order
+
+		if(inputs[CLOCK_INPUT].isConnected()) {
+			baseDelay = clock.period / divisions[division];
+			if(baseDelay > 30000.0f) {
+				baseDelay = 30000.0f;
+			}
+				
+		} else {
+			baseDelay = clamp(params[TIME_PARAM].getValue() + inputs[TIME_CV_INPUT].getVoltage(), 0.001f, HISTORY_SIZE / args.sampleRate);	
+		}
+
+		float delayMod = 0.0f;
+		if(inputs[TIME_CV_INPUT].isConnected() && inputs[CLOCK_INPUT].isConnected()) { //The CV can change either clocked or set delay by 10MS
+			delayMod = (0.001f * inputs[TIME_CV_INPUT].getVoltage()); 
+		}
 
-			// Stacking
-			if(params[STACK_TRIGGER_MODE_PARAM].getValue() == GATE_TRIGGE_MODE && inputs[TAP_STACK_CV_INPUT+tap].isConnected()) {
-				tapStacked[tap] = inputs[TAP_STACK_CV_INPUT+tap].getVoltage() > 0.0f;
+		float feedbackAmount = clamp(params[FEEDBACK_PARAM].getValue() + (inputs[FEEDBACK_INPUT].isConnected() ? (inputs[FEEDBACK_INPUT].getVoltage() / 10.0f) : 0), 0.0f, 1.0f);
+		for(int channel = 0;channel < CHANNELS;channel++) {
+			feedbackTap[channel] = (int)clamp(params[FEEDBACK_TAP_L_PARAM+channel].getValue() + (inputs[FEEDBACK_TAP_L_INPUT+channel].isConnected() ? (inputs[FEEDBACK_TAP_L_INPUT+channel].getVoltage() / 10.0f) : 0),0.0f,17.0);
+			feedbackSlip[channel] = clamp(params[FEEDBACK_L_SLIP_PARAM+channel].getValue() + (inputs[FEEDBACK_L_SLIP_CV_INPUT+channel].isConnected() ? (inputs[FEEDBACK_L_SLIP_CV_INPUT+channel].getVoltage() / 10.0f) : 0),-0.5f,0.5);
+			feedbackPitch[channel] = floor(params[FEEDBACK_L_PITCH_SHIFT_PARAM+channel].getValue() + (inputs[FEEDBACK_L_PITCH_SHIFT_CV_INPUT+channel].isConnected() ? (inputs[FEEDBACK_L_PITCH_SHIFT_CV_INPUT+channel].getVoltage()*2.4f) : 0));
+			feedbackDetune[channel] = floor(params[FEEDBACK_L_DETUNE_PARAM+channel].getValue() + (inputs[FEEDBACK_L_DETUNE_CV_INPUT+channel].isConnected() ? (inputs[FEEDBACK_L_DETUNE_CV_INPUT+channel].getVoltage()*10.0f) : 0));		
+		}
+
+		// Input includes anything coming back through the feedback returns
+		bool returnConnected[CHANNELS] = {inputs[FEEDBACK_L_RETURN].isConnected(), inputs[FEEDBACK_R_RETURN].isConnected()};
+		float inputLevel = 0.0f;
+		for(int n = 0; n < frames; n++) {
+			inputLevel = std::max(inputLevel, std::max(fabsf(block.input[n].main.l), fabsf(block.input[n].main.r)));
+			if(returnConnected[0]) {
+				inputLevel = std::max(inputLevel, fabsf(block.input[n].feedback.l));
 			}
-			//Button (or trigger) can override input
-			if (tap < NUM_TAPS -1 && stackingTrigger[tap].process(params[TAP_STACKED_PARAM+tap].getValue() + (params[STACK_TRIGGER_MODE_PARAM].getValue() == TRIGGER_TRIGGER_MODE ? inputs[TAP_STACK_CV_INPUT+tap].getVoltage() : 0.0f))) {
-				tapStacked[tap] = !tapStacked[tap];
+			if(returnConnected[1]) {
+				inputLevel = std::max(inputLevel, fabsf(block.input[n].feedback.r));
 			}
+		}
+		if(sleepDetector.sleeping(inputLevel)) {
+			pipeFrames = 0;
+			std::fill(block.output, block.output + frames, PortlandWeatherFrame{{0.0f, 0.0f}, {0.0f, 0.0f}});
+			return;
+		}
+
+		for(int tap = 0; tap < NUM_TAPS;tap++) { 
 
 			float pitch,detune;
 			pitch = floor(params[TAP_PITCH_SHIFT_PARAM+tap].getValue() + (inputs[TAP_PITCH_SHIFT_CV_INPUT+tap].isConnected() ? (inputs[TAP_PITCH_SHIFT_CV_INPUT+tap].getVoltage()*2.4f) : 0));
@@ -515,6 +873,11 @@ struct PortlandWeather : Module {
 			tapPitchShift[tap] = pitch;
 			tapDetune[tap] = detune;
 			pitch += detune/100.0f; 
+			float ratio = SemitonesToRatio(pitch);
+			for(int k=0;k<MAX_GRAINS;k++) {
+				buffers->granularPitchShift[tap][k].set_ratio(ratio);
+				buffers->granularPitchShift[tap][k].set_size(grainSize);
+			}
 
 			
 			//Normally the delay tap is the same as the tap itself, unless it is stacked, then it is its neighbor;
@@ -528,86 +891,13 @@ struct PortlandWeather : Module {
 			
 			
 			delayTime[tap] = (delay + delayMod); 
+			tapIndex[tap] = delayTime[tap] * args.sampleRate;
 
-			// if(tap == 0) { //TEST CODE
-			// 	testDelay = duration;
-			// }
-
-			float index = delayTime[tap] * args.sampleRate;
-			if(index > 0)
-			{
-				// How many samples do we need consume to catch up?
-				float consume = index - historyBuffer.size(tap);		
-
-				if (outBuffer[tap].empty()) {
-					
-					double ratio = 1.f;
-					if (std::fabs(consume) >= 16.f) {
-						ratio = std::pow(10.f, clamp(consume / 10000.f, -1.f, 1.f)) ;
-					}
-													
-
-					SRC_DATA srcData;
-					srcData.data_in = (const float*) historyBuffer.startData(tap);
-					srcData.data_out = (float*) outBuffer[tap].endData();
-					srcData.input_frames = std::min((int) historyBuffer.size(tap), 16);
-					srcData.output_frames = outBuffer[tap].capacity();
-					srcData.end_of_input = false;
-					srcData.src_ratio = ratio;
-					src_process(src[tap], &srcData);
-					historyBuffer.startIncr(tap,srcData.input_frames_used);
-					outBuffer[tap].endIncr(srcData.output_frames_gen);
-				}
-			}
-			
-			FloatFrame initialOutput = {0.0f, 0.0f};
-			FloatFrame wetTap = {0.0f, 0.0f};
-			if (!outBuffer[tap].empty()) {
-				initialOutput = outBuffer[tap].shift();
-			}
-		
-			
-			for(int k=0;k<MAX_GRAINS;k++) {
-				FloatFrame pitchShiftOut = initialOutput;
-				granularPitchShift[tap][k].set_ratio(SemitonesToRatio(pitch));
-				granularPitchShift[tap][k].set_size(grainSize);
-
-				bool useTriangleWindow = grainCount != 4;
-				granularPitchShift[tap][k].Process(&pitchShiftOut,useTriangleWindow); 
-				
-				if(k == 0) {
-					wetTap.l +=pitchShiftOut.l; //First one always use
-					wetTap.r +=pitchShiftOut.r; //First one always use
-				} else if (k == 2 && grainCount >= 2) {
-					wetTap.l +=pitchShiftOut.l; //Use middle grain for 2
-					wetTap.r +=pitchShiftOut.r; //Use middle grain for 2
-				} else if (k != 2 && grainCount == 3) {
-					wetTap.l +=pitchShiftOut.l; //Use them all
-					wetTap.r +=pitchShiftOut.r; //Use them all
-				}
-			}
-			wetTap.l = wetTap.l;	
-			wetTap.r = wetTap.r;		        	
-					
-
-			// Muting
-			if(params[MUTE_TRIGGER_MODE_PARAM].getValue() == GATE_TRIGGE_MODE && inputs[TAP_MUTE_CV_INPUT+tap].isConnected()) {
-				tapMuted[tap] = inputs[TAP_MUTE_CV_INPUT+tap].getVoltage() > 0.0f;
-			}
-			//Button (or trigger) can override input
-			if (mutingTrigger[tap].process(params[TAP_MUTE_PARAM+tap].getValue() + (inputs[TAP_MUTE_CV_INPUT+tap].isConnected() && params[MUTE_TRIGGER_MODE_PARAM].getValue() == TRIGGER_TRIGGER_MODE ? inputs[TAP_MUTE_CV_INPUT+tap].getVoltage() : 0))) {
-				tapMuted[tap] = !tapMuted[tap];
-				// if(!tapMuted[tap]) {
-				// 	activeTapCount +=1.0f;
-				// }
-			}			
-
-			//Each tap - channel has its own filter
-			int tapFilterType = (int)params[TAP_FILTER_TYPE_PARAM+tap].getValue();
 			// Apply Filter to tap wet output			
-			if(tapFilterType != FILTER_NONE) {
-				if(tapFilterType != lastFilterType[tap]) {
-					switch(tapFilterType) {
+			tapFilterType[tap] = (int)params[TAP_FILTER_TYPE_PARAM+tap].getValue();
+			if(tapFilterType[tap] != FILTER_NONE) {
+				if(tapFilterType[tap] != lastFilterType[tap]) {
+					switch(tapFilterType[tap]) {
 						case FILTER_LOWPASS:
 						filterParams[tap].setMode(StateVariableFilterParams<T>::Mode::LowPass);
 						break;
@@ -634,161 +924,71 @@ struct PortlandWeather : Module {
 					filterParams[tap].setQ(tapQ); 
 					lastTapQ[tap] = tapQ;
 				}
-				for(int channel=0;channel <CHANNELS;channel++) {		
-					if(channel == 0) {
-						wetTap.l = StateVariableFilter<T>::run(wetTap.l, filterStates[tap][channel], filterParams[tap]);
-					} else {
-						wetTap.r = StateVariableFilter<T>::run(wetTap.r, filterStates[tap][channel], filterParams[tap]);
-					}
-				}
 			}
-			lastFilterType[tap] = tapFilterType;
-
-			
-
+			lastFilterType[tap] = tapFilterType[tap];
 
 			if(!tapMuted[tap])  {
 				float pan = clamp((params[TAP_PAN_PARAM+tap].getValue() + (inputs[TAP_PAN_CV_INPUT+tap].isConnected() ? (inputs[TAP_PAN_CV_INPUT+tap].getVoltage() / 10.0f) : 0)),0.0f,1.0f);
-				wetTap.l = wetTap.l * clamp(params[TAP_MIX_PARAM+tap].getValue() + (inputs[TAP_MIX_CV_INPUT+tap].isConnected() ? (inputs[TAP_MIX_CV_INPUT+tap].getVoltage() / 10.0f) : 0),0.0f,1.0f) * (1.0 - pan);
-				wetTap.r = wetTap.r * clamp(params[TAP_MIX_PARAM+tap].getValue() + (inputs[TAP_MIX_CV_INPUT+tap].isConnected() ? (inputs[TAP_MIX_CV_INPUT+tap].getVoltage() / 10.0f) : 0),0.0f,1.0f) * pan;
+				float level = clamp(params[TAP_MIX_PARAM+tap].getValue() + (inputs[TAP_MIX_CV_INPUT+tap].isConnected() ? (inputs[TAP_MIX_CV_INPUT+tap].getVoltage() / 10.0f) : 0),0.0f,1.0f);
+				tapLevel[tap].l = level * (1.0 - pan);
+				tapLevel[tap].r = level * pan;
 			} else {
-				wetTap.l = 0.0f;
-				wetTap.r = 0.0f;
+				tapLevel[tap] = {0.0f, 0.0f};
 			} 
+		}
 
-			wet.l += wetTap.l;
-			wet.r += wetTap.r;
-		
-
-			lights[TAP_STACKED_LIGHT+tap].value = tapStacked[tap];
-			lights[TAP_MUTED_LIGHT+tap].value = (tapMuted[tap]);	
 
+		displayVersion.track(displayedDivision, division);
+		displayVersion.track(displayedDelay, (int)std::round(baseDelay * 1000.0));
+		displayVersion.track(displayedGroove, tapGroovePattern);
+		uint64_t filterTypes = 0;
+		for(int tap = 0; tap < NUM_TAPS; tap++) {
+			filterTypes = (filterTypes << 3) | lastFilterType[tap];
+		}
+		displayVersion.track(displayedFilterTypes, filterTypes);
+		for(int channel = 0; channel < CHANNELS; channel++) {
+			displayVersion.track(displayedFeedbackTap[channel], feedbackTap[channel]);
+			displayVersion.track(displayedFeedbackPitch[channel], feedbackPitch[channel]);
+			displayVersion.track(displayedFeedbackDetune[channel], feedbackDetune[channel]);
 		}
-
 				
-		//Process Feedback delays and pitch shifting
+		float longestDelay = 0.0f;
+		for(int tap = 0; tap < NUM_TAPS;tap++) {
+			longestDelay = std::max(longestDelay, delayTime[tap]);
+		}
+
+		//Feedback delays and pitch shifting
 		for(int channel = 0;channel < CHANNELS;channel ++) {
 			float delay = 0.0f;
-			FloatFrame initialFBOutput = {0.0f, 0.0f};
-
-			//Pull feedback time off of normal tap time
-			if(feedbackTap[channel] != NUM_TAPS ) {
-
-				
-				if(feedbackTap[channel] == NUM_TAPS+1) {
-					//External feedback time
-					delay = clamp(inputs[EXTERNAL_DELAY_TIME_INPUT].getVoltage(), 0.001f, 10.0f); //Need to process this same as other size...
-				} else { 
-					// Use tap as basis of delay time
-					int delayTap = feedbackTap[channel];				
-					while(delayTap < NUM_TAPS && tapStacked[delayTap]) {
-						delayTap++;			
-					}
-
-					float slip = feedbackSlip[channel] * baseDelay / NUM_TAPS;
-					delay = delayTime[delayTap] + slip; 
-				}
-			
-
-				float index = delay * args.sampleRate;
-				if(index > 0)
-				{
-					// How many samples do we need consume to catch up?
-					float consume = index - historyBuffer.size(NUM_TAPS+channel);		
-
-					if (outBuffer[NUM_TAPS+channel].empty()) {
-										
-						double ratio = 1.f;
-						if (std::fabs(consume) >= 16.f) {
-							ratio = std::pow(10.f, clamp(consume / 10000.f, -1.f, 1.f)) ; 
-						}
-														
-						SRC_DATA srcData;
-						srcData.data_in = (const float*) historyBuffer.startData(NUM_TAPS+channel);
-						srcData.data_out = (float*) outBuffer[NUM_TAPS+channel].endData();
-						srcData.input_frames = std::min((int) historyBuffer.size(NUM_TAPS+channel), 16);
-						srcData.output_frames = outBuffer[NUM_TAPS+channel].capacity();
-						srcData.end_of_input = false;
-						srcData.src_ratio = ratio;
-						src_process(src[NUM_TAPS+channel], &srcData);
-						historyBuffer.startIncr(NUM_TAPS+channel,srcData.input_frames_used);
-						outBuffer[NUM_TAPS+channel].endIncr(srcData.output_frames_gen);
-					}
-				}
-
-				if (!outBuffer[NUM_TAPS+channel].empty()) {
-					FloatFrame tempOutput = outBuffer[NUM_TAPS+channel].shift();
-					if(channel == 0) {
-						initialFBOutput.l = tempOutput.l; 
-					} else {
-						initialFBOutput.r = tempOutput.r;
-					}					
-				}				
-			}
-
 			if(feedbackTap[channel] == NUM_TAPS) { //This would be the All Taps setting
-				//float feedbackScaling = 4.0f; // Trying to make full feedback not, well feedback
 				delay = delayTime[NUM_TAPS-1]; // last tap
-				if(channel == 0) {
-					initialFBOutput.l = wet.l; 
-				} else {
-					initialFBOutput.r = wet.r;
+			} else if(feedbackTap[channel] == NUM_TAPS+1) {
+				//External feedback time
+				delay = clamp(inputs[EXTERNAL_DELAY_TIME_INPUT].getVoltage(), 0.001f, 10.0f); //Need to process this same as other size...
+			} else { 
+				// Use tap as basis of delay time
+				int delayTap = feedbackTap[channel];				
+				while(delayTap < NUM_TAPS && tapStacked[delayTap]) {
+					delayTap++;			
 				}
-			}
 
-			
-		
-			//Set reverse size = delay of feedback
-			reverseHistoryBuffer[channel].setDelaySize((delay) * args.sampleRate);			
-
-		
+				float slip = feedbackSlip[channel] * baseDelay / NUM_TAPS;
+				delay = delayTime[delayTap] + slip; 
+			}
+			tapIndex[NUM_TAPS+channel] = delay * args.sampleRate;
 
-			
-			float pitch,detune;
-			pitch = feedbackPitch[channel];
-			detune = feedbackDetune[channel];
-			pitch += detune/100.0f; 
+			//Set reverse window = delay of feedback
+			reverseHead[channel].setWindow(delay * args.sampleRate);
+			longestDelay = std::max(longestDelay, delay);			
 
-			FloatFrame pitchShiftedFB = {0.0f,0.0f};
+			float pitch = feedbackPitch[channel] + feedbackDetune[channel]/100.0f;
 			for(int k=0;k<MAX_GRAINS;k++) {
-				FloatFrame pitchShiftOut = initialFBOutput;
-				granularPitchShift[NUM_TAPS+channel][k].set_ratio(SemitonesToRatio(pitch));
-				granularPitchShift[NUM_TAPS+channel][k].set_size(grainSize);
-
-				bool useTriangleWindow = grainCount != 4;
-				granularPitchShift[NUM_TAPS+channel][k].Process(&pitchShiftOut,useTriangleWindow); 
-				
-				if(k == 0) {
-					pitchShiftedFB.l +=pitchShiftOut.l; //First one always use
-					pitchShiftedFB.r +=pitchShiftOut.r; //First one always use
-				} else if (k == 2 && grainCount >= 2) {
-					pitchShiftedFB.l +=pitchShiftOut.l; //Use middle grain for 2
-					pitchShiftedFB.r +=pitchShiftOut.r; //Use middle grain for 2
-				} else if (k != 2 && grainCount == 3) {
-					pitchShiftedFB.l +=pitchShiftOut.l; //Use them all
-					pitchShiftedFB.r +=pitchShiftOut.r; //Use them all
-				}
-			}
-
-			if(channel == 0) {
-				feedbackValue.l = pitchShiftedFB.l; 
-				//feedbackValue.l = initialFBOutput.l; 
-			} else {
-				feedbackValue.r = pitchShiftedFB.r;
-				//feedbackValue.r = initialFBOutput.r;
+				buffers->granularPitchShift[NUM_TAPS+channel][k].set_ratio(SemitonesToRatio(pitch));
+				buffers->granularPitchShift[NUM_TAPS+channel][k].set_size(grainSize);
 			}
 		}
-		
-		//activeTapCount = 16.0f;
-		//wet = wet / activeTapCount * sqrt(activeTapCount);	
-			
-		
 
-
-		//Apply global filtering
-		// TODO Stop setting cutoff all the time
 		float color = clamp(params[FEEDBACK_TONE_PARAM].getValue() + inputs[FEEDBACK_TONE_INPUT].getVoltage() / 10.0f, 0.0f, 1.0f);
-
 		if(color != lastColor) {
 			float lowpassFreq = 10000.0f * powf(10.0f, clamp(2.0f*color, 0.0f, 1.0f));
 			lowpassFilter[0].setCutoff(lowpassFreq / args.sampleRate);
@@ -801,45 +1001,118 @@ struct PortlandWeather : Module {
 			lastColor = color;
 		}
 
-		lowpassFilter[0].process(feedbackValue.l);
-		feedbackValue.l = lowpassFilter[0].lowpass();
-		lowpassFilter[1].process(feedbackValue.r);
-		feedbackValue.r = lowpassFilter[1].lowpass();
-		
-		highpassFilter[0].process(feedbackValue.l);
-		feedbackValue.l = highpassFilter[0].highpass();
-		highpassFilter[1].process(feedbackValue.r);
-		feedbackValue.r = highpassFilter[1].highpass();
+		FloatFrame wet[decltype(block)::MAX_SIZE]; // This is the mix of delays and input that is outputed
+		std::fill(wet, wet + frames, FloatFrame{0.0f, 0.0f});
+		FloatFrame sends[decltype(block)::MAX_SIZE];
+		bool tapsFedBack = reverse || feedbackTap[0] == NUM_TAPS || feedbackTap[1] == NUM_TAPS;
+		float tail = 0.0f;
+		for(int n = 0; n < frames; n++) {
+			// Push dry sample into history buffer. It always runs forwards; reverse only changes how the taps read it.
+			FloatFrame dryFrame;
+			dryFrame.l = block.input[n].main.l + lastFeedback.l * feedbackAmount;
+			dryFrame.r = block.input[n].main.r + lastFeedback.r * feedbackAmount;
+			if (!buffers->historyBuffer.full(NUM_TAPS-1)) {
+				buffers->historyBuffer.push(dryFrame);
+			}
 
-		outputs[FEEDBACK_L_OUTPUT].setVoltage(feedbackValue.l);
-		outputs[FEEDBACK_R_OUTPUT].setVoltage(feedbackValue.r);
+			if(tapsFedBack) {
+				for(int tap = 0; tap < NUM_TAPS;tap++) {
+					runTap(buffers, tap, 1, reverse, &tapWet[tap][n]);
+					wet[n].l += tapWet[tap][n].l;
+					wet[n].r += tapWet[tap][n].r;
+				}
+			}
 
-		if(inputs[FEEDBACK_L_RETURN].isConnected()) {
-			feedbackValue.l = inputs[FEEDBACK_L_RETURN].getVoltage();
+			FloatFrame feedbackValue = runFeedback(buffers, wet[n]); // This is the output of a tap that gets sent back to input
+			sends[n] = feedbackValue;
+
+			if(returnConnected[0]) {
+				feedbackValue.l = block.input[n].feedback.l;
+			}
+			if(returnConnected[1]) {
+				feedbackValue.r = block.input[n].feedback.r;
+			}
+			
+			if (pingPong) {
+				lastFeedback.l = feedbackValue.r;
+				lastFeedback.r = feedbackValue.l;
+			} else
+			{
+				lastFeedback.l = feedbackValue.l;
+				lastFeedback.r = feedbackValue.r;
+			}
+			denormals.flush(lastFeedback.l);
+			denormals.flush(lastFeedback.r);
+			tail = std::max(tail, std::max(fabsf(feedbackValue.l), fabsf(feedbackValue.r)));
 		}
-		if(inputs[FEEDBACK_R_RETURN].isConnected()) {
-			feedbackValue.r = inputs[FEEDBACK_R_RETURN].getVoltage();
+		for(int channel=0;channel <CHANNELS;channel++) {
+			denormals.flush(lowpassFilter[channel].xstate[0]);
+			denormals.flush(lowpassFilter[channel].ystate[0]);
+			denormals.flush(highpassFilter[channel].xstate[0]);
+			denormals.flush(highpassFilter[channel].ystate[0]);
 		}
-		
-		if (pingPong) {
-			lastFeedback.l = feedbackValue.r;
-			lastFeedback.r = feedbackValue.l;
-		} else
-		{
-			lastFeedback.l = feedbackValue.l;
-			lastFeedback.r = feedbackValue.r;
+		for(int tap = 0; tap < NUM_TAPS;tap++) {
+			for(int channel=0;channel <CHANNELS;channel++) {
+				filterStates[tap][channel].flushDenormals(denormals);
+			}
+		}
+
+		if(!tapsFedBack) {
+			if(threaded) {
+				tapBatch.buffers = buffers;
+				tapBatch.frames = frames;
+				tapBatch.submit();
+			} else {
+				for(int tap = 0; tap < NUM_TAPS;tap++) {
+					runTap(buffers, tap, frames, false, tapWet[tap]);
+				}
+				mixTaps(frames, wet);
+			}
 		}
-		
-		float mix = clamp(params[MIX_PARAM].getValue() + inputs[MIX_INPUT].getVoltage() / 10.0f, 0.0f, 1.0f);
-		float outL = crossfade(inFrame.l, wet.l, mix);  // Not sure this should be wet
-		float outR = crossfade(inFrame.r, wet.r, mix);  // Not sure this should be wet
-		
-		outputs[OUT_L_OUTPUT].setVoltage(outL);
-		outputs[OUT_R_OUTPUT].setVoltage(outR);
+
+		if(threaded) {
+			// What plays now is the last block, complete now that its taps are in. This one waits in the pipe for its own.
+			for(int n = 0; n < frames; n++) {
+				if(pipeFrames == frames) {
+					block.output[n].main.l = crossfade(pipeIn[n].l, pipeWet[n].l, pipeMix);
+					block.output[n].main.r = crossfade(pipeIn[n].r, pipeWet[n].r, pipeMix);
+					block.output[n].feedback = pipeSends[n];
+					tail = std::max(tail, std::max(fabsf(pipeWet[n].l), fabsf(pipeWet[n].r)));
+				} else {
+					block.output[n] = PortlandWeatherFrame{{0.0f, 0.0f}, {0.0f, 0.0f}};
+				}
+				pipeIn[n] = block.input[n].main;
+				pipeWet[n] = wet[n];
+				pipeSends[n] = sends[n];
+			}
+			pipeMix = mix;
+			pipeFrames = frames;
+			pipeTapsPending = !tapsFedBack;
+		} else {
+			for(int n = 0; n < frames; n++) {
+				block.output[n].main.l = crossfade(block.input[n].main.l, wet[n].l, mix);  // Not sure this should be wet
+				block.output[n].main.r = crossfade(block.input[n].main.r, wet[n].r, mix);  // Not sure this should be wet
+				block.output[n].feedback = sends[n];
+				tail = std::max(tail, std::max(fabsf(wet[n].l), fabsf(wet[n].r)));
+			}
+		}
+
+		// Once wet and feedback have been silent for as far back as any tap can read, the history it can reach is silent too.
+		// Reverse reads up to two feedback windows further back.
+		sleepDetector.holdTime = longestDelay * (reverse ? 3.0f : 1.0f) + 0.1f;
+		sleepDetector.track(inputLevel, tail, args.sampleTime * frames);
+		denormals.tick(args.sampleTime * frames);
 
 	}
 };
 
+constexpr const char* PortlandWeather::grooveNames[NUM_GROOVES];
+constexpr float PortlandWeather::tapGroovePatterns[NUM_GROOVES][NUM_TAPS];
+constexpr const char* PortlandWeather::filterNames[5];
+constexpr const char* PortlandWeather::tapNames[NUM_TAPS+2];
+constexpr double PortlandWeather::divisions[DIVISIONS];
+constexpr const char* PortlandWeather::divisionNames[DIVISIONS];
+
 
 
 
@@ -1028,7 +1301,7 @@ struct PortlandWeatherWidget : ModuleWidget {
 			display->module = module;
 			display->box.pos = Vec(0, 0);
 			display->box.size = Vec(box.size.x, 385);
-			addChild(display);
+			addChild(frozenwasteland::createVersionedDisplay(display, module));
 		}
 
 		addParam(createParam<RoundLargeFWSnapKnob>(Vec(12, 40), module, PortlandWeather::CLOCK_DIV_PARAM));
@@ -1148,6 +1421,16 @@ struct PortlandWeatherWidget : ModuleWidget {
 		}
 	};
 
+	struct ThreadedTapsItem : MenuItem {
+		PortlandWeather *module;
+		void onAction(event::Action &e) override {
+			module->setThreadedTaps(!module->threadedTaps);
+		}
+		void step() override {
+			rightText = module->threadedTaps ? "✔" : "";
+		}
+	};
+
 	struct GrainSizeItem : MenuItem {
 		PortlandWeather *module;
 		float grainSize;
@@ -1238,6 +1521,15 @@ struct PortlandWeatherWidget : ModuleWidget {
 		grainSize4Item->grainSize= 1.0f;
 		menu->addChild(grainSize4Item);
 
+		frozenwasteland::appendBlockMenu(menu, module->block);
+
+		ThreadedTapsItem *threadedTapsItem = new ThreadedTapsItem();
+		threadedTapsItem->text = "Taps on worker threads (one more block)";
+		threadedTapsItem->module = module;
+		menu->addChild(threadedTapsItem);
+
+		frozenwasteland::appendQualityMenu(menu, module->quality);
+
 		// DelayDisplayNoteItem *ddnItem = createMenuItem<DelayDisplayNoteItem>("Display delay values in notes", CHECKMARK(module->displayDelayNoteMode));
 		// ddnItem->module = module;
 		// menu->addChild(ddnItem);
@@ -1254,4 +1546,5 @@ struct PortlandWeatherWidget : ModuleWidget {
 };
 
 
+static frozenwasteland::FootprintReport footprint("PortlandWeather", sizeof(PortlandWeather), sizeof(PortlandWeatherBuffers) + sizeof(FloatFrame) * HISTORY_SIZE);
 Model *modelPortlandWeather = createModel<PortlandWeather, PortlandWeatherWidget>("PortlandWeather");
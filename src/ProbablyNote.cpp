@@ -1,7 +1,15 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/seed.hpp"
+#include "ui/scala.hpp"
+#include "ui/framebuffer.hpp"
+#include "ui/expander.hpp"
+#include "ui/messages.hpp"
+#include "ui/footprint.hpp"
 #include "dsp-noise/noise.hpp"
+#include "dsp-noise/distribution.hpp"
+#include "dsp-tuning/tuning.hpp"
 #include "osdialog.h"
 #include <sstream>
 #include <iomanip>
@@ -75,16 +83,24 @@ struct ProbablyNote : Module {
         NOTE_ACTIVE_LIGHT,
 		NUM_LIGHTS = NOTE_ACTIVE_LIGHT + MAX_NOTES*2
 	};
+	enum ChordRandomIds {
+		DISSONANCE_5_RANDOM,
+		DISSONANCE_7_RANDOM,
+		SUSPENSION_RANDOM,
+		SECOND_OR_FOURTH_RANDOM,
+		FIFTH_FLAT_OR_SHARP_RANDOM,
+		SEVENTH_FLAT_OR_SHARP_RANDOM,
+		CHORD_RANDOM_COUNT
+	};
 
-	// // Expander
-	// float consumerMessage[12] = {};// this module must read from here
-	// float producerMessage[12] = {};// mother will write into here
+	// Expander, the chord expander reads back which chord was played
+	frozenwasteland::ExpanderPublisher<frozenwasteland::PNChordFeedbackMessage> toChordExpander;
 
 
 
-	const char* noteNames[MAX_NOTES] = {"C","C#/Db","D","D#/Eb","E","F","F#/Gb","G","G#/Ab","A","A#/Bb","B"};
-	const char* scaleNames[MAX_NOTES] = {"Chromatic","Whole Tone","Ionian (Major)","Dorian","Phrygian","Lydian","Mixolydian","Aeolian (minor)","Locrian","Gypsy","Hungarian","Blues"};
-	float defaultScaleNoteWeighting[MAX_SCALES][MAX_NOTES] = {
+	static constexpr const char* noteNames[MAX_NOTES] = {"C","C#/Db","D","D#/Eb","E","F","F#/Gb","G","G#/Ab","A","A#/Bb","B"};
+	static constexpr const char* scaleNames[MAX_NOTES] = {"Chromatic","Whole Tone","Ionian (Major)","Dorian","Phrygian","Lydian","Mixolydian","Aeolian (minor)","Locrian","Gypsy","Hungarian","Blues"};
+	static constexpr float defaultScaleNoteWeighting[MAX_SCALES][MAX_NOTES] = {
 		{1,1,1,1,1,1,1,1,1,1,1,1},
 		{1,0,1,0,1,0,1,0,1,0,1,0},
 		{1,0,0.2,0,0.5,0.4,0,0.8,0,0.2,0,0.3},
@@ -98,7 +114,7 @@ struct ProbablyNote : Module {
 		{1,0,0.2,0.5,0,0,0.3,0.8,0.2,0,0,0.3},
 		{1,0,0,0.5,0,0.4,0,0.8,0,0,0.3,0},
 	}; 
-	bool defaultScaleNoteStatus[MAX_SCALES][MAX_NOTES] = {
+	static constexpr bool defaultScaleNoteStatus[MAX_SCALES][MAX_NOTES] = {
 		{1,1,1,1,1,1,1,1,1,1,1,1},
 		{1,0,1,0,1,0,1,0,1,0,1,0},
 		{1,0,1,0,1,1,0,1,0,1,0,1},
@@ -116,25 +132,32 @@ struct ProbablyNote : Module {
 	float scaleNoteWeighting[MAX_SCALES][MAX_NOTES]; 
 	bool scaleNoteStatus[MAX_SCALES][MAX_NOTES];
 
-	const char* tempermentNames[MAX_NOTES] = {"Equal","Just"};
-    double noteTemperment[MAX_TEMPERMENTS][MAX_NOTES] = {
+	static constexpr const char* tempermentNames[MAX_NOTES] = {"Equal","Just"};
+	static constexpr double noteTemperment[MAX_TEMPERMENTS][MAX_NOTES] = {
         {0,100,200,300,400,500,600,700,800,900,1000,1100},
         {0,111.73,203.91,315.64,386.61,498.04,582.51,701.955,813.69,884.36,996.09,1088.27},
     };
+	Tuning<MAX_NOTES> tunings[MAX_TEMPERMENTS] = {
+		Tuning<MAX_NOTES>(noteTemperment[0], 1200.0),
+		Tuning<MAX_NOTES>(noteTemperment[1], 1200.0),
+	};
+	frozenwasteland::ScalaTuning<MAX_NOTES> scala;
     
 
 	
-	dsp::SchmittTrigger clockTrigger,resetScaleTrigger,octaveWrapAroundTrigger,tempermentTrigger,shiftScalingTrigger,keyScalingTrigger,noteActiveTrigger[MAX_NOTES]; 
-	dsp::PulseGenerator noteChangePulse;
-    GaussianNoiseGenerator _gauss;
+	dsp::SchmittTrigger clockTrigger[PORT_MAX_CHANNELS],resetScaleTrigger,octaveWrapAroundTrigger,tempermentTrigger,shiftScalingTrigger,keyScalingTrigger,noteActiveTrigger[MAX_NOTES]; 
+	dsp::PulseGenerator noteChangePulse[PORT_MAX_CHANNELS];
+	frozenwasteland::SeededRandom random;
  
     bool octaveWrapAround = false;
     bool noteActive[MAX_NOTES] = {false};
     float noteScaleProbability[MAX_NOTES] = {0.0f};
     float noteInitialProbability[MAX_NOTES] = {0.0f};
+    float spreadProbability[MAX_NOTES] = {0.0f}; // noteInitialProbability relative to the input note, shared by every channel
+    float userProbability[MAX_NOTES] = {0.0f};
     float currentScaleNoteWeighting[MAX_NOTES] = {0.0};
     bool currentScaleNoteStatus[MAX_NOTES] = {false};
-    float actualProbability[MAX_NOTES] = {0.0};
+    WeightedChoice<MAX_NOTES> noteChoice[PORT_MAX_CHANNELS];
 	int controlIndex[MAX_NOTES] = {0};
 
 
@@ -151,11 +174,13 @@ struct ProbablyNote : Module {
 	float lowerSpread = 0.0;
 	float slant = 0;
 	float focus = 0; 
-	int currentNote = 0;
+	int channels = 1;
+	int currentNote[PORT_MAX_CHANNELS] = {0};
+	float octaveIn[PORT_MAX_CHANNELS] = {0.0f};
 	int probabilityNote = 0;
-	double lastQuantizedCV = 0.0;
+	double lastQuantizedCV[PORT_MAX_CHANNELS] = {0.0};
 	bool resetTriggered = false;
-	int lastNote = -1;
+	int lastNote = -1; // Channel 0, which is the one displayed
 	int lastSpread = -1;
 	float lastSlant = -1;
 	float lastFocus = -1;
@@ -165,6 +190,8 @@ struct ProbablyNote : Module {
 
 	bool useCircleLayout = false;
 
+	frozenwasteland::DisplayVersion displayVersion;
+
 	bool generateChords = false;
 	float dissonance5Prbability = 0.0;
 	float dissonance7Prbability = 0.0;
@@ -174,7 +201,7 @@ struct ProbablyNote : Module {
 	float externalDissonance7Random = 0.0;
 	float externalSuspensionRandom = 0.0;
 
-	int fifthOffset,seventhOffset,thirdOffset;
+	int fifthOffset = 0,seventhOffset = 0,thirdOffset = 0;
 
 
 
@@ -203,15 +230,13 @@ struct ProbablyNote : Module {
 		configParam(ProbablyNote::TEMPERMENT_PARAM, 0.0, 1.0, 0.0,"Just Intonation");
 		configParam(ProbablyNote::WEIGHT_SCALING_PARAM, 0.0, 1.0, 0.0,"Weight Scaling","%",0,100);
 
-        srand(time(NULL));
 
         for(int i=0;i<MAX_NOTES;i++) {
             configParam(ProbablyNote::NOTE_ACTIVE_PARAM + i, 0.0, 1.0, 0.0,"Note Active");		
             configParam(ProbablyNote::NOTE_WEIGHT_PARAM + i, 0.0, 1.0, 0.0,"Note Weight");		
         }
 
-		// rightExpander.producerMessage = producerMessage;
-		// rightExpander.consumerMessage = consumerMessage;
+		toChordExpander.attach(rightExpander);
 
 		onReset();
 	}
@@ -220,45 +245,10 @@ struct ProbablyNote : Module {
         return (1 - t) * v0 + t * v1;
     }
 
-    int weightedProbability(float *weights,float scaling,float randomIn) {
-        float weightTotal = 0.0f;
-		float linearWeight, logWeight, weight;
-            
-        for(int i = 0;i <MAX_NOTES; i++) {
-			linearWeight = weights[i];
-			logWeight = std::log10(weights[i]*10 + 1);
-			weight = lerp(linearWeight,logWeight,scaling);
-            weightTotal += weight;
-        }
-
-        int chosenWeight = -1;        
-        float rnd = randomIn * weightTotal;
-        for(int i = 0;i <MAX_NOTES;i++ ) {
-			linearWeight = weights[i];
-			logWeight = std::log10(weights[i]*10 + 1);
-			weight = lerp(linearWeight,logWeight,scaling);
-
-            if(rnd < weight) {
-                chosenWeight = i;
-                break;
-            }
-            rnd -= weight;
-        }
-        return chosenWeight;
-    }
-
 	double quantizedCVValue(int note, int key, bool useJustIntonation) {
-		if(!useJustIntonation) {
-			return (note / 12.0); 
-		} else {
-			int octaveAdjust = 0;
-			int notePosition = note - key;
-			if(notePosition < 0) {
-				notePosition += MAX_NOTES;
-				octaveAdjust -=1;
-			}
-			return (noteTemperment[1][notePosition] / 1200.0) + (key /12.0) + octaveAdjust; 
-		}
+		if(scala.loaded)
+			return scala.tuning.pitch(note, key);
+		return tunings[useJustIntonation ? 1 : 0].pitch(note, key);
 	}
 
 	int nextActiveNote(int note,int offset) {
@@ -312,10 +302,14 @@ struct ProbablyNote : Module {
 				json_object_set_new(rootJ, buf2, json_integer((int) scaleNoteStatus[i][j]));
 			}
 		}
+		random.toJson(rootJ);
+		scala.toJson(rootJ);
 		return rootJ;
 	};
 
 	void dataFromJson(json_t *rootJ) override {
+		random.fromJson(rootJ);
+		scala.fromJson(rootJ);
 
 		json_t *sumO = json_object_get(rootJ, "octaveWrapAround");
 		if (sumO) {
@@ -341,6 +335,7 @@ struct ProbablyNote : Module {
 		json_t *sumCl = json_object_get(rootJ, "useCircleLayout");
 		if (sumCl) {
 			useCircleLayout = json_integer_value(sumCl);			
+			displayVersion.bump();
 		}
 
 
@@ -376,30 +371,17 @@ struct ProbablyNote : Module {
 
 	void process(const ProcessArgs &args) override {
 
-		// //Get Expander Info
-		// if(rightExpander.module && rightExpander.module->model == modelPNChordExpander) {	
-		// 	generateChords = true;		
-		// 	float *messagesFromExpander = (float*)rightExpander.consumerMessage;
-		// 	dissonance5Prbability = messagesFromExpander[0];
-		// 	dissonance7Prbability = messagesFromExpander[1];
-		// 	suspensionProbability = messagesFromExpander[2];
-		// 	externalDissonance5Random = messagesFromExpander[4];
-		// 	externalDissonance7Random = messagesFromExpander[5];
-		// 	externalSuspensionRandom = messagesFromExpander[6];
-
-		// 	//Send outputs to slaves if present		
-		// 	float *messageToExpander = (float*)(rightExpander.module->leftExpander.producerMessage);
-			
-		// 	messageToExpander[0] = thirdOffset; 
-		// 	messageToExpander[1] = fifthOffset; 
-		// 	messageToExpander[2] = seventhOffset; 
-		// 	rightExpander.module->leftExpander.messageFlipRequested = true;
-
-							
-
-		// } else {
-		// 	generateChords = false;
-		// }
+		//Get Expander Info
+		const frozenwasteland::ExpanderPacket<frozenwasteland::PNChordMessage> *chordExpander = frozenwasteland::readExpander<frozenwasteland::PNChordMessage>(rightExpander.module, true);
+		generateChords = chordExpander != NULL;
+		if(generateChords) {
+			dissonance5Prbability = chordExpander->payload.dissonance5Probability;
+			dissonance7Prbability = chordExpander->payload.dissonance7Probability;
+			suspensionProbability = chordExpander->payload.suspensionProbability;
+			externalDissonance5Random = chordExpander->payload.dissonance5Random;
+			externalDissonance7Random = chordExpander->payload.dissonance7Random;
+			externalSuspensionRandom = chordExpander->payload.suspensionRandom;
+		}
 
 	
         if (resetScaleTrigger.process(params[RESET_SCALE_PARAM].getValue())) {
@@ -456,44 +438,49 @@ struct ProbablyNote : Module {
 		
         octave = clamp(params[OCTAVE_PARAM].getValue() + (inputs[OCTAVE_INPUT].getVoltage() * 0.4 * params[OCTAVE_CV_ATTENUVERTER_PARAM].getValue()),-4.0f,4.0f);
 
-        double noteIn = inputs[NOTE_INPUT].getVoltage();
-        double octaveIn = std::floor(noteIn);
-        double fractionalValue = noteIn - octaveIn;
-        double lastDif = 1.0f;    
-        for(int i = 0;i<MAX_NOTES;i++) {            
-			double currentDif = std::abs((i / 12.0) - fractionalValue);
-			if(currentDif < lastDif) {
-				lastDif = currentDif;
-				currentNote = i;
-			}            
-        }
+		//A channel for every note or trigger channel, so a mono trigger can clock a poly note input and vice versa
+		channels = std::max(std::max(inputs[NOTE_INPUT].getChannels(), inputs[TRIGGER_INPUT].getChannels()), 1);
+
+		//Nearest note to each input, as plain loops over the channels so they vectorize
+		float noteIn[PORT_MAX_CHANNELS];
+		for(int c = 0; c < channels; c++) {
+			noteIn[c] = inputs[NOTE_INPUT].getPolyVoltage(c);
+		}
+		for(int c = 0; c < channels; c++) {
+			octaveIn[c] = std::floor(noteIn[c]);
+			int note = (int)std::ceil((noteIn[c] - octaveIn[c]) * MAX_NOTES - 0.5f);
+			currentNote[c] = std::min(std::max(note, 0), MAX_NOTES - 1);
+		}
 
-		if(lastNote != currentNote || lastSpread != spread || lastSlant != slant || lastFocus != focus) {
+		if(lastSpread != spread || lastSlant != slant || lastFocus != focus) {
 			for(int i = 0; i<MAX_NOTES;i++) {
-				noteInitialProbability[i] = 0.0;
+				spreadProbability[i] = 0.0;
 			}
-			noteInitialProbability[currentNote] = 1.0;
+			spreadProbability[0] = 1.0;
 			upperSpread = std::ceil((float)spread * std::min(slant+1.0,1.0));
 			lowerSpread = std::ceil((float)spread * std::min(1.0-slant,1.0));
 
 			
 
 			for(int i=1;i<=spread;i++) {
-				int noteAbove = (currentNote + i) % MAX_NOTES;
-				int noteBelow = (currentNote - i);
-				if(noteBelow < 0)
-                    noteBelow +=MAX_NOTES;
-
 				float upperInitialProbability = lerp(1.0,lerp(0.1,1.0,focus),(float)i/(float)spread); 
 				float lowerInitialProbability = lerp(1.0,lerp(0.1,1.0,focus),(float)i/(float)spread); 
 
-				noteInitialProbability[noteAbove] = i <= upperSpread ? upperInitialProbability : 0.0f;				
-				noteInitialProbability[noteBelow] = i <= lowerSpread ? lowerInitialProbability : 0.0f;				
+				spreadProbability[i] = i <= upperSpread ? upperInitialProbability : 0.0f;				
+				spreadProbability[MAX_NOTES - i] = i <= lowerSpread ? lowerInitialProbability : 0.0f;				
 			}
-			lastNote = currentNote;
 			lastSpread = spread;
 			lastSlant = slant;
 			lastFocus = focus;
+			lastNote = -1;
+		}
+
+		if(lastNote != currentNote[0]) {
+			for(int i = 0; i<MAX_NOTES;i++) {
+				noteInitialProbability[i] = spreadProbability[(i - currentNote[0] + MAX_NOTES) % MAX_NOTES];
+			}
+			lastNote = currentNote[0];
+			displayVersion.bump();
 		}
 
 		weightShift = params[SHIFT_PARAM].getValue();
@@ -579,6 +566,7 @@ struct ProbablyNote : Module {
 			lastScale = scale;
 			lastWeightShift = weightShift;
 			resetTriggered = false;
+			displayVersion.bump();
 		}
 
 		for(int i=0;i<MAX_NOTES;i++) {
@@ -587,20 +575,17 @@ struct ProbablyNote : Module {
             if (noteActiveTrigger[i].process( params[NOTE_ACTIVE_PARAM+i].getValue())) {
                 noteActive[actualTarget] = !noteActive[actualTarget];             }	
 
-			float userProbability;
 			if(noteActive[actualTarget]) {
-	            userProbability = clamp(params[NOTE_WEIGHT_PARAM+i].getValue() + (inputs[NOTE_WEIGHT_INPUT+i].getVoltage() / 10.0f),0.0f,1.0f);    
-				lights[NOTE_ACTIVE_LIGHT+i*2].value = userProbability;    
+	            userProbability[actualTarget] = clamp(params[NOTE_WEIGHT_PARAM+i].getValue() + (inputs[NOTE_WEIGHT_INPUT+i].getVoltage() / 10.0f),0.0f,1.0f);    
+				lights[NOTE_ACTIVE_LIGHT+i*2].value = userProbability[actualTarget];    
 				lights[NOTE_ACTIVE_LIGHT+i*2+1].value = 0;    
 			}
 			else { 
-				userProbability = 0.0;
+				userProbability[actualTarget] = 0.0;
 				lights[NOTE_ACTIVE_LIGHT+i*2].value = 0;    
 				lights[NOTE_ACTIVE_LIGHT+i*2+1].value = 1;    	
 			}
 
-			actualProbability[actualTarget] = noteInitialProbability[actualTarget] * userProbability; 
-
 			if(useCircleLayout) {
 				int scalePosition = controlIndex[controlOffset] - key;
 				if (scalePosition < 0)
@@ -614,129 +599,148 @@ struct ProbablyNote : Module {
         }
 
 		if( inputs[TRIGGER_INPUT].active ) {
-			if (clockTrigger.process(inputs[TRIGGER_INPUT].getVoltage()) ) {		
-				float rnd = ((float) rand()/RAND_MAX);
-				if(inputs[EXTERNAL_RANDOM_INPUT].isConnected()) {
-					rnd = inputs[EXTERNAL_RANDOM_INPUT].getVoltage() / 10.0f;
-				}	
+			//A chord takes up the whole output, so chords are only built for a single channel
+			bool chordMode = generateChords && channels == 1;
+			outputs[QUANT_OUTPUT].setChannels(chordMode ? 4 : channels);
+			outputs[WEIGHT_OUTPUT].setChannels(channels);
+			outputs[NOTE_CHANGE_OUTPUT].setChannels(channels);
+
+			for(int c = 0; c < channels; c++) {
+				if (clockTrigger[c].process(inputs[TRIGGER_INPUT].getPolyVoltage(c)) ) {		
+					float rnd = random.uniform();
+					if(inputs[EXTERNAL_RANDOM_INPUT].isConnected()) {
+						rnd = inputs[EXTERNAL_RANDOM_INPUT].getPolyVoltage(c) / 10.0f;
+					}	
 			
-				int randomNote = weightedProbability(actualProbability,params[WEIGHT_SCALING_PARAM].getValue(), rnd);
-				if(randomNote == -1) { //Couldn't find a note, so find first active
-					bool noteOk = false;
-					int notesSearched = 0;
-					randomNote = currentNote; 
-					do {
-						randomNote = (randomNote + 1) % MAX_NOTES;
-						notesSearched +=1;
-						noteOk = noteActive[randomNote] || notesSearched >= MAX_NOTES;
-					} while(!noteOk);
-				}
+					//The shared spread, centred on this channel's note, times the shared note weights
+					for(int i = 0; i < MAX_NOTES; i++) {
+						noteChoice[c].setWeight(i, spreadProbability[(i - currentNote[c] + MAX_NOTES) % MAX_NOTES] * userProbability[i]);
+					}
+					noteChoice[c].setScaling(params[WEIGHT_SCALING_PARAM].getValue());
+					int randomNote = noteChoice[c].choose(rnd);
+					if(randomNote == -1) { //Couldn't find a note, so find first active
+						bool noteOk = false;
+						int notesSearched = 0;
+						randomNote = currentNote[c]; 
+						do {
+							randomNote = (randomNote + 1) % MAX_NOTES;
+							notesSearched +=1;
+							noteOk = noteActive[randomNote] || notesSearched >= MAX_NOTES;
+						} while(!noteOk);
+					}
 
 
-				probabilityNote = randomNote;
-				float octaveAdjust = 0.0;
-				if(!octaveWrapAround) {
-					if(randomNote > currentNote && randomNote - currentNote > upperSpread)
-						octaveAdjust = -1.0;
-					if(randomNote < currentNote && currentNote - randomNote > lowerSpread)
-						octaveAdjust = 1.0;
-				}
+					if(c == 0)
+						displayVersion.track(probabilityNote, randomNote);
+					float octaveAdjust = 0.0;
+					if(!octaveWrapAround) {
+						if(randomNote > currentNote[c] && randomNote - currentNote[c] > upperSpread)
+							octaveAdjust = -1.0;
+						if(randomNote < currentNote[c] && currentNote[c] - randomNote > lowerSpread)
+							octaveAdjust = 1.0;
+					}
 
-				double quantitizedNoteCV = quantizedCVValue(randomNote,key,justIntonation);
-				quantitizedNoteCV += octaveIn + octave + octaveAdjust;
+					double quantitizedNoteCV = quantizedCVValue(randomNote,key,justIntonation);
+					quantitizedNoteCV += octaveIn[c] + octave + octaveAdjust;
 				
 				
-				//Chord Stuff
-				if(!generateChords) { 
-					outputs[QUANT_OUTPUT].setChannels(1);
-					outputs[QUANT_OUTPUT].setVoltage(quantitizedNoteCV,0);
-				} else {
-					outputs[QUANT_OUTPUT].setChannels(4);
-					outputs[QUANT_OUTPUT].setVoltage(quantitizedNoteCV,0);
-
-					float rndDissonance5 = ((float) rand()/RAND_MAX);
-					if(externalDissonance5Random != -1)
-						rndDissonance5 = externalDissonance5Random;
-
-					float rndDissonance7 = ((float) rand()/RAND_MAX);
-					if(externalDissonance7Random != -1)
-						rndDissonance7 = externalDissonance7Random;
-
-					float rndSuspension = ((float) rand()/RAND_MAX);
-					if(externalSuspensionRandom != -1)
-						rndSuspension = externalSuspensionRandom;
-					//float rndInversion = ((float) rand()/RAND_MAX);
-
-					int secondNote = nextActiveNote(randomNote,2);					
-					if(rndSuspension < suspensionProbability) {
-						float secondOrFourth = ((float) rand()/RAND_MAX);
-						if(secondOrFourth > 0.5) {
-							thirdOffset = 1;
-							secondNote = nextActiveNote(randomNote,3);
-						} else {
-							thirdOffset =-1;
-							secondNote = nextActiveNote(randomNote,1);
-						}					
+					//Chord Stuff
+					if(!chordMode) { 
+						outputs[QUANT_OUTPUT].setVoltage(quantitizedNoteCV,c);
 					} else {
-						thirdOffset = 0;
-					}
-					int secondNoteOctave = 0;
-					if(secondNote < randomNote) {
-						secondNoteOctave +=1;
-					}
+						outputs[QUANT_OUTPUT].setVoltage(quantitizedNoteCV,0);
+
+						//Everything the chord might need, drawn in one go
+						float chordRandom[CHORD_RANDOM_COUNT];
+						random.fill(chordRandom, CHORD_RANDOM_COUNT);
+
+						float rndDissonance5 = chordRandom[DISSONANCE_5_RANDOM];
+						if(externalDissonance5Random != -1)
+							rndDissonance5 = externalDissonance5Random;
+
+						float rndDissonance7 = chordRandom[DISSONANCE_7_RANDOM];
+						if(externalDissonance7Random != -1)
+							rndDissonance7 = externalDissonance7Random;
+
+						float rndSuspension = chordRandom[SUSPENSION_RANDOM];
+						if(externalSuspensionRandom != -1)
+							rndSuspension = externalSuspensionRandom;
+						//float rndInversion = ((float) rand()/RAND_MAX);
+
+						int secondNote = nextActiveNote(randomNote,2);					
+						if(rndSuspension < suspensionProbability) {
+							float secondOrFourth = chordRandom[SECOND_OR_FOURTH_RANDOM];
+							if(secondOrFourth > 0.5) {
+								thirdOffset = 1;
+								secondNote = nextActiveNote(randomNote,3);
+							} else {
+								thirdOffset =-1;
+								secondNote = nextActiveNote(randomNote,1);
+							}					
+						} else {
+							thirdOffset = 0;
+						}
+						int secondNoteOctave = 0;
+						if(secondNote < randomNote) {
+							secondNoteOctave +=1;
+						}
 
-					int thirdNote = nextActiveNote(randomNote,4);
-					if(rndDissonance5 < dissonance5Prbability) {
-						float flatOrSharp = ((float) rand()/RAND_MAX);
-						fifthOffset = -1;
-						if(flatOrSharp > 0.5) {
-							fifthOffset = 1;
+						int thirdNote = nextActiveNote(randomNote,4);
+						if(rndDissonance5 < dissonance5Prbability) {
+							float flatOrSharp = chordRandom[FIFTH_FLAT_OR_SHARP_RANDOM];
+							fifthOffset = -1;
+							if(flatOrSharp > 0.5) {
+								fifthOffset = 1;
+							}
+							thirdNote = (thirdNote + fifthOffset) % MAX_NOTES;
+							if(thirdNote < 0)
+								thirdNote += MAX_NOTES;
+						} else {
+							fifthOffset = 0;
+						}
+						int thirdNoteOctave = 0;
+						if(thirdNote < randomNote) {
+							thirdNoteOctave +=1;
 						}
-						thirdNote = (thirdNote + fifthOffset) % MAX_NOTES;
-						if(thirdNote < 0)
-							thirdNote += MAX_NOTES;
-					} else {
-						fifthOffset = 0;
-					}
-					int thirdNoteOctave = 0;
-					if(thirdNote < randomNote) {
-						thirdNoteOctave +=1;
-					}
 
-					int fourthNote = nextActiveNote(randomNote,6);
-					if(rndDissonance7 < dissonance7Prbability) {
-						float flatOrSharp = ((float) rand()/RAND_MAX);
-						seventhOffset = -1;
-						if(flatOrSharp > 0.5) {
-							seventhOffset = 1;
+						int fourthNote = nextActiveNote(randomNote,6);
+						if(rndDissonance7 < dissonance7Prbability) {
+							float flatOrSharp = chordRandom[SEVENTH_FLAT_OR_SHARP_RANDOM];
+							seventhOffset = -1;
+							if(flatOrSharp > 0.5) {
+								seventhOffset = 1;
+							}
+							fourthNote = (fourthNote + seventhOffset) % MAX_NOTES;
+							if(fourthNote < 0)
+								fourthNote += MAX_NOTES;
+						} else {
+							seventhOffset = 0;
+						}
+						int fourthNoteOctave = 0;
+						if(fourthNote < randomNote) {
+							fourthNoteOctave +=1;
 						}
-						fourthNote = (fourthNote + seventhOffset) % MAX_NOTES;
-						if(fourthNote < 0)
-							fourthNote += MAX_NOTES;
-					} else {
-						seventhOffset = 0;
-					}
-					int fourthNoteOctave = 0;
-					if(fourthNote < randomNote) {
-						fourthNoteOctave +=1;
-					}
 			
-					outputs[QUANT_OUTPUT].setVoltage((double)secondNote/12.0 + octaveIn + octave + octaveAdjust + secondNoteOctave,1);
-					outputs[QUANT_OUTPUT].setVoltage((double)thirdNote/12.0 + octaveIn + octave + octaveAdjust + thirdNoteOctave,2);
-					outputs[QUANT_OUTPUT].setVoltage((double)fourthNote/12.0 + octaveIn + octave + octaveAdjust + fourthNoteOctave,3);
-				}
+						outputs[QUANT_OUTPUT].setVoltage((double)secondNote/12.0 + octaveIn[c] + octave + octaveAdjust + secondNoteOctave,1);
+						outputs[QUANT_OUTPUT].setVoltage((double)thirdNote/12.0 + octaveIn[c] + octave + octaveAdjust + thirdNoteOctave,2);
+						outputs[QUANT_OUTPUT].setVoltage((double)fourthNote/12.0 + octaveIn[c] + octave + octaveAdjust + fourthNoteOctave,3);
+					}
 
-				outputs[WEIGHT_OUTPUT].setVoltage(clamp((params[NOTE_WEIGHT_PARAM+randomNote].getValue() + (inputs[NOTE_WEIGHT_INPUT+randomNote].getVoltage() / 10.0f) * 10.0f),0.0f,10.0f));
-				if(lastQuantizedCV != quantitizedNoteCV) {
-					noteChangePulse.trigger();	
-					lastQuantizedCV = quantitizedNoteCV;
-				}        
+					outputs[WEIGHT_OUTPUT].setVoltage(clamp((params[NOTE_WEIGHT_PARAM+randomNote].getValue() + (inputs[NOTE_WEIGHT_INPUT+randomNote].getVoltage() / 10.0f) * 10.0f),0.0f,10.0f),c);
+					if(lastQuantizedCV[c] != quantitizedNoteCV) {
+						noteChangePulse[c].trigger();	
+						lastQuantizedCV[c] = quantitizedNoteCV;
+					}        
 
+				}
+				outputs[NOTE_CHANGE_OUTPUT].setVoltage(noteChangePulse[c].process(1.0 / args.sampleRate) ? 10.0 : 0,c);
 			}
-			outputs[NOTE_CHANGE_OUTPUT].setVoltage(noteChangePulse.process(1.0 / args.sampleRate) ? 10.0 : 0);
-		
 		}
 
+		toChordExpander.set(toChordExpander.message.thirdOffset, thirdOffset);
+		toChordExpander.set(toChordExpander.message.fifthOffset, fifthOffset);
+		toChordExpander.set(toChordExpander.message.seventhOffset, seventhOffset);
+		toChordExpander.send();
 	}
 
 	// For more advanced Module features, see engine/Module.hpp in the Rack API.
@@ -746,8 +750,18 @@ struct ProbablyNote : Module {
 	void onReset() override;
 };
 
+constexpr const char* ProbablyNote::noteNames[MAX_NOTES];
+constexpr const char* ProbablyNote::scaleNames[MAX_NOTES];
+constexpr float ProbablyNote::defaultScaleNoteWeighting[MAX_SCALES][MAX_NOTES];
+constexpr bool ProbablyNote::defaultScaleNoteStatus[MAX_SCALES][MAX_NOTES];
+constexpr const char* ProbablyNote::tempermentNames[MAX_NOTES];
+constexpr double ProbablyNote::noteTemperment[MAX_TEMPERMENTS][MAX_NOTES];
+
 void ProbablyNote::onReset() {
-	clockTrigger.reset();
+	random.restart();
+	for(int c = 0; c < PORT_MAX_CHANNELS; c++) {
+		clockTrigger[c].reset();
+	}
 	resetTriggered = true;
 	for(int i = 0;i<MAX_SCALES;i++) {
 		for(int j=0;j<MAX_NOTES;j++) {
@@ -772,6 +786,7 @@ struct ProbablyNoteWidget : ModuleWidget {
 	ParamWidget* weightParams[MAX_NOTES];
 	ParamWidget* noteOnParams[MAX_NOTES];
 	LightWidget* lights[MAX_NOTES];
+	int lastLayout = -1; // Controls are only repositioned when the layout changes
 
 
 	struct ProbablyNoteDisplay : TransparentWidget {
@@ -1097,7 +1112,7 @@ struct ProbablyNoteWidget : ModuleWidget {
 			display->module = module;
 			display->box.pos = Vec(0, 0);
 			display->box.size = Vec(box.size.x, box.size.y);
-			addChild(display);
+			addChild(frozenwasteland::createVersionedDisplay(display, module));
 		}
 
 		addChild(createWidget<ScrewSilver>(Vec(RACK_GRID_WIDTH - 12, 0)));
@@ -1335,145 +1350,149 @@ struct ProbablyNoteWidget : ModuleWidget {
 		if (module) {
 			//panel->visible = ((((ProbablyNote*)module)->useCircleLayout) == 0);
 
-			if((((ProbablyNote*)module)->useCircleLayout) == 0) {
-				circlePanel->visible  = false;
-				panel->visible = true;
-
-				weightParams[0]->box.pos.x = 119;
-				weightParams[0]->box.pos.y = 306;
-				inputs[0]->box.pos.x = 142;
-				inputs[0]->box.pos.y =310;
-				noteOnParams[0]->box.pos.x = 97;
-				noteOnParams[0]->box.pos.y = 307;
-				lights[0]->box.pos.x = 98.5;
-				lights[0]->box.pos.y = 308.5;
+			int layout = ((ProbablyNote*)module)->useCircleLayout;
+			if(layout != lastLayout) {
+				lastLayout = layout;
+				if(layout == 0) {
+					circlePanel->visible  = false;
+					panel->visible = true;
+
+					weightParams[0]->box.pos.x = 119;
+					weightParams[0]->box.pos.y = 306;
+					inputs[0]->box.pos.x = 142;
+					inputs[0]->box.pos.y =310;
+					noteOnParams[0]->box.pos.x = 97;
+					noteOnParams[0]->box.pos.y = 307;
+					lights[0]->box.pos.x = 98.5;
+					lights[0]->box.pos.y = 308.5;
 												
-				weightParams[1]->box.pos.x = 47;
-				weightParams[1]->box.pos.y = 292;
-				inputs[1]->box.pos.x = 32;
-				inputs[1]->box.pos.y = 296;
-				noteOnParams[1]->box.pos.x = 69;
-				noteOnParams[1]->box.pos.y = 294;
-				lights[1]->box.pos.x = 70.5;
-				lights[1]->box.pos.y = 294.5;
-
-				weightParams[2]->box.pos.x = 119;
-				weightParams[2]->box.pos.y = 278;
-				inputs[2]->box.pos.x = 142;
-				inputs[2]->box.pos.y = 282;
-				noteOnParams[2]->box.pos.x = 97;
-				noteOnParams[2]->box.pos.y = 279;
-				lights[2]->box.pos.x = 98.5;
-				lights[2]->box.pos.y = 280.5;
-
-				weightParams[3]->box.pos.x = 47;
-				weightParams[3]->box.pos.y = 264;
-				inputs[3]->box.pos.x = 32;
-				inputs[3]->box.pos.y = 268;
-				noteOnParams[3]->box.pos.x = 69;
-				noteOnParams[3]->box.pos.y = 265;
-				lights[3]->box.pos.x = 70.5;
-				lights[3]->box.pos.y = 266.5;
-
-
-				weightParams[4]->box.pos.x = 119;
-				weightParams[4]->box.pos.y = 250;
-				inputs[4]->box.pos.x = 142;
-				inputs[4]->box.pos.y = 254;
-				noteOnParams[4]->box.pos.x = 97;
-				noteOnParams[4]->box.pos.y = 251;
-				lights[4]->box.pos.x = 98.5;
-				lights[4]->box.pos.y = 252;
-
-				weightParams[5]->box.pos.x = 119;
-				weightParams[5]->box.pos.y = 222;
-				inputs[5]->box.pos.x = 142;
-				inputs[5]->box.pos.y = 226;
-				noteOnParams[5]->box.pos.x = 97;
-				noteOnParams[5]->box.pos.y = 223;
-				lights[5]->box.pos.x = 98.5;
-				lights[5]->box.pos.y = 224.5;
-
-				weightParams[6]->box.pos.x = 47;
-				weightParams[6]->box.pos.y = 208;
-				inputs[6]->box.pos.x = 32;
-				inputs[6]->box.pos.y = 212;
-				noteOnParams[6]->box.pos.x = 69;
-				noteOnParams[6]->box.pos.y = 209;
-				lights[6]->box.pos.x = 70.5;
-				lights[6]->box.pos.y = 210.5;
-
-
-				weightParams[7]->box.pos.x = 119;
-				weightParams[7]->box.pos.y = 194;
-				inputs[7]->box.pos.x = 142;
-				inputs[7]->box.pos.y = 198;
-				noteOnParams[7]->box.pos.x = 97;
-				noteOnParams[7]->box.pos.y = 195;
-				lights[7]->box.pos.x = 98.5;
-				lights[7]->box.pos.y = 196.5;
-
-				weightParams[8]->box.pos.x = 47;
-				weightParams[8]->box.pos.y = 180;
-				inputs[8]->box.pos.x = 32;
-				inputs[8]->box.pos.y = 184;
-				noteOnParams[8]->box.pos.x = 69;
-				noteOnParams[8]->box.pos.y = 181;
-				lights[8]->box.pos.x = 70.5;
-				lights[8]->box.pos.y = 182.5;
-
-				weightParams[9]->box.pos.x = 119;
-				weightParams[9]->box.pos.y = 166;
-				inputs[9]->box.pos.x = 142;
-				inputs[9]->box.pos.y = 170;
-				noteOnParams[9]->box.pos.x = 97;
-				noteOnParams[9]->box.pos.y = 167;
-				lights[9]->box.pos.x = 98.5;
-				lights[9]->box.pos.y = 168.5;
-
-				weightParams[10]->box.pos.x = 47;
-				weightParams[10]->box.pos.y = 152;
-				inputs[10]->box.pos.x = 32;
-				inputs[10]->box.pos.y = 156;
-				noteOnParams[10]->box.pos.x = 69;
-				noteOnParams[10]->box.pos.y = 153;
-				lights[10]->box.pos.x = 70.5;
-				lights[10]->box.pos.y = 154.5;
-
-				weightParams[11]->box.pos.x = 119;
-				weightParams[11]->box.pos.y = 138;
-				inputs[11]->box.pos.x = 142;
-				inputs[11]->box.pos.y = 142;
-				noteOnParams[11]->box.pos.x = 97;
-				noteOnParams[11]->box.pos.y = 139;
-				lights[11]->box.pos.x = 98.5;
-				lights[11]->box.pos.y = 140.5;
+					weightParams[1]->box.pos.x = 47;
+					weightParams[1]->box.pos.y = 292;
+					inputs[1]->box.pos.x = 32;
+					inputs[1]->box.pos.y = 296;
+					noteOnParams[1]->box.pos.x = 69;
+					noteOnParams[1]->box.pos.y = 294;
+					lights[1]->box.pos.x = 70.5;
+					lights[1]->box.pos.y = 294.5;
+
+					weightParams[2]->box.pos.x = 119;
+					weightParams[2]->box.pos.y = 278;
+					inputs[2]->box.pos.x = 142;
+					inputs[2]->box.pos.y = 282;
+					noteOnParams[2]->box.pos.x = 97;
+					noteOnParams[2]->box.pos.y = 279;
+					lights[2]->box.pos.x = 98.5;
+					lights[2]->box.pos.y = 280.5;
+
+					weightParams[3]->box.pos.x = 47;
+					weightParams[3]->box.pos.y = 264;
+					inputs[3]->box.pos.x = 32;
+					inputs[3]->box.pos.y = 268;
+					noteOnParams[3]->box.pos.x = 69;
+					noteOnParams[3]->box.pos.y = 265;
+					lights[3]->box.pos.x = 70.5;
+					lights[3]->box.pos.y = 266.5;
+
+
+					weightParams[4]->box.pos.x = 119;
+					weightParams[4]->box.pos.y = 250;
+					inputs[4]->box.pos.x = 142;
+					inputs[4]->box.pos.y = 254;
+					noteOnParams[4]->box.pos.x = 97;
+					noteOnParams[4]->box.pos.y = 251;
+					lights[4]->box.pos.x = 98.5;
+					lights[4]->box.pos.y = 252;
+
+					weightParams[5]->box.pos.x = 119;
+					weightParams[5]->box.pos.y = 222;
+					inputs[5]->box.pos.x = 142;
+					inputs[5]->box.pos.y = 226;
+					noteOnParams[5]->box.pos.x = 97;
+					noteOnParams[5]->box.pos.y = 223;
+					lights[5]->box.pos.x = 98.5;
+					lights[5]->box.pos.y = 224.5;
+
+					weightParams[6]->box.pos.x = 47;
+					weightParams[6]->box.pos.y = 208;
+					inputs[6]->box.pos.x = 32;
+					inputs[6]->box.pos.y = 212;
+					noteOnParams[6]->box.pos.x = 69;
+					noteOnParams[6]->box.pos.y = 209;
+					lights[6]->box.pos.x = 70.5;
+					lights[6]->box.pos.y = 210.5;
+
+
+					weightParams[7]->box.pos.x = 119;
+					weightParams[7]->box.pos.y = 194;
+					inputs[7]->box.pos.x = 142;
+					inputs[7]->box.pos.y = 198;
+					noteOnParams[7]->box.pos.x = 97;
+					noteOnParams[7]->box.pos.y = 195;
+					lights[7]->box.pos.x = 98.5;
+					lights[7]->box.pos.y = 196.5;
+
+					weightParams[8]->box.pos.x = 47;
+					weightParams[8]->box.pos.y = 180;
+					inputs[8]->box.pos.x = 32;
+					inputs[8]->box.pos.y = 184;
+					noteOnParams[8]->box.pos.x = 69;
+					noteOnParams[8]->box.pos.y = 181;
+					lights[8]->box.pos.x = 70.5;
+					lights[8]->box.pos.y = 182.5;
+
+					weightParams[9]->box.pos.x = 119;
+					weightParams[9]->box.pos.y = 166;
+					inputs[9]->box.pos.x = 142;
+					inputs[9]->box.pos.y = 170;
+					noteOnParams[9]->box.pos.x = 97;
+					noteOnParams[9]->box.pos.y = 167;
+					lights[9]->box.pos.x = 98.5;
+					lights[9]->box.pos.y = 168.5;
+
+					weightParams[10]->box.pos.x = 47;
+					weightParams[10]->box.pos.y = 152;
+					inputs[10]->box.pos.x = 32;
+					inputs[10]->box.pos.y = 156;
+					noteOnParams[10]->box.pos.x = 69;
+					noteOnParams[10]->box.pos.y = 153;
+					lights[10]->box.pos.x = 70.5;
+					lights[10]->box.pos.y = 154.5;
+
+					weightParams[11]->box.pos.x = 119;
+					weightParams[11]->box.pos.y = 138;
+					inputs[11]->box.pos.x = 142;
+					inputs[11]->box.pos.y = 142;
+					noteOnParams[11]->box.pos.x = 97;
+					noteOnParams[11]->box.pos.y = 139;
+					lights[11]->box.pos.x = 98.5;
+					lights[11]->box.pos.y = 140.5;
 
-			} else {
-				circlePanel->visible  = true;
-				panel->visible = false;
-
-				for(int i=0;i<MAX_NOTES;i++) {
-					double position = 2.0 * M_PI / MAX_NOTES * i  - M_PI / 2.0; // Rotate 90 degrees
-
-					double x= cos(position) * 54.0 + 90.0;
-					double y= sin(position) * 54.0 + 230.5;
-
-					//Rotate inputs 1 degrees
-					weightParams[i]->box.pos.x = x;
-					weightParams[i]->box.pos.y = y;
-					x= cos(position + (M_PI / 180.0 * 1.0)) * 36.0 + 94.0;
-					y= sin(position + (M_PI / 180.0 * 1.0)) * 36.0 + 235.0;
-					inputs[i]->box.pos.x = x;
-					inputs[i]->box.pos.y = y;
-
-					//Rotate buttons 5 degrees
-					x= cos(position - (M_PI / 180.0 * 5.0)) * 75.0 + 91.0;
-					y= sin(position - (M_PI / 180.0 * 5.0)) * 75.0 + 231.0;
-					noteOnParams[i]->box.pos.x = x;
-					noteOnParams[i]->box.pos.y = y;
-					lights[i]->box.pos.x = x+1.5;
-					lights[i]->box.pos.y = y+1.5;
+				} else {
+					circlePanel->visible  = true;
+					panel->visible = false;
+
+					for(int i=0;i<MAX_NOTES;i++) {
+						double position = 2.0 * M_PI / MAX_NOTES * i  - M_PI / 2.0; // Rotate 90 degrees
+
+						double x= cos(position) * 54.0 + 90.0;
+						double y= sin(position) * 54.0 + 230.5;
+
+						//Rotate inputs 1 degrees
+						weightParams[i]->box.pos.x = x;
+						weightParams[i]->box.pos.y = y;
+						x= cos(position + (M_PI / 180.0 * 1.0)) * 36.0 + 94.0;
+						y= sin(position + (M_PI / 180.0 * 1.0)) * 36.0 + 235.0;
+						inputs[i]->box.pos.x = x;
+						inputs[i]->box.pos.y = y;
+
+						//Rotate buttons 5 degrees
+						x= cos(position - (M_PI / 180.0 * 5.0)) * 75.0 + 91.0;
+						y= sin(position - (M_PI / 180.0 * 5.0)) * 75.0 + 231.0;
+						noteOnParams[i]->box.pos.x = x;
+						noteOnParams[i]->box.pos.y = y;
+						lights[i]->box.pos.x = x+1.5;
+						lights[i]->box.pos.y = y+1.5;
+					}
 				}
 			}
 		}
@@ -1487,6 +1506,7 @@ struct ProbablyNoteWidget : ModuleWidget {
 		bool layout;
 		void onAction(event::Action &e) override {
 			module->useCircleLayout = layout;
+			module->displayVersion.bump();
 		}
 		void step() override {
 			rightText = (module->useCircleLayout == layout) ? "✔" : "";
@@ -1517,11 +1537,18 @@ struct ProbablyNoteWidget : ModuleWidget {
 		pnLayout2Item->module = module;
 		pnLayout2Item->layout= true;
 		menu->addChild(pnLayout2Item);
+
+		menu->addChild(new MenuLabel());
+		frozenwasteland::appendScalaMenu(menu, &module->scala);
+
+		menu->addChild(new MenuLabel());
+		menu->addChild(frozenwasteland::createFixedSeedItem(&module->random));
 			
 	}
 };
 
 
 // Define the Model with the Module type, ModuleWidget type, and module slug
+static frozenwasteland::FootprintReport footprint("ProbablyNote", sizeof(ProbablyNote));
 Model *modelProbablyNote = createModel<ProbablyNote, ProbablyNoteWidget>("ProbablyNote");
     
\ No newline at end of file
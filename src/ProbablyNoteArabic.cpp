@@ -1,7 +1,11 @@
  #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/seed.hpp"
+#include "ui/footprint.hpp"
 #include "dsp-noise/noise.hpp"
+#include "dsp-noise/distribution.hpp"
+#include "dsp-tuning/tuning.hpp"
 #include "osdialog.h"
 #include <sstream>
 #include <iomanip>
@@ -71,10 +75,10 @@ struct ProbablyNoteArabic : Module {
 	};
 
 
-	const char* noteNames[MAX_NOTES] = {"C","C#/Db","D","D#/Eb","E","F","F#/Gb","G","G#/Ab","A","A#/Bb","B"};
-	const char* scaleNames[MAX_JINS] = {"Ajam","Bayati","Hijaz","Kurd","Nahawand","Nikriz","Rast","Saba","Sikah"};
-	const char* arabicScaleNames[MAX_JINS] = {"عجم","بياتي","حجاز","كرد","نهاوند","نكريز","راست","صبا","سيكاه"};
-	float defaultScaleNoteWeighting[MAX_SCALES][MAX_NOTES] = {
+	static constexpr const char* noteNames[MAX_NOTES] = {"C","C#/Db","D","D#/Eb","E","F","F#/Gb","G","G#/Ab","A","A#/Bb","B"};
+	static constexpr const char* scaleNames[MAX_JINS] = {"Ajam","Bayati","Hijaz","Kurd","Nahawand","Nikriz","Rast","Saba","Sikah"};
+	static constexpr const char* arabicScaleNames[MAX_JINS] = {"عجم","بياتي","حجاز","كرد","نهاوند","نكريز","راست","صبا","سيكاه"};
+	static constexpr float defaultScaleNoteWeighting[MAX_SCALES][MAX_NOTES] = {
 		{1,1,1,1,1,1,1,1,1,1,1,1},
 		{1,0,1,0,1,0,1,0,1,0,1,0},
 		{1,0,0.2,0.5,0,0.4,0,0.8,0.2,0,0.3,0},
@@ -90,23 +94,27 @@ struct ProbablyNoteArabic : Module {
 	}; 
     float scaleNoteWeighting[MAX_SCALES][MAX_NOTES]; 
 
-	const char* tempermentNames[MAX_NOTES] = {"Equal","Just"};
-    double noteTemperment[MAX_NOTES] = {
+	static constexpr const char* tempermentNames[MAX_NOTES] = {"Equal","Just"};
+	static constexpr double noteTemperment[MAX_NOTES] = {
         0,111.73,203.91,315.64,386.61,498.04,582.51,701.955,813.69,884.36,996.09,1088.27
     };
+	Tuning<MAX_NOTES> tunings[2] = {
+		Tuning<MAX_NOTES>::equal(1200.0),
+		Tuning<MAX_NOTES>(noteTemperment, 1200.0),
+	};
     
 
 	
 	dsp::SchmittTrigger clockTrigger,writeScaleTrigger,octaveWrapAroundTrigger,tempermentTrigger,shiftScalingTrigger,noteActiveTrigger[MAX_NOTES]; 
 	dsp::PulseGenerator noteChangePulse;
-    GaussianNoiseGenerator _gauss;
+	frozenwasteland::SeededRandom random;
  
     bool octaveWrapAround = false;
     bool noteActive[MAX_NOTES] = {false};
     float noteScaleProbability[MAX_NOTES] = {0.0f};
     float noteInitialProbability[MAX_NOTES] = {0.0f};
     float currentScaleNoteWeighting[MAX_NOTES] = {0.0};
-	float actualProbability[MAX_NOTES] = {0.0};
+	WeightedChoice<MAX_NOTES> noteChoice;
 
 
     int scale = 0;
@@ -150,7 +158,6 @@ struct ProbablyNoteArabic : Module {
 		configParam(ProbablyNoteArabic::OCTAVE_WRAPAROUND_PARAM, 0.0, 1.0, 0.0,"Octave Wraparound");
 		
 
-        srand(time(NULL));
 
         for(int i=0;i<MAX_NOTES;i++) {
             configParam(ProbablyNoteArabic::NOTE_ACTIVE_PARAM + i, 0.0, 1.0, 0.0,"Note Active");		
@@ -164,24 +171,6 @@ struct ProbablyNoteArabic : Module {
         return (1 - t) * v0 + t * v1;
     }
 
-    int weightedProbability(float *weights,float randomIn) {
-        float weightTotal = 0.0f;
-        for(int i = 0;i <MAX_NOTES; i++) {
-            weightTotal += weights[i];
-        }
-
-        int chosenWeight = -1;        
-        float rnd = randomIn * weightTotal;
-        for(int i = 0;i <MAX_NOTES;i++ ) {
-            if(rnd < weights[i]) {
-                chosenWeight = i;
-                break;
-            }
-            rnd -= weights[i];
-        }
-        return chosenWeight;
-    }
-
 	json_t *dataToJson() override {
 		json_t *rootJ = json_object();
 
@@ -201,10 +190,12 @@ struct ProbablyNoteArabic : Module {
 				json_object_set_new(rootJ, buf, json_real((float) scaleNoteWeighting[i][j]));
 			}
 		}
+		random.toJson(rootJ);
 		return rootJ;
 	};
 
 	void dataFromJson(json_t *rootJ) override {
+		random.fromJson(rootJ);
 
 		json_t *sumO = json_object_get(rootJ, "octaveWrapAround");
 		if (sumO) {
@@ -421,17 +412,17 @@ struct ProbablyNoteArabic : Module {
 				lights[NOTE_ACTIVE_LIGHT+i*2+1].value = 1;    
 			}
 
-			actualProbability[i] = noteInitialProbability[i] * userProbability; 
+			noteChoice.setWeight(i, noteInitialProbability[i] * userProbability); 
         }
 
 		if( inputs[TRIGGER_INPUT].active ) {
 			if (clockTrigger.process(inputs[TRIGGER_INPUT].value) ) {		
-				float rnd = ((float) rand()/RAND_MAX);
+				float rnd = random.uniform();
 				if(inputs[EXTERNAL_RANDOM_INPUT].isConnected()) {
 					rnd = inputs[EXTERNAL_RANDOM_INPUT].getVoltage() / 10.0f;
 				}	
 			
-				int randomNote = weightedProbability(actualProbability,rnd);
+				int randomNote = noteChoice.choose(rnd);
 				if(randomNote == -1) { //Couldn't find a note, so find first active
 					bool noteOk = false;
 					int notesSearched = 0;
@@ -453,17 +444,7 @@ struct ProbablyNoteArabic : Module {
 						octaveAdjust = 1.0;
 				}
 
-				double quantitizedNoteCV;
-				if(!justIntonation) {
-					quantitizedNoteCV = randomNote / 12.0; 
-				} else {
-					int notePosition = randomNote - key;
-					if(notePosition < 0) {
-						notePosition += MAX_NOTES;
-						octaveAdjust -=1;
-					}
-					quantitizedNoteCV =(noteTemperment[notePosition] / 1200.0) + (key /12.0); 
-				}
+				double quantitizedNoteCV = tunings[justIntonation ? 1 : 0].pitch(randomNote, key);
 				quantitizedNoteCV += octaveIn + octave + octaveAdjust; 
 				outputs[QUANT_OUTPUT].setVoltage(quantitizedNoteCV);
 				outputs[WEIGHT_OUTPUT].setVoltage(clamp((params[NOTE_WEIGHT_PARAM+randomNote].getValue() + (inputs[NOTE_WEIGHT_INPUT+randomNote].getVoltage() / 10.0f) * 10.0f),0.0f,10.0f));
@@ -484,7 +465,15 @@ struct ProbablyNoteArabic : Module {
 	void onReset() override;
 };
 
+constexpr const char* ProbablyNoteArabic::noteNames[MAX_NOTES];
+constexpr const char* ProbablyNoteArabic::scaleNames[MAX_JINS];
+constexpr const char* ProbablyNoteArabic::arabicScaleNames[MAX_JINS];
+constexpr float ProbablyNoteArabic::defaultScaleNoteWeighting[MAX_SCALES][MAX_NOTES];
+constexpr const char* ProbablyNoteArabic::tempermentNames[MAX_NOTES];
+constexpr double ProbablyNoteArabic::noteTemperment[MAX_NOTES];
+
 void ProbablyNoteArabic::onReset() {
+	random.restart();
 	clockTrigger.reset();
 	for(int i = 0;i<MAX_SCALES;i++) {
 		for(int j=0;j<MAX_NOTES;j++) {
@@ -952,5 +941,6 @@ struct ProbablyNoteArabicWidget : ModuleWidget {
 
 
 // Define the Model with the Module type, ModuleWidget type, and module slug
+static frozenwasteland::FootprintReport footprint("ProbablyNoteArabic", sizeof(ProbablyNoteArabic));
 Model *modelProbablyNoteArabic = createModel<ProbablyNoteArabic, ProbablyNoteArabicWidget>("ProbablyNoteArabic");
     
\ No newline at end of file
@@ -1,7 +1,12 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/seed.hpp"
+#include "ui/scala.hpp"
+#include "ui/footprint.hpp"
 #include "dsp-noise/noise.hpp"
+#include "dsp-noise/distribution.hpp"
+#include "dsp-tuning/tuning.hpp"
 #include "osdialog.h"
 #include <sstream>
 #include <iomanip>
@@ -79,9 +84,9 @@ struct ProbablyNoteBP : Module {
 	};
 
 
-	const char* noteNames[MAX_NOTES] = {"C","C#/Db","D","E","F","F#/Gb","G","H","H#/Jb","J","A","A#/Bb","B"};
-	const char* scaleNames[MAX_SCALES] = {"Chromatic","Lambda 1","Lambda 2","Lambda 3","Lambda 4","Lambda 5","Lambda 6","Lambda 7","Lambda 8","Lambda 9"};
-	float defaultScaleNoteWeighting[MAX_SCALES][MAX_NOTES] = {
+	static constexpr const char* noteNames[MAX_NOTES] = {"C","C#/Db","D","E","F","F#/Gb","G","H","H#/Jb","J","A","A#/Bb","B"};
+	static constexpr const char* scaleNames[MAX_SCALES] = {"Chromatic","Lambda 1","Lambda 2","Lambda 3","Lambda 4","Lambda 5","Lambda 6","Lambda 7","Lambda 8","Lambda 9"};
+	static constexpr float defaultScaleNoteWeighting[MAX_SCALES][MAX_NOTES] = {
 		{1,1,1,1,1,1,1,1,1,1,1,1,1},
 		{1,0,0.2,0.5,0.4,0,0.8,0.2,0,0.3,0.2,0,0.2},
 		{1,0.2,0.5,0,0.4,0.8,0,0.2,0.3,0,0.2,0.2,0},
@@ -93,7 +98,7 @@ struct ProbablyNoteBP : Module {
 		{1,0,0.2,0.5,0,0.4,0.8,0.2,0,0.3,0.2,0,0.2},
 		{1,0.2,0,0.5,0.4,0.8,0,0.2,0.3,0,0.2,0.2,0}
 	}; 
-	bool defaultScaleNoteStatus[MAX_SCALES][MAX_NOTES] = {
+	static constexpr bool defaultScaleNoteStatus[MAX_SCALES][MAX_NOTES] = {
 		{1,1,1,1,1,1,1,1,1,1,1,1,1},
 		{1,0,1,1,1,0,1,1,0,1,1,0,1},
 		{1,1,1,0,1,1,0,1,1,0,1,1,0},
@@ -110,17 +115,22 @@ struct ProbablyNoteBP : Module {
     float scaleNoteWeighting[MAX_SCALES][MAX_NOTES]; 
 	bool scaleNoteStatus[MAX_SCALES][MAX_NOTES];
 
-	const char* tempermentNames[MAX_NOTES] = {"Equal","Just"};
-    double noteTemperment[MAX_TEMPERMENTS][MAX_NOTES] = {
+	static constexpr const char* tempermentNames[MAX_NOTES] = {"Equal","Just"};
+	static constexpr double noteTemperment[MAX_TEMPERMENTS][MAX_NOTES] = {
         {0,146,293,439,585,732,878,1024,1170,1317,1463,1609,1756},
         {0,133,301.85,435,583,737,884,1018,1165,1319,1467,1600,1769},
     };
+	Tuning<MAX_NOTES> tunings[MAX_TEMPERMENTS] = {
+		Tuning<MAX_NOTES>(noteTemperment[0], 1901.955),
+		Tuning<MAX_NOTES>(noteTemperment[1], 1901.955),
+	};
+	frozenwasteland::ScalaTuning<MAX_NOTES> scala;
     
-	const double tritaveFrequency = 1.5849625;
+	static constexpr double tritaveFrequency = 1.5849625;
 	
 	dsp::SchmittTrigger clockTrigger,resetScaleTrigger,tritaveWrapAroundTrigger,tempermentTrigger,tritaveMappingTrigger,shiftScalingTrigger,keyScalingTrigger,noteActiveTrigger[MAX_NOTES]; 
 	dsp::PulseGenerator noteChangePulse;
-    GaussianNoiseGenerator _gauss;
+	frozenwasteland::SeededRandom random;
  
     bool tritaveWrapAround = false;
     bool noteActive[MAX_NOTES] = {false};
@@ -128,7 +138,7 @@ struct ProbablyNoteBP : Module {
     float noteInitialProbability[MAX_NOTES] = {0.0f};
     float currentScaleNoteWeighting[MAX_NOTES] = {0.0};
 	bool currentScaleNoteStatus[MAX_NOTES] = {false};
-	float actualProbability[MAX_NOTES] = {0.0};
+	WeightedChoice<MAX_NOTES> noteChoice;
 	int controlIndex[MAX_NOTES] = {0};
 
 
@@ -183,7 +193,6 @@ struct ProbablyNoteBP : Module {
 		configParam(ProbablyNoteBP::TEMPERMENT_PARAM, 0.0, 1.0, 0.0,"Just Intonation");
 		configParam(ProbablyNoteBP::WEIGHT_SCALING_PARAM, 0.0, 1.0, 0.0,"Weight Scaling","%",0,100);
 
-        srand(time(NULL));
 
         for(int i=0;i<MAX_NOTES;i++) {
             configParam(ProbablyNoteBP::NOTE_ACTIVE_PARAM + i, 0.0, 1.0, 0.0,"Note Active");		
@@ -197,43 +206,10 @@ struct ProbablyNoteBP : Module {
         return (1 - t) * v0 + t * v1;
     }
 
-    int weightedProbability(float *weights,float scaling,float randomIn) {
-        float weightTotal = 0.0f;
-		float linearWeight, logWeight, weight;
-            
-        for(int i = 0;i <MAX_NOTES; i++) {
-			linearWeight = weights[i];
-			logWeight = std::log10(weights[i]*10 + 1);
-			weight = lerp(linearWeight,logWeight,scaling);
-            weightTotal += weight;
-        }
-
-        int chosenWeight = -1;        
-        float rnd = randomIn * weightTotal;
-        for(int i = 0;i <MAX_NOTES;i++ ) {
-			linearWeight = weights[i];
-			logWeight = std::log10(weights[i]*10 + 1);
-			weight = lerp(linearWeight,logWeight,scaling);
-
-            if(rnd < weight) {
-                chosenWeight = i;
-                break;
-            }
-            rnd -= weights[i];
-        }
-        return chosenWeight;
-    }
-
-	double quantizedCVValue(int note, int key, bool useJustIntonation) {
-		int tempermemtIndex = useJustIntonation ? 1 : 0;
-
-		int tritaveAdjust = 0;
-		int notePosition = note - key;
-		if(notePosition < 0) {
-			notePosition += MAX_NOTES;
-			tritaveAdjust -=1;
-		}
-		return (noteTemperment[tempermemtIndex][notePosition] / 1200.0) + (key / 13.0) + tritaveAdjust; 
+	const Tuning<MAX_NOTES> &currentTuning(bool useJustIntonation) {
+		if(scala.loaded)
+			return scala.tuning;
+		return tunings[useJustIntonation ? 1 : 0];
 	}
 
 		int nextActiveNote(int note,int offset) {
@@ -285,10 +261,14 @@ struct ProbablyNoteBP : Module {
 				json_object_set_new(rootJ, buf2, json_integer((int) scaleNoteStatus[i][j]));
 			}
 		}
+		random.toJson(rootJ);
+		scala.toJson(rootJ);
 		return rootJ;
 	};
 
 	void dataFromJson(json_t *rootJ) override {
+		random.fromJson(rootJ);
+		scala.fromJson(rootJ);
 
 		json_t *sumO = json_object_get(rootJ, "tritaveWrapAround");
 		if (sumO) {
@@ -562,7 +542,7 @@ struct ProbablyNoteBP : Module {
 				lights[NOTE_ACTIVE_LIGHT+i*2+1].value = 1;    	
 			}
 
-			actualProbability[actualTarget] = noteInitialProbability[actualTarget] * userProbability; 
+			noteChoice.setWeight(actualTarget, noteInitialProbability[actualTarget] * userProbability); 
 
 			int scalePosition = controlIndex[controlOffset] - key;
 			if (scalePosition < 0)
@@ -574,12 +554,13 @@ struct ProbablyNoteBP : Module {
 
 		if( inputs[TRIGGER_INPUT].active ) {
 			if (clockTrigger.process(inputs[TRIGGER_INPUT].value) ) {		
-				float rnd = ((float) rand()/RAND_MAX);
+				float rnd = random.uniform();
 				if(inputs[EXTERNAL_RANDOM_INPUT].isConnected()) {
 					rnd = inputs[EXTERNAL_RANDOM_INPUT].getVoltage() / 10.0f;
 				}	
 			
-				int randomNote = weightedProbability(actualProbability,params[WEIGHT_SCALING_PARAM].getValue(), rnd);
+				noteChoice.setScaling(params[WEIGHT_SCALING_PARAM].getValue());
+				int randomNote = noteChoice.choose(rnd);
 				if(randomNote == -1) { //Couldn't find a note, so find first active
 					bool noteOk = false;
 					int notesSearched = 0;
@@ -602,15 +583,10 @@ struct ProbablyNoteBP : Module {
 				}
 
 				
-				int tempermentIndex = justIntonation ? 1 : 0;
-				int notePosition = randomNote - key;
-				if(notePosition < 0) {
-					notePosition += MAX_NOTES;
-					tritaveAdjust -=1;
-				}
-				double quantitizedNoteCV = (noteTemperment[tempermentIndex][notePosition] / 1200.0) + (key * 146.308 / 1200.0); 
+				const Tuning<MAX_NOTES> &tuning = currentTuning(justIntonation);
+				double quantitizedNoteCV = tuning.pitch(randomNote, key);
 
-				quantitizedNoteCV += (tritaveIn + tritave + tritaveAdjust) * tritaveFrequency; 
+				quantitizedNoteCV += (tritaveIn + tritave + tritaveAdjust) * tuning.periodVolts; 
 				outputs[QUANT_OUTPUT].setVoltage(quantitizedNoteCV);
 				outputs[WEIGHT_OUTPUT].setVoltage(clamp((params[NOTE_WEIGHT_PARAM+randomNote].getValue() + (inputs[NOTE_WEIGHT_INPUT+randomNote].getVoltage() / 10.0f) * 10.0f),0.0f,10.0f));
 				if(lastQuantizedCV != quantitizedNoteCV) {
@@ -630,7 +606,15 @@ struct ProbablyNoteBP : Module {
 	void onReset() override;
 };
 
+constexpr const char* ProbablyNoteBP::noteNames[MAX_NOTES];
+constexpr const char* ProbablyNoteBP::scaleNames[MAX_SCALES];
+constexpr float ProbablyNoteBP::defaultScaleNoteWeighting[MAX_SCALES][MAX_NOTES];
+constexpr bool ProbablyNoteBP::defaultScaleNoteStatus[MAX_SCALES][MAX_NOTES];
+constexpr const char* ProbablyNoteBP::tempermentNames[MAX_NOTES];
+constexpr double ProbablyNoteBP::noteTemperment[MAX_TEMPERMENTS][MAX_NOTES];
+
 void ProbablyNoteBP::onReset() {
+	random.restart();
 	clockTrigger.reset();
 	for(int i = 0;i<MAX_SCALES;i++) {
 		for(int j=0;j<MAX_NOTES;j++) {
@@ -886,10 +870,17 @@ struct ProbablyNoteBPWidget : ModuleWidget {
 
 	}
 
-	
+	void appendContextMenu(Menu *menu) override {
+		ProbablyNoteBP *module = dynamic_cast<ProbablyNoteBP*>(this->module);
+		assert(module);
+
+		menu->addChild(new MenuLabel());
+		frozenwasteland::appendScalaMenu(menu, &module->scala);
+	}
 };
 
 
 // Define the Model with the Module type, ModuleWidget type, and module slug
+static frozenwasteland::FootprintReport footprint("ProbablyNoteBP", sizeof(ProbablyNoteBP));
 Model *modelProbablyNoteBP = createModel<ProbablyNoteBP, ProbablyNoteBPWidget>("ProbablyNoteBP");
     
\ No newline at end of file
@@ -1,14 +1,13 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/expander.hpp"
+#include "ui/messages.hpp"
+#include "ui/footprint.hpp"
 
 #define TRACK_COUNT 4
 #define MAX_STEPS 18
 #define NUM_TAPS 16
-#define PASSTHROUGH_LEFT_VARIABLE_COUNT 13
-#define PASSTHROUGH_RIGHT_VARIABLE_COUNT 8
-#define TRACK_LEVEL_PARAM_COUNT TRACK_COUNT * 6
-#define PASSTHROUGH_OFFSET MAX_STEPS * TRACK_COUNT * 3 + TRACK_LEVEL_PARAM_COUNT
 
 
 struct QARGrooveExpander : Module {
@@ -60,9 +59,8 @@ struct QARGrooveExpander : Module {
 
 	const char* stepNames[MAX_STEPS] {"1","2","3","4","5","6","7","8","9","10","11","12","13","14","15","16","17","18"};
 
-	// Expander
-	float consumerMessage[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + PASSTHROUGH_RIGHT_VARIABLE_COUNT] = {};// this module must read from here
-	float producerMessage[PASSTHROUGH_OFFSET + 1 + PASSTHROUGH_LEFT_VARIABLE_COUNT + PASSTHROUGH_RIGHT_VARIABLE_COUNT] = {};// mother will write into here
+	// Expander, read by the QAR on the left
+	frozenwasteland::ExpanderPublisher<frozenwasteland::QARGrooveMessage> toMother;
 
     float lerp(float v0, float v1, float t) {
 	  return (1 - t) * v0 + t * v1;
@@ -97,8 +95,7 @@ struct QARGrooveExpander : Module {
 		configParam(GROOVE_LENGTH_SAME_AS_TRACK_PARAM, 0.0, 1.0, 0.0);
 		configParam(RANDOM_DISTRIBUTION_PATTERN_PARAM, 0.0, 1.0, 0.0);
 
-		leftExpander.producerMessage = producerMessage;
-		leftExpander.consumerMessage = consumerMessage;
+		toMother.attach(leftExpander);
 
 		
         onReset();
@@ -175,70 +172,24 @@ struct QARGrooveExpander : Module {
 
         
 
-		bool motherPresent = (leftExpander.module && (leftExpander.module->model == modelQuadAlgorithmicRhythm || leftExpander.module->model == modelQARProbabilityExpander || leftExpander.module->model == modelQARGrooveExpander));
-		//lights[CONNECTED_LIGHT].value = motherPresent;
-		if (motherPresent) {
-			// To Mother
-			float *producerMessage = (float*) leftExpander.producerMessage;
-
-			//Initalize
-			for (int i = 0; i < PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT; i++) {
-                producerMessage[i] = 0.0;
-			}
-
-			//If another expander is present, get its values (we can overwrite them)
-			bool anotherExpanderPresent = (rightExpander.module && (rightExpander.module->model == modelQARGrooveExpander || rightExpander.module->model == modelQARProbabilityExpander || rightExpander.module->model == modelQuadAlgorithmicRhythm));
-			if(anotherExpanderPresent)
-			{			
-				float *message = (float*) rightExpander.module->leftExpander.consumerMessage;	
-
-                if(rightExpander.module->model == modelQARProbabilityExpander || rightExpander.module->model == modelQARGrooveExpander ) { // Get QRE values							
-					for(int i = 0; i < PASSTHROUGH_OFFSET; i++) {
-                        producerMessage[i] = message[i];
-					}
-				}
-
-				//QAR Pass through left
-				for(int i = 0; i < PASSTHROUGH_LEFT_VARIABLE_COUNT; i++) {
-					producerMessage[PASSTHROUGH_OFFSET + i] = message[PASSTHROUGH_OFFSET + i];
-				}
-
-				//QAR Pass through right
-				float *messagesFromMother = (float*)leftExpander.consumerMessage;
-				float *messageToSlave = (float*)(rightExpander.module->leftExpander.producerMessage);	
-				for(int i = 0; i < PASSTHROUGH_RIGHT_VARIABLE_COUNT;i++) {
-					messageToSlave[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + i] = messagesFromMother[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + i];
-				}	
-			}
-
-
-            float grooveLength = clamp(params[GROOVE_LENGTH_PARAM].getValue() + (inputs[GROOVE_LENGTH_INPUT].isConnected() ? inputs[GROOVE_LENGTH_INPUT].getVoltage() * 1.8f * params[GROOVE_LENGTH_CV_PARAM].getValue() : 0.0f),1.0,18.0f);
-            float grooveAmount = clamp(params[GROOVE_AMOUNT_PARAM].getValue() + (inputs[GROOVE_AMOUNT_INPUT].isConnected() ? inputs[GROOVE_AMOUNT_INPUT].getVoltage() / 10 * params[GROOVE_AMOUNT_CV_PARAM].getValue() : 0.0f),0.0,1.0f);
-            float randomAmount = clamp(params[SWING_RANDOMNESS_PARAM].getValue() + (inputs[SWING_RANDOMNESS_INPUT].isConnected() ? inputs[SWING_RANDOMNESS_INPUT].getVoltage() / 10 * params[SWING_RANDOMNESS_CV_PARAM].getValue() : 0.0f),0.0,1.0f);
-            for (int i = 0; i < TRACK_COUNT; i++) {
-                if(trackGrooveSelected[i]) {
-                    producerMessage[TRACK_COUNT + i] = stepsOrDivs ? 2 : 1;
-                    producerMessage[TRACK_COUNT * 2 + i] = grooveLength;
-                    producerMessage[TRACK_COUNT * 3 + i] = grooveIsTrackLength;
-                    producerMessage[TRACK_COUNT * 4 + i] = randomAmount;
-                    producerMessage[TRACK_COUNT * 5 + i] = gaussianDistribution;
-                    
-    				for (int j = 0; j < MAX_STEPS; j++) {
-                        float initialSwingAmount = clamp(params[STEP_1_SWING_AMOUNT_PARAM+j].getValue() + (inputs[STEP_1_SWING_AMOUNT_INPUT + j].isConnected() ? inputs[STEP_1_SWING_AMOUNT_INPUT + j].getVoltage() / 10 * params[STEP_1_SWING_CV_ATTEN_PARAM + j].getValue() : 0.0f),-0.5,0.5f);
-						producerMessage[TRACK_LEVEL_PARAM_COUNT + (MAX_STEPS * TRACK_COUNT * 2) + (i * MAX_STEPS) + j] = lerp(0,initialSwingAmount,grooveAmount);
-					} 					 
-				} 
-			}
-		
-			// From Mother	
-			
-			
-			leftExpander.messageFlipRequested = true;
-		
-		}		
-		
+		// To Mother, only what changed. The QAR finds this module itself, so nothing needs passing along the chain.
+		float grooveLength = clamp(params[GROOVE_LENGTH_PARAM].getValue() + (inputs[GROOVE_LENGTH_INPUT].isConnected() ? inputs[GROOVE_LENGTH_INPUT].getVoltage() * 1.8f * params[GROOVE_LENGTH_CV_PARAM].getValue() : 0.0f),1.0,18.0f);
+		float grooveAmount = clamp(params[GROOVE_AMOUNT_PARAM].getValue() + (inputs[GROOVE_AMOUNT_INPUT].isConnected() ? inputs[GROOVE_AMOUNT_INPUT].getVoltage() / 10 * params[GROOVE_AMOUNT_CV_PARAM].getValue() : 0.0f),0.0,1.0f);
+		float randomAmount = clamp(params[SWING_RANDOMNESS_PARAM].getValue() + (inputs[SWING_RANDOMNESS_INPUT].isConnected() ? inputs[SWING_RANDOMNESS_INPUT].getVoltage() / 10 * params[SWING_RANDOMNESS_CV_PARAM].getValue() : 0.0f),0.0,1.0f);
+		for (int i = 0; i < TRACK_COUNT; i++) {
+			toMother.set(toMother.message.trackSelected[i], trackGrooveSelected[i]);
+		}
+		toMother.set(toMother.message.useDivs, stepsOrDivs);
+		toMother.set(toMother.message.grooveLength, (int)grooveLength);
+		toMother.set(toMother.message.grooveIsTrackLength, grooveIsTrackLength);
+		toMother.set(toMother.message.randomAmount, randomAmount);
+		toMother.set(toMother.message.gaussian, gaussianDistribution);
+		for (int j = 0; j < MAX_STEPS; j++) {
+			float initialSwingAmount = clamp(params[STEP_1_SWING_AMOUNT_PARAM+j].getValue() + (inputs[STEP_1_SWING_AMOUNT_INPUT + j].isConnected() ? inputs[STEP_1_SWING_AMOUNT_INPUT + j].getVoltage() / 10 * params[STEP_1_SWING_CV_ATTEN_PARAM + j].getValue() : 0.0f),-0.5,0.5f);
+			toMother.set(toMother.message.swing[j], lerp(0,initialSwingAmount,grooveAmount));
+		}
+		toMother.send();
 	}
-
     
 	
 	
@@ -256,11 +207,6 @@ struct QARGrooveExpander : Module {
             //params[SWING_1_PARAM+i].setValue(0);
 			trackGrooveSelected[i] = true;
 		}
-
-		for(int i = 0; i < PASSTHROUGH_LEFT_VARIABLE_COUNT + PASSTHROUGH_RIGHT_VARIABLE_COUNT; i++) {
-			producerMessage[MAX_STEPS * TRACK_COUNT * 2 + 1 + i] = 0;
-			consumerMessage[MAX_STEPS * TRACK_COUNT * 2 + 1 + i] = 0;
-		}
 	}
 };
 
@@ -334,5 +280,6 @@ struct QARGrooveExpanderWidget : ModuleWidget {
 	}
 };
 
+static frozenwasteland::FootprintReport footprint("QARGrooveExpander", sizeof(QARGrooveExpander));
 Model *modelQARGrooveExpander = createModel<QARGrooveExpander, QARGrooveExpanderWidget>("QARGrooveExpander");
  
\ No newline at end of file
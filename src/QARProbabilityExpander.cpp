@@ -1,13 +1,12 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/expander.hpp"
+#include "ui/messages.hpp"
+#include "ui/footprint.hpp"
 
 #define TRACK_COUNT 4
 #define MAX_STEPS 18
-#define PASSTHROUGH_LEFT_VARIABLE_COUNT 13
-#define PASSTHROUGH_RIGHT_VARIABLE_COUNT 8
-#define TRACK_LEVEL_PARAM_COUNT TRACK_COUNT * 6
-#define PASSTHROUGH_OFFSET MAX_STEPS * TRACK_COUNT * 3 + TRACK_LEVEL_PARAM_COUNT
 
 struct QARProbabilityExpander : Module {
 	enum ParamIds {
@@ -46,9 +45,8 @@ struct QARProbabilityExpander : Module {
 
 	const char* stepNames[MAX_STEPS] {"1","2","3","4","5","6","7","8","9","10","11","12","13","14","15","16","17","18"};
 
-	// Expander
-	float consumerMessage[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + PASSTHROUGH_RIGHT_VARIABLE_COUNT] = {};// this module must read from here
-	float producerMessage[PASSTHROUGH_OFFSET + 1 + PASSTHROUGH_LEFT_VARIABLE_COUNT + PASSTHROUGH_RIGHT_VARIABLE_COUNT] = {};// mother will write into here
+	// Expander, read by the QAR on the left
+	frozenwasteland::ExpanderPublisher<frozenwasteland::QARProbabilityMessage> toMother;
 
 	
 	dsp::SchmittTrigger stepDivTrigger,trackProbabilityTrigger[TRACK_COUNT],probabiltyGroupModeTrigger[MAX_STEPS];
@@ -59,8 +57,7 @@ struct QARProbabilityExpander : Module {
 	QARProbabilityExpander() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		
-		leftExpander.producerMessage = producerMessage;
-		leftExpander.consumerMessage = consumerMessage;
+		toMother.attach(leftExpander);
 
 		
 		for(int i =0;i<TRACK_COUNT;i++) {
@@ -154,62 +151,17 @@ struct QARProbabilityExpander : Module {
 		}
 		
 
-		bool motherPresent = (leftExpander.module && (leftExpander.module->model == modelQuadAlgorithmicRhythm || leftExpander.module->model == modelQARProbabilityExpander || leftExpander.module->model == modelQARGrooveExpander));
-		//lights[CONNECTED_LIGHT].value = motherPresent;
-		if (motherPresent) {
-			// To Mother
-			float *producerMessage = (float*) leftExpander.producerMessage;
-
-			//Initalize
-			for (int i = 0; i < PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT; i++) {
-                producerMessage[i] = 0.0;
-			}
-
-			//If another expander is present, get its values (we can overwrite them)
-			bool anotherExpanderPresent = (rightExpander.module && (rightExpander.module->model == modelQARProbabilityExpander || rightExpander.module->model == modelQARGrooveExpander || rightExpander.module->model == modelQuadAlgorithmicRhythm));
-			if(anotherExpanderPresent)
-			{			
-				float *message = (float*) rightExpander.module->leftExpander.consumerMessage;	
-
-				if(rightExpander.module->model == modelQARProbabilityExpander || rightExpander.module->model == modelQARGrooveExpander ) { // Get QRE values							
-					for(int i = 0; i < PASSTHROUGH_OFFSET; i++) {
-                        producerMessage[i] = message[i];
-					}
-				}
-
-				//QAR Pass through left
-				for(int i = 0; i < PASSTHROUGH_LEFT_VARIABLE_COUNT; i++) {
-					producerMessage[PASSTHROUGH_OFFSET + i] = message[PASSTHROUGH_OFFSET + i];
-				}
-
-				//QAR Pass through right
-				float *messagesFromMother = (float*)leftExpander.consumerMessage;
-				float *messageToSlave = (float*)(rightExpander.module->leftExpander.producerMessage);	
-				for(int i = 0; i < PASSTHROUGH_RIGHT_VARIABLE_COUNT;i++) {
-					messageToSlave[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + i] = messagesFromMother[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + i];
-				}	
-			}
-		
-			for (int i = 0; i < TRACK_COUNT; i++) {
-                if(trackProbabilitySelected[i]) {
-                    producerMessage[i] = stepsOrDivs ? 2 : 1;
-    				for (int j = 0; j < MAX_STEPS; j++) {
-						producerMessage[TRACK_LEVEL_PARAM_COUNT + i * MAX_STEPS + j] = clamp(params[PROBABILITY_1_PARAM+j].getValue() + (inputs[PROBABILITY_1_INPUT + j].isConnected() ? inputs[PROBABILITY_1_INPUT + j].getVoltage() / 10 * params[PROBABILITY_ATTEN_1_PARAM + j].getValue() : 0.0f),0.0,1.0f);
-						producerMessage[TRACK_LEVEL_PARAM_COUNT + (MAX_STEPS * TRACK_COUNT) + i * MAX_STEPS + j] = probabilityGroupMode[j];
-						//producerMessage[TRACK_LEVEL_PARAM_COUNT + (MAX_STEPS * TRACK_COUNT * 2) + i * MAX_STEPS + j] = probabilityGroupNumber;
-					} 					 
-				} 
-			}			
-						
-			// From Mother	
-			
-			
-			leftExpander.messageFlipRequested = true;
-		
-		}		
-		
+		// To Mother, only what changed. The QAR finds this module itself, so nothing needs passing along the chain.
+		for (int i = 0; i < TRACK_COUNT; i++) {
+			toMother.set(toMother.message.trackSelected[i], trackProbabilitySelected[i]);
+		}
+		toMother.set(toMother.message.useDivs, stepsOrDivs);
+		for (int j = 0; j < MAX_STEPS; j++) {
+			toMother.set(toMother.message.probability[j], clamp(params[PROBABILITY_1_PARAM+j].getValue() + (inputs[PROBABILITY_1_INPUT + j].isConnected() ? inputs[PROBABILITY_1_INPUT + j].getVoltage() / 10 * params[PROBABILITY_ATTEN_1_PARAM + j].getValue() : 0.0f),0.0,1.0f));
+			toMother.set(toMother.message.groupMode[j], probabilityGroupMode[j]);
+		}
+		toMother.send();
 	}
-
     
 	
 	
@@ -225,10 +177,6 @@ struct QARProbabilityExpander : Module {
 			trackProbabilitySelected[i] = true;
 		}
 
-		for(int i = 0; i < PASSTHROUGH_LEFT_VARIABLE_COUNT + PASSTHROUGH_RIGHT_VARIABLE_COUNT; i++) {
-			producerMessage[MAX_STEPS * TRACK_COUNT * 2 + 1 + i] = 0;
-			consumerMessage[MAX_STEPS * TRACK_COUNT * 2 + 1 + i] = 0;
-		}
 	}
 };
 
@@ -289,4 +237,5 @@ struct QARProbabilityExpanderWidget : ModuleWidget {
 	}
 };
 
+static frozenwasteland::FootprintReport footprint("QARProbabilityExpander", sizeof(QARProbabilityExpander));
 Model *modelQARProbabilityExpander = createModel<QARProbabilityExpander, QARProbabilityExpanderWidget>("QARProbabilityExpander");
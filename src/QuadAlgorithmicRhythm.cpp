@@ -3,18 +3,18 @@
 #include <time.h>
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
+#include "ui/framebuffer.hpp"
+#include "ui/seed.hpp"
+#include "ui/expander.hpp"
+#include "ui/messages.hpp"
+#include "ui/footprint.hpp"
+#include "dsp-rhythm/rhythm.hpp"
+#include "dsp-clock/clock.hpp"
 #include "dsp-noise/noise.hpp"
 
 #define TRACK_COUNT 4
 #define MAX_STEPS 18
 #define NUM_ALGORITHMS 3
-#define EXPANDER_MAX_STEPS 18
-#define NUM_RULERS 10
-#define MAX_DIVISIONS 6
-#define PASSTHROUGH_LEFT_VARIABLE_COUNT 13
-#define PASSTHROUGH_RIGHT_VARIABLE_COUNT 8
-#define TRACK_LEVEL_PARAM_COUNT TRACK_COUNT * 6
-#define PASSTHROUGH_OFFSET MAX_STEPS * TRACK_COUNT * 3 + TRACK_LEVEL_PARAM_COUNT
 
 using namespace frozenwasteland::dsp;
 
@@ -141,13 +141,19 @@ struct QuadAlgorithmicRhythm : Module {
 		NOT_TRIGGERED_PGTS
 	};
 
-	// // Expander
-	// float consumerMessage[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + PASSTHROUGH_RIGHT_VARIABLE_COUNT] = {};// this module must read from here
-	// float producerMessage[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + PASSTHROUGH_RIGHT_VARIABLE_COUNT] = {};// mother will write into here
+	// Expanders. A chained QAR on the left reads toMaster, one on the right reads toSlave.
+	frozenwasteland::ExpanderPublisher<frozenwasteland::QARSlaveMessage> toMaster;
+	frozenwasteland::ExpanderPublisher<frozenwasteland::QARMasterMessage> toSlave;
+	const frozenwasteland::ExpanderPacket<frozenwasteland::QARProbabilityMessage> *probabilitySource[TRACK_COUNT];
+	const frozenwasteland::ExpanderPacket<frozenwasteland::QARGrooveMessage> *grooveSource[TRACK_COUNT];
+	Module *probabilityModule[TRACK_COUNT];
+	Module *grooveModule[TRACK_COUNT];
+	frozenwasteland::ExpanderWatch probabilityWatch[TRACK_COUNT];
+	frozenwasteland::ExpanderWatch grooveWatch[TRACK_COUNT];
+	bool expanderChanged[TRACK_COUNT];
 	
     int algorithnMatrix[TRACK_COUNT];
-	bool beatMatrix[TRACK_COUNT][MAX_STEPS];
-	bool accentMatrix[TRACK_COUNT][MAX_STEPS];
+	frozenwasteland::dsp::RhythmCore<TRACK_COUNT, MAX_STEPS> rhythm;
 
 	float probabilityMatrix[TRACK_COUNT][MAX_STEPS];
 	float swingMatrix[TRACK_COUNT][MAX_STEPS];
@@ -161,8 +167,17 @@ struct QuadAlgorithmicRhythm : Module {
 	int stepsCount[TRACK_COUNT];
 	int lastStepsCount[TRACK_COUNT];
 	double stepDuration[TRACK_COUNT];
-	double lastStepTime[TRACK_COUNT];	
     double lastSwingDuration[TRACK_COUNT];
+	double nextSwingDuration[TRACK_COUNT];
+	// Steps are scheduled on clockSample, which counts samples while the clock is connected.
+	// Each track only works out when its next step is due when something it depends on changes.
+	int64_t clockSample = 0;
+	int64_t lastStepSample[TRACK_COUNT];
+	int64_t nextStepSample[TRACK_COUNT];
+	bool scheduleChanged[TRACK_COUNT];
+	int scheduledStepsCount[TRACK_COUNT];
+	double scheduledDuration = 0.0;
+	double scheduledMasterStepCount = 0.0;
 
 	float swingRandomness[TRACK_COUNT];
 	bool useGaussianDistribution[TRACK_COUNT] = {false};
@@ -170,36 +185,18 @@ struct QuadAlgorithmicRhythm : Module {
 	bool trackSwingUsingDivs[TRACK_COUNT] = {false};
 	int subBeatLength[TRACK_COUNT];
 	int subBeatIndex[TRACK_COUNT];
+	uint64_t patternKey[TRACK_COUNT]; // Packed pattern inputs, changes when the pattern needs redrawing
+	// No packed key sets the top byte, so this never matches one
+	static const uint64_t NO_PATTERN_KEY = ~(uint64_t) 0;
 
+	frozenwasteland::DisplayVersion displayVersion;
 
 
-
-	// float expanderOutputValue[TRACK_COUNT];
-	// float expanderAccentValue[TRACK_COUNT];
-	// float expanderEocValue[TRACK_COUNT];
-	// float lastExpanderEocValue[TRACK_COUNT];
-	
-	// float expanderClockValue = 0;
-	// float expanderResetValue = 0;
-	// float expanderMuteValue = 0;
-
 	double maxStepCount;
 	double masterStepCount;
 
 	const char* trackNames[TRACK_COUNT] {"1","2","3","4"};
 
-    const int rulerOrders[NUM_RULERS] = {1,2,3,4,5,5,6,6,6,6};
-	const int rulerLengths[NUM_RULERS] = {0,1,3,6,11,11,17,17,17,17};
-	const int rulers[NUM_RULERS][MAX_DIVISIONS] = {{0},
-												   {0,1},
-												   {0,1,3},
-												   {0,1,4,6},
-												   {0,1,4,9,11},
-												   {0,2,7,8,11},
-												   {0,1,4,10,12,17},
-												   {0,1,4,10,15,17},
-												   {0,1,8,11,13,17},
-												   {0,1,8,12,14,17}};
 
 	bool running[TRACK_COUNT];
 	int chainMode = 0;
@@ -207,16 +204,14 @@ struct QuadAlgorithmicRhythm : Module {
 	bool muted = false;
 	bool constantTime = false;
 	int masterTrack = 0;
-	bool QARExpanderDisconnectReset = true;
 
-	double timeElapsed = 0.0;
-	double duration = 0.0;
-	bool firstClockReceived = false;
+	frozenwasteland::dsp::ClockTracker clock;
 
-	dsp::SchmittTrigger clockTrigger,resetTrigger,chainModeTrigger,constantTimeTrigger,muteTrigger,algorithmButtonTrigger[TRACK_COUNT],algorithmInputTrigger[TRACK_COUNT],startTrigger[TRACK_COUNT];
+	dsp::SchmittTrigger resetTrigger,chainModeTrigger,constantTimeTrigger,muteTrigger,algorithmButtonTrigger[TRACK_COUNT],algorithmInputTrigger[TRACK_COUNT],startTrigger[TRACK_COUNT];
 	dsp::PulseGenerator beatPulse[TRACK_COUNT],accentPulse[TRACK_COUNT],eocPulse[TRACK_COUNT];
 
 	GaussianNoiseGenerator _gauss;
+	frozenwasteland::SeededRandom random;
 
 
 
@@ -262,10 +257,10 @@ struct QuadAlgorithmicRhythm : Module {
 		configParam(RESET_PARAM, 0.0, 1.0, 0.0);
 		configParam(MUTE_PARAM, 0.0, 1.0, 0.0);
 
-		// leftExpander.producerMessage = producerMessage;
-		// leftExpander.consumerMessage = consumerMessage;
+		toMaster.attach(leftExpander);
+		toSlave.attach(rightExpander);
 		
-		srand(time(NULL));
+		clock.lateMode = frozenwasteland::dsp::CLOCK_STRETCH_FROM_FIRST_EDGE;
 		
 
 		for(int i = 0; i < TRACK_COUNT; i++) {
@@ -273,28 +268,25 @@ struct QuadAlgorithmicRhythm : Module {
 			beatIndex[i] = -1;
 			stepsCount[i] = MAX_STEPS;
 			lastStepsCount[i] = -1;
-			lastStepTime[i] = 0.0;
+			patternKey[i] = NO_PATTERN_KEY;
+			lastStepSample[i] = 0;
+			scheduleChanged[i] = true;
 			stepDuration[i] = 0.0;
             lastSwingDuration[i] = 0.0;
 			subBeatIndex[i] = -1;
 			swingRandomness[i] = 0.0f;
 			useGaussianDistribution[i] = false;	
 			probabilityGroupTriggered[i] = PENDING_PGTS;
-
-
-
-
-			// expanderOutputValue[i] = 0.0;
-			// expanderAccentValue[i] = 0.0;
-			// expanderEocValue[i] = 0.0;
-			// lastExpanderEocValue[i] = 0.0;
+			probabilityGroupFirstStep[i] = -1;
+			subBeatLength[i] = MAX_STEPS;
+			trackSwingUsingDivs[i] = false;
+			expanderChanged[i] = true;
 
 			running[i] = true;
 			for(int j = 0; j < MAX_STEPS; j++) {
 				probabilityMatrix[i][j] = 1.0;
 				swingMatrix[i][j] = 0.0;
-				beatMatrix[i][j] = false;
-				accentMatrix[i][j] = false;				
+				probabilityGroupModeMatrix[i][j] = NONE_PGTM;
 			}
 		}	
 
@@ -303,70 +295,22 @@ struct QuadAlgorithmicRhythm : Module {
 
 	void process(const ProcessArgs &args) override  {
 
-		int beatLocation[MAX_STEPS];
+		bool patternChanged[TRACK_COUNT] = {false};
 
-		// //Initialize
-		// for(int i = 0; i < TRACK_COUNT; i++) {
-		// 	expanderOutputValue[i] = 0; 
-		// 	expanderAccentValue[i] = 0; 
-		// 	lastExpanderEocValue[i] = 0;
-		// }
-		// //See if a slave is passing through an expander
-		// bool slavedQARPresent = false;
-		// bool rightExpanderPresent = (rightExpander.module 
-		// && (rightExpander.module->model == modelQuadAlgorithmicRhythm || rightExpander.module->model == modelQARProbabilityExpander || rightExpander.module->model == modelQARGrooveExpander));
-		// if(rightExpanderPresent)
-		// {			
-		// 	float *message = (float*) rightExpander.module->leftExpander.consumerMessage;
-		// 	slavedQARPresent = message[PASSTHROUGH_OFFSET];  // Slave QAR Exists flag
-
-		// 	if(slavedQARPresent) {			
-		// 		for(int i = 0; i < TRACK_COUNT; i++) {
-		// 			expanderOutputValue[i] = message[PASSTHROUGH_OFFSET + 1 + i * 3] ; 
-		// 			expanderAccentValue[i] = message[PASSTHROUGH_OFFSET + 1 + i * 3 + 1] ; 
-		// 			lastExpanderEocValue[i] = message[PASSTHROUGH_OFFSET + 1 + i * 3 + 2] ; 					
-		// 		}
-		// 	}
-		// }
-	
-		
-		// // Initialize
-		// for(int i = 0; i < TRACK_COUNT; i++) {				
-		// 	expanderEocValue[i] = 0; 
-		// }
-		// expanderClockValue = 0; 
-		// expanderResetValue = 0; 
-		// expanderMuteValue = 0; 
-
-		// //See if a master is passing through an expander
-		// bool masterQARPresent = false;
-		// bool leftExpanderPresent = (leftExpander.module && (leftExpander.module->model == modelQuadAlgorithmicRhythm
-		//  || leftExpander.module->model == modelQARProbabilityExpander || leftExpander.module->model == modelQARGrooveExpander));
-		// if(leftExpanderPresent)
-		// {			
-		// 	float *consumerMessage = (float*)leftExpander.consumerMessage;
-		// 	masterQARPresent = consumerMessage[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT]; 
-
-		// 	if(masterQARPresent) {
-			
-		// 		expanderClockValue = consumerMessage[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 1] ; 
-		// 		expanderResetValue = consumerMessage[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 2] ; 
-		// 		expanderMuteValue = consumerMessage[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 3] ; 
-
-		// 		for(int i = 0; i < TRACK_COUNT; i++) {				
-		// 			expanderEocValue[i] = consumerMessage[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 4 + i] ; 
-		// 		}
-		// 	}
-		// }
-
-		//if(slavedQARPresent)
-		//lights[IS_MASTER_LIGHT].value = slavedQARPresent;
+		//Expanders and chained QARs. Each is read straight from the module that publishes it.
+		const frozenwasteland::ExpanderPacket<frozenwasteland::QARSlaveMessage> *slave = scanRight();
+		const frozenwasteland::ExpanderPacket<frozenwasteland::QARMasterMessage> *master = scanLeft();
+		bool slavedQARPresent = slave != NULL;
+		bool masterQARPresent = master != NULL;
 
-		//if(masterQARPresent)
-		//lights[IS_SLAVE_LIGHT].value = masterQARPresent;
-
-
-		
+		for(int i = 0; i < TRACK_COUNT; i++) {
+			if(probabilityWatch[i].changed(probabilityModule[i], probabilitySource[i])) {
+				expanderChanged[i] = true;
+			}
+			if(grooveWatch[i].changed(grooveModule[i], grooveSource[i])) {
+				expanderChanged[i] = true;
+			}
+		}
 
 		//Set startup state	
 		if(!initialized) {
@@ -378,12 +322,13 @@ struct QuadAlgorithmicRhythm : Module {
 		if (constantTimeTrigger.process(params[CONSTANT_TIME_MODE_PARAM].getValue())) {
 			masterTrack = (masterTrack + 1) % 5;
 			constantTime = masterTrack > 0;
+			displayVersion.bump();
 			for(int trackNumber=0;trackNumber<TRACK_COUNT;trackNumber++) {
 				beatIndex[trackNumber] = -1;
-                lastStepTime[trackNumber] = 0;
+                lastStepSample[trackNumber] = clockSample;
+				scheduleChanged[trackNumber] = true;
                 lastSwingDuration[trackNumber] = 0; // Not sure about this
-				// expanderEocValue[trackNumber] = 0; 
-				// lastExpanderEocValue[trackNumber] = 0;		
+				expanderChanged[trackNumber] = true;
 			}
 			
 		}
@@ -433,12 +378,6 @@ struct QuadAlgorithmicRhythm : Module {
 			}		
             
             
-			//clear out the matrix and levels
-			for(int j=0;j<MAX_STEPS;j++)
-			{
-				beatLocation[j] = 0;
-			}
-
 			float stepsCountf = std::floor(params[(trackNumber * 7) + STEPS_1_PARAM].getValue());			
 			if(inputs[trackNumber * 8].isConnected()) {
 				stepsCountf += inputs[trackNumber * 8 + STEPS_1_INPUT].getVoltage() * 1.8;
@@ -507,290 +446,70 @@ struct QuadAlgorithmicRhythm : Module {
 			int accentDivision = int(accentDivisionf);
 			int accentRotation = int(accentRotationf);
 
+			// Patterns are only rebuilt when their quantized inputs change. Logic tracks also follow the two tracks they are based on
+			// Each input gets a byte of its own, so the key is the same only when every input is
+			uint64_t key = 0;
+			const int fields[] = {algorithnMatrix[trackNumber], stepsCount[trackNumber], division, offset, pad, accentDivision, accentRotation};
+			for(int field : fields) {
+				key = (key << 8) | (uint8_t) field;
+			}
+			patternChanged[trackNumber] = key != patternKey[trackNumber];
+			if(algorithnMatrix[trackNumber] == BOOLEAN_LOGIC_ALGO) {
+				patternChanged[trackNumber] = patternChanged[trackNumber] || patternChanged[trackNumber-1] || patternChanged[trackNumber-2];
+			}
+			if(patternChanged[trackNumber]) {
+				patternKey[trackNumber] = key;
+				displayVersion.bump();
+			}
 
-			if(stepsCount[trackNumber] > 0) {
-				
-                int bucket = stepsCount[trackNumber] - pad - 1;                    
-                if(algorithnMatrix[trackNumber] == EUCLIDEAN_ALGO ) { //Euclidean Algorithn
-                    int euclideanBeatIndex = 0;
-					//Set padded steps to false
-					for(int euclideanStepIndex = 0; euclideanStepIndex < pad; euclideanStepIndex++) {
-						beatMatrix[trackNumber][((euclideanStepIndex + offset) % (stepsCount[trackNumber]))] = false;	
-					}
-                    for(int euclideanStepIndex = 0; euclideanStepIndex < stepsCount[trackNumber]-pad; euclideanStepIndex++)
-                    {
-                        bucket += division;
-                        if(bucket >= stepsCount[trackNumber]-pad) {
-                            bucket -= (stepsCount[trackNumber] - pad);
-                            beatMatrix[trackNumber][((euclideanStepIndex + offset + pad) % (stepsCount[trackNumber]))] = true;	
-                            beatLocation[euclideanBeatIndex] = (euclideanStepIndex + offset + pad) % stepsCount[trackNumber];	
-                            euclideanBeatIndex++;	
-                        } else
-                        {
-                            beatMatrix[trackNumber][((euclideanStepIndex + offset + pad) % (stepsCount[trackNumber]))] = false;	
-                        }
-                        
-                    }
-                } else if(algorithnMatrix[trackNumber] == GOLUMB_RULER_ALGO) { //Golomb Ruler Algorithm
-				
-                    int rulerToUse = clamp(division - 1,0,MAX_DIVISIONS);
-                    int actualStepCount = stepsCount[trackNumber] - pad;
-                    while(rulerLengths[rulerToUse] + 1 > actualStepCount && rulerToUse >= 	0) {
-                        rulerToUse -=1;
-                    } 
-                    
-                    //Multiply beats so that low division beats fill out entire pattern
-                    int spaceMultiplier = (actualStepCount / (rulerLengths[rulerToUse] + 1)) + 1;
-                    if(actualStepCount % (rulerLengths[rulerToUse] + 1) == 0) {
-                        spaceMultiplier -=1;
-                    }	
-
-                    //Set all beats to false
-                    for(int j=0;j<actualStepCount;j++)
-                    {
-                        beatMatrix[trackNumber][j] = false; 			
-                    }
-
-                    for (int rulerIndex = 0; rulerIndex < rulerOrders[rulerToUse];rulerIndex++)
-                    {
-                        int divisionLocation = rulers[rulerToUse][rulerIndex] * spaceMultiplier;
-                        divisionLocation +=pad;
-                        if(rulerIndex > 0) {
-                            divisionLocation -=1;
-                        }
-                        beatMatrix[trackNumber][(divisionLocation + offset) % stepsCount[trackNumber]] = true;
-                        beatLocation[rulerIndex] = (divisionLocation + offset) % stepsCount[trackNumber];	            
-                    }
-                } else { //Boolean Logic only for tracs 3 and 4
-					int logicBeatCount = 0;
-					int logicMode = (division-1) % 6; 
-
-					for (int logicBeatIndex = 0; logicBeatIndex < stepsCount[trackNumber];logicBeatIndex++) {
-						bool isBeat = false;
-						switch (logicMode) {
-							case 0 :
-								isBeat = beatMatrix[trackNumber-1][logicBeatIndex] && beatMatrix[trackNumber-2][logicBeatIndex];  //AND
-								break;
-							case 1 :
-								isBeat = beatMatrix[trackNumber-1][logicBeatIndex] || beatMatrix[trackNumber-2][logicBeatIndex];  //OR
-								break;
-							case 2 :
-								isBeat = beatMatrix[trackNumber-1][logicBeatIndex] != beatMatrix[trackNumber-2][logicBeatIndex]; //XOR
-								break;
-							case 3 :
-								isBeat = !(beatMatrix[trackNumber-1][logicBeatIndex] && beatMatrix[trackNumber-2][logicBeatIndex]);  //NAND
-								break;
-							case 4 :
-								isBeat = !(beatMatrix[trackNumber-1][logicBeatIndex] || beatMatrix[trackNumber-2][logicBeatIndex]); //NOR
-								break;
-							case 5 :
-								isBeat = beatMatrix[trackNumber-1][logicBeatIndex] == beatMatrix[trackNumber-2][logicBeatIndex]; //IMP
-								break;
-						}
-						beatMatrix[trackNumber][(logicBeatIndex + offset) % stepsCount[trackNumber]] = isBeat;
-						if(isBeat) {
-                        	beatLocation[(logicBeatIndex + offset) % stepsCount[trackNumber]] = logicBeatIndex;	
-							logicBeatCount ++;
-						}
-					}
-
-				}
-
-				bucket = division - 1;
-				for(int accentIndex = 0; accentIndex < division; accentIndex++)
-				{
-					bucket += accentDivision;
-					if(bucket >= division) {
-						bucket -= division;
-						accentMatrix[trackNumber][beatLocation[(accentIndex + accentRotation) % division]] = true;				
-					} else
-					{
-						accentMatrix[trackNumber][beatLocation[(accentIndex + accentRotation) % division]] = false;
-					}
-					
-				}	        	
-			}	
+			if(patternChanged[trackNumber]) {
+				rhythm.generate(trackNumber, algorithnMatrix[trackNumber], stepsCount[trackNumber], division, offset, pad, accentDivision, accentRotation);
+				expanderChanged[trackNumber] = true;
+			}
 		}
 
 		float resetInput = inputs[RESET_INPUT].getVoltage();
-		// if(!inputs[RESET_INPUT].isConnected() && masterQARPresent) {
-		// 	resetInput = expanderResetValue;
-		// }
+		if(!inputs[RESET_INPUT].isConnected() && masterQARPresent) {
+			resetInput = master->payload.reset;
+		}
 		resetInput += params[RESET_PARAM].getValue(); //RESET BUTTON ALWAYS WORKS		
 		if(resetTrigger.process(resetInput)) {
 			for(int trackNumber=0;trackNumber<4;trackNumber++)
 			{
 				beatIndex[trackNumber] = -1;
-				lastStepTime[trackNumber] = 0;
+				lastStepSample[trackNumber] = clockSample;
+				scheduleChanged[trackNumber] = true;
 				lastSwingDuration[trackNumber] = 0; // Not sure about this
-				// expanderEocValue[trackNumber] = 0; 
-				// lastExpanderEocValue[trackNumber] = 0;		
 				subBeatIndex[trackNumber] = -1;
 				swingRandomness[trackNumber] = 0.0f;
 				useGaussianDistribution[trackNumber] = false;	
+				expanderChanged[trackNumber] = true;
 			}
-			timeElapsed = 0;
-			firstClockReceived = false;
+			clock.reset();
 			setRunningState();
+			displayVersion.bump();
 		}
 		
 
 		
 
-		//Get Expander Info
-		// if(rightExpander.module && (rightExpander.module->model == modelQARProbabilityExpander || rightExpander.module->model == modelQARGrooveExpander))
-		// {			
-		// 	QARExpanderDisconnectReset = true;
-		// 	float *message = (float*) rightExpander.module->leftExpander.consumerMessage;
-
-		// 	//Process Probability Expander Stuff						
-		// 	for(int i = 0; i < TRACK_COUNT; i++) {
-		// 		probabilityGroupFirstStep[i] = -1;
-		// 		for(int j = 0; j < MAX_STEPS; j++) { //reset all probabilities, find first group step
-		// 			workingProbabilityMatrix[i][j] = 1;					
-		// 		}
-
-		// 		if(message[i] > 0) { // 0 is track not selected
-		// 			bool useDivs = message[i] == 2; //2 is divs
-		// 			for(int j = 0; j < MAX_STEPS; j++) { // Assign probabilites and swing
-		// 				int stepIndex = j;
-		// 				bool stepFound = true;
-		// 				if(useDivs) { //Use j as a count to the div # we are looking for
-		// 					int divIndex = -1;
-		// 					stepFound = false;
-		// 					for(int k = 0; k< MAX_STEPS; k++) {
-		// 						if (beatMatrix[i][k]) {
-		// 							divIndex ++;
-		// 							if(divIndex == j) {
-		// 								stepIndex = k;
-		// 								stepFound = true;	
-		// 								break;								
-		// 							}
-		// 						}
-		// 					}
-		// 				}
-						
-		// 				if(stepFound) {
-		// 					float probability = message[TRACK_LEVEL_PARAM_COUNT + (i * EXPANDER_MAX_STEPS) + j];
-		// 					float probabilityMode = message[TRACK_LEVEL_PARAM_COUNT + (EXPANDER_MAX_STEPS * TRACK_COUNT) + (i * EXPANDER_MAX_STEPS) + j];
-							
-		// 					workingProbabilityMatrix[i][stepIndex] = probability;
-		// 					probabilityGroupModeMatrix[i][stepIndex] = probabilityMode;
-		// 					for(int j = 0; j < MAX_STEPS; j++) { //reset all probabilities, find first group step
-		// 						if(probabilityGroupFirstStep[i] < 0 && probabilityGroupModeMatrix[i][j] != NONE_PGTM ) {
-		// 							probabilityGroupFirstStep[i] = j;
-		// 							break;
-		// 						}
-		// 					}
-		// 				} 
-		// 			}
-		// 		}
-		// 	}
-
-		// 	//Process Groove Expander Stuff									
-		// 	for(int i = 0; i < TRACK_COUNT; i++) {
-		// 		for(int j = 0; j < MAX_STEPS; j++) { //reset all probabilities
-		// 			workingSwingMatrix[i][j] = 0.0;
-		// 		}
-
-		// 		if(message[TRACK_COUNT + i] > 0) { // 0 is track not selected
-		// 			bool useDivs = message[TRACK_COUNT + i] == 2; //2 is divs
-		// 			trackSwingUsingDivs[i] = useDivs;
-
-		// 			int grooveLength = (int)(message[TRACK_COUNT * 2 + i]);
-		// 			bool useTrackLength = message[TRACK_COUNT * 3 + i];
-
-		// 			swingRandomness[i] = message[TRACK_COUNT * 4 + i];
-		// 			useGaussianDistribution[i] = message[TRACK_COUNT * 5 + i];
-
-		// 			if(useTrackLength) {
-		// 				grooveLength = stepsCount[i];
-		// 			}
-		// 			subBeatLength[i] = grooveLength;
-		// 			if(subBeatIndex[i] >= grooveLength) { //Reset if necessary
-		// 				subBeatIndex[i] = 0;
-		// 			}
-					
-
-		// 			int workingBeatIndex;
-		// 			if(!useDivs) {
-		// 				workingBeatIndex = (subBeatIndex[i] - beatIndex[i]) % grooveLength; 
-		// 				if(workingBeatIndex <0) {
-		// 					workingBeatIndex +=grooveLength;
-		// 				}
-		// 			} else {
-		// 				int divCount = -1;
-		// 				for(int k = 0; k<= beatIndex[i]; k++) {
-		// 					if (beatMatrix[i][k]) {
-		// 						divCount++;
-		// 					}
-		// 				}
-
-		// 				workingBeatIndex = (subBeatIndex[i] - divCount) % grooveLength; 
-		// 				if(workingBeatIndex <0) {
-		// 					workingBeatIndex +=grooveLength;
-		// 				}
-		// 			}
-
-		// 			for(int j = 0; j < MAX_STEPS; j++) { // Assign probabilites and swing
-		// 				int stepIndex = j;
-		// 				bool stepFound = true;
-		// 				if(useDivs) { //Use j as a count to the div # we are looking for
-		// 					int divIndex = -1;
-		// 					stepFound = false;
-		// 					for(int k = 0; k< MAX_STEPS; k++) {
-		// 						if (beatMatrix[i][k]) {
-		// 							divIndex ++;
-		// 							if(divIndex == j) {
-		// 								stepIndex = k;
-		// 								stepFound = true;	
-		// 								break;								
-		// 							}
-		// 						}
-		// 					}
-		// 				}
-						
-		// 				if(stepFound) {
-		// 					float swing = message[TRACK_LEVEL_PARAM_COUNT + (EXPANDER_MAX_STEPS * TRACK_COUNT * 2) + (i * EXPANDER_MAX_STEPS) + workingBeatIndex];
-		// 					workingSwingMatrix[i][stepIndex] = swing;						
-		// 				} 
-		// 				workingBeatIndex +=1;
-		// 				if(workingBeatIndex >= grooveLength) {
-		// 					workingBeatIndex = 0;
-		// 				}
-		// 			}
-		// 		}
-		// 	}
-			
-			
-		// } else {
-			if(QARExpanderDisconnectReset) { //If QRE gets disconnected, reset probability and swing
-				for(int i = 0; i < TRACK_COUNT; i++) {
-					subBeatIndex[i] = 0;
-					for(int j = 0; j < MAX_STEPS; j++) { //reset all probabilities
-						workingProbabilityMatrix[i][j] = 1;
-						workingSwingMatrix[i][j] = 0;
-					}
-				}
-				QARExpanderDisconnectReset = false;
-			}
-		// }
-
-
-		//set calculated probability and swing
+		//Expander probability and swing only need working out again when an expander, the pattern or the groove position changes
+		bool anyExpanderChanged = false;
 		for(int i = 0; i < TRACK_COUNT; i++) {
-			for(int j = 0; j < MAX_STEPS; j++) { 
-				probabilityMatrix[i][j] = workingProbabilityMatrix[i][j];
-				swingMatrix[i][j] =workingSwingMatrix[i][j];
+			if(expanderChanged[i]) {
+				applyExpanders(i);
+				expanderChanged[i] = false;
+				anyExpanderChanged = true;
 			}
 		}
+		if(anyExpanderChanged) {
+			setProbabilityAndSwing();
+		}
 
-
-		
 		float muteInput = inputs[MUTE_INPUT].getVoltage();
-		// if(!inputs[MUTE_INPUT].isConnected() && masterQARPresent) {
-		// 	muteInput = expanderMuteValue;
-		// }
+		if(!inputs[MUTE_INPUT].isConnected() && masterQARPresent) {
+			muteInput = master->payload.mute;
+		}
 		muteInput += params[MUTE_PARAM].getValue(); //MUTE BUTTON ALWAYS WORKS		
 		if(muteTrigger.process(muteInput)) {
 			muted = !muted;
@@ -803,65 +522,57 @@ struct QuadAlgorithmicRhythm : Module {
 			float startInput = 0;
 			if(inputs[START_1_INPUT + (trackNumber * 8)].isConnected()) {
 				startInput = inputs[START_1_INPUT + (trackNumber * 8)].getVoltage();
-			} //else if(masterQARPresent) {
-			// 	startInput = expanderEocValue[trackNumber];
-			// } else if(rightExpanderPresent) {
-			// 	startInput = lastExpanderEocValue[trackNumber];
-			// }
+			} else if(masterQARPresent) {
+				startInput = master->payload.eoc[trackNumber];
+			} else if(slavedQARPresent) {
+				startInput = slave->payload.eoc[trackNumber];
+			}
 			
-			if(chainMode != CHAIN_MODE_NONE && (inputs[(trackNumber * 8) + START_1_INPUT].isConnected()/* || masterQARPresent || slavedQARPresent*/) && !running[trackNumber]) {
+			if(chainMode != CHAIN_MODE_NONE && (inputs[(trackNumber * 8) + START_1_INPUT].isConnected() || masterQARPresent || slavedQARPresent) && !running[trackNumber]) {
 				if(startTrigger[trackNumber].process(startInput)) {
 					running[trackNumber] = true;
 					beatIndex[trackNumber] = -1;
-					lastStepTime[trackNumber] = 200000; //Trying some arbitrary large value
+					lastStepSample[trackNumber] = clockSample - (int64_t)(200000 * args.sampleRate); //Trying some arbitrary large value
+					scheduleChanged[trackNumber] = true;
+					displayVersion.bump();
 				}
 			}
 		}
 
-		//Calculate clock duration
-		double timeAdvance =1.0 / args.sampleRate;
-		timeElapsed += timeAdvance;
-
 		float clockInput = inputs[CLOCK_INPUT].getVoltage();
-		// if(!inputs[CLOCK_INPUT].isConnected() && masterQARPresent) {
-		// 	clockInput = expanderClockValue;
-		// }
+		if(!inputs[CLOCK_INPUT].isConnected() && masterQARPresent) {
+			clockInput = master->payload.clock;
+		}
 
 	
 
-		if(inputs[CLOCK_INPUT].isConnected()/* || masterQARPresent*/) {
-			if(clockTrigger.process(clockInput)) {
-				if(firstClockReceived) {
-					duration = timeElapsed;
-				}
-				timeElapsed = 0;
-				firstClockReceived = true;							
-			} else if(firstClockReceived && timeElapsed > duration) {  //allow absense of second clock to affect duration
-				duration = timeElapsed;
-			}			
+		if(inputs[CLOCK_INPUT].isConnected() || masterQARPresent) {
+			clockSample++;
+			//Calculate clock duration
+			clock.process(clockInput, args.sampleTime);
 			
+			bool durationChanged = clock.period != scheduledDuration;
+			scheduledDuration = clock.period;
+			bool masterStepCountChanged = constantTime && masterStepCount != scheduledMasterStepCount;
+			scheduledMasterStepCount = masterStepCount;
+
 			for(int trackNumber=0;trackNumber < TRACK_COUNT;trackNumber++) {
-				if(stepsCount[trackNumber] > 0 && constantTime && beatIndex[trackNumber] >= 0 ) {
-					double stepsChangeAdjustemnt = (double)(lastStepsCount[trackNumber] / (double)stepsCount[trackNumber]); 
-					stepDuration[trackNumber] = duration * masterStepCount / (double)stepsCount[trackNumber] * stepsChangeAdjustemnt; //Constant Time scales duration based on a master track
+				if(!running[trackNumber]) {
+					//Stopped tracks hold their place
+					lastStepSample[trackNumber]++;
+					scheduleChanged[trackNumber] = true;
+					continue;
 				}
-				else
-					stepDuration[trackNumber] = duration; //Otherwise Clock based
-				
-
-                //swing is affected by next beat
-                int nextBeat = beatIndex[trackNumber] + 1;
-                if(nextBeat >= stepsCount[trackNumber])
-                    nextBeat = 0;
-                double swingDuration = (calculatedSwingRandomness[trackNumber] + swingMatrix[trackNumber][nextBeat]) * stepDuration[trackNumber];
-            
-				if(running[trackNumber]) {
-					lastStepTime[trackNumber] +=timeAdvance;
-					if(stepDuration[trackNumber] > 0.0 && lastStepTime[trackNumber] >= stepDuration[trackNumber] + swingDuration - lastSwingDuration[trackNumber]) {
-						lastSwingDuration[trackNumber] = swingDuration;
-						lastStepsCount[trackNumber] = stepsCount[trackNumber];
-						advanceBeat(trackNumber);					
-					}					
+
+				if(scheduleChanged[trackNumber] || durationChanged || masterStepCountChanged || stepsCount[trackNumber] != scheduledStepsCount[trackNumber]) {
+					scheduleStep(trackNumber, args.sampleRate);
+				}
+
+				if(clockSample >= nextStepSample[trackNumber]) {
+					lastSwingDuration[trackNumber] = nextSwingDuration[trackNumber];
+					lastStepsCount[trackNumber] = stepsCount[trackNumber];
+					advanceBeat(trackNumber);
+					scheduleStep(trackNumber, args.sampleRate);
 				}	
 			}			
 		}
@@ -870,14 +581,14 @@ struct QuadAlgorithmicRhythm : Module {
 		for(int trackNumber=0;trackNumber<TRACK_COUNT;trackNumber++) {
             //Send Out Beat
 			float beatOutputValue = beatPulse[trackNumber].process(1.0 / args.sampleRate) ? 10.0 : 0;
-			// if(slavedQARPresent)
-			// 	beatOutputValue =  clamp(beatOutputValue + expanderOutputValue[trackNumber],0.0f,10.0f);
+			if(slavedQARPresent)
+				beatOutputValue =  clamp(beatOutputValue + slave->payload.beat[trackNumber],0.0f,10.0f);
             outputs[(trackNumber * 3) + OUTPUT_1].setVoltage(beatOutputValue);	
 
             //Send out Accent
 			float accentOutputValue = accentPulse[trackNumber].process(1.0 / args.sampleRate) ? 10.0 : 0;
-			// if(slavedQARPresent)
-			// 	accentOutputValue = clamp(accentOutputValue + expanderAccentValue[trackNumber] ,0.0f,10.0f);
+			if(slavedQARPresent)
+				accentOutputValue = clamp(accentOutputValue + slave->payload.accent[trackNumber] ,0.0f,10.0f);
             outputs[(trackNumber * 3) + ACCENT_OUTPUT_1].setVoltage(accentOutputValue);	
 
 			//Send out End of Cycle
@@ -885,31 +596,18 @@ struct QuadAlgorithmicRhythm : Module {
 			outputs[(trackNumber * 3) + EOC_OUTPUT_1].setVoltage(eocOutputValue);				
 			
 			
-			// if(leftExpanderPresent) {
-			// 	producerMessage[PASSTHROUGH_OFFSET + 1 + trackNumber * 3] = beatOutputValue; 
-			// 	producerMessage[PASSTHROUGH_OFFSET + 1 + trackNumber * 3 + 1] = accentOutputValue;
-			// 	producerMessage[PASSTHROUGH_OFFSET + 1 + trackNumber * 3 + 2] = rightExpanderPresent ? lastExpanderEocValue[trackNumber] : eocOutputValue; // If last QAR send Eoc Back, otherwise pass through
-			// } 
-			// if(rightExpanderPresent) {
-			// 	float *messageToSlave = (float*)(rightExpander.module->leftExpander.producerMessage);	
-			// 	messageToSlave[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 4 + trackNumber] = eocOutputValue; 				
-			// }
-
+			//Only sent when they change, so an idle chain costs nothing
+			toMaster.set(toMaster.message.beat[trackNumber], beatOutputValue);
+			toMaster.set(toMaster.message.accent[trackNumber], accentOutputValue);
+			toMaster.set(toMaster.message.eoc[trackNumber], slavedQARPresent ? slave->payload.eoc[trackNumber] : eocOutputValue); // If last QAR send Eoc Back, otherwise pass through
+			toSlave.set(toSlave.message.eoc[trackNumber], eocOutputValue);
 		}
 
-		// //Send outputs to slaves if present		
-		// if(rightExpanderPresent) {
-		// 	float *messageToSlave = (float*)(rightExpander.module->leftExpander.producerMessage);
-		// 	messageToSlave[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT] = true; // tell slave Master is present
-		// 	messageToSlave[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 1] = clockInput; 
-		// 	messageToSlave[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 2] = resetInput; 
-		// 	messageToSlave[PASSTHROUGH_OFFSET + PASSTHROUGH_LEFT_VARIABLE_COUNT + 3] = muteInput; 				
-		// }
-		
-		// if(leftExpanderPresent) {
-		// 	producerMessage[PASSTHROUGH_OFFSET] = true; //Tell Master that slave is present
-		// 	leftExpander.messageFlipRequested = true;	
-		// } 			
+		toSlave.set(toSlave.message.clock, clockInput);
+		toSlave.set(toSlave.message.reset, resetInput);
+		toSlave.set(toSlave.message.mute, muteInput);
+		toMaster.send();
+		toSlave.send();
 	}
 
 
@@ -928,6 +626,7 @@ struct QuadAlgorithmicRhythm : Module {
 		json_object_set_new(rootJ, "chainMode", json_integer((int) chainMode));
 		json_object_set_new(rootJ, "muted", json_integer((bool) muted));
 
+		random.toJson(rootJ);
 		return rootJ;
 	}
 
@@ -957,6 +656,144 @@ struct QuadAlgorithmicRhythm : Module {
 		json_t *mutedJ = json_object_get(rootJ, "muted");
 		if (mutedJ)
 			muted = json_integer_value(mutedJ);
+
+		random.fromJson(rootJ);
+		restartRandom();
+
+		displayVersion.bump();
+	}
+
+	//set calculated probability and swing, only needed when the working values change
+	void setProbabilityAndSwing() {
+		for(int i = 0; i < TRACK_COUNT; i++) {
+			for(int j = 0; j < MAX_STEPS; j++) { 
+				probabilityMatrix[i][j] = workingProbabilityMatrix[i][j];
+				swingMatrix[i][j] =workingSwingMatrix[i][j];
+			}
+			scheduleChanged[i] = true;
+		}
+		displayVersion.bump();
+	}
+
+	//Walks right through any QAR expanders, the closest one with a track selected setting that track.
+	//Returns the message of a chained QAR beyond them, if there is one.
+	const frozenwasteland::ExpanderPacket<frozenwasteland::QARSlaveMessage> *scanRight() {
+		for(int i = 0; i < TRACK_COUNT; i++) {
+			probabilitySource[i] = NULL;
+			probabilityModule[i] = NULL;
+			grooveSource[i] = NULL;
+			grooveModule[i] = NULL;
+		}
+		for(Module *module = rightExpander.module; module; module = module->rightExpander.module) {
+			const frozenwasteland::ExpanderPacket<frozenwasteland::QARProbabilityMessage> *probability = frozenwasteland::readExpander<frozenwasteland::QARProbabilityMessage>(module, true);
+			const frozenwasteland::ExpanderPacket<frozenwasteland::QARGrooveMessage> *groove = frozenwasteland::readExpander<frozenwasteland::QARGrooveMessage>(module, true);
+			if(probability) {
+				for(int i = 0; i < TRACK_COUNT; i++) {
+					if(!probabilitySource[i] && probability->payload.trackSelected[i]) {
+						probabilitySource[i] = probability;
+						probabilityModule[i] = module;
+					}
+				}
+			} else if(groove) {
+				for(int i = 0; i < TRACK_COUNT; i++) {
+					if(!grooveSource[i] && groove->payload.trackSelected[i]) {
+						grooveSource[i] = groove;
+						grooveModule[i] = module;
+					}
+				}
+			} else {
+				return frozenwasteland::readExpander<frozenwasteland::QARSlaveMessage>(module, true);
+			}
+		}
+		return NULL;
+	}
+
+	//The message of a QAR chained on the left, past the expanders that belong to it
+	const frozenwasteland::ExpanderPacket<frozenwasteland::QARMasterMessage> *scanLeft() {
+		for(Module *module = leftExpander.module; module; module = module->leftExpander.module) {
+			if(!frozenwasteland::readExpander<frozenwasteland::QARProbabilityMessage>(module, true) && !frozenwasteland::readExpander<frozenwasteland::QARGrooveMessage>(module, true)) {
+				return frozenwasteland::readExpander<frozenwasteland::QARMasterMessage>(module, false);
+			}
+		}
+		return NULL;
+	}
+
+	//Works out a track's probability and swing from its expanders. Without one it plays every step straight.
+	void applyExpanders(int trackNumber) {
+		//Expander step j is either step j, or the track's j'th beat when the expander counts divisions
+		int beatLocation[MAX_STEPS];
+		int beats = patternLocations(rhythm.beats[trackNumber], 0, MAX_STEPS, beatLocation);
+
+		probabilityGroupFirstStep[trackNumber] = -1;
+		for(int j = 0; j < MAX_STEPS; j++) {
+			workingProbabilityMatrix[trackNumber][j] = 1;
+			workingSwingMatrix[trackNumber][j] = 0;
+			probabilityGroupModeMatrix[trackNumber][j] = NONE_PGTM;
+		}
+
+		if(probabilitySource[trackNumber]) {
+			const frozenwasteland::QARProbabilityMessage &message = probabilitySource[trackNumber]->payload;
+			int count = message.useDivs ? beats : MAX_STEPS;
+			for(int j = 0; j < count; j++) {
+				int stepIndex = message.useDivs ? beatLocation[j] : j;
+				workingProbabilityMatrix[trackNumber][stepIndex] = message.probability[j];
+				probabilityGroupModeMatrix[trackNumber][stepIndex] = message.groupMode[j];
+			}
+			for(int j = 0; j < MAX_STEPS; j++) {
+				if(probabilityGroupModeMatrix[trackNumber][j] != NONE_PGTM) {
+					probabilityGroupFirstStep[trackNumber] = j;
+					break;
+				}
+			}
+		}
+
+		if(!grooveSource[trackNumber]) {
+			subBeatIndex[trackNumber] = 0;
+			trackSwingUsingDivs[trackNumber] = false;
+			swingRandomness[trackNumber] = 0.0f;
+			useGaussianDistribution[trackNumber] = false;
+			return;
+		}
+
+		const frozenwasteland::QARGrooveMessage &message = grooveSource[trackNumber]->payload;
+		trackSwingUsingDivs[trackNumber] = message.useDivs;
+		swingRandomness[trackNumber] = message.randomAmount;
+		useGaussianDistribution[trackNumber] = message.gaussian;
+
+		int grooveLength = message.grooveIsTrackLength ? stepsCount[trackNumber] : message.grooveLength;
+		grooveLength = clamp(grooveLength, 1, MAX_STEPS);
+		subBeatLength[trackNumber] = grooveLength;
+		if(subBeatIndex[trackNumber] >= grooveLength) { //Reset if necessary
+			subBeatIndex[trackNumber] = 0;
+		}
+
+		//Line the groove up so the current step gets the groove step it is on
+		int position = beatIndex[trackNumber];
+		if(message.useDivs) {
+			position = beatIndex[trackNumber] >= 0 ? __builtin_popcountll(rhythm.beats[trackNumber] & fullMask(beatIndex[trackNumber] + 1)) - 1 : -1;
+		}
+		int workingBeatIndex = (subBeatIndex[trackNumber] - position) % grooveLength;
+		if(workingBeatIndex < 0) {
+			workingBeatIndex += grooveLength;
+		}
+
+		int count = message.useDivs ? beats : MAX_STEPS;
+		for(int j = 0; j < count; j++) {
+			int stepIndex = message.useDivs ? beatLocation[j] : j;
+			workingSwingMatrix[trackNumber][stepIndex] = message.swing[workingBeatIndex];
+			workingBeatIndex++;
+			if(workingBeatIndex >= grooveLength) {
+				workingBeatIndex = 0;
+			}
+		}
+	}
+
+	//A fixed seed also pins the swing randomness
+	void restartRandom() {
+		random.restart();
+		if(random.fixedSeed) {
+			_gauss.seed(random.generator.next());
+		}
 	}
 
 	void setRunningState() {
@@ -969,12 +806,41 @@ struct QuadAlgorithmicRhythm : Module {
 				running[trackNumber] = true;
 			}
 		}
+		displayVersion.bump();
+	}
+
+	//Works out which clock sample the track's next step is due on, counting from its last step
+	void scheduleStep(int trackNumber, double sampleRate) {
+		if(stepsCount[trackNumber] > 0 && constantTime && beatIndex[trackNumber] >= 0 ) {
+			double stepsChangeAdjustemnt = (double)(lastStepsCount[trackNumber] / (double)stepsCount[trackNumber]); 
+			stepDuration[trackNumber] = clock.period * masterStepCount / (double)stepsCount[trackNumber] * stepsChangeAdjustemnt; //Constant Time scales duration based on a master track
+		}
+		else
+			stepDuration[trackNumber] = clock.period; //Otherwise Clock based
+
+		//swing is affected by next beat
+		int nextBeat = beatIndex[trackNumber] + 1;
+		if(nextBeat >= stepsCount[trackNumber])
+			nextBeat = 0;
+		nextSwingDuration[trackNumber] = (calculatedSwingRandomness[trackNumber] + swingMatrix[trackNumber][nextBeat]) * stepDuration[trackNumber];
+
+		if(stepDuration[trackNumber] > 0.0) {
+			//Small tolerance so durations measured in whole samples don't round up to the next sample
+			double stepSamples = (stepDuration[trackNumber] + nextSwingDuration[trackNumber] - lastSwingDuration[trackNumber]) * sampleRate;
+			nextStepSample[trackNumber] = lastStepSample[trackNumber] + std::max((int64_t)std::ceil(stepSamples - 1e-6), (int64_t)1);
+		} else {
+			nextStepSample[trackNumber] = INT64_MAX;
+		}
+		scheduledStepsCount[trackNumber] = stepsCount[trackNumber];
+		scheduleChanged[trackNumber] = false;
 	}
 
 	void advanceBeat(int trackNumber) {
        
 		beatIndex[trackNumber]++;
-		lastStepTime[trackNumber] = 0.0;
+		lastStepSample[trackNumber] = clockSample;
+		scheduleChanged[trackNumber] = true;
+		displayVersion.bump();
     
 		//End of Cycle
 		if(beatIndex[trackNumber] >= stepsCount[trackNumber]) {
@@ -991,15 +857,19 @@ struct QuadAlgorithmicRhythm : Module {
 			if(subBeatIndex[trackNumber] >= subBeatLength[trackNumber]) { 
 				subBeatIndex[trackNumber] = 0;
 			}
-		} else if(trackSwingUsingDivs[trackNumber] && beatMatrix[trackNumber][beatIndex[trackNumber]] == true) {
+		} else if(trackSwingUsingDivs[trackNumber] && rhythm.beat(trackNumber, beatIndex[trackNumber])) {
 			subBeatIndex[trackNumber]++;
 			if(subBeatIndex[trackNumber] >= subBeatLength[trackNumber]) { 
 				subBeatIndex[trackNumber] = 0;
 			}
 		}
+		//The groove is lined up with the current step
+		if(grooveSource[trackNumber]) {
+			expanderChanged[trackNumber] = true;
+		}
 
 
-        bool probabilityResult = (float) rand()/RAND_MAX < probabilityMatrix[trackNumber][beatIndex[trackNumber]];	
+        bool probabilityResult = random.uniform() < probabilityMatrix[trackNumber][beatIndex[trackNumber]];	
 		if(probabilityGroupModeMatrix[trackNumber][beatIndex[trackNumber]] != NONE_PGTM) {
 			if(probabilityGroupFirstStep[trackNumber] == beatIndex[trackNumber]) {
 				probabilityGroupTriggered[trackNumber] = probabilityResult ? TRIGGERED_PGTS : NOT_TRIGGERED_PGTS;
@@ -1009,12 +879,12 @@ struct QuadAlgorithmicRhythm : Module {
 		}
 
         //Create Beat Trigger    
-        if(beatMatrix[trackNumber][beatIndex[trackNumber]] == true && probabilityResult && running[trackNumber] && !muted) {
+        if(rhythm.beat(trackNumber, beatIndex[trackNumber]) && probabilityResult && running[trackNumber] && !muted) {
             beatPulse[trackNumber].trigger();		
         } 
 
         //Create Accent Trigger
-        if(accentMatrix[trackNumber][beatIndex[trackNumber]] == true && probabilityResult && running[trackNumber] && !muted) {
+        if(rhythm.accent(trackNumber, beatIndex[trackNumber]) && probabilityResult && running[trackNumber] && !muted) {
             accentPulse[trackNumber].trigger();
         }
 
@@ -1027,25 +897,30 @@ struct QuadAlgorithmicRhythm : Module {
 			} while (!gaussOk);
 			calculatedSwingRandomness[trackNumber] = 1.0 - gaussian / 2 * swingRandomness[trackNumber];
 		} else {
-			calculatedSwingRandomness[trackNumber] = 1.0 - (((double) rand()/RAND_MAX - 0.5f) * swingRandomness[trackNumber]);
+			calculatedSwingRandomness[trackNumber] = 1.0 - ((random.uniform() - 0.5f) * swingRandomness[trackNumber]);
 		}
 	}
 	// For more advanced Module features, read Rack's engine.hpp header file
 	// - onSampleRateChange: event triggered by a change of sample rate
 	// - onReset, onRandomize, onCreate, onDelete: implements special behavior when user clicks these from the context menu
 
+	void onSampleRateChange() override {
+		for(int i = 0; i < TRACK_COUNT; i++) {
+			scheduleChanged[i] = true;
+		}
+	}
+
     void onReset() override {
 		for(int i = 0; i < TRACK_COUNT; i++) {
             algorithnMatrix[i] = EUCLIDEAN_ALGO;
+			patternKey[i] = NO_PATTERN_KEY;
 			beatIndex[i] = -1;
 			stepsCount[i] = MAX_STEPS;
-			lastStepTime[i] = 0.0;
+			lastStepSample[i] = clockSample;
+			scheduleChanged[i] = true;
 			stepDuration[i] = 0.0;
             lastSwingDuration[i] = 0.0;
-			// expanderAccentValue[i] = 0.0;
-			// expanderOutputValue[i] = 0.0;
-			// expanderEocValue[i] = 0; 
-			// lastExpanderEocValue[i] = 0;
+			expanderChanged[i] = true;
 			probabilityGroupTriggered[i] = PENDING_PGTS;
 			swingRandomness[i] = 0.0f;
 			useGaussianDistribution[i] = false;	
@@ -1054,10 +929,12 @@ struct QuadAlgorithmicRhythm : Module {
 			for(int j = 0; j < MAX_STEPS; j++) {
 				probabilityMatrix[i][j] = 1.0;
 				swingMatrix[i][j] = 0.0;
-				beatMatrix[i][j] = false;
-				accentMatrix[i][j] = false;				
+				probabilityGroupModeMatrix[i][j] = NONE_PGTM;
 			}
 		}	
+		rhythm.clear();
+		restartRandom();
+		displayVersion.bump();
 	}
 };
 
@@ -1169,8 +1046,8 @@ struct QARBeatDisplay : TransparentWidget {
 		for(int trackNumber = 0;trackNumber < TRACK_COUNT;trackNumber++) {
             int algorithn = module->algorithnMatrix[trackNumber];
             for(int stepNumber = 0;stepNumber < module->stepsCount[trackNumber];stepNumber++) {				
-                bool isBeat = module->beatMatrix[trackNumber][stepNumber];
-				bool isAccent = module->accentMatrix[trackNumber][stepNumber];
+                bool isBeat = module->rhythm.beat(trackNumber, stepNumber);
+				bool isAccent = module->rhythm.accent(trackNumber, stepNumber);
 				bool isCurrent = module->beatIndex[trackNumber] == stepNumber && module->running[trackNumber];		
 				float probability = module->probabilityMatrix[trackNumber][stepNumber];
 				float swing = module->swingMatrix[trackNumber][stepNumber];				
@@ -1205,7 +1082,7 @@ struct QuadAlgorithmicRhythmWidget : ModuleWidget {
 			display->module = module;
 			display->box.pos = Vec(16, 34);
 			display->box.size = Vec(box.size.x-31, 351);
-			addChild(display);
+			addChild(frozenwasteland::createVersionedDisplay(display, module));
 		}
 
 
@@ -1318,6 +1195,15 @@ struct QuadAlgorithmicRhythmWidget : ModuleWidget {
 		addChild(createLight<LargeLight<RedLight>>(Vec(415, 347), module, QuadAlgorithmicRhythm::MUTED_LIGHT));
 		
 	}
+
+	void appendContextMenu(Menu *menu) override {
+		QuadAlgorithmicRhythm *module = dynamic_cast<QuadAlgorithmicRhythm*>(this->module);
+		assert(module);
+
+		menu->addChild(new MenuLabel());
+		menu->addChild(frozenwasteland::createFixedSeedItem(&module->random));
+	}
 };
 
+static frozenwasteland::FootprintReport footprint("QuadAlgorithmicRhythm", sizeof(QuadAlgorithmicRhythm));
 Model *modelQuadAlgorithmicRhythm = createModel<QuadAlgorithmicRhythm, QuadAlgorithmicRhythmWidget>("QuadAlgorithmicRhythm");
@@ -1,5 +1,6 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
+#include "ui/footprint.hpp"
 
 struct LowFrequencyOscillator {
 	float phase = 0.0;
@@ -185,4 +186,5 @@ struct QuantussyCellWidget : ModuleWidget {
 	}
 };
 
+static frozenwasteland::FootprintReport footprint("QuantussyCell", sizeof(QuantussyCell));
 Model *modelQuantussyCell = createModel<QuantussyCell, QuantussyCellWidget>("QuantussyCell");
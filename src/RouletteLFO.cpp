@@ -2,6 +2,8 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/snapshot.hpp"
+#include "ui/footprint.hpp"
 
 
 #define BUFFER_SIZE 512
@@ -56,10 +58,12 @@ struct RouletteLFO : Module {
 	};
 	
 
-	float bufferX1[BUFFER_SIZE] = {};
-	float bufferY1[BUFFER_SIZE] = {};
+	// Decimated scope points, drained by RouletteScopeDisplay on the UI thread
+	struct ScopePoint {
+		float x, y, scaling;
+	};
+	frozenwasteland::SampleChannel<ScopePoint, BUFFER_SIZE> scopeChannel;
 	float displayScaling = 1;
-	int bufferIndex = 0;
 	float frameIndex = 0;	
 	float scopeDeltaTime = powf(2.0, -8);
 
@@ -183,20 +187,9 @@ struct RouletteLFO : Module {
 		//Update scope.
 		int frameCount = (int)ceilf(scopeDeltaTime * args.sampleRate);
 
-		// Add frame to buffers
-		if (bufferIndex < BUFFER_SIZE) {
-			if (++frameIndex > frameCount) {
-				frameIndex = 0;
-				bufferX1[bufferIndex] = x1;
-				bufferY1[bufferIndex] = y1;
-				bufferIndex++;
-			}
-		}
-
-		// Are we waiting on the next trigger?
-		if (bufferIndex >= BUFFER_SIZE) {
-			bufferIndex = 0;
+		if (++frameIndex > frameCount) {
 			frameIndex = 0;
+			scopeChannel.push({x1, y1, displayScaling});
 		}
 
 		x1 = x1 * scaling;
@@ -232,6 +225,11 @@ struct RouletteScopeDisplay : TransparentWidget {
 	std::shared_ptr<Font> font;
 
 
+	float bufferX1[BUFFER_SIZE] = {};
+	float bufferY1[BUFFER_SIZE] = {};
+	float displayScaling = 1;
+	int bufferIndex = 0;
+
 	RouletteScopeDisplay() {
 	}
 
@@ -270,15 +268,23 @@ struct RouletteScopeDisplay : TransparentWidget {
 	void draw(const DrawArgs &args) override {
 		if (!module)
 			return;
+		RouletteLFO::ScopePoint point;
+		while (module->scopeChannel.shift(point)) {
+			bufferX1[bufferIndex] = point.x;
+			bufferY1[bufferIndex] = point.y;
+			displayScaling = point.scaling;
+			bufferIndex = (bufferIndex + 1) % BUFFER_SIZE;
+		}
+
 		float valuesX[BUFFER_SIZE];
 		float valuesY[BUFFER_SIZE];
-		float scaling = module->displayScaling;
+		float scaling = displayScaling;
 		for (int i = 0; i < BUFFER_SIZE; i++) {
 			int j = i;
 			// Lock display to buffer if buffer update deltaTime <= 2^-11
-			j = (i + module->bufferIndex) % BUFFER_SIZE;
-			valuesX[i] = (module->bufferX1[j]) / (1.5f * scaling);
-			valuesY[i] = (module->bufferY1[j]) / (1.5f * scaling);
+			j = (i + bufferIndex) % BUFFER_SIZE;
+			valuesX[i] = bufferX1[j] / (1.5f * scaling);
+			valuesY[i] = bufferY1[j] / (1.5f * scaling);
 		}
 
 		nvgStrokeColor(args.vg, nvgRGBA(0x9f, 0xe4, 0x36, 0xc0));
@@ -353,4 +359,5 @@ struct RouletteLFOWidget : ModuleWidget {
 	}
 };
 
+static frozenwasteland::FootprintReport footprint("RouletteLFO", sizeof(RouletteLFO));
 Model *modelRouletteLFO = createModel<RouletteLFO, RouletteLFOWidget>("RouletteLFO2");
@@ -1,18 +1,15 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/expander.hpp"
+#include "ui/messages.hpp"
+#include "ui/footprint.hpp"
+#include "dsp-noise/mersenne.hpp"
 //#include <dsp/digital.hpp>
 
 #include <sstream>
 #include <iomanip>
-
-#define N 624
-#define M 397
-#define MATRIX_A 0x9908b0dfUL   /* constant vector a */
-#define UPPER_MASK 0x80000000UL /* most significant w-r bits */
-#define LOWER_MASK 0x7fffffffUL /* least significant r bits */
-
-
+#include <inttypes.h>
 
 #define NBOUT 4
 
@@ -51,11 +48,8 @@ struct SeedsOfChange : Module {
 	float outbuffer[NBOUT * 2];
 
 
-	// // Expander
-	// float consumerMessage[4] = {};// this module must read from here
-	// float producerMessage[4] = {};// mother will write into here
-	// int seed;
-	// float clockValue,resetValue,distributionValue;
+	// Expander, read by every CV and gate expander chained on the right
+	frozenwasteland::ExpanderPublisher<frozenwasteland::SeedsOfChangeMessage> toExpanders;
 
 
 	dsp::SchmittTrigger resetTrigger,clockTrigger,distributionModeTrigger; 
@@ -74,16 +68,13 @@ struct SeedsOfChange : Module {
 			configParam(SeedsOfChange::GATE_PROBABILITY_1_PARAM + i, 0.0, 1.0, 0.0,"Gate Probability","%",0,100);
 		}
 
-		// rightExpander.producerMessage = producerMessage;
-		// rightExpander.consumerMessage = consumerMessage;
+		toExpanders.attach(rightExpander);
 
 	}
-	unsigned long mt[N]; /* the array for the state vector  */
-	int mti=N+1; /* mti==N+1 means mt[N] is not initialized */
-	void init_genrand(unsigned long s);
-	unsigned long genrand_int32();
+	frozenwasteland::dsp::MersenneTwister twister;
+	uint64_t latest_seed = 5489UL;
+	void init_genrand(uint64_t s);
 	double genrand_real();
-	int latest_seed = 0;
 	float normal_number();
 
 	void process(const ProcessArgs &args) override {
@@ -102,7 +93,8 @@ struct SeedsOfChange : Module {
 		resetInput += params[RESET_PARAM].getValue(); 		
 
         if (resetTrigger.process(resetInput) ) {
-            init_genrand((unsigned long)(inputs[SEED_INPUT].isConnected() ? inputs[SEED_INPUT].getVoltage()*999.9 : params[SEED_PARAM].getValue()));
+            float seed = inputs[SEED_INPUT].isConnected() ? inputs[SEED_INPUT].getVoltage()*999.9 : params[SEED_PARAM].getValue();
+            init_genrand((uint64_t)std::max(seed, 0.0f));
         } 
 
 		if( inputs[CLOCK_INPUT].active ) {
@@ -142,18 +134,12 @@ struct SeedsOfChange : Module {
 			outputs[GATE_1_OUTPUT+i].value = outbuffer[i+NBOUT] ? inputs[CLOCK_INPUT].value : 0;
 		}	
 
-		// //Set Expander Info
-		// if(rightExpander.module && rightExpander.module->model == modelSeedsOfChangeCVExpander) {	
-
-		// 	//Send outputs to slaves if present		
-		// 	float *messageToExpander = (float*)(rightExpander.module->leftExpander.producerMessage);
-			
-		// 	messageToExpander[0] = latest_seed; 
-		// 	messageToExpander[1] = inputs[CLOCK_INPUT].getVoltage(); 
-		// 	messageToExpander[2] = resetInput; 
-		// 	messageToExpander[3] = gaussianMode; 
-		// 	rightExpander.module->leftExpander.messageFlipRequested = true;						
-		// }					
+		//Set Expander Info
+		toExpanders.set(toExpanders.message.seed, latest_seed);
+		toExpanders.set(toExpanders.message.clock, inputs[CLOCK_INPUT].getVoltage());
+		toExpanders.set(toExpanders.message.reset, resetInput);
+		toExpanders.set(toExpanders.message.gaussian, gaussianMode);
+		toExpanders.send();
 	}
 
 	// For more advanced Module features, see engine/Module.hpp in the Rack API.
@@ -161,6 +147,23 @@ struct SeedsOfChange : Module {
 	// - onSampleRateChange: event triggered by a change of sample rate
 	// - onReset, onRandomize: implements custom behavior requested by the user
 	void onReset() override;
+
+	// The seed and how far into its sequence we are, so a patch carries on where it was saved
+	json_t *dataToJson() override {
+		json_t *rootJ = json_object();
+		json_object_set_new(rootJ, "seed", json_integer((json_int_t)twister.getSeed()));
+		json_object_set_new(rootJ, "position", json_integer((json_int_t)twister.getPosition()));
+		return rootJ;
+	}
+
+	void dataFromJson(json_t *rootJ) override {
+		json_t *seedJ = json_object_get(rootJ, "seed");
+		json_t *positionJ = json_object_get(rootJ, "position");
+		if (seedJ) {
+			latest_seed = (uint64_t)json_integer_value(seedJ);
+			twister.seek(latest_seed, positionJ ? (uint64_t)json_integer_value(positionJ) : 0);
+		}
+	}
 };
 
 void SeedsOfChange::onReset() {
@@ -172,66 +175,15 @@ void SeedsOfChange::onReset() {
 	clockTrigger.reset();
 }
 
-/* initializes mt[N] with a seed */
-void SeedsOfChange::init_genrand(unsigned long s)
+void SeedsOfChange::init_genrand(uint64_t s)
 {
-	
-	s = s>9999?9999:s;
 	latest_seed = s;
-    mt[0]= s & 0xffffffffUL;
-    for (mti=1; mti<N; mti++) {
-        mt[mti] = 
-	    (1812433253UL * (mt[mti-1] ^ (mt[mti-1] >> 30)) + mti); 
-        /* See Knuth TAOCP Vol2. 3rd Ed. P.106 for multiplier. */
-        /* In the previous versions, MSBs of the seed affect   */
-        /* only MSBs of the array mt[].                        */
-        /* 2002/01/09 modified by Makoto Matsumoto             */
-        mt[mti] &= 0xffffffffUL;
-        /* for >32 bit machines */
-    }
-}
-/* generates a random number on [0,0xffffffff]-interval */
-unsigned long SeedsOfChange::genrand_int32()
-{
-    unsigned long y;
-    static unsigned long mag01[2]={0x0UL, MATRIX_A};
-    /* mag01[x] = x * MATRIX_A  for x=0,1 */
-
-    if (mti >= N) { /* generate N words at one time */
-        int kk;
-
-        if (mti == N+1)   /* if init_genrand() has not been called, */
-            init_genrand(5489UL); /* a default initial seed is used */
-
-        for (kk=0;kk<N-M;kk++) {
-            y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
-            mt[kk] = mt[kk+M] ^ (y >> 1) ^ mag01[y & 0x1UL];
-        }
-        for (;kk<N-1;kk++) {
-            y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
-            mt[kk] = mt[kk+(M-N)] ^ (y >> 1) ^ mag01[y & 0x1UL];
-        }
-        y = (mt[N-1]&UPPER_MASK)|(mt[0]&LOWER_MASK);
-        mt[N-1] = mt[M-1] ^ (y >> 1) ^ mag01[y & 0x1UL];
-
-        mti = 0;
-    }
-  
-    y = mt[mti++];
-
-    /* Tempering */
-    y ^= (y >> 11);
-    y ^= (y << 7) & 0x9d2c5680UL;
-    y ^= (y << 15) & 0xefc60000UL;
-    y ^= (y >> 18);
-
-    return y;
+	twister.seed(s);
 }
 /* generates a random number on [0,1)-real-interval */
 double SeedsOfChange::genrand_real()
 {
-    return genrand_int32()*(1.0/4294967296.0); 
-    /* divided by 2^32 */
+    return twister.nextReal();
 }
 float SeedsOfChange::normal_number() {
 	const double x1 = .68;
@@ -258,14 +210,14 @@ struct SeedsOfChangeSeedDisplay : TransparentWidget {
 		font = APP->window->loadFont(asset::plugin(pluginInstance, "res/fonts/01 Digit.ttf"));
 	}
 
-	void drawSeed(const DrawArgs &args, Vec pos, int seed) {
+	void drawSeed(const DrawArgs &args, Vec pos, uint64_t seed) {
 		nvgFontSize(args.vg, 12);
 		nvgFontFaceId(args.vg, font->handle);
 		nvgTextLetterSpacing(args.vg, -1);
 
 		nvgFillColor(args.vg, nvgRGBA(0x00, 0xff, 0x00, 0xff));
 		char text[128];
-		snprintf(text, sizeof(text), " %i", seed);
+		snprintf(text, sizeof(text), " %" PRIu64, seed);
 		nvgText(args.vg, pos.x, pos.y, text, NULL);
 	}
 
@@ -329,4 +281,5 @@ struct SeedsOfChangeWidget : ModuleWidget {
 
 
 // Define the Model with the Module type, ModuleWidget type, and module slug
+static frozenwasteland::FootprintReport footprint("SeedsOfChange", sizeof(SeedsOfChange));
 Model *modelSeedsOfChange = createModel<SeedsOfChange, SeedsOfChangeWidget>("SeedsOfChange");
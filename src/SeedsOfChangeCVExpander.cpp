@@ -1,6 +1,9 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/expander.hpp"
+#include "ui/messages.hpp"
+#include "ui/footprint.hpp"
 //#include <dsp/digital.hpp>
 
 #include <sstream>
@@ -38,10 +41,6 @@ struct SeedsOfChangeCVExpander : Module {
 
 	float outbuffer[NBOUT];
 
-	// Expander
-	float consumerMessage[4] = {};// this module must read from here
-	float producerMessage[4] = {};// mother will write into here
-
 	
 	dsp::SchmittTrigger resetTrigger,clockTrigger,distributionModeTrigger; 
 
@@ -54,46 +53,26 @@ struct SeedsOfChangeCVExpander : Module {
 			configParam(SeedsOfChangeCVExpander::MULTIPLY_1_PARAM + i, 0.0f, 10.0f, 10.0f, "Multiply");			
 			configParam(SeedsOfChangeCVExpander::OFFSET_1_PARAM + i, -10.0f, 10.0f, 0.0f,"Offset");						
 		}
-
-		leftExpander.producerMessage = producerMessage;
-		leftExpander.consumerMessage = consumerMessage;
 	}
 	unsigned long mt[N]; /* the array for the state vector  */
 	int mti=N+1; /* mti==N+1 means mt[N] is not initialized */
 	void init_genrand(unsigned long s);
 	unsigned long genrand_int32();
 	double genrand_real();
-	int latest_seed = 0;
-	float resetInput, clockInput;
+	uint64_t latest_seed = 0;
+	float resetInput = 0.0f, clockInput = 0.0f;
 	float normal_number();
 
 	void process(const ProcessArgs &args) override {
 
-		bool motherPresent = (leftExpander.module && (leftExpander.module->model == modelSeedsOfChange || leftExpander.module->model == modelSeedsOfChangeCVExpander || leftExpander.module->model == modelSeedsOfChangeGateExpander));
-		if (motherPresent) {
-			// To Mother
-
-			leftExpander.module->rightExpander.messageFlipRequested = true;
-
-			// From Mother	
-			float *messagesFromMother = (float*)leftExpander.consumerMessage;		
-			latest_seed = messagesFromMother[0]; 
-			clockInput = messagesFromMother[1]; 
-			resetInput = messagesFromMother[2]; 
-			gaussianMode = messagesFromMother[3]; 					
-		}
-
-		//Set Expander Info
-		if(rightExpander.module && (rightExpander.module->model == modelSeedsOfChangeCVExpander || rightExpander.module->model == modelSeedsOfChangeGateExpander)) {	
-
-			//Send outputs to slaves if present		
-			float *messageToExpander = (float*)(rightExpander.module->leftExpander.producerMessage);
-			
-			messageToExpander[0] = latest_seed; 
-			messageToExpander[1] = clockInput;
-			messageToExpander[2] = resetInput; 
-			messageToExpander[3] = gaussianMode; 
-			rightExpander.module->leftExpander.messageFlipRequested = true;						
+		//The Seeds of Change at the head of the chain, read directly rather than handed along by each expander
+		Module *mother = frozenwasteland::pastExpanders(leftExpander.module, true, {modelSeedsOfChangeCVExpander, modelSeedsOfChangeGateExpander});
+		const frozenwasteland::ExpanderPacket<frozenwasteland::SeedsOfChangeMessage> *fromMother = frozenwasteland::readExpander<frozenwasteland::SeedsOfChangeMessage>(mother, false);
+		if (fromMother) {
+			latest_seed = fromMother->payload.seed; 
+			clockInput = fromMother->payload.clock; 
+			resetInput = fromMother->payload.reset; 
+			gaussianMode = fromMother->payload.gaussian; 					
 		}
 			
         if (resetTrigger.process(resetInput) ) {
@@ -261,4 +240,5 @@ struct SeedsOfChangeCVExpanderWidget : ModuleWidget {
 
 
 // Define the Model with the Module type, ModuleWidget type, and module slug
+static frozenwasteland::FootprintReport footprint("SeedsOfChangeCVExpander", sizeof(SeedsOfChangeCVExpander));
 Model *modelSeedsOfChangeCVExpander = createModel<SeedsOfChangeCVExpander, SeedsOfChangeCVExpanderWidget>("SeedsOfChangeCVExpander");
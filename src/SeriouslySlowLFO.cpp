@@ -1,5 +1,6 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
+#include "ui/footprint.hpp"
 
 
 //Not sure why this is necessary, but SSLFO is running twice as fast as sample rate says it should
@@ -338,4 +339,5 @@ struct SeriouslySlowLFOWidget : ModuleWidget {
 	}
 };
 
+static frozenwasteland::FootprintReport footprint("SeriouslySlowLFO", sizeof(SeriouslySlowLFO));
 Model *modelSeriouslySlowLFO = createModel<SeriouslySlowLFO, SeriouslySlowLFOWidget>("SeriouslySlowLFO");
@@ -1,6 +1,11 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
 #include "ui/ports.hpp"
+#include "ui/storage.hpp"
+#include "ui/sleep.hpp"
+#include "ui/denormal.hpp"
+#include "ui/footprint.hpp"
+#include "ui/quality.hpp"
 #include "ringbuffer.hpp"
 #include "samplerate.h"
 #include "dsp-noise/noise.hpp"
@@ -11,6 +16,27 @@ using namespace frozenwasteland::dsp;
 #define MAX_GRAINS 8
 #define GRAIN_SPACING 256 //This will undoubtably become a parameter
 
+// Quality tiers. Each grain is a string with its own resampler, so the cap and the interpolation set most of the cost; eco also updates the color filters every 16 samples.
+static const frozenwasteland::QualityProfile stringTheoryQuality[frozenwasteland::NUM_QUALITY_TIERS] = {
+	// interpolation, oversample, grain cap, filter stages, control interval, estimated cost
+	{frozenwasteland::INTERPOLATION_HOLD, 1, 4, 1, 16, 0.5f},
+	{frozenwasteland::INTERPOLATION_LINEAR, 1, MAX_GRAINS, 1, 1, 1.0f},
+	{frozenwasteland::INTERPOLATION_SINC, 1, MAX_GRAINS, 1, 1, 2.0f},
+};
+
+// The 64 MB of grain histories, built off the engine thread once the module exists
+struct StringTheoryBuffers {
+	FrozenWasteland::MirroredRingBuffer<float, HISTORY_SIZE> historyBuffer[MAX_GRAINS];
+
+	bool allocated() const {
+		for(int i=0;i<MAX_GRAINS;i++) {
+			if(!historyBuffer[i].allocated)
+				return false;
+		}
+		return true;
+	}
+};
+
 struct StringTheory : Module {
 	enum ParamIds {
 		COARSE_TIME_PARAM,
@@ -72,15 +98,40 @@ struct StringTheory : Module {
 		NUM_WINDOW_FUNCTIONS
 	};
 
-	dsp::DoubleRingBuffer<float, HISTORY_SIZE> historyBuffer[MAX_GRAINS];
+	frozenwasteland::DeferredStorage<StringTheoryBuffers> storage;
+	frozenwasteland::SleepDetector sleepDetector;
+	frozenwasteland::DenormalMonitor denormals{"StringTheory"};
 	dsp::DoubleRingBuffer<float, 16> outBuffer[MAX_GRAINS];
-	SRC_STATE *src[MAX_GRAINS];
+	// The resamplers in use, or NULL until the first tier's are built
+	SRC_STATE **src = NULL;
+	// Each interpolation order's resamplers, built off the engine thread when a tier that reads through it is first asked for
+	frozenwasteland::TierResamplers<MAX_GRAINS, 1> resamplers;
+	int interpolation = frozenwasteland::INTERPOLATION_LINEAR;
+	frozenwasteland::QualitySetting quality{stringTheoryQuality};
+	int grainCap = MAX_GRAINS;
+	int controlCountdown = 0;
 	dsp::RCFilter lowpassFilter;
 	dsp::RCFilter highpassFilter;
 
-	WhiteNoiseGenerator _whiteNoise;
-	PinkNoiseGenerator _pinkNoise;
-	GaussianNoiseGenerator _gaussianNoise;
+	// One of each noise for the plucks and another for the ring modulator, so each sees a contiguous stream
+	struct NoiseSource {
+		WhiteNoiseGenerator white;
+		PinkNoiseGenerator pink;
+		GaussianNoiseGenerator gaussian;
+
+		float next(int noiseType) {
+			switch(noiseType) {
+				case PINK_NOISE :
+					return pink.next();
+				case GAUSSIAN_NOISE :
+					return gaussian.next();
+				default :
+					return white.next();
+			}
+		}
+	};
+	NoiseSource pluckNoise;
+	NoiseSource ringModNoise;
 
 	dsp::SchmittTrigger pluckTrigger, noiseTypeTrigger,windowFunctionTrigger;
 
@@ -128,22 +179,57 @@ struct StringTheory : Module {
 		configParam(WINDOW_FUNCTION_PARAM, 0.f, 1.f, 0.0f);
 
 
-		for(int i=0;i<MAX_GRAINS;i++) {
-			src[i] = src_new(SRC_LINEAR, 1, NULL);
-			assert(src[i]);
-		}
+		quality.prepare = [this](const frozenwasteland::QualityProfile &profile) {
+			resamplers.request(profile.interpolation);
+		};
+		quality.prepare(quality.profile());
+		quality.update();
+		applyQuality();
+		storage.request();
 		//src = src_new(SRC_LINEAR, 1, NULL);
 	}
 
-	~StringTheory() {
+	json_t *dataToJson() override {
+		json_t *rootJ = json_object();
+		json_object_set_new(rootJ, "quality", json_integer(quality.requested));
+		return rootJ;
+	}
+
+	void dataFromJson(json_t *rootJ) override {
+		json_t *qualityJ = json_object_get(rootJ, "quality");
+		if (qualityJ) {
+			quality.request(json_integer_value(qualityJ));
+		}
+	}
+
+	// Switches to the quality tier's grain cap and control rate, and to its resamplers once useResamplers() finds them built
+	void applyQuality() {
+		const frozenwasteland::QualityProfile &profile = quality.profile();
+		interpolation = profile.interpolation;
+		grainCap = profile.grainCap;
+		controlCountdown = 0;
+	}
+
+	// Until the tier's resamplers are built the old ones carry on. The ones it switches to start empty, so each string loses a few samples at most.
+	void useResamplers() {
+		SRC_STATE **ready = resamplers.get(interpolation);
+		if(!ready || ready == src) {
+			return;
+		}
+		src = ready;
 		for(int i=0;i<MAX_GRAINS;i++) {
-			src_delete(src[i]);
+			src_reset(src[i]);
 		}
 	}
 
 	void process(const ProcessArgs &args) override {
+		frozenwasteland::DenormalGuard denormalGuard;
+		if(quality.update()) {
+			applyQuality();
+		}
+		useResamplers();
 		
-		grainCount = params[GRAIN_COUNT_PARAM].getValue();
+		grainCount = std::min((int) params[GRAIN_COUNT_PARAM].getValue(), grainCap);
 
 		// Compute delay time in seconds - eventually milliseconds
 		float coarseDelay = params[COARSE_TIME_PARAM].getValue() + inputs[COARSE_TIME_INPUT].getVoltage() / 10.f;
@@ -204,32 +290,75 @@ struct StringTheory : Module {
 		float ringModMix = clamp(params[RING_MOD_MIX_PARAM].getValue() + inputs[RING_MOD_MIX_INPUT].getVoltage() / 10.0f,0.0f,1.0f);
 
 
-		float ringModIn = 0.0;
 		switch(noiseType) {
 			case WHITE_NOISE :
 				lights[NOISE_TYPE_LIGHT].value = 1;
 				lights[NOISE_TYPE_LIGHT + 1].value = 1;
 				lights[NOISE_TYPE_LIGHT + 2].value = 1;
-				ringModIn = _whiteNoise.next() * 5.0f;
 				break;
 			case PINK_NOISE :
 				lights[NOISE_TYPE_LIGHT].value = 1;
 				lights[NOISE_TYPE_LIGHT + 1].value = 0.1;
 				lights[NOISE_TYPE_LIGHT + 2].value = 0.1;
-				ringModIn = _pinkNoise.next() * 5.0f;
 				break;
 			case GAUSSIAN_NOISE :
 				lights[NOISE_TYPE_LIGHT].value = 0.2f;
 				lights[NOISE_TYPE_LIGHT + 1].value = 0.2f;
 				lights[NOISE_TYPE_LIGHT + 2].value = 0.2f;
-				ringModIn = _gaussianNoise.next() * 5.0f;
 				break;
 		}
+		float ringModIn;
 		if(inputs[EXTERNAL_RING_MOD_INPUT].isConnected()) {
 			ringModIn = inputs[EXTERNAL_RING_MOD_INPUT].getVoltage();
+		} else {
+			ringModIn = ringModNoise.next(noiseType) * 5.0f;
 		}
 
+
+		StringTheoryBuffers *buffers = storage.get();
+		if(!buffers || !src) {
+			// Histories or resamplers still being built, or no memory for them, so the strings stay silent until they can ring
+			outputs[FB_SEND_OUTPUT].setChannels(grainCount);
+			for(int i=0; i<grainCount;i++) {
+				outputs[FB_SEND_OUTPUT].setVoltage(0.0f,i);
+			}
+			outputs[OUT_OUTPUT].setVoltage(0.0f);
+			return;
+		}
+
+		// A pluck makes its own sound from noise, so a string that is still taking its pluck counts as input
+		float inputLevel = fabsf(inputs[IN_INPUT].getVoltage());
+		for(int i=0; i<grainCount;i++) {
+			if(acceptingInput[i]) {
+				inputLevel = 10.0f;
+			}
+		}
+		for(int c=0; c<inputs[FB_RETURN_INPUT].getChannels();c++) {
+			inputLevel = std::max(inputLevel, fabsf(inputs[FB_RETURN_INPUT].getVoltage(c)));
+		}
+		if(sleepDetector.sleeping(inputLevel)) {
+			outputs[FB_SEND_OUTPUT].setChannels(grainCount);
+			for(int i=0; i<grainCount;i++) {
+				outputs[FB_SEND_OUTPUT].setVoltage(0.0f,i);
+			}
+			outputs[OUT_OUTPUT].setVoltage(0.0f);
+			return;
+		}
 	
+		// Every string goes through the same color filters, so their cutoffs are set once, at the quality tier's control rate
+		if(--controlCountdown <= 0) {
+			float color = params[COLOR_PARAM].getValue() + inputs[COLOR_INPUT].getVoltage() / 10.f;
+			color = clamp(color, 0.f, 1.f);
+			float colorFreq = std::pow(100.f, 2.f * color - 1.f);
+
+			float lowpassFreq = clamp(20000.f * colorFreq, 20.f, 20000.f);
+			lowpassFilter.setCutoffFreq(lowpassFreq / args.sampleRate);
+
+			float highpassFreq = clamp(20.f * colorFreq, 20.f, 20000.f);
+			highpassFilter.setCutoff(highpassFreq / args.sampleRate);
+			controlCountdown = quality.profile().controlInterval;
+		}
+
 		for(int i=0; i<grainCount;i++) {
 			timeDelay[i] -= 1.0;
 			if(timeDelay[i] > 0)
@@ -248,17 +377,7 @@ struct StringTheory : Module {
 				if(inputs[IN_INPUT].isConnected()) {
 					in = inputs[IN_INPUT].getVoltage();
 				} else {
-					switch(noiseType) {
-						case WHITE_NOISE :
-							in = _whiteNoise.next() * 5.0f;
-							break;
-						case PINK_NOISE :
-							in = _pinkNoise.next() * 5.0f;
-							break;
-						case GAUSSIAN_NOISE :
-							in = _gaussianNoise.next() * 5.0f;
-							break;
-					}
+					in = pluckNoise.next(noiseType) * 5.0f;
 				}
 				switch (windowFunction) {
 					case NO_WINDOW_FUNCTION :
@@ -278,12 +397,12 @@ struct StringTheory : Module {
 
 
 			// Push dry sample into history buffer
-			if (!historyBuffer[i].full()) {
-				historyBuffer[i].push(dry);
+			if (!buffers->historyBuffer[i].full()) {
+				buffers->historyBuffer[i].push(dry);
 			}
 
 			// How many samples do we need consume to catch up?
-			float consume = (index * (1.0 + (float)i / (float)grainCount * (params[SPREAD_PARAM].getValue() + inputs[SPREAD_INPUT].getVoltage() / 10.0f))) - historyBuffer[i].size();
+			float consume = (index * (1.0 + (float)i / (float)grainCount * (params[SPREAD_PARAM].getValue() + inputs[SPREAD_INPUT].getVoltage() / 10.0f))) - buffers->historyBuffer[i].size();
 
 			if (outBuffer[i].empty()) {
 				double ratio = 1.f;
@@ -295,16 +414,16 @@ struct StringTheory : Module {
 				}
 
 				SRC_DATA srcData;
-				srcData.data_in = (const float*) historyBuffer[i].startData();
+				srcData.data_in = (const float*) buffers->historyBuffer[i].startData();
 				srcData.data_out = (float*) outBuffer[i].endData();
-				srcData.input_frames = std::min((int) historyBuffer[i].size(), 16);
+				srcData.input_frames = std::min((int) buffers->historyBuffer[i].size(), 16);
 				srcData.output_frames = outBuffer[i].capacity();
 				srcData.end_of_input = false;
 				srcData.src_ratio = ratio;
 				srcData.input_frames_used = 0;
 				srcData.output_frames_gen = 0;
 				src_process(src[i], &srcData);
-				historyBuffer[i].startIncr(srcData.input_frames_used);
+				buffers->historyBuffer[i].startIncr(srcData.input_frames_used);
 				outBuffer[i].endIncr(srcData.output_frames_gen);
 			}
 
@@ -325,17 +444,9 @@ struct StringTheory : Module {
 			}
 
 			// Apply color to delay wet output
-			float color = params[COLOR_PARAM].getValue() + inputs[COLOR_INPUT].getVoltage() / 10.f;
-			color = clamp(color, 0.f, 1.f);
-			float colorFreq = std::pow(100.f, 2.f * color - 1.f);
-
-			float lowpassFreq = clamp(20000.f * colorFreq, 20.f, 20000.f);
-			lowpassFilter.setCutoffFreq(lowpassFreq / args.sampleRate);
 			lowpassFilter.process(individualWet[i]);
 			individualWet[i] = lowpassFilter.lowpass();
 
-			float highpassFreq = clamp(20.f * colorFreq, 20.f, 20000.f);
-			highpassFilter.setCutoff(highpassFreq / args.sampleRate);
 			highpassFilter.process(individualWet[i]);
 			individualWet[i] = highpassFilter.highpass();
 			
@@ -344,6 +455,7 @@ struct StringTheory : Module {
 		float wet = 0.f;
 		for(int i= 0; i<grainCount;i++) {
 			lastWet[i] = individualWet[(i + feedBackShift) % grainCount];
+			denormals.flush(lastWet[i]);
 			if(i < ringModGrain) {
 				float ringModdedValue = ringModIn * individualWet[i] / 5.0f;
 				individualWet[i] = lerp(individualWet[i], ringModdedValue, ringModMix);
@@ -354,6 +466,15 @@ struct StringTheory : Module {
 		
 		outputs[FB_SEND_OUTPUT].setChannels(grainCount);
 		outputs[OUT_OUTPUT].setVoltage(wet);
+
+		// Spread, knob plus CV, makes a string up to three times the delay long
+		float tail = fabsf(wet);
+		for(int i= 0; i<grainCount;i++) {
+			tail = std::max(tail, fabsf(lastWet[i]));
+		}
+		sleepDetector.holdTime = 3.0f * index * args.sampleTime + 0.1f;
+		sleepDetector.track(inputLevel, tail, args.sampleTime);
+		denormals.tick(args.sampleTime);
 	}
 };
 
@@ -415,7 +536,15 @@ struct StringTheoryWidget : ModuleWidget {
 		addChild(createLight<LargeLight<RedGreenBlueLight>>(Vec(81, 307), module, StringTheory::WINDOW_FUNCTION_LIGHT));
 
 	}
+
+	void appendContextMenu(Menu *menu) override {
+		StringTheory *module = dynamic_cast<StringTheory*>(this->module);
+		assert(module);
+
+		frozenwasteland::appendQualityMenu(menu, module->quality);
+	}
 };
 
 
+static frozenwasteland::FootprintReport footprint("StringTheory", sizeof(StringTheory), sizeof(StringTheoryBuffers) + sizeof(float) * HISTORY_SIZE * MAX_GRAINS);
 Model *modelStringTheory = createModel<StringTheory, StringTheoryWidget>("StringTheory");
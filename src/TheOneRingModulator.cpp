@@ -1,6 +1,7 @@
 #include <string.h>
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
+#include "ui/footprint.hpp"
 
 #define BUFFER_SIZE 512
 
@@ -224,4 +225,5 @@ struct TheOneRingModulatorWidget : ModuleWidget {
 	}
 };
 
+static frozenwasteland::FootprintReport footprint("TheOneRingModulator", sizeof(TheOneRingModulator));
 Model *modelTheOneRingModulator = createModel<TheOneRingModulator, TheOneRingModulatorWidget>("TheOneRingModulator");
@@ -1,6 +1,11 @@
 #include "FrozenWasteland.hpp"
 #include "StateVariableFilter.h"
 #include "ui/knobs.hpp"
+#include "ui/sleep.hpp"
+#include "ui/denormal.hpp"
+#include "ui/expander.hpp"
+#include "ui/messages.hpp"
+#include "ui/footprint.hpp"
 
 using namespace std;
 
@@ -72,6 +77,8 @@ struct VoxInhumana : Module {
 	};
 	
 	StateVariableFilterState<T> filterStates[BANDS * 2];
+	frozenwasteland::SleepDetector sleepDetector;
+	frozenwasteland::DenormalMonitor denormals{"VoxInhumana"};
     StateVariableFilterParams<T> filterParams[BANDS * 2];
 	
 	float freq[BANDS] = {0};
@@ -100,7 +107,7 @@ struct VoxInhumana : Module {
 	// Second Index is Vowel (a,e,i,o,u) // should find more
 	// Third if filter/formant index
 	// Fourth: Cutoff,Q,Peak db)
-	const float formantParameters[5][5][BANDS][3] = {
+	static constexpr float formantParameters[5][5][BANDS][3] = {
 		//Bass
 		{
 			{{600,10,0},{1040,15,-7},{2250,21,-9},{2450,20,-9},{2750,21,-20}}, //a
@@ -200,6 +207,7 @@ struct VoxInhumana : Module {
 	}
 	
 	void process(const ProcessArgs &args) override {
+		frozenwasteland::DenormalGuard denormalGuard;
 	
 		float signalIn = inputs[SIGNAL_IN].getVoltage()/5.0f;
 		
@@ -213,19 +221,19 @@ struct VoxInhumana : Module {
 		lights[VOWEL_1_LIGHT].value = 1.0-vowelBalance;
 		lights[VOWEL_2_LIGHT].value = vowelBalance;
 
-		// //Get Expander Info
-		// if(rightExpander.module && rightExpander.module->model == modelVoxInhumanaExpander) {			
-		// 	float *message = (float*) rightExpander.module->leftExpander.consumerMessage;
-		// 	for(int i = 0; i < BANDS; i++) {
-		// 		expanderQ[i] = message[i * 2];
-		// 		twelveDbSlope[i] = message[i * 2 + 1];					
-		// 	}			
-		// } else {
-		// 	for(int i = 0; i < BANDS; i++) {
-		// 		expanderQ[i] = 0;
-		// 		twelveDbSlope[i] =false;					
-		// 	}			
-		// }
+		//Get Expander Info
+		const frozenwasteland::ExpanderPacket<frozenwasteland::VoxInhumanaMessage> *expander = frozenwasteland::readExpander<frozenwasteland::VoxInhumanaMessage>(rightExpander.module, true);
+		if(expander) {
+			for(int i = 0; i < BANDS; i++) {
+				expanderQ[i] = expander->payload.q[i];
+				twelveDbSlope[i] = expander->payload.twelveDbSlope[i];
+			}			
+		} else {
+			for(int i = 0; i < BANDS; i++) {
+				expanderQ[i] = 0;
+				twelveDbSlope[i] =false;					
+			}			
+		}
 		
 		for (int i=0; i<BANDS;i++) {
 			float cutoffExp = params[FREQ_1_CUTOFF_PARAM+i].getValue() + inputs[FREQ_1_CUTOFF_INPUT+i].getVoltage() * params[FREQ_1_CV_ATTENUVERTER_PARAM+i].getValue(); 
@@ -254,6 +262,12 @@ struct VoxInhumana : Module {
 			}		
 		}
 
+		float inputLevel = fabsf(inputs[SIGNAL_IN].getVoltage());
+		if(sleepDetector.sleeping(inputLevel)) {
+			outputs[VOX_OUTPUT].setVoltage(0.0f);
+			return;
+		}
+
 		float out = 0.0f;	
 		for(int i=0;i<BANDS;i++) {
 			float lastFilterOut;
@@ -272,10 +286,20 @@ struct VoxInhumana : Module {
 
 
 		outputs[VOX_OUTPUT].setVoltage(out / 5.0f);
-		
+
+		// A muted formant can still be ringing, so its filter state counts as tail too
+		float tail = fabsf(out / 5.0f);
+		for(int i=0;i<BANDS*2;i++) {
+			filterStates[i].flushDenormals(denormals);
+			tail = std::max(tail, std::max(fabsf(filterStates[i].z1), fabsf(filterStates[i].z2)) * 5.0f);
+		}
+		sleepDetector.track(inputLevel, tail, args.sampleTime);
+		denormals.tick(args.sampleTime);
 	}
 };
 
+constexpr float VoxInhumana::formantParameters[5][5][BANDS][3];
+
 
 
 
@@ -410,4 +434,5 @@ struct VoxInhumanaWidget : ModuleWidget {
 };
 
 
+static frozenwasteland::FootprintReport footprint("VoxInhumana", sizeof(VoxInhumana));
 Model *modelVoxInhumana = createModel<VoxInhumana, VoxInhumanaWidget>("VoxInhumana");
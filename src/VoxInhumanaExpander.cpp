@@ -1,5 +1,8 @@
 #include "FrozenWasteland.hpp"
 #include "ui/knobs.hpp"
+#include "ui/expander.hpp"
+#include "ui/messages.hpp"
+#include "ui/footprint.hpp"
 
 #define FORMANT_COUNT 5
 
@@ -45,9 +48,8 @@ struct VoxInhumanaExpander : Module {
 
 	const char* formantNames[FORMANT_COUNT] {"1","2","3","4","5"};
 
-	// Expander
-	float consumerMessage[FORMANT_COUNT * 2] = {};// this module must read from here
-	float producerMessage[FORMANT_COUNT * 2] = {};// mother will write into here
+	// Expander, read by the Vox Inhumana on the left
+	frozenwasteland::ExpanderPublisher<frozenwasteland::VoxInhumanaMessage> toMother;
 
 	
 	dsp::SchmittTrigger slopeTrigger[FORMANT_COUNT];
@@ -73,8 +75,7 @@ struct VoxInhumanaExpander : Module {
         configParam(SLOPE_5_PARAM, 0, 1, 0,"Formant 5 6/12db Slope");
 
 
-		leftExpander.producerMessage = producerMessage;
-		leftExpander.consumerMessage = consumerMessage;
+		toMother.attach(leftExpander);
 
 		for(int i =0;i<FORMANT_COUNT;i++) {
 			twelveDbSlopeSelected[i] = false;
@@ -121,27 +122,13 @@ struct VoxInhumanaExpander : Module {
 			lights[FORMANT_1_SLOPE_LIGHT+i].value = twelveDbSlopeSelected[i];			
 		}
 
-		bool motherPresent = (leftExpander.module && leftExpander.module->model == modelVoxInhumana);
-		
-		if (motherPresent) {
-			// To Mother
-			float *producerMessage = (float*) leftExpander.producerMessage;
-			
-			
-			for (int i = 0; i < FORMANT_COUNT; i++) {
-                producerMessage[i * 2] = clamp(params[Q_1_PARAM+i].getValue() + (inputs[Q_1_INPUT + i].isConnected() ? inputs[Q_1_INPUT + i].getVoltage() * 10 * params[Q_2_ATTENUVERTER_PARAM + i].getValue() : 0.0f),1.0,100.0f);
-                producerMessage[i * 2 + 1] = twelveDbSlopeSelected[i];                 
-			}			
-						
-			// From Mother	
-			
-			
-			leftExpander.messageFlipRequested = true;
-		
-		}		
-		
+		// To Mother, only what changed
+		for (int i = 0; i < FORMANT_COUNT; i++) {
+			toMother.set(toMother.message.q[i], clamp(params[Q_1_PARAM+i].getValue() + (inputs[Q_1_INPUT + i].isConnected() ? inputs[Q_1_INPUT + i].getVoltage() * 10 * params[Q_2_ATTENUVERTER_PARAM + i].getValue() : 0.0f),1.0,100.0f));
+			toMother.set(toMother.message.twelveDbSlope[i], twelveDbSlopeSelected[i]);
+		}
+		toMother.send();
 	}
-
     
 	
 	
@@ -201,4 +188,5 @@ struct VoxInhumanaExpanderWidget : ModuleWidget {
 	}
 };
 
+static frozenwasteland::FootprintReport footprint("VoxInhumanaExpander", sizeof(VoxInhumanaExpander));
 Model *modelVoxInhumanaExpander = createModel<VoxInhumanaExpander, VoxInhumanaExpanderWidget>("VoxInhumanaExpander");
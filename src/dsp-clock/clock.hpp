@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace frozenwasteland {
+namespace dsp {
+
+/** What the measured period does while the next clock edge is late */
+enum ClockLateMode {
+	/** Keep the last period until an edge arrives */
+	CLOCK_HOLD_WHEN_LATE,
+	/** Once a period is known, stretch it to the time since the last edge */
+	CLOCK_STRETCH_WHEN_LATE,
+	/** Stretch from the first edge on, so a single edge already gives a (growing) period */
+	CLOCK_STRETCH_FROM_FIRST_EDGE
+};
+
+/** Measures the period of a clock input.
+Edges are found with the same thresholds as Rack's SchmittTrigger (high at 1V, low at 0V) and placed between samples by linear interpolation.
+Periods that stay within lockTolerance of the current estimate are averaged, so a steady clock whose period isn't a whole number of samples
+settles on its true period instead of alternating between the two nearest sample counts. Larger changes are taken as a new tempo and used as is.
+*/
+struct ClockTracker {
+	/** Gain of the period average once locked. 1 follows every edge, smaller values smooth more. */
+	double smoothing = 0.25;
+	/** Relative period change treated as a tempo change rather than jitter */
+	double lockTolerance = 0.1;
+	/** Edges averaged before settling on `smoothing`, so the estimate converges quickly after a tempo change */
+	int lockInEdges = 4;
+	/** Seconds without an edge before the period is dropped. 0 never drops it. */
+	double timeout = 0.0;
+	ClockLateMode lateMode = CLOCK_STRETCH_WHEN_LATE;
+
+	/** Smoothed period in seconds, 0 until known */
+	double period = 0.0;
+	/** Seconds from the last edge to the current sample */
+	double elapsed = 0.0;
+
+	int edges = 0;
+	int lockedEdges = 0;
+	bool high = false;
+	float lastVoltage = 0.f;
+	double measuredPeriod = 0.0;
+
+	/** Forgets the period. The edge detector keeps its state, like a SchmittTrigger that isn't reset. */
+	void reset() {
+		period = 0.0;
+		elapsed = 0.0;
+		edges = 0;
+		lockedEdges = 0;
+		measuredPeriod = 0.0;
+	}
+
+	/** True once two edges have been seen */
+	bool locked() const {
+		return edges >= 2;
+	}
+
+	/** Processes one sample of the clock input. Returns true on a rising edge. */
+	bool process(float voltage, double sampleTime) {
+		elapsed += sampleTime;
+		bool edge = false;
+		if (high) {
+			high = voltage > 0.f;
+		} else if (voltage >= 1.f) {
+			high = true;
+			edge = true;
+			// How far back, in samples, the input crossed 1V
+			double fraction = voltage > lastVoltage ? (voltage - 1.f) / (voltage - lastVoltage) : 0.0;
+			if (fraction > 1.0)
+				fraction = 1.0;
+			onEdge(fraction * sampleTime);
+		}
+		lastVoltage = voltage;
+
+		if (!edge && edges > 0) {
+			if (timeout > 0.0 && elapsed > timeout) {
+				reset();
+			} else if (elapsed > period && (lateMode == CLOCK_STRETCH_FROM_FIRST_EDGE || (lateMode == CLOCK_STRETCH_WHEN_LATE && locked()))) {
+				//allow absense of next clock to affect duration
+				period = elapsed;
+			}
+		}
+		return edge;
+	}
+
+	void onEdge(double sinceEdge) {
+		if (edges > 0) {
+			double newPeriod = elapsed - sinceEdge;
+			if (measuredPeriod <= 0.0 || newPeriod > measuredPeriod * (1.0 + lockTolerance) || newPeriod < measuredPeriod * (1.0 - lockTolerance)) {
+				// New tempo
+				measuredPeriod = newPeriod;
+				lockedEdges = 1;
+			} else {
+				lockedEdges++;
+				double gain = 1.0 / lockedEdges;
+				if (lockedEdges > lockInEdges || gain < smoothing)
+					gain = smoothing;
+				measuredPeriod += (newPeriod - measuredPeriod) * gain;
+			}
+			period = measuredPeriod;
+		}
+		if (edges < 2)
+			edges++;
+		elapsed = sinceEdge;
+	}
+};
+
+} // namespace dsp
+} // namespace frozenwasteland
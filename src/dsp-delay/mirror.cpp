@@ -0,0 +1,106 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "mirror.hpp"
+
+using namespace FrozenWasteland;
+
+
+bool MirroredMemory::allocate(size_t newSize) {
+	release();
+	if (allocateMirrored(newSize))
+		return true;
+
+	// Plain doubled block. Zeroing it here touches every page now rather than on the engine thread.
+	data = malloc(2 * newSize);
+	if (!data)
+		return false;
+	memset(data, 0, 2 * newSize);
+	size = newSize;
+	mirrored = false;
+	return true;
+}
+
+bool MirroredMemory::allocateMirrored(size_t newSize) {
+#if defined(__linux__) && defined(SYS_memfd_create)
+	long pageSize = sysconf(_SC_PAGESIZE);
+	if (pageSize <= 0 || newSize == 0 || newSize % pageSize != 0)
+		return false;
+	bool huge = newSize >= HUGE_PAGE_MIN && newSize % HUGE_PAGE_SIZE == 0;
+	size_t align = huge ? HUGE_PAGE_SIZE : pageSize;
+
+	// memfd_create() by syscall number, since older C libraries don't wrap it. 1 is MFD_CLOEXEC.
+	int fd = (int) syscall(SYS_memfd_create, "frozenwasteland-ring", 1u);
+	if (fd < 0)
+		return false;
+	if (ftruncate(fd, newSize) != 0) {
+		close(fd);
+		return false;
+	}
+
+	// Reserve address space for both views, with slack to align them for huge pages, then give back the slack
+	size_t reserveSize = 2 * newSize + align - pageSize;
+	char *reserve = (char *) mmap(NULL, reserveSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (reserve == MAP_FAILED) {
+		close(fd);
+		return false;
+	}
+	char *base = (char *) (((uintptr_t) reserve + align - 1) & ~(uintptr_t) (align - 1));
+	if (base > reserve)
+		munmap(reserve, base - reserve);
+	if (reserve + reserveSize > base + 2 * newSize)
+		munmap(base + 2 * newSize, reserve + reserveSize - (base + 2 * newSize));
+
+	bool mapped = mmap(base, newSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED
+		&& mmap(base + newSize, newSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED;
+	close(fd);
+	if (!mapped) {
+		munmap(base, 2 * newSize);
+		return false;
+	}
+
+#ifdef MADV_HUGEPAGE
+	// Only a hint: shmem huge pages also depend on /sys/kernel/mm/transparent_hugepage/shmem_enabled
+	if (huge)
+		madvise(base, 2 * newSize, MADV_HUGEPAGE);
+#endif
+
+	// Fault in both views now: writing the first allocates the pages, reading the second maps them there too
+	memset(base, 0, newSize);
+	volatile char sink = 0;
+	for (size_t i = 0; i < newSize; i += pageSize) {
+		sink += base[newSize + i];
+	}
+	(void) sink;
+
+	data = base;
+	size = newSize;
+	mirrored = true;
+	return true;
+#else
+	(void) newSize;
+	return false;
+#endif
+}
+
+void MirroredMemory::release() {
+	if (!data)
+		return;
+#if defined(__linux__)
+	if (mirrored)
+		munmap(data, 2 * size);
+	else
+		free(data);
+#else
+	free(data);
+#endif
+	data = NULL;
+	size = 0;
+	mirrored = false;
+}
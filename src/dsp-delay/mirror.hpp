@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+
+namespace FrozenWasteland {
+
+/** A block of memory followed immediately by a second view of the same bytes, so data[i] and data[i + size] are one location.
+On Linux the block is a memfd mapped twice back to back, and a write to either half shows up in both.
+Elsewhere, or if the mapping fails, it is an ordinary block of twice the size and the caller must write both halves itself (mirrored is false).
+Blocks of at least HUGE_PAGE_MIN bytes are aligned for, and advised to use, transparent huge pages, which cuts the TLB misses of many taps reading far apart.
+Every page is touched on allocation, so call this off the engine thread.
+*/
+struct MirroredMemory {
+	static const size_t HUGE_PAGE_SIZE = 2 << 20;
+	static const size_t HUGE_PAGE_MIN = 4 << 20;
+
+	void *data = NULL;
+	size_t size = 0;
+	bool mirrored = false;
+
+	MirroredMemory() {}
+	MirroredMemory(const MirroredMemory &) = delete;
+	MirroredMemory &operator=(const MirroredMemory &) = delete;
+	~MirroredMemory() {
+		release();
+	}
+
+	/** Allocates size zeroed bytes, plus the second view. Returns false only if no memory could be had at all. */
+	bool allocate(size_t size);
+	void release();
+	bool allocateMirrored(size_t size);
+};
+
+} // namespace FrozenWasteland
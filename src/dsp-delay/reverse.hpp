@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <math.h>
+
+namespace FrozenWasteland {
+
+/** Backwards playback over a forward history, with no second copy of the input.
+Each window of length samples starts at the tap's own delay and walks back into the past, getting two samples further behind the newest every sample.
+Two heads half a window apart, each faded in and out with a triangle, hide the jump back to the start of the window.
+*/
+struct ReverseHead {
+	size_t window = 2;
+	size_t position = 0;
+
+	void setWindow(float samples) {
+		window = samples > 2.0f ? (size_t) samples : 2;
+		if (position >= window)
+			position %= window;
+	}
+	void reset() {
+		position = 0;
+	}
+	void advance() {
+		if (++position >= window)
+			position = 0;
+	}
+
+	/** Lags behind the newest sample for both heads, reading a tap delay samples long, and their crossfade gains, which sum to 1 */
+	void heads(float delay, float lag[2], float gain[2]) const {
+		for (int k = 0; k < 2; k++) {
+			size_t p = (position + k * window / 2) % window;
+			float phase = (float) p / window;
+			lag[k] = delay + 2.0f * p;
+			gain[k] = 1.0f - fabsf(2.0f * phase - 1.0f);
+		}
+	}
+};
+
+} // namespace FrozenWasteland
@@ -2,6 +2,7 @@
 
 #include <string.h>
 #include "dsp/common.hpp"
+#include "mirror.hpp"
 
 
 namespace FrozenWasteland {
@@ -285,6 +286,159 @@ struct MultiTapDoubleRingBuffer {
 };
 
 
+/** DoubleRingBuffer over MirroredMemory. Where the memory is mirrored every sample is stored once and endIncr() copies nothing,
+halving the memory and write bandwidth. Otherwise it keeps both copies itself, exactly as DoubleRingBuffer does.
+S must be a power of 2, and S * sizeof(T) a whole number of pages to be mirrored.
+The block is allocated and faulted in by the constructor, so build large ones off the engine thread.
+If no memory could be had at all, allocated is false and data is NULL, and the buffer must not be used.
+*/
+template <typename T, size_t S>
+struct MirroredRingBuffer {
+	MirroredMemory memory;
+	T *data;
+	bool allocated;
+	size_t start = 0;
+	size_t end = 0;
+
+	MirroredRingBuffer() {
+		allocated = memory.allocate(sizeof(T) * S);
+		data = (T *) memory.data;
+	}
+
+	size_t mask(size_t i) const {
+		return i & (S - 1);
+	}
+	void push(T t) {
+		size_t i = mask(end++);
+		data[i] = t;
+		if (!memory.mirrored)
+			data[i + S] = t;
+	}
+	T shift() {
+		return data[mask(start++)];
+	}
+	void clear() {
+		start = end;
+	}
+	bool empty() const {
+		return start == end;
+	}
+	bool full() const {
+		return end - start == S;
+	}
+	size_t size() const {
+		return end - start;
+	}
+	size_t capacity() const {
+		return S - size();
+	}
+	/** Returns a pointer to S consecutive elements for appending.
+	If any data is appended, you must call endIncr afterwards.
+	*/
+	T *endData() {
+		return &data[mask(end)];
+	}
+	void endIncr(size_t n) {
+		if (!memory.mirrored) {
+			size_t e = mask(end);
+			size_t e1 = e + n;
+			size_t e2 = (e1 < S) ? e1 : S;
+			std::memcpy(&data[S + e], &data[e], sizeof(T) * (e2 - e));
+			if (e1 > S) {
+				std::memcpy(data, &data[S], sizeof(T) * (e1 - S));
+			}
+		}
+		end += n;
+	}
+	/** Returns a pointer to S consecutive elements for consumption
+	If any data is consumed, call startIncr afterwards.
+	*/
+	const T *startData() const {
+		return &data[mask(start)];
+	}
+	void startIncr(size_t n) {
+		start += n;
+	}
+};
+
+/** MultiTapDoubleRingBuffer over MirroredMemory, see MirroredRingBuffer. Provides N # of taps into the array. */
+template <typename T, size_t S, int N>
+struct MirroredMultiTapRingBuffer {
+	MirroredMemory memory;
+	T *data;
+	bool allocated;
+	size_t start[N];
+	size_t end = 0;
+
+	MirroredMultiTapRingBuffer() {
+		allocated = memory.allocate(sizeof(T) * S);
+		data = (T *) memory.data;
+		for(int i=0;i<N;i++) {
+			start[i]= 0;
+		}
+	}
+
+	size_t mask(size_t i) const {
+		return i & (S - 1);
+	}
+	void push(T t) {
+		size_t i = mask(end++);
+		data[i] = t;
+		if (!memory.mirrored)
+			data[i + S] = t;
+	}
+	T shift(int tap) {
+		return data[mask(start[tap]++)];
+	}
+	void clear() {
+		for(int i=0;i<N;i++) {
+			start[i] = end;
+		}
+	}
+	bool empty(int tap) const {
+		return start[tap] == end;
+	}
+	bool full(int tap) const {
+		return end - start[tap] == S;
+	}
+	size_t size(int tap) const {
+		return end - start[tap];
+	}
+	size_t capacity(int tap) const {
+		return S - size(tap);
+	}
+	T *endData() {
+		return &data[mask(end)];
+	}
+	void endIncr(size_t n) {
+		if (!memory.mirrored) {
+			size_t e = mask(end);
+			size_t e1 = e + n;
+			size_t e2 = (e1 < S) ? e1 : S;
+			std::memcpy(&data[S + e], &data[e], sizeof(T) * (e2 - e));
+			if (e1 > S) {
+				std::memcpy(data, &data[S], sizeof(T) * (e1 - S));
+			}
+		}
+		end += n;
+	}
+	const T *startData(int tap) const {
+		return &data[mask(start[tap])];
+	}
+	void startIncr(int tap, size_t n) {
+		start[tap] += n;
+	}
+	/** The sample pushed lag samples before the newest, for reading outside the taps. lag must be below stored(). */
+	const T &past(size_t lag) const {
+		return data[mask(end - 1 - lag)];
+	}
+	/** How many samples can be read with past() */
+	size_t stored() const {
+		return end < S ? end : S;
+	}
+};
+
+
 
 /** A cyclic buffer which maintains a valid linear array of size S by sliding along a larger block of size N.
 The linear array of S elements are moved back to the start of the block once it outgrows past the end.
@@ -153,4 +153,15 @@ class StateVariableFilterState
 public:
     T z1 = 0;		// the delay line buffer
     T z2 = 0;		// the delay line buffer
+
+    /**
+     * Zero the delay line once it has decayed to nothing.
+     * monitor is a frozenwasteland::DenormalMonitor
+     */
+    template <typename M>
+    void flushDenormals(M& monitor)
+    {
+        monitor.flush(z1);
+        monitor.flush(z2);
+    }
 };
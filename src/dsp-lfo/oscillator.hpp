@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cmath>
+
+namespace frozenwasteland {
+namespace dsp {
+
+/** Number of oscillators advanced together by LowFrequencyOscillator4.
+All per-lane loops are fixed length and branch free so the compiler can keep them in one SSE register.
+*/
+static const int LFO_LANES = 4;
+
+/** sin(2 * pi * x) for any x.
+Folded into a quarter period and evaluated with a 9th order polynomial (error < 4e-6), so it vectorizes where sinf() can't.
+*/
+inline float lfoSin2Pi(float x) {
+	x -= std::floor(x + 0.5f); // [-0.5, 0.5)
+	x = x > 0.25f ? 0.5f - x : x;
+	x = x < -0.25f ? -0.5f - x : x;
+	float y = x * float(2 * M_PI);
+	float y2 = y * y;
+	return y * (1.0f + y2 * (-1.0f / 6.0f + y2 * (1.0f / 120.0f + y2 * (-1.0f / 5040.0f + y2 * (1.0f / 362880.0f)))));
+}
+
+/** Shared waveshape evaluation for the skewsaw/sine family used by the LFOs.
+Phase must be in [0, 1). Skew and waveSlope are expected to be clamped to [0, 1] by the caller.
+Offset shifts the output to the unipolar 0..2 range.
+*/
+inline float lfoSine(float phase, bool offset) {
+	// Sin wave is 90 degrees out of phase with other waves
+	return offset ? 1.0f - lfoSin2Pi(phase) : lfoSin2Pi(phase - 0.25f);
+}
+
+inline float lfoSkewsaw(float phase, float skew, float waveSlope, bool offset) {
+	float rising = skew > 0.0f ? 2.0f * phase / skew : 2.0f; //Avoid /0 error
+	float inverseSkew = 1.0f - skew;
+	float falling = 2.0f * (1.0f - (phase - skew) / (inverseSkew > 0.0f ? inverseSkew : 1.0f));
+	float saw = (phase <= skew ? rising : falling) - (offset ? 0.0f : 1.0f);
+	return saw + (lfoSine(phase, offset) - saw) * waveSlope;
+}
+
+inline float lfoSquare(float phase, float pw, float waveSlope, bool offset) {
+	float sqr = (phase < pw ? 1.0f : -1.0f) + (offset ? 1.0f : 0.0f);
+	return sqr + (lfoSine(phase, offset) - sqr) * waveSlope;
+}
+
+/** Evaluates the skewsaw/sine shape for LFO_LANES phases at once */
+inline void lfoSkewsaw4(const float *phase, const float *skew, const float *waveSlope, bool offset, float *out) {
+	for (int i = 0; i < LFO_LANES; i++) {
+		out[i] = lfoSkewsaw(phase[i], skew[i], waveSlope[i], offset);
+	}
+}
+
+inline void lfoSquare4(const float *phase, const float *pw, const float *waveSlope, bool offset, float *out) {
+	for (int i = 0; i < LFO_LANES; i++) {
+		out[i] = lfoSquare(phase[i], pw[i], waveSlope[i], offset);
+	}
+}
+
+/** Four skewsaw/sine LFOs stepped together.
+Each lane has its own pitch, base phase, skew and wave slope. Pitch is only converted to frequency for lanes whose pitch changed.
+*/
+struct LowFrequencyOscillator4 {
+	alignas(16) float basePhase[LFO_LANES] = {};
+	alignas(16) float phase[LFO_LANES] = {};
+	alignas(16) float pitch[LFO_LANES] = {};
+	alignas(16) float freq[LFO_LANES] = {1.0f, 1.0f, 1.0f, 1.0f};
+	alignas(16) float skew[LFO_LANES] = {0.5f, 0.5f, 0.5f, 0.5f}; // Triangle
+	alignas(16) float waveSlope[LFO_LANES] = {1.0f, 1.0f, 1.0f, 1.0f}; //Original (1 is sin)
+	bool offset = false;
+
+	void setPitch(int lane, float newPitch) {
+		newPitch = fminf(newPitch, 8.0f);
+		if (newPitch != pitch[lane]) {
+			pitch[lane] = newPitch;
+			freq[lane] = exp2f(newPitch);
+		}
+	}
+
+	void setBasePhase(int lane, float initialPhase) {
+		//Apply change, then remember
+		float p = phase[lane] + initialPhase - basePhase[lane];
+		if (p >= 1.0f)
+			p -= 1.0f;
+		else if (p < 0.0f)
+			p += 1.0f;
+		phase[lane] = p;
+		basePhase[lane] = initialPhase;
+	}
+
+	void step(float dt) {
+		for (int i = 0; i < LFO_LANES; i++) {
+			float deltaPhase = fminf(freq[i] * dt, 0.5f);
+			float p = phase[i] + deltaPhase;
+			phase[i] = p >= 1.0f ? p - 1.0f : p;
+		}
+	}
+
+	void skewsaw(float *out) const {
+		lfoSkewsaw4(phase, skew, waveSlope, offset, out);
+	}
+};
+
+} // namespace dsp
+} // namespace frozenwasteland
@@ -1,24 +1,27 @@
 #pragma once
 
+#include <random>
+
 namespace frozenwasteland {
 namespace dsp {
 
-struct Generator {
-	float _current = 0.0;
-
-	Generator() {}
-	virtual ~Generator() {}
+/** Process wide source of seeds, so every generator starts somewhere different */
+class Seeds {
+private:
+	std::mt19937 _generator;
+	Seeds();
+	unsigned int _next();
 
-	float current() {
-		return _current;
-	}
+public:
+	Seeds(const Seeds&) = delete;
+	void operator=(const Seeds&) = delete;
+	static Seeds& getInstance();
 
-	float next() {
-		return _current = _next();
-	}
-
-	virtual float _next() = 0;
+	static unsigned int next();
 };
 
+/** Values the noise generators make per refill of their internal block */
+static const int NOISE_BLOCK_SIZE = 32;
+
 } // namespace dsp
 } // namespace frozenwasteland
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cmath>
+
+namespace frozenwasteland {
+namespace dsp {
+
+/** Picks an index with probability proportional to its weight.
+Weights are set every sample but the cumulative table is only rebuilt when one of them (or the scaling) actually changes, so a draw is a binary search of cached sums.
+This is a search of the cumulative sums rather than a Walker alias table so that a random value always maps to the same index as a linear scan would,
+and an external random CV still sweeps through the entries in order.
+*/
+template <int SIZE>
+struct WeightedChoice {
+	float _weights[SIZE] = {};
+	float _cumulative[SIZE] = {};
+	float _scaling = 0.0f;
+	bool _dirty = true;
+
+	void setWeight(int index, float weight) {
+		if (weight != _weights[index]) {
+			_weights[index] = weight;
+			_dirty = true;
+		}
+	}
+
+	float getWeight(int index) const {
+		return _weights[index];
+	}
+
+	/** 0 uses the weights as they are, 1 flattens them logarithmically so low weights count for more */
+	void setScaling(float scaling) {
+		if (scaling != _scaling) {
+			_scaling = scaling;
+			_dirty = true;
+		}
+	}
+
+	void rebuild() {
+		float total = 0.0f;
+		for (int i = 0; i < SIZE; i++) {
+			float weight = _weights[i];
+			if (_scaling != 0.0f) {
+				weight = (1 - _scaling) * weight + _scaling * std::log10(weight * 10 + 1);
+			}
+			total += weight;
+			_cumulative[i] = total;
+		}
+		_dirty = false;
+	}
+
+	/** Index for a random value in [0, 1), or -1 when every weight is 0 */
+	int choose(float random) {
+		if (_dirty)
+			rebuild();
+		float target = random * _cumulative[SIZE - 1];
+		int low = 0;
+		int high = SIZE;
+		while (low < high) {
+			int middle = (low + high) / 2;
+			if (target < _cumulative[middle])
+				high = middle;
+			else
+				low = middle + 1;
+		}
+		return low < SIZE ? low : -1;
+	}
+};
+
+} // namespace dsp
+} // namespace frozenwasteland
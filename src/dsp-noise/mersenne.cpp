@@ -0,0 +1,261 @@
+#include <stddef.h>
+#include <vector>
+
+#include "mersenne.hpp"
+
+using namespace frozenwasteland::dsp;
+
+
+namespace {
+
+const int MT_N = MersenneTwister::MT_N;
+const int MT_M = MersenneTwister::MT_M;
+/** Dimension of the MT19937 state, and degree of its characteristic polynomial */
+const int MT_DEGREE = 19937;
+/** Words for a polynomial of degree below 2 * MT_DEGREE, with padding for unaligned reads */
+const int POLY_WORDS = (2 * MT_DEGREE + 63) / 64 + 2;
+
+typedef std::vector<uint64_t> Bits;
+
+bool getBit(const Bits &bits, int i) {
+	return (bits[i >> 6] >> (i & 63)) & 1;
+}
+
+void flipBit(Bits &bits, int i) {
+	bits[i >> 6] ^= uint64_t(1) << (i & 63);
+}
+
+/** 64 bits starting at bit position pos */
+uint64_t getWord(const Bits &bits, int pos) {
+	int word = pos >> 6;
+	int shift = pos & 63;
+	if (shift == 0)
+		return bits[word];
+	return (bits[word] >> shift) | (bits[word + 1] << (64 - shift));
+}
+
+/** dst ^= src << shift, for the first `words` words of src */
+void xorShifted(Bits &dst, const Bits &src, int shift, int words) {
+	int wordShift = shift >> 6;
+	int bitShift = shift & 63;
+	for (int i = words - 1; i >= 0; i--) {
+		if (i + wordShift + 1 < (int)dst.size() && bitShift)
+			dst[i + wordShift + 1] ^= src[i] >> (64 - bitShift);
+		if (i + wordShift < (int)dst.size())
+			dst[i + wordShift] ^= src[i] << bitShift;
+	}
+}
+
+/** Berlekamp-Massey over GF(2). Returns the exponents of the nonzero terms, below MT_DEGREE, of the characteristic polynomial of MT19937. */
+std::vector<int> computeCharacteristicTerms() {
+	const int length = 2 * MT_DEGREE;
+
+	// Bit 0 of each state word, in generation order. Stored reversed so the discrepancy is a word-wise dot product.
+	MersenneTwister twister;
+	twister.seed(5489UL);
+	Bits reversed(length / 64 + 4, 0);
+	for (int n = 0; n < length; n++) {
+		if (n % MT_N == 0)
+			twister.twist();
+		if (twister._mt[n % MT_N] & 1)
+			flipBit(reversed, length - 1 - n);
+	}
+
+	int words = length / 64 + 4;
+	Bits c(words, 0), b(words, 0);
+	c[0] = b[0] = 1;
+	int l = 0, m = 1;
+	for (int n = 0; n < length; n++) {
+		// s[n] + sum c[i] s[n - i], where s[n - i] is reversed[length - 1 - n + i]
+		int offset = length - 1 - n;
+		uint64_t sum = 0;
+		for (int w = 0; w <= l / 64; w++) {
+			sum ^= c[w] & getWord(reversed, offset + w * 64);
+		}
+		if (!__builtin_parityll(sum)) {
+			m++;
+		} else if (2 * l <= n) {
+			Bits t = c;
+			xorShifted(c, b, m, words - (m >> 6) - 1);
+			l = n + 1 - l;
+			b = t;
+			m = 1;
+		} else {
+			xorShifted(c, b, m, words - (m >> 6) - 1);
+			m++;
+		}
+	}
+
+	// The connection polynomial is the reverse of the characteristic polynomial
+	std::vector<int> terms;
+	for (int i = 1; i <= l; i++) {
+		if (getBit(c, i))
+			terms.push_back(l - i);
+	}
+	return terms;
+}
+
+const std::vector<int> &characteristicTerms() {
+	static const std::vector<int> terms = computeCharacteristicTerms();
+	return terms;
+}
+
+/** Reduces every bit at or above `top` (down to MT_DEGREE) using x^MT_DEGREE = sum of the lower terms */
+void reduce(Bits &p, int top) {
+	const std::vector<int> &terms = characteristicTerms();
+	for (int i = top; i >= MT_DEGREE; i--) {
+		if (getBit(p, i)) {
+			flipBit(p, i);
+			for (size_t t = 0; t < terms.size(); t++) {
+				flipBit(p, i - MT_DEGREE + terms[t]);
+			}
+		}
+	}
+}
+
+uint64_t spreadBits(uint32_t x) {
+	uint64_t v = x;
+	v = (v | (v << 16)) & 0x0000ffff0000ffffULL;
+	v = (v | (v << 8)) & 0x00ff00ff00ff00ffULL;
+	v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	v = (v | (v << 2)) & 0x3333333333333333ULL;
+	v = (v | (v << 1)) & 0x5555555555555555ULL;
+	return v;
+}
+
+/** p = p^2 mod phi. Squaring over GF(2) just spreads the bits out. */
+void squareMod(Bits &p) {
+	const int lowWords = (MT_DEGREE + 63) / 64;
+	for (int i = lowWords - 1; i >= 0; i--) {
+		uint64_t w = p[i];
+		p[2 * i + 1] = spreadBits(uint32_t(w >> 32));
+		p[2 * i] = spreadBits(uint32_t(w));
+	}
+	reduce(p, 2 * MT_DEGREE - 2);
+}
+
+/** p = p * x mod phi */
+void multiplyByXMod(Bits &p) {
+	const int lowWords = (MT_DEGREE + 63) / 64;
+	for (int i = lowWords; i > 0; i--) {
+		p[i] = (p[i] << 1) | (p[i - 1] >> 63);
+	}
+	p[0] <<= 1;
+	reduce(p, MT_DEGREE);
+}
+
+/** State as a ring of words, oldest first from idx, stepped one word at a time */
+struct RingState {
+	uint32_t mt[MT_N];
+	int idx;
+
+	void step() {
+		int next = idx + 1 < MT_N ? idx + 1 : 0;
+		int middle = idx + MT_M < MT_N ? idx + MT_M : idx + MT_M - MT_N;
+		mt[idx] = MersenneTwister::twistWord(mt[idx], mt[next], mt[middle]);
+		idx = next;
+	}
+
+	void add(const RingState &other) {
+		for (int j = 0; j < MT_N; j++) {
+			mt[(idx + j) % MT_N] ^= other.mt[(other.idx + j) % MT_N];
+		}
+	}
+};
+
+} // namespace
+
+
+void MersenneTwister::seed(uint64_t value) {
+	_seed = value;
+	_position = 0;
+	_index = MT_N;
+
+	uint32_t first = value <= 0xffffffffULL ? uint32_t(value) : 19650218UL;
+	_mt[0] = first;
+	for (int i = 1; i < MT_N; i++) {
+		_mt[i] = 1812433253UL * (_mt[i - 1] ^ (_mt[i - 1] >> 30)) + i;
+	}
+	if (value <= 0xffffffffULL)
+		return;
+
+	// init_by_array() with the seed's two halves as the key
+	uint32_t key[2] = {uint32_t(value), uint32_t(value >> 32)};
+	int i = 1, j = 0;
+	for (int k = MT_N; k; k--) {
+		_mt[i] = (_mt[i] ^ ((_mt[i - 1] ^ (_mt[i - 1] >> 30)) * 1664525UL)) + key[j] + j;
+		i++;
+		j++;
+		if (i >= MT_N) {
+			_mt[0] = _mt[MT_N - 1];
+			i = 1;
+		}
+		if (j >= 2)
+			j = 0;
+	}
+	for (int k = MT_N - 1; k; k--) {
+		_mt[i] = (_mt[i] ^ ((_mt[i - 1] ^ (_mt[i - 1] >> 30)) * 1566083941UL)) - i;
+		i++;
+		if (i >= MT_N) {
+			_mt[0] = _mt[MT_N - 1];
+			i = 1;
+		}
+	}
+	_mt[0] = 0x80000000UL;
+}
+
+void MersenneTwister::discard(uint64_t count) {
+	_position += count;
+
+	uint64_t inBlock = (uint64_t)(MT_N - _index);
+	if (count <= inBlock) {
+		_index += (int)count;
+		return;
+	}
+	count -= inBlock;
+
+	// Skip whole blocks, keeping the one the new position falls in to twist normally
+	uint64_t blocks = (count - 1) / MT_N;
+	if (blocks >= JUMP_MIN_BLOCKS) {
+		jump(blocks);
+	} else {
+		for (uint64_t b = 0; b < blocks; b++) {
+			twist();
+		}
+	}
+	twist();
+	temper();
+	_index = (int)(count - blocks * MT_N);
+}
+
+void MersenneTwister::jump(uint64_t blocks) {
+	uint64_t steps = blocks * MT_N;
+
+	// g = x^steps mod phi
+	Bits g(POLY_WORDS, 0);
+	g[0] = 1;
+	for (int bit = 63; bit >= 0; bit--) {
+		squareMod(g);
+		if ((steps >> bit) & 1)
+			multiplyByXMod(g);
+	}
+
+	// New state = g(f) applied to the current one, by Horner's rule
+	RingState state;
+	RingState result;
+	for (int i = 0; i < MT_N; i++) {
+		state.mt[i] = _mt[i];
+		result.mt[i] = 0;
+	}
+	state.idx = 0;
+	result.idx = 0;
+	for (int i = MT_DEGREE - 1; i >= 0; i--) {
+		result.step();
+		if (getBit(g, i))
+			result.add(state);
+	}
+	for (int i = 0; i < MT_N; i++) {
+		_mt[i] = result.mt[(result.idx + i) % MT_N];
+	}
+	_index = MT_N;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace frozenwasteland {
+namespace dsp {
+
+/** MT19937, giving the same sequence as the reference init_genrand()/genrand_int32() for 32 bit seeds.
+The state is twisted and tempered a whole block at a time in fixed length loops without data dependent branches, so the compiler can vectorize them.
+Seeds above 32 bits go through init_by_array(). discard() skips ahead in O(log n) state updates using the jump polynomial method
+(Haramoto et al., "Efficient Jump Ahead for F2-Linear Random Number Generators"), so a position can be restored without replaying it.
+*/
+struct MersenneTwister {
+	static const int MT_N = 624;
+	static const int MT_M = 397;
+	static const uint32_t MATRIX_A = 0x9908b0dfUL;
+	static const uint32_t UPPER_MASK = 0x80000000UL;
+	static const uint32_t LOWER_MASK = 0x7fffffffUL;
+	/** Below this many skipped blocks, twisting through them is cheaper than a jump */
+	static const uint64_t JUMP_MIN_BLOCKS = 131072;
+
+	uint32_t _mt[MT_N];
+	uint32_t _block[MT_N];
+	int _index = MT_N;
+	uint64_t _seed = 0;
+	uint64_t _position = 0;
+
+	MersenneTwister() {
+		seed(5489UL); // reference default
+	}
+
+	void seed(uint64_t value);
+
+	/** Seed the generator was last started from */
+	uint64_t getSeed() const {
+		return _seed;
+	}
+
+	/** Numbers drawn (or skipped) since seeding */
+	uint64_t getPosition() const {
+		return _position;
+	}
+
+	uint32_t next() {
+		if (_index >= MT_N) {
+			twist();
+			temper();
+		}
+		_position++;
+		return _block[_index++];
+	}
+
+	/** Uniform in [0, 1), as genrand_real2() */
+	double nextReal() {
+		return next() * (1.0 / 4294967296.0);
+	}
+
+	/** Skips count numbers */
+	void discard(uint64_t count);
+
+	/** Same state as seed(value) followed by drawing position numbers */
+	void seek(uint64_t value, uint64_t position) {
+		seed(value);
+		discard(position);
+	}
+
+	static uint32_t twistWord(uint32_t upper, uint32_t lower, uint32_t m) {
+		uint32_t y = (upper & UPPER_MASK) | (lower & LOWER_MASK);
+		return m ^ (y >> 1) ^ (-(y & 1u) & MATRIX_A);
+	}
+
+	/** Generates the next MT_N words of state */
+	void twist() {
+		int kk = 0;
+		for (; kk < MT_N - MT_M; kk++) {
+			_mt[kk] = twistWord(_mt[kk], _mt[kk + 1], _mt[kk + MT_M]);
+		}
+		for (; kk < MT_N - 1; kk++) {
+			_mt[kk] = twistWord(_mt[kk], _mt[kk + 1], _mt[kk + (MT_M - MT_N)]);
+		}
+		_mt[MT_N - 1] = twistWord(_mt[MT_N - 1], _mt[0], _mt[MT_M - 1]);
+		_index = 0;
+	}
+
+	void temper() {
+		for (int i = 0; i < MT_N; i++) {
+			uint32_t y = _mt[i];
+			y ^= (y >> 11);
+			y ^= (y << 7) & 0x9d2c5680UL;
+			y ^= (y << 15) & 0xefc60000UL;
+			y ^= (y >> 18);
+			_block[i] = y;
+		}
+	}
+
+	/** Advances the state by blocks * MT_N words without producing them */
+	void jump(uint64_t blocks);
+};
+
+} // namespace dsp
+} // namespace frozenwasteland
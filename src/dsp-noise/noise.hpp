@@ -1,76 +1,128 @@
 #pragma once
 
-#include <random>
+#include <cmath>
 
 #include "base.hpp"
+#include "random.hpp"
+#include "../dsp-lfo/oscillator.hpp"
 
 namespace frozenwasteland {
 namespace dsp {
 
-class Seeds {
-private:
-	std::mt19937 _generator;
-	Seeds();
-	unsigned int _next();
+/** Per sample access to a noise generator that works in blocks.
+TGenerator provides fill(); next() hands out a block of NOISE_BLOCK_SIZE values at a time, so there is no per sample dispatch or distribution object.
+*/
+template <class TGenerator>
+struct BufferedNoise {
+	float _block[NOISE_BLOCK_SIZE];
+	int _position = NOISE_BLOCK_SIZE;
+	float _current = 0.0f;
+
+	float current() {
+		return _current;
+	}
 
-public:
-	Seeds(const Seeds&) = delete;
-	void operator=(const Seeds&) = delete;
-	static Seeds& getInstance();
+	float next() {
+		if (_position >= NOISE_BLOCK_SIZE) {
+			static_cast<TGenerator*>(this)->fill(_block, NOISE_BLOCK_SIZE);
+			_position = 0;
+		}
+		return _current = _block[_position++];
+	}
 
-	static unsigned int next();
+	/** Drops buffered values, after a reseed */
+	void flush() {
+		_position = NOISE_BLOCK_SIZE;
+	}
 };
 
-struct NoiseGenerator : Generator {
-	std::minstd_rand _generator; // one of the faster options.
+/** Uniform white noise in [-1, 1) */
+struct WhiteNoiseGenerator : BufferedNoise<WhiteNoiseGenerator> {
+	RandomGenerator4 _random;
 
-	NoiseGenerator() : _generator(Seeds::next()) {}
+	void seed(uint64_t value) {
+		_random.seed(value);
+		flush();
+	}
+
+	void fill(float *out, int count) {
+		_random.fill(out, count);
+		for (int i = 0; i < count; i++) {
+			out[i] = out[i] * 2.0f - 1.0f;
+		}
+	}
 };
 
-struct WhiteNoiseGenerator : NoiseGenerator {
-	std::uniform_real_distribution<float> _uniform;
+/** Voss-McCartney pink noise: PINK_ROWS white values held for 1, 2, 4 ... samples, plus fresh white noise.
+Row k is redrawn on samples whose count has k trailing zeros, so exactly one row changes per sample and the sum is kept running.
+*/
+struct PinkNoiseGenerator : BufferedNoise<PinkNoiseGenerator> {
+	static const int PINK_ROWS = 7;
 
-	WhiteNoiseGenerator() : _uniform(-1.0, 1.0) {}
+	WhiteNoiseGenerator _white;
+	float _rows[PINK_ROWS] = {};
+	float _sum = 0.0f;
+	uint32_t _count = 0;
 
-	virtual float _next() override {
-		return _uniform(_generator);
+	void seed(uint64_t value) {
+		_white.seed(value);
+		flush();
 	}
-};
 
-template<typename G>
-struct BasePinkNoiseGenerator : NoiseGenerator {
-	static const int _n = 7;
-	G _g;
-	G _gs[_n];
-	uint32_t _count = _g.next();
-
-	virtual float _next() override {
-		// See: http://www.firstpr.com.au/dsp/pink-noise/
-		float sum = _g.next();
-		for (int i = 0, bit = 1; i < _n; ++i, bit <<= 1) {
-			if (_count & bit) {
-				sum += _gs[i].next();
+	void fill(float *out, int count) {
+		for (int start = 0; start < count; start += NOISE_BLOCK_SIZE) {
+			int n = count - start < NOISE_BLOCK_SIZE ? count - start : NOISE_BLOCK_SIZE;
+			float updates[NOISE_BLOCK_SIZE];
+			_white.fill(out + start, n);
+			_white.fill(updates, n);
+			for (int i = 0; i < n; i++) {
+				// The guard bit stops at PINK_ROWS, which means no row changes this sample
+				int row = __builtin_ctz(++_count | (1u << PINK_ROWS));
+				if (row < PINK_ROWS) {
+					_sum += updates[i] - _rows[row];
+					_rows[row] = updates[i];
+				}
+				out[start + i] = (_sum + out[start + i]) * (1.0f / (PINK_ROWS + 1));
 			}
-			else {
-				sum += _gs[i].current();
+			// Resum once a block so rounding in the running sum can't build up
+			_sum = 0.0f;
+			for (int k = 0; k < PINK_ROWS; k++) {
+				_sum += _rows[k];
 			}
 		}
-		++_count;
-		return sum / (float)(_n + 1);
 	}
 };
 
-struct PinkNoiseGenerator : BasePinkNoiseGenerator<WhiteNoiseGenerator> {};
-
-struct RedNoiseGenerator : BasePinkNoiseGenerator<PinkNoiseGenerator> {};
+/** Normally distributed noise (mean 0, deviation 1) by Box-Muller.
+Each block of uniforms gives a block of pairs, using the polynomial sine from the LFOs so the angle part vectorizes.
+A short fill only works out the pairs it needs; per sample callers should use next(), which pays for a whole block once per NOISE_BLOCK_SIZE values.
+*/
+struct GaussianNoiseGenerator : BufferedNoise<GaussianNoiseGenerator> {
+	RandomGenerator4 _random;
 
-struct GaussianNoiseGenerator : NoiseGenerator {
-	std::normal_distribution<float> _normal;
-
-	GaussianNoiseGenerator() : _normal(0, 1.0) {}
+	void seed(uint64_t value) {
+		_random.seed(value);
+		flush();
+	}
 
-	virtual float _next() override {
-		return _normal(_generator);
+	void fill(float *out, int count) {
+		while (count > 0) {
+			int n = count < NOISE_BLOCK_SIZE ? count : NOISE_BLOCK_SIZE;
+			int pairs = (n + 1) / 2;
+			float uniforms[NOISE_BLOCK_SIZE];
+			float normals[NOISE_BLOCK_SIZE];
+			_random.fill(uniforms, 2 * pairs);
+			for (int i = 0; i < pairs; i++) {
+				float radius = std::sqrt(-2.0f * std::log(1.0f - uniforms[i])); // 1 - u is never 0
+				normals[i] = radius * lfoSin2Pi(uniforms[i + pairs]);
+				normals[i + pairs] = radius * lfoSin2Pi(uniforms[i + pairs] + 0.25f);
+			}
+			for (int i = 0; i < n; i++) {
+				out[i] = normals[i];
+			}
+			out += n;
+			count -= n;
+		}
 	}
 };
 
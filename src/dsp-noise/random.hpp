@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "base.hpp"
+
+namespace frozenwasteland {
+namespace dsp {
+
+/** Per-instance pseudo random numbers (xoshiro128+).
+Each module owns one, so there is no shared state or locking between engine threads, and a given seed always gives the same sequence.
+*/
+struct RandomGenerator {
+	uint32_t _state[4];
+
+	RandomGenerator() {
+		seed(((uint64_t)Seeds::next() << 32) | Seeds::next());
+	}
+
+	explicit RandomGenerator(uint64_t value) {
+		seed(value);
+	}
+
+	/** Spreads a 64 bit seed over the state with splitmix64, so similar seeds still give unrelated sequences */
+	void seed(uint64_t value) {
+		for (int i = 0; i < 4; i += 2) {
+			uint64_t z = (value += 0x9e3779b97f4a7c15ULL);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			z ^= z >> 31;
+			_state[i] = (uint32_t)z;
+			_state[i + 1] = (uint32_t)(z >> 32);
+		}
+	}
+
+	static uint32_t rotl(uint32_t x, int k) {
+		return (x << k) | (x >> (32 - k));
+	}
+
+	uint32_t next() {
+		uint32_t result = _state[0] + _state[3];
+		uint32_t t = _state[1] << 9;
+		_state[2] ^= _state[0];
+		_state[3] ^= _state[1];
+		_state[1] ^= _state[2];
+		_state[0] ^= _state[3];
+		_state[2] ^= t;
+		_state[3] = rotl(_state[3], 11);
+		return result;
+	}
+
+	/** Uniform in [0, 1), from the top 24 bits (the low bits of xoshiro128+ are weaker) */
+	float uniform() {
+		return (next() >> 8) * (1.0f / 16777216.0f);
+	}
+
+	/** Fills out with count uniform [0, 1) values, for code that draws several numbers per event */
+	void fill(float *out, int count) {
+		for (int i = 0; i < count; i++) {
+			out[i] = uniform();
+		}
+	}
+};
+
+/** Number of xoshiro128+ streams stepped together by RandomGenerator4 */
+static const int RANDOM_LANES = 4;
+
+/** Four independent xoshiro128+ streams in structure of arrays layout.
+The state update is the same fixed length, branch free loop for every lane, so the compiler keeps it in one SSE register.
+Used for bulk noise, where one scalar stream would be the bottleneck.
+*/
+struct RandomGenerator4 {
+	alignas(16) uint32_t _s0[RANDOM_LANES];
+	alignas(16) uint32_t _s1[RANDOM_LANES];
+	alignas(16) uint32_t _s2[RANDOM_LANES];
+	alignas(16) uint32_t _s3[RANDOM_LANES];
+
+	RandomGenerator4() {
+		seed(((uint64_t)Seeds::next() << 32) | Seeds::next());
+	}
+
+	/** Each lane gets its own state from one scalar generator */
+	void seed(uint64_t value) {
+		RandomGenerator lanes(value);
+		for (int i = 0; i < RANDOM_LANES; i++) {
+			_s0[i] = lanes.next();
+			_s1[i] = lanes.next();
+			_s2[i] = lanes.next();
+			_s3[i] = lanes.next() | 1; // never all zero
+		}
+	}
+
+	/** RANDOM_LANES uniform [0, 1) values */
+	void uniform4(float *out) {
+		for (int i = 0; i < RANDOM_LANES; i++) {
+			uint32_t result = _s0[i] + _s3[i];
+			uint32_t t = _s1[i] << 9;
+			_s2[i] ^= _s0[i];
+			_s3[i] ^= _s1[i];
+			_s1[i] ^= _s2[i];
+			_s0[i] ^= _s3[i];
+			_s2[i] ^= t;
+			_s3[i] = (_s3[i] << 11) | (_s3[i] >> 21);
+			out[i] = (result >> 8) * (1.0f / 16777216.0f);
+		}
+	}
+
+	void fill(float *out, int count) {
+		int i = 0;
+		for (; i + RANDOM_LANES <= count; i += RANDOM_LANES) {
+			uniform4(out + i);
+		}
+		if (i < count) {
+			float rest[RANDOM_LANES];
+			uniform4(rest);
+			for (int j = 0; j < RANDOM_LANES && i + j < count; j++) {
+				out[i + j] = rest[j];
+			}
+		}
+	}
+};
+
+} // namespace dsp
+} // namespace frozenwasteland
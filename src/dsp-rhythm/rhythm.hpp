@@ -0,0 +1,288 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace frozenwasteland {
+namespace dsp {
+
+/** One bit per step, step 0 in the least significant bit. */
+typedef uint64_t StepMask;
+
+static const int MAX_MASK_STEPS = 64;
+
+enum RhythmAlgorithm {
+	EUCLIDEAN_RHYTHM,
+	GOLOMB_RULER_RHYTHM,
+	BOOLEAN_LOGIC_RHYTHM
+};
+
+enum RhythmLogicMode {
+	AND_LOGIC,
+	OR_LOGIC,
+	XOR_LOGIC,
+	NAND_LOGIC,
+	NOR_LOGIC,
+	XNOR_LOGIC,
+	NUM_LOGIC_MODES
+};
+
+constexpr StepMask stepBit(int step) {
+	return StepMask(1) << step;
+}
+
+/** Mask with the first `steps` bits set */
+constexpr StepMask fullMask(int steps) {
+	return steps >= MAX_MASK_STEPS ? ~StepMask(0) : stepBit(steps) - 1;
+}
+
+/** Rotates a pattern of length `steps` towards later steps, wrapping at the pattern end */
+inline StepMask rotateMask(StepMask mask, int amount, int steps) {
+	if (steps <= 0)
+		return 0;
+	mask &= fullMask(steps);
+	amount %= steps;
+	if (amount == 0)
+		return mask;
+	return ((mask << amount) | (mask >> (steps - amount))) & fullMask(steps);
+}
+
+/** Steps covered by the precomputed pattern tables. Longer patterns are computed on demand. */
+static const int RHYTHM_TABLE_STEPS = 32;
+
+/** Bucket (Bresenham) distribution of `hits` over `steps`, as used by QAR. Step 0 is a hit whenever hits > 0. */
+constexpr StepMask bucketMaskFrom(int steps, int hits, int step, int bucket) {
+	return step >= steps ? 0 :
+		bucket + hits >= steps ? (StepMask(1) << step) | bucketMaskFrom(steps, hits, step + 1, bucket + hits - steps) :
+		bucketMaskFrom(steps, hits, step + 1, bucket + hits);
+}
+
+constexpr StepMask bucketMask(int steps, int hits) {
+	return bucketMaskFrom(steps, hits, 0, steps - 1);
+}
+
+/** Level distribution used by the original Quad Euclidean Rhythm: the rests are dealt out in rounds of one per hit, so gaps are front loaded.
+Every step is a hit when hits >= steps.
+*/
+constexpr StepMask levelMaskFrom(int hits, int fullLevels, int remainder, int hit, int step) {
+	return hit >= hits ? 0 : (StepMask(1) << step) | levelMaskFrom(hits, fullLevels, remainder, hit + 1, step + 1 + fullLevels + (hit < remainder ? 1 : 0));
+}
+
+constexpr StepMask levelMask(int steps, int hits) {
+	return hits <= 0 || steps <= 0 ? 0 :
+		hits >= steps ? fullMask(steps) :
+		levelMaskFrom(hits, (steps - hits) / hits, (steps - hits) % hits, 0, 0);
+}
+
+template <int... I>
+struct RhythmIndices {};
+
+template <class A, class B>
+struct ConcatRhythmIndices;
+
+template <int... A, int... B>
+struct ConcatRhythmIndices<RhythmIndices<A...>, RhythmIndices<B...> > {
+	typedef RhythmIndices<A..., (int(sizeof...(A)) + B)...> type;
+};
+
+/** 0..N-1, built in halves to keep template recursion shallow */
+template <int N>
+struct MakeRhythmIndices {
+	typedef typename ConcatRhythmIndices<typename MakeRhythmIndices<N / 2>::type, typename MakeRhythmIndices<N - N / 2>::type>::type type;
+};
+
+template <>
+struct MakeRhythmIndices<0> {
+	typedef RhythmIndices<> type;
+};
+
+template <>
+struct MakeRhythmIndices<1> {
+	typedef RhythmIndices<0> type;
+};
+
+/** Every (steps, hits) pattern up to RHYTHM_TABLE_STEPS, indexed by steps * (RHYTHM_TABLE_STEPS + 1) + hits */
+template <class Indices>
+struct RhythmTables;
+
+template <int... I>
+struct RhythmTables<RhythmIndices<I...> > {
+	static constexpr StepMask bucket[sizeof...(I)] = {bucketMask(I / (RHYTHM_TABLE_STEPS + 1), I % (RHYTHM_TABLE_STEPS + 1))...};
+	static constexpr StepMask level[sizeof...(I)] = {levelMask(I / (RHYTHM_TABLE_STEPS + 1), I % (RHYTHM_TABLE_STEPS + 1))...};
+};
+
+template <int... I>
+constexpr StepMask RhythmTables<RhythmIndices<I...> >::bucket[sizeof...(I)];
+
+template <int... I>
+constexpr StepMask RhythmTables<RhythmIndices<I...> >::level[sizeof...(I)];
+
+typedef RhythmTables<MakeRhythmIndices<(RHYTHM_TABLE_STEPS + 1) * (RHYTHM_TABLE_STEPS + 1)>::type> PatternTables;
+
+inline bool inPatternTable(int steps, int hits) {
+	return steps >= 0 && steps <= RHYTHM_TABLE_STEPS && hits >= 0 && hits <= RHYTHM_TABLE_STEPS;
+}
+
+/** Euclidean pattern starting on step 0, QAR style */
+inline StepMask euclideanMask(int steps, int hits) {
+	return inPatternTable(steps, hits) ? PatternTables::bucket[steps * (RHYTHM_TABLE_STEPS + 1) + hits] : bucketMask(steps, hits);
+}
+
+/** Euclidean pattern starting on step 0, original Quad Euclidean Rhythm style */
+inline StepMask levelEuclideanMask(int steps, int hits) {
+	return inPatternTable(steps, hits) ? PatternTables::level[steps * (RHYTHM_TABLE_STEPS + 1) + hits] : levelMask(steps, hits);
+}
+
+/** Positions of a pattern's hits once it is moved `shift` steps later in a track of `steps`, in pattern order. Returns the hit count. */
+inline int patternLocations(StepMask pattern, int shift, int steps, int *locations) {
+	int count = 0;
+	for (StepMask m = pattern; m; m &= m - 1) {
+		locations[count++] = (__builtin_ctzll(m) + shift) % steps;
+	}
+	return count;
+}
+
+/** Beat mask of a list of step positions */
+inline StepMask locationsMask(const int *locations, int count) {
+	StepMask mask = 0;
+	for (int i = 0; i < count; i++) {
+		mask |= stepBit(locations[i]);
+	}
+	return mask;
+}
+
+inline StepMask logicMask(StepMask a, StepMask b, int mode, int steps) {
+	StepMask mask = 0;
+	switch (mode) {
+		case AND_LOGIC : mask = a & b; break;
+		case OR_LOGIC : mask = a | b; break;
+		case XOR_LOGIC : mask = a ^ b; break;
+		case NAND_LOGIC : mask = ~(a & b); break;
+		case NOR_LOGIC : mask = ~(a | b); break;
+		case XNOR_LOGIC : mask = ~(a ^ b); break;
+	}
+	return mask & fullMask(steps);
+}
+
+/** Golomb rulers of increasing order. Rulers of the same order are alternates. */
+static const int NUM_RULERS = 10;
+static const int MAX_RULER_ORDER = 6;
+constexpr int rulerOrders[NUM_RULERS] = {1,2,3,4,5,5,6,6,6,6};
+constexpr int rulerLengths[NUM_RULERS] = {0,1,3,6,11,11,17,17,17,17};
+constexpr int rulers[NUM_RULERS][MAX_RULER_ORDER] = {{0},
+													{0,1},
+													{0,1,3},
+													{0,1,4,6},
+													{0,1,4,9,11},
+													{0,2,7,8,11},
+													{0,1,4,10,12,17},
+													{0,1,4,10,15,17},
+													{0,1,8,11,13,17},
+													{0,1,8,12,14,17}};
+
+/** Largest ruler, at or below `ruler`, whose marks fit in `steps` */
+constexpr int fitRuler(int ruler, int steps) {
+	return ruler > 0 && rulerLengths[ruler] + 1 > steps ? fitRuler(ruler - 1, steps) : ruler;
+}
+
+/** Ruler marks are spread out so low order rulers still fill the pattern */
+constexpr int rulerSpacing(int ruler, int steps) {
+	return (steps / (rulerLengths[ruler] + 1)) + (steps % (rulerLengths[ruler] + 1) == 0 ? 0 : 1);
+}
+
+/** Places the largest ruler at or below `ruler` that fits after `pad` steps, then moves it `offset` steps later.
+Spread marks can run past the end of the track and wrap, so placement depends on the whole track and isn't tabulated.
+Returns the number of marks, in ruler order.
+*/
+inline int golombLocations(int ruler, int steps, int pad, int offset, int *locations) {
+	int activeSteps = steps - pad;
+	ruler = fitRuler(ruler, activeSteps);
+	int spaceMultiplier = rulerSpacing(ruler, activeSteps);
+	for (int rulerIndex = 0; rulerIndex < rulerOrders[ruler]; rulerIndex++) {
+		int divisionLocation = rulers[ruler][rulerIndex] * spaceMultiplier + pad;
+		if (rulerIndex > 0) {
+			divisionLocation -= 1;
+		}
+		locations[rulerIndex] = (divisionLocation + offset) % steps;
+	}
+	return rulerOrders[ruler];
+}
+
+/** Sets or clears `division` accents spread by the bucket algorithm over the beats listed in beatLocation, starting at accentRotation */
+inline StepMask accentMask(const int *beatLocation, int division, int accentDivision, int accentRotation) {
+	StepMask accents = euclideanMask(division, accentDivision);
+	StepMask mask = 0;
+	for (int accentIndex = 0; accentIndex < division; accentIndex++) {
+		int location = beatLocation[(accentIndex + accentRotation) % division];
+		if ((accents >> accentIndex) & 1) {
+			mask |= stepBit(location);
+		} else {
+			mask &= ~stepBit(location);
+		}
+	}
+	return mask;
+}
+
+/** Accents spread over `count` beats with the level distribution, starting at accentRotation (original Quad rhythm modules) */
+inline StepMask levelAccentMask(const int *beatLocation, int count, int accentDivision, int accentRotation) {
+	StepMask mask = 0;
+	for (StepMask m = levelEuclideanMask(count, accentDivision); m; m &= m - 1) {
+		mask |= stepBit(beatLocation[(__builtin_ctzll(m) + accentRotation) % count]);
+	}
+	return mask;
+}
+
+/** Beat and accent step masks for TRACKS algorithmic rhythm tracks of up to STEPS steps.
+Boolean logic tracks combine the two tracks before them, so tracks must be generated in order.
+*/
+template <int TRACKS, int STEPS>
+struct RhythmCore {
+	static_assert(STEPS <= MAX_MASK_STEPS, "Step masks hold at most 64 steps");
+
+	StepMask beats[TRACKS] = {};
+	StepMask accents[TRACKS] = {};
+
+	bool beat(int track, int step) const {
+		return (beats[track] >> step) & 1;
+	}
+
+	bool accent(int track, int step) const {
+		return (accents[track] >> step) & 1;
+	}
+
+	void clear() {
+		for (int i = 0; i < TRACKS; i++) {
+			beats[i] = 0;
+			accents[i] = 0;
+		}
+	}
+
+	/** Rebuilds a track. Division is the hit count (Euclidean), ruler order (Golomb) or logic mode + 1 (boolean). */
+	void generate(int track, int algorithm, int steps, int division, int offset, int pad, int accentDivision, int accentRotation) {
+		if (steps <= 0)
+			return;
+
+		int beatLocation[MAX_MASK_STEPS] = {};
+		StepMask mask = 0;
+		if (algorithm == EUCLIDEAN_RHYTHM) {
+			StepMask pattern = euclideanMask(steps - pad, division);
+			patternLocations(pattern, offset + pad, steps, beatLocation);
+			mask = rotateMask(pattern << pad, offset, steps);
+		} else if (algorithm == GOLOMB_RULER_RHYTHM) {
+			int marks = golombLocations(division - 1 < MAX_RULER_ORDER ? division - 1 : MAX_RULER_ORDER, steps, pad, offset, beatLocation);
+			mask = locationsMask(beatLocation, marks);
+		} else if (track >= 2) {
+			StepMask pattern = logicMask(beats[track - 1], beats[track - 2], (division - 1) % NUM_LOGIC_MODES, steps);
+			for (StepMask m = pattern; m; m &= m - 1) {
+				int logicBeatIndex = __builtin_ctzll(m);
+				beatLocation[(logicBeatIndex + offset) % steps] = logicBeatIndex;
+			}
+			mask = rotateMask(pattern, offset, steps);
+		}
+
+		beats[track] = mask;
+		accents[track] = accentMask(beatLocation, division, accentDivision, accentRotation);
+	}
+};
+
+} // namespace dsp
+} // namespace frozenwasteland
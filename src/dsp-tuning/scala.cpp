@@ -0,0 +1,109 @@
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "tuning.hpp"
+
+using namespace frozenwasteland::dsp;
+
+
+namespace {
+
+/** Next line that isn't a comment, without its line ending */
+bool nextLine(std::istringstream &in, std::string &line) {
+	while (std::getline(in, line)) {
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		if (line.empty() || line[0] != '!')
+			return true;
+	}
+	return false;
+}
+
+/** A pitch line is cents if it has a decimal point, otherwise a ratio like 3/2 or a whole number like 2. Anything after the value is ignored. */
+bool parsePitch(const std::string &line, double &cents) {
+	std::istringstream in(line);
+	std::string value;
+	if (!(in >> value))
+		return false;
+
+	char *end;
+	if (value.find('.') != std::string::npos) {
+		cents = std::strtod(value.c_str(), &end);
+		return end != value.c_str();
+	}
+
+	long numerator = std::strtol(value.c_str(), &end, 10);
+	if (end == value.c_str())
+		return false;
+	long denominator = 1;
+	if (*end == '/') {
+		const char *start = end + 1;
+		denominator = std::strtol(start, &end, 10);
+		if (end == start)
+			return false;
+	}
+	if (numerator <= 0 || denominator <= 0)
+		return false;
+	cents = 1200.0 * std::log2((double)numerator / denominator);
+	return true;
+}
+
+} // namespace
+
+
+bool ScalaScale::load(const std::string &path, std::string &error) {
+	std::ifstream file(path.c_str());
+	if (!file.is_open()) {
+		error = "Could not open " + path;
+		return false;
+	}
+	std::stringstream text;
+	text << file.rdbuf();
+	return parse(text.str(), error);
+}
+
+bool ScalaScale::parse(const std::string &text, std::string &error) {
+	std::istringstream in(text);
+	std::string line;
+
+	if (!nextLine(in, line)) {
+		error = "No description line";
+		return false;
+	}
+	std::string newDescription = line;
+
+	if (!nextLine(in, line)) {
+		error = "No note count";
+		return false;
+	}
+	int count = std::atoi(line.c_str());
+	if (count <= 0) {
+		error = "Bad note count: " + line;
+		return false;
+	}
+
+	// The file lists every step above the root, ending with the period
+	std::vector<double> steps(1, 0.0);
+	for (int i = 0; i < count; i++) {
+		double cents;
+		if (!nextLine(in, line) || !parsePitch(line, cents)) {
+			std::ostringstream message;
+			message << "Bad or missing pitch " << (i + 1) << " of " << count;
+			error = message.str();
+			return false;
+		}
+		steps.push_back(cents);
+	}
+	if (steps.back() <= 0.0) {
+		error = "The period must be above the root";
+		return false;
+	}
+
+	description = newDescription;
+	periodCents = steps.back();
+	steps.pop_back();
+	cents = steps;
+	return true;
+}
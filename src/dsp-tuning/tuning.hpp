@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace frozenwasteland {
+namespace dsp {
+
+/** A scale of NOTES steps that repeats every period (1200 cents for an octave, 1901.955 for the 3:1 tritave of Bohlen-Pierce).
+Steps are given in cents above the period's root and compiled once into a volts table, so turning a note into a pitch is a lookup and an add.
+*/
+template <int NOTES>
+struct Tuning {
+	/** Volts above the root for each step, 0 for the root itself */
+	double volts[NOTES] = {};
+	double periodVolts = 1.0;
+
+	Tuning() {}
+
+	Tuning(const double *cents, double periodCents) {
+		set(cents, periodCents);
+	}
+
+	void set(const double *cents, double periodCents) {
+		for (int i = 0; i < NOTES; i++) {
+			volts[i] = cents[i] / 1200.0;
+		}
+		periodVolts = periodCents / 1200.0;
+	}
+
+	/** Every step the same size */
+	void setEqual(double periodCents) {
+		for (int i = 0; i < NOTES; i++) {
+			volts[i] = periodCents / 1200.0 * i / NOTES;
+		}
+		periodVolts = periodCents / 1200.0;
+	}
+
+	static Tuning equal(double periodCents) {
+		Tuning tuning;
+		tuning.setEqual(periodCents);
+		return tuning;
+	}
+
+	/** Pitch of note (0 to NOTES - 1) in the first period, for a scale whose root is key.
+	The scale is tuned from its root, so notes below the key come from the period below.
+	*/
+	double pitch(int note, int key) const {
+		int position = note - key;
+		double period = 0.0;
+		if (position < 0) {
+			position += NOTES;
+			period = -1.0;
+		}
+		return volts[position] + key * periodVolts / NOTES + period * periodVolts;
+	}
+};
+
+/** Steps of a Scala (.scl) file, in cents, with the root (0 cents) first. */
+struct ScalaScale {
+	std::string description;
+	std::vector<double> cents;
+	double periodCents = 1200.0;
+
+	int size() const {
+		return (int)cents.size();
+	}
+
+	/** Reads a .scl file. On failure returns false and leaves the reason in error. */
+	bool load(const std::string &path, std::string &error);
+
+	/** Parses the text of a .scl file */
+	bool parse(const std::string &text, std::string &error);
+
+	template <int NOTES>
+	bool compile(Tuning<NOTES> &tuning) const {
+		if (size() != NOTES)
+			return false;
+		tuning.set(cents.data(), periodCents);
+		return true;
+	}
+};
+
+} // namespace dsp
+} // namespace frozenwasteland
@@ -40,6 +40,13 @@ public:
     void setPeakGain(double peakGainDB);
     void setBiquad(int type, double Fc, double Q, double peakGain);
     float process(float in);
+    void reset() { z1 = z2 = 0.0; }
+    // Zeroes z1 and z2 once they have decayed to nothing, through a frozenwasteland::DenormalMonitor
+    template <typename M>
+    void flushDenormals(M &monitor) {
+        monitor.flush(z1);
+        monitor.flush(z2);
+    }
 
 protected:
     void calcBiquad(void);
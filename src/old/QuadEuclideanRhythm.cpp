@@ -2,8 +2,7 @@
 #include <string.h>
 #include "../FrozenWasteland.hpp"
 #include "dsp/digital.hpp"
-#define NUM_RULERS 10
-#define MAX_DIVISIONS 6
+#include "../dsp-rhythm/rhythm.hpp"
 #define TRACK_COUNT 4
 #define MAX_STEPS 18
 
@@ -102,8 +101,8 @@ struct QuadEuclideanRhythm : Module {
 		CHAIN_MODE_EMPLOYEE
 	};
 
-	bool beatMatrix[TRACK_COUNT][MAX_STEPS];
-	bool accentMatrix[TRACK_COUNT][MAX_STEPS];
+	frozenwasteland::dsp::StepMask beatMask[TRACK_COUNT] = {};
+	frozenwasteland::dsp::StepMask accentMask[TRACK_COUNT] = {};
 	int beatIndex[TRACK_COUNT];
 	int stepsCount[TRACK_COUNT];
 	float stepDuration[TRACK_COUNT];
@@ -132,10 +131,6 @@ struct QuadEuclideanRhythm : Module {
 			lastStepTime[i] = 0.0;
 			stepDuration[i] = 0.0;
 			running[i] = true;
-			for(unsigned j = 0; j < MAX_STEPS; j++) {
-				beatMatrix[i][j] = false;
-				accentMatrix[i][j] = false;
-			}
 		}		
 	}
 	void step() override;
@@ -200,9 +195,7 @@ struct QuadEuclideanRhythm : Module {
 
 void QuadEuclideanRhythm::step() {
 
-	int levelArray[16];
-	int accentLevelArray[16];
-	int beatLocation[16];
+	int beatLocation[MAX_STEPS];
 
 	//Set startup state
 	if(!initialized) {
@@ -233,15 +226,9 @@ void QuadEuclideanRhythm::step() {
 	maxStepCount = 0;
 
 	for(int trackNumber=0;trackNumber<4;trackNumber++) {
-		//clear out the matrix and levels
-		for(int j=0;j<16;j++)
-		{
-			beatMatrix[trackNumber][j] = false; 
-			accentMatrix[trackNumber][j] = false;
-			levelArray[j] = 0;		
-			accentLevelArray[j] = 0;	
-			beatLocation[j] = 0;
-		}
+		//clear out the masks
+		beatMask[trackNumber] = 0;
+		accentMask[trackNumber] = 0;
 
 		float stepsCountf = params[trackNumber * 6].value;
 		if(inputs[trackNumber * 7].active) {
@@ -305,47 +292,14 @@ void QuadEuclideanRhythm::step() {
 
 		if(stepsCount[trackNumber] > 0) {
 			//Calculate Beats
-			int level = 0;
-			int restsLeft = std::max(0,stepsCount[trackNumber]-division-pad); // just make sure no negatives
-			do {
-				levelArray[level] = std::min(restsLeft,division); 
-				restsLeft = restsLeft - division;
-				level += 1;
-			} while (restsLeft > 0 && level < 16);
-
-			int tempIndex =pad;
-			int beatIndex = 0;
-			for (int j = 0; j < division; j++) {
-	            beatMatrix[trackNumber][(tempIndex + offset) % stepsCount[trackNumber]] = true;
-	            beatLocation[beatIndex] = (tempIndex + offset) % stepsCount[trackNumber];
-	            tempIndex++;
-	            beatIndex++;
-	            for (int k = 0; k < 16; k++) {
-	                if (levelArray[k] > j) {
-	                    tempIndex++;
-	                }
-	            }
-	        }	
+			frozenwasteland::dsp::StepMask pattern = frozenwasteland::dsp::levelEuclideanMask(stepsCount[trackNumber] - pad, division);
+			int beatCount = frozenwasteland::dsp::patternLocations(pattern, offset + pad, stepsCount[trackNumber], beatLocation);
+			beatMask[trackNumber] = frozenwasteland::dsp::rotateMask(pattern << pad, offset, stepsCount[trackNumber]);
 
 	        //Calculate Accents
-	        level = 0;
-	        restsLeft = std::max(0,division-accentDivision); // just make sure no negatives
-	        do {
-				accentLevelArray[level] = std::min(restsLeft,accentDivision);
-				restsLeft = restsLeft - accentDivision;
-				level += 1;
-			} while (restsLeft > 0 && level < 16);
-
-			tempIndex =0;
-			for (int j = 0; j < accentDivision; j++) {
-	            accentMatrix[trackNumber][beatLocation[(tempIndex + accentRotation) % division]] = true;
-	            tempIndex++;
-	            for (int k = 0; k < 16; k++) {
-	                if (accentLevelArray[k] > j) {
-	                    tempIndex++;
-	                }
-	            }
-	        }	
+			if(beatCount > 0) {
+				accentMask[trackNumber] = frozenwasteland::dsp::levelAccentMask(beatLocation, beatCount, accentDivision, accentRotation);
+			}
         }	
 	}
 
@@ -424,13 +378,13 @@ void QuadEuclideanRhythm::step() {
 	for(int trackNumber=0;trackNumber<TRACK_COUNT;trackNumber++) {
 		float outputValue = (lastStepTime[trackNumber] < stepDuration[trackNumber] / 2) ? 10.0 : 0.0;
 		//Send out beat
-		if(beatMatrix[trackNumber][beatIndex[trackNumber]] == true && running[trackNumber] && !muted) {
+		if(((beatMask[trackNumber] >> beatIndex[trackNumber]) & 1) && running[trackNumber] && !muted) {
 			outputs[trackNumber * 3].value = outputValue;
 		} else {
 			outputs[trackNumber * 3].value = 0.0;	
 		}
 		//send out accent
-		if(accentMatrix[trackNumber][beatIndex[trackNumber]] == true && running[trackNumber] && !muted) {
+		if(((accentMask[trackNumber] >> beatIndex[trackNumber]) & 1) && running[trackNumber] && !muted) {
 			outputs[trackNumber * 3 + 1].value = outputValue;	
 		} else {
 			outputs[trackNumber * 3 + 1].value = 0.0;	
@@ -488,8 +442,8 @@ struct QERBeatDisplay : TransparentWidget {
 
 		for(int trackNumber = 0;trackNumber < 4;trackNumber++) {
 			for(int stepNumber = 0;stepNumber < module->stepsCount[trackNumber];stepNumber++) {				
-				bool isBeat = module->beatMatrix[trackNumber][stepNumber];
-				bool isAccent = module->accentMatrix[trackNumber][stepNumber];
+				bool isBeat = (module->beatMask[trackNumber] >> stepNumber) & 1;
+				bool isAccent = (module->accentMask[trackNumber] >> stepNumber) & 1;
 				bool isCurrent = module->beatIndex[trackNumber] == stepNumber && module->running[trackNumber];				
 				drawBox(vg, float(stepNumber), float(trackNumber),isBeat,isAccent,isCurrent);
 			}
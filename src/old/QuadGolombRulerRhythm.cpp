@@ -2,8 +2,7 @@
 #include <string.h>
 #include "../FrozenWasteland.hpp"
 #include "dsp/digital.hpp"
-#define NUM_RULERS 10
-#define MAX_DIVISIONS 6
+#include "../dsp-rhythm/rhythm.hpp"
 #define TRACK_COUNT 4
 #define MAX_STEPS 18
 
@@ -103,8 +102,8 @@ struct QuadGolombRulerRhythm : Module {
 	};
 
 
-	bool beatMatrix[TRACK_COUNT][MAX_STEPS];
-	bool accentMatrix[TRACK_COUNT][MAX_STEPS];
+	frozenwasteland::dsp::StepMask beatMask[TRACK_COUNT] = {};
+	frozenwasteland::dsp::StepMask accentMask[TRACK_COUNT] = {};
 	int beatIndex[TRACK_COUNT];
 	int stepsCount[TRACK_COUNT];
 	float stepDuration[TRACK_COUNT];
@@ -112,19 +111,6 @@ struct QuadGolombRulerRhythm : Module {
 	float maxStepCount;
 
 
-	const int rulerOrders[NUM_RULERS] = {1,2,3,4,5,5,6,6,6,6};
-	const int rulerLengths[NUM_RULERS] = {0,1,3,6,11,11,17,17,17,17};
-	const int rulers[NUM_RULERS][MAX_DIVISIONS] = {{0},
-												   {0,1},
-												   {0,1,3},
-												   {0,1,4,6},
-												   {0,1,4,9,11},
-												   {0,2,7,8,11},
-												   {0,1,4,10,12,17},
-												   {0,1,4,10,15,17},
-												   {0,1,8,11,13,17},
-												   {0,1,8,12,14,17}};
-
 	bool running[TRACK_COUNT];
 	int chainMode = 0;
 	bool initialized = false;
@@ -146,10 +132,6 @@ struct QuadGolombRulerRhythm : Module {
 			lastStepTime[i] = 0.0;
 			stepDuration[i] = 0.0;
 			running[i] = true;
-			for(unsigned j = 0; j < MAX_STEPS; j++) {
-				beatMatrix[i][j] = false;
-				accentMatrix[i][j] = false;
-			}
 		}		
 	}
 	void step() override;
@@ -213,7 +195,6 @@ struct QuadGolombRulerRhythm : Module {
 
 void QuadGolombRulerRhythm::step() {
 
-	int accentLevelArray[MAX_STEPS];
 	int beatLocation[MAX_STEPS];
 
 	//Set startup state
@@ -244,14 +225,9 @@ void QuadGolombRulerRhythm::step() {
 
 
 	for(int trackNumber=0;trackNumber<TRACK_COUNT;trackNumber++) {
-		//clear out the matrix and levels
-		for(int j=0;j<MAX_STEPS;j++)
-		{
-			beatMatrix[trackNumber][j] = false; 
-			accentMatrix[trackNumber][j] = false;
-			accentLevelArray[j] = 0;	
-			beatLocation[j] = 0;
-		}
+		//clear out the masks
+		beatMask[trackNumber] = 0;
+		accentMask[trackNumber] = 0;
 
 		float stepsCountf = params[trackNumber * 6].value;
 		if(inputs[trackNumber * 7].active) {
@@ -263,7 +239,7 @@ void QuadGolombRulerRhythm::step() {
 		if(inputs[(trackNumber * 7) + 1].active) {
 			divisionf += inputs[(trackNumber * 7) + 1].value;
 		}		
-		divisionf = clamp(divisionf,0.0f,(float)(NUM_RULERS-1));
+		divisionf = clamp(divisionf,0.0f,(float)(frozenwasteland::dsp::NUM_RULERS-1));
 
 		float offsetf = params[(trackNumber * 6) + 2].value;
 		if(inputs[(trackNumber * 7) + 2].active) {
@@ -315,52 +291,11 @@ void QuadGolombRulerRhythm::step() {
 		//Ruler Lengths and orders are 0 based, which is why I add 1 here. 	
 		//Yes, I could add 1 to length in the constant array, but I want that to match wikipedia definition				
 		if(stepsCount[trackNumber] > 0 && division > 0) {
-			int rulerToUse = division - 1;
-			int actualStepCount = stepsCount[trackNumber] - pad;
-			while(rulerLengths[rulerToUse] + 1 > actualStepCount && rulerToUse >= 	0) {
-				rulerToUse -=1;
-			} 
-			
-			//Multiply beats so that low division beats fill out entire pattern
-			int spaceMultiplier = (actualStepCount / (rulerLengths[rulerToUse] + 1)) + 1;
-			if(actualStepCount % (rulerLengths[rulerToUse] + 1) == 0) {
-				spaceMultiplier -=1;
-			}			
-
-			
-
-			for (int j = 0; j < rulerOrders[rulerToUse];j++)
-			{
-				int divisionLocation = rulers[rulerToUse][j] * spaceMultiplier;
-				divisionLocation +=pad;
-				if(j > 0) {
-					divisionLocation -=1;
-				}
-				beatMatrix[trackNumber][(divisionLocation + offset) % stepsCount[trackNumber]] = true;
-	            beatLocation[j] = (divisionLocation + offset) % stepsCount[trackNumber];	            
-			}
-
-		
+			int rulerCount = frozenwasteland::dsp::golombLocations(division - 1, stepsCount[trackNumber], pad, offset, beatLocation);
+			beatMask[trackNumber] = frozenwasteland::dsp::locationsMask(beatLocation, rulerCount);
 
 	        //Calculate Accents
-	        int level = 0;
-	        int restsLeft = std::max(0,rulerOrders[rulerToUse]-accentDivision); // just make sure no negatives
-	        do {
-				accentLevelArray[level] = std::min(restsLeft,accentDivision);
-				restsLeft = restsLeft - accentDivision;
-				level += 1;
-			} while (restsLeft > 0 && level < MAX_STEPS);
-
-			int tempIndex =0;
-			for (int j = 0; j < accentDivision; j++) {
-	            accentMatrix[trackNumber][beatLocation[(tempIndex + accentRotation) % rulerOrders[rulerToUse]]] = true;
-	            tempIndex++;
-	            for (int k = 0; k < MAX_STEPS; k++) {
-	                if (accentLevelArray[k] > j) {
-	                    tempIndex++;
-	                }
-	            }
-	        }	
+			accentMask[trackNumber] = frozenwasteland::dsp::levelAccentMask(beatLocation, rulerCount, accentDivision, accentRotation);
         }	
 	}
 
@@ -438,13 +373,13 @@ void QuadGolombRulerRhythm::step() {
 	for(int trackNumber=0;trackNumber<TRACK_COUNT;trackNumber++) {
 		float outputValue = (lastStepTime[trackNumber] < stepDuration[trackNumber] / 2) ? 10.0 : 0.0;
 		//Send out beat
-		if(beatMatrix[trackNumber][beatIndex[trackNumber]] == true && running[trackNumber] && !muted) {
+		if(((beatMask[trackNumber] >> beatIndex[trackNumber]) & 1) && running[trackNumber] && !muted) {
 			outputs[trackNumber * 3].value = outputValue;	
 		} else {
 			outputs[trackNumber * 3].value = 0.0;	
 		}
 		//send out accent
-		if(accentMatrix[trackNumber][beatIndex[trackNumber]] == true && running[trackNumber] && !muted) {
+		if(((accentMask[trackNumber] >> beatIndex[trackNumber]) & 1) && running[trackNumber] && !muted) {
 			outputs[trackNumber * 3 + 1].value = outputValue;	
 		} else {
 			outputs[trackNumber * 3 + 1].value = 0.0;	
@@ -504,8 +439,8 @@ struct QBRBeatDisplay : TransparentWidget {
 
 		for(int trackNumber = 0;trackNumber < 4;trackNumber++) {
 			for(int stepNumber = 0;stepNumber < module->stepsCount[trackNumber];stepNumber++) {				
-				bool isBeat = module->beatMatrix[trackNumber][stepNumber];
-				bool isAccent = module->accentMatrix[trackNumber][stepNumber];
+				bool isBeat = (module->beatMask[trackNumber] >> stepNumber) & 1;
+				bool isAccent = (module->accentMask[trackNumber] >> stepNumber) & 1;
 				bool isCurrent = module->beatIndex[trackNumber] == stepNumber && module->running[trackNumber];				
 				drawBox(vg, float(stepNumber), float(trackNumber),isBeat,isAccent,isCurrent);
 			}
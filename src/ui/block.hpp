@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include "../FrozenWasteland.hpp"
+
+namespace frozenwasteland {
+
+/** Opt-in block processing for modules whose per-sample work is mostly overhead, such as control reads, coefficient updates and resampler calls that could serve many frames at once.
+process() passes each input frame to step(), which returns the output frame to play.
+Once size frames have been gathered, the module's block function runs over all of them and writes output[]. That output plays during the next block, so a block of n frames adds n frames of latency.
+A block of one frame is processed and played straight away with no latency, and is the default.
+The menu only requests a size. It takes effect at the next block boundary, on the engine thread.
+*/
+template <typename IN, typename OUT, int MAX = 64>
+struct BlockProcessor {
+	static const int MAX_SIZE = MAX;
+
+	IN input[MAX];
+	OUT output[MAX] = {};
+	int size = 1;
+	int requestedSize = 1;
+	int position = 0;
+
+	/** Asks for a block size, clamped to what the buffers hold, from the menu or a patch */
+	void request(int frames) {
+		requestedSize = clamp(frames, 1, MAX);
+	}
+
+	template <typename F>
+	OUT step(const IN &frame, F processBlock) {
+		if (position == 0 && requestedSize != size) {
+			size = clamp(requestedSize, 1, MAX);
+			std::fill(output, output + MAX, OUT());
+		}
+		input[position] = frame;
+		if (size == 1) {
+			processBlock(1);
+			return output[0];
+		}
+		OUT played = output[position];
+		if (++position >= size) {
+			processBlock(size);
+			position = 0;
+		}
+		return played;
+	}
+
+	/** Frames between an input and its output */
+	int latency() const {
+		return size > 1 ? size : 0;
+	}
+};
+
+template <typename B>
+struct BlockSizeItem : MenuItem {
+	B *block;
+	int size;
+	void onAction(event::Action &e) override {
+		block->request(size);
+	}
+	void step() override {
+		rightText = (block->requestedSize == size) ? "✔" : "";
+	}
+};
+
+/** Block size choices for a module's context menu, with the latency each one adds at the current sample rate */
+template <typename B>
+void appendBlockMenu(Menu *menu, B &block) {
+	menu->addChild(new MenuLabel()); // empty line
+
+	MenuLabel *label = new MenuLabel();
+	label->text = "Block Processing";
+	menu->addChild(label);
+
+	float sampleRate = APP->engine->getSampleRate();
+	const int sizes[] = {1, 16, 32, 64};
+	for (int size : sizes) {
+		char text[64];
+		snprintf(text, sizeof(text), "%d samples (%.2f ms latency)", size, size * 1000.0f / sampleRate);
+		BlockSizeItem<B> *item = new BlockSizeItem<B>();
+		item->text = size == 1 ? "Off" : text;
+		item->block = &block;
+		item->size = size;
+		menu->addChild(item);
+	}
+}
+
+} // namespace frozenwasteland
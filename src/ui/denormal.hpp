@@ -0,0 +1,110 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+#ifdef FROZENWASTELAND_DENORMAL_DEBUG
+#include "../FrozenWasteland.hpp"
+#endif
+
+namespace frozenwasteland {
+
+/** Turns on flush-to-zero and denormals-are-zero for the rest of a process() call, if the host hasn't already, and puts the old mode back afterwards.
+Declare one at the top of process(). Where the host has already set them, which Rack's engine threads do, it costs one register read.
+*/
+struct DenormalGuard {
+#if defined(__SSE__)
+	// FTZ and DAZ bits of MXCSR
+	static const unsigned int FLUSH = 0x8040;
+	unsigned int saved;
+
+	DenormalGuard() {
+		saved = _mm_getcsr();
+		if ((saved & FLUSH) != FLUSH)
+			_mm_setcsr(saved | FLUSH);
+	}
+	~DenormalGuard() {
+		if ((saved & FLUSH) != FLUSH)
+			_mm_setcsr(saved);
+	}
+#elif defined(__aarch64__)
+	// FZ bit of FPCR, which covers NEON as well
+	static const uint64_t FLUSH = 1 << 24;
+	uint64_t saved;
+
+	DenormalGuard() {
+		__asm__ __volatile__("mrs %0, fpcr" : "=r"(saved));
+		if (!(saved & FLUSH)) {
+			uint64_t flush = saved | FLUSH;
+			__asm__ __volatile__("msr fpcr, %0" : : "r"(flush));
+		}
+	}
+	~DenormalGuard() {
+		if (!(saved & FLUSH))
+			__asm__ __volatile__("msr fpcr, %0" : : "r"(saved));
+	}
+#elif defined(__arm__) && defined(__ARM_FP)
+	// FZ bit of FPSCR
+	static const uint32_t FLUSH = 1 << 24;
+	uint32_t saved;
+
+	DenormalGuard() {
+		__asm__ __volatile__("vmrs %0, fpscr" : "=r"(saved));
+		if (!(saved & FLUSH)) {
+			uint32_t flush = saved | FLUSH;
+			__asm__ __volatile__("vmsr fpscr, %0" : : "r"(flush));
+		}
+	}
+	~DenormalGuard() {
+		if (!(saved & FLUSH))
+			__asm__ __volatile__("vmsr fpscr, %0" : : "r"(saved));
+	}
+#endif
+	DenormalGuard(const DenormalGuard &) = delete;
+	DenormalGuard &operator=(const DenormalGuard &) = delete;
+};
+
+/** Zeroes recursive state (feedback, filter memories, envelopes) once it has decayed below FLOOR, long before it could reach the subnormal range.
+This is for the CPUs and hosts where DenormalGuard can't do anything, and it leaves silent state at exactly zero for the SleepDetector.
+Build with DENORMAL_DEBUG=1 and each module logs, once a second, how many state values it zeroed, each of which would otherwise have decayed on into the subnormal range.
+*/
+struct DenormalMonitor {
+	/** -300 dB below 1 V, far below anything audible but well clear of FLT_MIN */
+	static constexpr float FLOOR = 1e-15f;
+
+	const char *name;
+#ifdef FROZENWASTELAND_DENORMAL_DEBUG
+	uint32_t events = 0;
+	float elapsed = 0.0f;
+#endif
+
+	DenormalMonitor(const char *name) : name(name) {}
+
+	template <typename T>
+	void flush(T &state) {
+		if (fabs(state) < T(FLOOR)) {
+#ifdef FROZENWASTELAND_DENORMAL_DEBUG
+			if (state != T(0))
+				events++;
+#endif
+			state = T(0);
+		}
+	}
+
+	/** Call once per process() */
+	void tick(float sampleTime) {
+#ifdef FROZENWASTELAND_DENORMAL_DEBUG
+		elapsed += sampleTime;
+		if (elapsed < 1.0f)
+			return;
+		if (events > 0)
+			DEBUG("%s: %u decaying state values zeroed in the last second", name, events);
+		events = 0;
+		elapsed = 0.0f;
+#endif
+	}
+};
+
+} // namespace frozenwasteland
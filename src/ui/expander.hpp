@@ -0,0 +1,145 @@
+#pragma once
+
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <initializer_list>
+#include "../FrozenWasteland.hpp"
+
+namespace frozenwasteland {
+
+/** First bytes of every expander message, so a neighbour can check what it is reading before it reads it */
+struct ExpanderHeader {
+	uint32_t type = 0;
+	uint32_t version = 0;
+	/** Bumped every time the publisher sends a change. Readers compare it to skip work when nothing moved. */
+	uint32_t sequence = 0;
+};
+
+/** A message struct T carries its own TYPE and VERSION, a new VERSION whenever its layout changes */
+template <typename T>
+struct ExpanderPacket {
+	ExpanderHeader header;
+	T payload;
+};
+
+/** Publishes a T on one side of its own module, for whichever neighbours want to read it.
+The owner writes fields through set(), which only records the bytes that actually changed, and calls send() once per process.
+Only those bytes are copied into the producer buffer, so a sequencer whose knobs are still costs nothing but the comparisons.
+Modules further along a chain read the publisher directly with readExpander() instead of having every module in between copy the message on.
+*/
+template <typename T>
+struct ExpanderPublisher {
+	T message = {};
+
+	ExpanderPacket<T> _packets[2];
+	Module::Expander *_expander = NULL;
+	uint32_t _sequence = 0;
+	// Byte ranges of message that the producer buffer is missing: changed since the last send, and sent last time but only to the other buffer
+	size_t _pendingBegin = 0, _pendingEnd = 0;
+	size_t _flippedBegin = 0, _flippedEnd = 0;
+
+	/** Publishes on the given side, leftExpander for messages read by the module to the left */
+	void attach(Module::Expander &expander) {
+		for (int i = 0; i < 2; i++) {
+			_packets[i].header.type = T::TYPE;
+			_packets[i].header.version = T::VERSION;
+			_packets[i].payload = message;
+		}
+		_expander = &expander;
+		expander.producerMessage = &_packets[0];
+		expander.consumerMessage = &_packets[1];
+	}
+
+	template <typename V, typename W>
+	void set(V &field, W value) {
+		V converted = value;
+		if (field == converted)
+			return;
+		field = converted;
+		mark(&field, sizeof(V));
+	}
+
+	/** Records a change made to message directly */
+	void mark(const void *field, size_t size) {
+		size_t begin = (const char *)field - (const char *)&message;
+		extend(_pendingBegin, _pendingEnd, begin, begin + size);
+	}
+
+	/** Marks the whole message, after a reset or load */
+	void markAll() {
+		extend(_pendingBegin, _pendingEnd, 0, sizeof(T));
+	}
+
+	/** Copies the pending changes into the producer buffer and asks for a flip. Returns false when there was nothing to send. */
+	bool send() {
+		if (_pendingBegin == _pendingEnd)
+			return false;
+		size_t begin = _pendingBegin, end = _pendingEnd;
+		extend(begin, end, _flippedBegin, _flippedEnd);
+
+		ExpanderPacket<T> *producer = (ExpanderPacket<T> *)_expander->producerMessage;
+		memcpy((char *)&producer->payload + begin, (const char *)&message + begin, end - begin);
+		producer->header.sequence = ++_sequence;
+		_expander->messageFlipRequested = true;
+
+		_flippedBegin = _pendingBegin;
+		_flippedEnd = _pendingEnd;
+		_pendingBegin = _pendingEnd = 0;
+		return true;
+	}
+
+	static void extend(size_t &begin, size_t &end, size_t otherBegin, size_t otherEnd) {
+		if (otherBegin == otherEnd)
+			return;
+		if (begin == end) {
+			begin = otherBegin;
+			end = otherEnd;
+			return;
+		}
+		begin = std::min(begin, otherBegin);
+		end = std::max(end, otherEnd);
+	}
+};
+
+/** The T a neighbour publishes on the given side, or NULL if it isn't one of ours or isn't publishing a T there */
+template <typename T>
+const ExpanderPacket<T> *readExpander(Module *module, bool left) {
+	if (!module || !module->model || module->model->plugin != pluginInstance)
+		return NULL;
+	const Module::Expander &expander = left ? module->leftExpander : module->rightExpander;
+	const ExpanderPacket<T> *packet = (const ExpanderPacket<T> *)expander.consumerMessage;
+	if (!packet || packet->header.type != T::TYPE || packet->header.version != T::VERSION)
+		return NULL;
+	return packet;
+}
+
+/** The first module from module onwards, stepping left or right, that isn't one of the given expanders.
+Expanders further down a chain use this to read the module at its head directly.
+*/
+inline Module *pastExpanders(Module *module, bool left, std::initializer_list<Model *> expanders) {
+	while (module && std::find(expanders.begin(), expanders.end(), module->model) != expanders.end()) {
+		module = left ? module->leftExpander.module : module->rightExpander.module;
+	}
+	return module;
+}
+
+/** Remembers which publisher was read last and at what sequence, so a reader only redoes its work when that changes */
+struct ExpanderWatch {
+	Module *module = NULL;
+	uint32_t sequence = 0;
+
+	template <typename T>
+	bool changed(Module *source, const ExpanderPacket<T> *packet) {
+		uint32_t newSequence = packet ? packet->header.sequence : 0;
+		if (!packet)
+			source = NULL;
+		if (source == module && newSequence == sequence)
+			return false;
+		module = source;
+		sequence = newSequence;
+		return true;
+	}
+};
+
+} // namespace frozenwasteland
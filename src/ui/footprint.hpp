@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+#include "../FrozenWasteland.hpp"
+
+namespace frozenwasteland {
+
+/** Reports how much memory one instance of a module costs, so instance size can be tracked as tables and state change.
+Each module declares one at file scope, with its sizeof and whatever it allocates on the heap per instance.
+Build with FOOTPRINT_REPORT=1 and every module logs its line when the plugin loads; otherwise this does nothing.
+*/
+struct FootprintReport {
+	FootprintReport(const char *name, size_t instance, size_t heap = 0) {
+#ifdef FROZENWASTELAND_FOOTPRINT_REPORT
+		INFO("Footprint %s: %zu bytes per instance, %zu bytes heap", name, instance, heap);
+#endif
+	}
+};
+
+} // namespace frozenwasteland
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include "../FrozenWasteland.hpp"
+
+namespace frozenwasteland {
+
+/** Change counter for everything a module's display shows.
+The audio thread bumps it when displayed state changes; the UI only re-renders the display when it sees a new value.
+*/
+struct DisplayVersion {
+	std::atomic<uint32_t> value{0};
+
+	void bump() {
+		value.fetch_add(1, std::memory_order_release);
+	}
+	uint32_t get() const {
+		return value.load(std::memory_order_acquire);
+	}
+	/** Stores value in last and bumps if it changed. Cheap enough to call every sample. */
+	template <typename T>
+	void track(T &last, const T &current) {
+		if (current != last) {
+			last = current;
+			bump();
+		}
+	}
+};
+
+/** Framebuffer that only redraws its children when the module's displayVersion moves.
+TModule must have a `DisplayVersion displayVersion` member. With no module (library browser) it renders once.
+*/
+template <class TModule>
+struct VersionedFramebuffer : FramebufferWidget {
+	TModule *module = NULL;
+	uint32_t lastVersion = 0;
+
+	void step() override {
+		if (module) {
+			uint32_t version = module->displayVersion.get();
+			if (version != lastVersion) {
+				lastVersion = version;
+				dirty = true;
+			}
+		}
+		FramebufferWidget::step();
+	}
+};
+
+/** Wraps display in a VersionedFramebuffer occupying the display's box. The display is moved to the framebuffer origin. */
+template <class TModule>
+VersionedFramebuffer<TModule> *createVersionedDisplay(Widget *display, TModule *module) {
+	VersionedFramebuffer<TModule> *fb = new VersionedFramebuffer<TModule>();
+	fb->module = module;
+	fb->box = display->box;
+	display->box.pos = Vec(0, 0);
+	fb->addChild(display);
+	return fb;
+}
+
+} // namespace frozenwasteland
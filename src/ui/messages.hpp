@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stdint.h>
+
+// Messages passed between modules and their expanders, see ui/expander.hpp.
+// Every message has its own TYPE, and its VERSION goes up whenever its layout changes so an old neighbour is ignored rather than misread.
+
+namespace frozenwasteland {
+
+static const int QAR_TRACK_COUNT = 4;
+static const int QAR_MAX_STEPS = 18;
+
+/** QAR probability expander, published to its left for the nearest QAR */
+struct QARProbabilityMessage {
+	static const uint32_t TYPE = 0x51415250; // QARP
+	static const uint32_t VERSION = 1;
+
+	bool trackSelected[QAR_TRACK_COUNT];
+	/** Steps are numbered by the track's beats rather than its steps */
+	bool useDivs;
+	float probability[QAR_MAX_STEPS];
+	int groupMode[QAR_MAX_STEPS];
+};
+
+/** QAR groove expander, published to its left for the nearest QAR */
+struct QARGrooveMessage {
+	static const uint32_t TYPE = 0x51415247; // QARG
+	static const uint32_t VERSION = 1;
+
+	bool trackSelected[QAR_TRACK_COUNT];
+	bool useDivs;
+	bool grooveIsTrackLength;
+	bool gaussian;
+	int grooveLength;
+	float randomAmount;
+	/** Swing for each groove step, already scaled by the groove amount */
+	float swing[QAR_MAX_STEPS];
+};
+
+/** What a chained QAR sends back to the QAR on its left */
+struct QARSlaveMessage {
+	static const uint32_t TYPE = 0x51415253; // QARS
+	static const uint32_t VERSION = 1;
+
+	/** Outputs, including everything chained after this QAR */
+	float beat[QAR_TRACK_COUNT];
+	float accent[QAR_TRACK_COUNT];
+	/** End of cycle of the last QAR in the chain, which restarts the first */
+	float eoc[QAR_TRACK_COUNT];
+};
+
+/** What a QAR sends on to a chained QAR on its right */
+struct QARMasterMessage {
+	static const uint32_t TYPE = 0x5141524d; // QARM
+	static const uint32_t VERSION = 1;
+
+	float clock;
+	float reset;
+	float mute;
+	float eoc[QAR_TRACK_COUNT];
+};
+
+/** Probably Note chord expander, published to its left */
+struct PNChordMessage {
+	static const uint32_t TYPE = 0x504e4348; // PNCH
+	static const uint32_t VERSION = 1;
+
+	float dissonance5Probability;
+	float dissonance7Probability;
+	float suspensionProbability;
+	/** External random values, -1 when the input isn't patched */
+	float dissonance5Random;
+	float dissonance7Random;
+	float suspensionRandom;
+};
+
+/** The last chord Probably Note played, published to its right for the chord expander's display */
+struct PNChordFeedbackMessage {
+	static const uint32_t TYPE = 0x504e4346; // PNCF
+	static const uint32_t VERSION = 1;
+
+	int thirdOffset;
+	int fifthOffset;
+	int seventhOffset;
+};
+
+static const int VOX_FORMANT_COUNT = 5;
+
+/** Vox Inhumana expander, published to its left */
+struct VoxInhumanaMessage {
+	static const uint32_t TYPE = 0x564f5845; // VOXE
+	static const uint32_t VERSION = 1;
+
+	float q[VOX_FORMANT_COUNT];
+	bool twelveDbSlope[VOX_FORMANT_COUNT];
+};
+
+/** BPM LFO state, published to its right for any phase expanders */
+struct BPMLFOMessage {
+	static const uint32_t TYPE = 0x42504d4c; // BPML
+	static const uint32_t VERSION = 1;
+
+	bool clockConnected;
+	float clock;
+	float reset;
+	float hold;
+	float multiplier;
+	float division;
+	float initialPhase;
+	float offset;
+	float holdMode;
+	float holdClockMode;
+	float waveshape;
+	float waveSlope;
+	float skew;
+};
+
+/** Seeds of Change state, published to its right for any CV and gate expanders */
+struct SeedsOfChangeMessage {
+	static const uint32_t TYPE = 0x534f4353; // SOCS
+	static const uint32_t VERSION = 1;
+
+	uint64_t seed;
+	float clock;
+	float reset;
+	bool gaussian;
+};
+
+} // namespace frozenwasteland
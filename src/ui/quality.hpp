@@ -0,0 +1,207 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include "samplerate.h"
+#include "settings.hpp"
+#include "storage.hpp"
+
+namespace frozenwasteland {
+
+enum QualityTier {
+	QUALITY_ECO,
+	QUALITY_STANDARD,
+	QUALITY_HIGH,
+	NUM_QUALITY_TIERS
+};
+
+enum Interpolation {
+	INTERPOLATION_HOLD,
+	INTERPOLATION_LINEAR,
+	INTERPOLATION_SINC,
+	NUM_INTERPOLATIONS
+};
+
+/** The libsamplerate converter for an interpolation order */
+inline int srcConverter(int interpolation) {
+	switch (interpolation) {
+		case INTERPOLATION_HOLD:
+			return SRC_ZERO_ORDER_HOLD;
+		case INTERPOLATION_SINC:
+			return SRC_SINC_FASTEST;
+		default:
+			return SRC_LINEAR;
+	}
+}
+
+/** One libsamplerate converter per stream, all of one interpolation order, for DeferredStorage to build off the engine thread */
+template <int INTERPOLATION, int STREAMS, int CHANNELS>
+struct Resamplers {
+	SRC_STATE *states[STREAMS];
+
+	Resamplers() {
+		for (int i = 0; i < STREAMS; i++) {
+			int error;
+			states[i] = src_new(srcConverter(INTERPOLATION), CHANNELS, &error);
+		}
+	}
+	~Resamplers() {
+		for (int i = 0; i < STREAMS; i++) {
+			if (states[i])
+				src_delete(states[i]);
+		}
+	}
+
+	bool allocated() const {
+		for (int i = 0; i < STREAMS; i++) {
+			if (!states[i])
+				return false;
+		}
+		return true;
+	}
+};
+
+/** Resamplers for a module whose quality tiers read through different interpolation orders.
+Each order's converters are only made once a tier that uses it has been asked for, so a module that never leaves standard never builds the sinc ones.
+*/
+template <int STREAMS, int CHANNELS>
+struct TierResamplers {
+	DeferredStorage<Resamplers<INTERPOLATION_HOLD, STREAMS, CHANNELS>> hold;
+	DeferredStorage<Resamplers<INTERPOLATION_LINEAR, STREAMS, CHANNELS>> linear;
+	DeferredStorage<Resamplers<INTERPOLATION_SINC, STREAMS, CHANNELS>> sinc;
+
+	/** Starts building an order's converters, once. Call off the engine thread. */
+	void request(int interpolation) {
+		switch (interpolation) {
+			case INTERPOLATION_HOLD:
+				hold.request();
+				break;
+			case INTERPOLATION_SINC:
+				sinc.request();
+				break;
+			default:
+				linear.request();
+				break;
+		}
+	}
+
+	/** An order's converters, or NULL until they are built */
+	SRC_STATE **get(int interpolation) const {
+		switch (interpolation) {
+			case INTERPOLATION_HOLD:
+				return hold.get() ? hold.get()->states : NULL;
+			case INTERPOLATION_SINC:
+				return sinc.get() ? sinc.get()->states : NULL;
+			default:
+				return linear.get() ? linear.get()->states : NULL;
+		}
+	}
+};
+
+/** What one quality tier selects for one module.
+Each module declares a table of these, from eco up, next to its other constants, and ignores the fields it has no use for.
+Its standard entry is what the module did before there were tiers, so patches sound the same unless someone picks another tier.
+A table only goes as far as the tiers that change something for that module, so one with nothing for high to add stops at standard.
+*/
+struct QualityProfile {
+	/** How delay lines and resamplers read between samples */
+	int interpolation;
+	/** Oversampling factor of whatever the module oversamples */
+	int oversample;
+	/** Most grains run at once, per tap or string */
+	int grainCap;
+	/** Filter sections in each cascade */
+	int filterStages;
+	/** Samples between control updates; 1 updates every sample */
+	int controlInterval;
+	/** Expected CPU use against standard, estimated from the work the other fields add or remove rather than measured. The menu shows it as an estimate. */
+	float cost;
+};
+
+inline const char *qualityName(int tier) {
+	static const char *names[NUM_QUALITY_TIERS] = {"Eco", "Standard", "High"};
+	return names[clamp(tier, 0, NUM_QUALITY_TIERS - 1)];
+}
+
+/** A module's quality tier: the plugin-wide one from PluginSettings, unless the context menu or the patch overrides it.
+The menu and dataFromJson only request a tier. The module calls update() on the engine thread, where it is safe to switch, and reconfigures itself from profile() when it returns true.
+A tier that needs something built first can set prepare, which request() calls off the engine thread with the requested tier's profile.
+*/
+struct QualitySetting {
+	const QualityProfile *profiles;
+	/** How many tiers the module's table offers */
+	const int tiers;
+	const int pluginTier;
+	/** The override, or -1 to follow the plugin setting */
+	int requested = -1;
+	/** The tier in use, or -1 before the first update() */
+	int tier = -1;
+	std::function<void(const QualityProfile &)> prepare;
+
+	/** A plugin setting above what the table offers gets the module's highest tier */
+	template <int N>
+	QualitySetting(const QualityProfile (&profiles)[N]) : profiles(profiles), tiers(N), pluginTier(clamp(PluginSettings::get().quality, 0, N - 1)) {
+		static_assert(N > QUALITY_STANDARD && N <= NUM_QUALITY_TIERS, "a quality table runs from eco to at least standard");
+	}
+
+	/** Asks for a tier, or -1 for the plugin setting, clamped to the tiers the module offers */
+	void request(int wanted) {
+		requested = clamp(wanted, -1, tiers - 1);
+		if (prepare)
+			prepare(profiles[requestedTier()]);
+	}
+
+	int requestedTier() const {
+		return requested >= 0 ? std::min(requested, tiers - 1) : pluginTier;
+	}
+
+	/** True the first time, and whenever another tier has been requested since */
+	bool update() {
+		int wanted = requestedTier();
+		if (wanted == tier)
+			return false;
+		tier = wanted;
+		return true;
+	}
+
+	const QualityProfile &profile() const {
+		return profiles[tier >= 0 ? tier : requestedTier()];
+	}
+};
+
+struct QualityItem : MenuItem {
+	QualitySetting *quality;
+	int tier;
+	void onAction(event::Action &e) override {
+		quality->request(tier);
+	}
+	void step() override {
+		rightText = (quality->requested == tier) ? "✔" : "";
+	}
+};
+
+/** Quality choices for a module's context menu, one per tier it offers, each with its estimated cost against standard. The heading can say when the tiers apply, if not always. */
+inline void appendQualityMenu(Menu *menu, QualitySetting &quality, const char *heading = "Quality") {
+	menu->addChild(new MenuLabel()); // empty line
+
+	MenuLabel *label = new MenuLabel();
+	label->text = heading;
+	menu->addChild(label);
+
+	for (int tier = -1; tier < quality.tiers; tier++) {
+		char text[64];
+		if (tier < 0)
+			snprintf(text, sizeof(text), "Plugin setting (%s)", qualityName(quality.pluginTier));
+		else if (tier == QUALITY_STANDARD)
+			snprintf(text, sizeof(text), "%s", qualityName(tier));
+		else
+			snprintf(text, sizeof(text), "%s (est. %.1fx the CPU)", qualityName(tier), quality.profiles[tier].cost);
+		QualityItem *item = new QualityItem();
+		item->text = text;
+		item->quality = &quality;
+		item->tier = tier;
+		menu->addChild(item);
+	}
+}
+
+} // namespace frozenwasteland
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "../FrozenWasteland.hpp"
+#include "../dsp-tuning/tuning.hpp"
+#include "osdialog.h"
+
+namespace frozenwasteland {
+
+/** A Scala tuning that replaces a module's built in temperaments while it is loaded.
+The compiled steps are saved in the patch, so it still plays in tune without the .scl file.
+*/
+template <int NOTES>
+struct ScalaTuning {
+	dsp::Tuning<NOTES> tuning;
+	bool loaded = false;
+	std::string description;
+	std::string lastPath;
+
+	/** Loads a .scl file, telling the user why if it can't be used */
+	bool load(const std::string &path) {
+		lastPath = path;
+		dsp::ScalaScale scale;
+		std::string error;
+		if (!scale.load(path, error)) {
+			osdialog_message(OSDIALOG_WARNING, OSDIALOG_OK, error.c_str());
+			return false;
+		}
+		if (scale.size() != NOTES) {
+			std::string message = rack::string::f("%s has %d notes per period, this module needs %d", path.c_str(), scale.size(), NOTES);
+			osdialog_message(OSDIALOG_WARNING, OSDIALOG_OK, message.c_str());
+			return false;
+		}
+		set(scale.description, scale.cents.data(), scale.periodCents);
+		return true;
+	}
+
+	void set(const std::string &newDescription, const double *cents, double periodCents) {
+		dsp::Tuning<NOTES> compiled(cents, periodCents);
+		tuning = compiled;
+		description = newDescription;
+		loaded = true;
+	}
+
+	void clear() {
+		loaded = false;
+	}
+
+	void toJson(json_t *rootJ) {
+		if (!loaded)
+			return;
+		json_t *centsJ = json_array();
+		for (int i = 0; i < NOTES; i++) {
+			json_array_append_new(centsJ, json_real(tuning.volts[i] * 1200.0));
+		}
+		json_object_set_new(rootJ, "scalaCents", centsJ);
+		json_object_set_new(rootJ, "scalaPeriod", json_real(tuning.periodVolts * 1200.0));
+		json_object_set_new(rootJ, "scalaDescription", json_string(description.c_str()));
+	}
+
+	void fromJson(json_t *rootJ) {
+		json_t *centsJ = json_object_get(rootJ, "scalaCents");
+		json_t *periodJ = json_object_get(rootJ, "scalaPeriod");
+		if (!centsJ || !periodJ || (int)json_array_size(centsJ) != NOTES) {
+			loaded = false;
+			return;
+		}
+		double cents[NOTES];
+		for (int i = 0; i < NOTES; i++) {
+			cents[i] = json_number_value(json_array_get(centsJ, i));
+		}
+		json_t *descriptionJ = json_object_get(rootJ, "scalaDescription");
+		set(descriptionJ ? json_string_value(descriptionJ) : "", cents, json_number_value(periodJ));
+	}
+};
+
+template <int NOTES>
+struct LoadScalaItem : MenuItem {
+	ScalaTuning<NOTES> *scala;
+
+	void onAction(event::Action &e) override {
+		std::string dir = scala->lastPath.empty() ? asset::user("") : rack::string::directory(scala->lastPath);
+		osdialog_filters *filters = osdialog_filters_parse("Scala scale:scl");
+		char *path = osdialog_file(OSDIALOG_OPEN, dir.c_str(), NULL, filters);
+		osdialog_filters_free(filters);
+		if (path) {
+			scala->load(path);
+			free(path);
+		}
+	}
+	void step() override {
+		rightText = scala->loaded ? "✔" : "";
+		MenuItem::step();
+	}
+};
+
+template <int NOTES>
+struct ClearScalaItem : MenuItem {
+	ScalaTuning<NOTES> *scala;
+
+	void onAction(event::Action &e) override {
+		scala->clear();
+	}
+};
+
+/** Load and clear items, plus the loaded scale's description */
+template <int NOTES>
+void appendScalaMenu(Menu *menu, ScalaTuning<NOTES> *scala) {
+	LoadScalaItem<NOTES> *loadItem = new LoadScalaItem<NOTES>();
+	loadItem->text = "Load Scala tuning...";
+	loadItem->scala = scala;
+	menu->addChild(loadItem);
+
+	if (scala->loaded) {
+		ClearScalaItem<NOTES> *clearItem = new ClearScalaItem<NOTES>();
+		clearItem->text = "Clear Scala tuning";
+		clearItem->scala = scala;
+		menu->addChild(clearItem);
+
+		if (!scala->description.empty()) {
+			MenuLabel *descriptionLabel = new MenuLabel();
+			descriptionLabel->text = scala->description;
+			menu->addChild(descriptionLabel);
+		}
+	}
+}
+
+} // namespace frozenwasteland
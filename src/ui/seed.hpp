@@ -0,0 +1,73 @@
+#pragma once
+
+#include "../FrozenWasteland.hpp"
+#include "../dsp-noise/random.hpp"
+
+namespace frozenwasteland {
+
+/** A module's random source, optionally pinned to a seed saved in the patch.
+With a fixed seed the sequence restarts on load and reset, so a patch renders the same way every time.
+*/
+struct SeededRandom {
+	dsp::RandomGenerator generator;
+	bool fixedSeed = false;
+	uint64_t seed = 0;
+
+	float uniform() {
+		return generator.uniform();
+	}
+
+	void fill(float *out, int count) {
+		generator.fill(out, count);
+	}
+
+	/** Back to the start of the fixed sequence. Does nothing without a fixed seed. */
+	void restart() {
+		if (fixedSeed)
+			generator.seed(seed);
+	}
+
+	void setFixedSeed(bool fixed) {
+		fixedSeed = fixed;
+		if (fixed) {
+			seed = ((uint64_t)dsp::Seeds::next() << 32) | dsp::Seeds::next();
+			restart();
+		}
+	}
+
+	void toJson(json_t *rootJ) {
+		if (fixedSeed)
+			json_object_set_new(rootJ, "seed", json_integer((json_int_t)seed));
+	}
+
+	void fromJson(json_t *rootJ) {
+		json_t *seedJ = json_object_get(rootJ, "seed");
+		fixedSeed = seedJ != NULL;
+		if (seedJ) {
+			seed = (uint64_t)json_integer_value(seedJ);
+			restart();
+		}
+	}
+};
+
+/** Context menu toggle for SeededRandom::fixedSeed */
+struct FixedSeedItem : MenuItem {
+	SeededRandom *random;
+
+	void onAction(event::Action &e) override {
+		random->setFixedSeed(!random->fixedSeed);
+	}
+	void step() override {
+		rightText = random->fixedSeed ? "✔" : "";
+		MenuItem::step();
+	}
+};
+
+inline FixedSeedItem *createFixedSeedItem(SeededRandom *random) {
+	FixedSeedItem *item = new FixedSeedItem();
+	item->text = "Fixed random seed";
+	item->random = random;
+	return item;
+}
+
+} // namespace frozenwasteland
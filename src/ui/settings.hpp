@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "../FrozenWasteland.hpp"
+
+namespace frozenwasteland {
+
+/** Settings that belong to the machine rather than to a patch, read once from FrozenWasteland.json in the Rack user folder.
+A missing file, or missing keys, leave the defaults. Nothing writes the file; it is edited by hand, e.g.
+	{
+		"workerThreads": 3,
+		"workerCores": [5, 6, 7],
+		"workerRealtime": true,
+		"quality": "eco"
+	}
+*/
+struct PluginSettings {
+	/** Threads in the worker pool shared by every module's threaded mode */
+	int workerThreads = 2;
+	/** CPU cores the workers are pinned to, one each in turn. Empty, or no valid core numbers, leaves them to the scheduler. Linux only. */
+	std::vector<int> workerCores;
+	/** Ask for SCHED_FIFO priority for the workers, which needs the same rights as Rack's own realtime engine threads. Linux only. */
+	bool workerRealtime = false;
+	/** Quality tier every module uses unless its context menu overrides it: 0 eco, 1 standard, 2 high, or the highest a module offers. The file spells it "eco", "standard" or "high". */
+	int quality = 1;
+
+	static const PluginSettings &get() {
+		static const PluginSettings settings = load(asset::user("FrozenWasteland.json"));
+		return settings;
+	}
+
+	static PluginSettings load(const std::string &path) {
+		PluginSettings settings;
+		FILE *file = fopen(path.c_str(), "r");
+		if (!file)
+			return settings;
+		json_error_t error;
+		json_t *rootJ = json_loadf(file, 0, &error);
+		fclose(file);
+		if (!rootJ) {
+			WARN("%s: %s at line %d", path.c_str(), error.text, error.line);
+			return settings;
+		}
+
+		json_t *threadsJ = json_object_get(rootJ, "workerThreads");
+		if (threadsJ)
+			settings.workerThreads = json_integer_value(threadsJ);
+
+		json_t *coresJ = json_object_get(rootJ, "workerCores");
+		size_t i;
+		json_t *coreJ;
+		json_array_foreach(coresJ, i, coreJ) {
+			settings.workerCores.push_back(json_integer_value(coreJ));
+		}
+
+		json_t *realtimeJ = json_object_get(rootJ, "workerRealtime");
+		if (realtimeJ)
+			settings.workerRealtime = json_is_true(realtimeJ);
+
+		const char *quality = json_string_value(json_object_get(rootJ, "quality"));
+		const char *tiers[] = {"eco", "standard", "high"};
+		for (int tier = 0; quality && tier < 3; tier++) {
+			if (strcmp(quality, tiers[tier]) == 0)
+				settings.quality = tier;
+		}
+
+		json_decref(rootJ);
+		return settings;
+	}
+};
+
+} // namespace frozenwasteland
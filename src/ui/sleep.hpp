@@ -0,0 +1,48 @@
+#pragma once
+
+#include <math.h>
+
+namespace frozenwasteland {
+
+/** Lets an effect stop processing once its input and everything it is still sounding have gone quiet.
+The module does its cheap control work (triggers, lights, clocks) every sample as usual, then asks sleeping() before its DSP graph.
+While it is asleep it writes zeros and returns. Its internal state is left exactly as it was, already below the threshold, so the first non-silent input sample simply carries on from there.
+After each awake sample it reports its loudest input and its loudest tail (outputs, feedback paths, anything still ringing) to track().
+*/
+struct SleepDetector {
+	/** -120 dB below a 10 V peak */
+	float threshold = 1e-5f;
+	/** How long input and tail must stay below threshold. Delays set this to cover everything they can still play back. */
+	float holdTime = 1.0f;
+	float silentTime = 0.0f;
+	bool asleep = false;
+
+	/** True while the module can skip its DSP. Any input above the threshold wakes it straight away. */
+	bool sleeping(float input) {
+		if (!asleep)
+			return false;
+		if (fabsf(input) > threshold) {
+			wake();
+			return false;
+		}
+		return true;
+	}
+
+	void track(float input, float tail, float sampleTime) {
+		if (fabsf(input) > threshold || fabsf(tail) > threshold) {
+			silentTime = 0.0f;
+			return;
+		}
+		silentTime += sampleTime;
+		if (silentTime >= holdTime)
+			asleep = true;
+	}
+
+	/** Wake up and restart the silence count, e.g. on reset or when something other than input will make sound */
+	void wake() {
+		asleep = false;
+		silentTime = 0.0f;
+	}
+};
+
+} // namespace frozenwasteland
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+
+namespace frozenwasteland {
+
+/** Latest-value channel from the audio thread to a widget (triple buffer).
+The producer fills write() and calls publish(); the consumer calls read() and gets the most recent complete snapshot.
+Neither side ever blocks or waits on the other. Single producer, single consumer.
+*/
+template <typename T>
+struct SnapshotChannel {
+	static const int INDEX_MASK = 3;
+	static const int FRESH = 4;
+
+	T buffers[3] = {};
+	std::atomic<int> middle{1};
+	int back = 0; // producer only
+	int front = 2; // consumer only
+
+	/** Buffer to fill before publish(). Its contents are stale, so write every field. */
+	T &write() {
+		return buffers[back];
+	}
+	void publish() {
+		back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+	}
+	/** Returns true if a new snapshot arrived since the last call. The result is valid until the next read(). */
+	bool read(T &t) {
+		bool fresh = false;
+		if (middle.load(std::memory_order_relaxed) & FRESH) {
+			front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+			fresh = true;
+		}
+		t = buffers[front];
+		return fresh;
+	}
+};
+
+/** Lock-free FIFO for decimated samples from the audio thread to a widget.
+S must be a power of 2. When the widget isn't draining (e.g. scrolled off screen) new samples are dropped rather than blocking.
+Single producer, single consumer.
+*/
+template <typename T, size_t S>
+struct SampleChannel {
+	T data[S];
+	std::atomic<size_t> start{0};
+	std::atomic<size_t> end{0};
+
+	size_t mask(size_t i) const {
+		return i & (S - 1);
+	}
+	bool push(const T &t) {
+		size_t e = end.load(std::memory_order_relaxed);
+		if (e - start.load(std::memory_order_acquire) >= S)
+			return false;
+		data[mask(e)] = t;
+		end.store(e + 1, std::memory_order_release);
+		return true;
+	}
+	bool shift(T &t) {
+		size_t s = start.load(std::memory_order_relaxed);
+		if (s == end.load(std::memory_order_acquire))
+			return false;
+		t = data[mask(s)];
+		start.store(s + 1, std::memory_order_release);
+		return true;
+	}
+};
+
+} // namespace frozenwasteland
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <new>
+#include <stdint.h>
+#include "../FrozenWasteland.hpp"
+
+namespace frozenwasteland {
+
+/** Storage too big to build on the thread that creates the module, such as a delay's history buffers.
+request() hands the allocation to a worker thread, which builds a T and publishes it with an atomic pointer swap.
+T's constructor should write every page it owns (zeroing its buffers), so the page faults land on the worker rather than the engine.
+Until then get() returns NULL and the module plays silence or dry signal.
+T must say whether it got all of its memory through a bool allocated() const. If it didn't, or T itself couldn't be allocated, the failure is logged and get() stays NULL, so the module stays on that path for good.
+Deleting the module hands the storage back to a worker in the same way, so neither adding nor removing one stalls the UI or the engine.
+*/
+template <typename T>
+struct DeferredStorage {
+	// Shared with the worker, which may outlive the module if it is deleted while still allocating
+	struct Slot {
+		std::atomic<T *> storage{NULL};
+	};
+	std::shared_ptr<Slot> slot = std::make_shared<Slot>();
+	bool requested = false;
+
+	DeferredStorage() {}
+	DeferredStorage(const DeferredStorage &) = delete;
+	DeferredStorage &operator=(const DeferredStorage &) = delete;
+
+	~DeferredStorage() {
+		T *storage = slot->storage.exchange(released(), std::memory_order_acq_rel);
+		if (storage) {
+			std::thread([storage]() {
+				delete storage;
+			}).detach();
+		}
+	}
+
+	/** Starts building the storage, once. Call from the module's constructor. */
+	void request() {
+		if (requested)
+			return;
+		requested = true;
+		std::shared_ptr<Slot> shared = slot;
+		std::thread([shared]() {
+			T *storage = new (std::nothrow) T();
+			if (storage && !storage->allocated()) {
+				delete storage;
+				storage = NULL;
+			}
+			if (!storage) {
+				WARN("FrozenWasteland: could not allocate %zu bytes of module storage", sizeof(T));
+				return;
+			}
+			T *expected = NULL;
+			if (!shared->storage.compare_exchange_strong(expected, storage, std::memory_order_acq_rel)) {
+				// The module was deleted before we finished
+				delete storage;
+			}
+		}).detach();
+	}
+
+	/** The storage, or NULL while it is still being built */
+	T *get() const {
+		T *storage = slot->storage.load(std::memory_order_acquire);
+		return storage == released() ? NULL : storage;
+	}
+
+	static T *released() {
+		return reinterpret_cast<T *>(uintptr_t(1));
+	}
+};
+
+} // namespace frozenwasteland
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "settings.hpp"
+#include "denormal.hpp"
+
+namespace frozenwasteland {
+
+inline void cpuRelax() {
+#if defined(__SSE2__)
+	_mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+/** Work a module splits into parts that can run at the same time, such as one part per delay tap.
+The module submits it at the end of one block and waits for it at the start of the next, so the workers have a whole block to run it while the engine thread moves on.
+Parts must touch disjoint state, and the module combines their results in a fixed order, so its output doesn't depend on which thread ran which part.
+`make check-workers` runs a batch on the pool this way and checks it matches the same parts run inline, bit for bit.
+The number of parts is fixed, which keeps a worker still holding the last submission from claiming a part twice.
+*/
+struct WorkerBatch {
+	const int parts;
+	std::atomic<int> next;
+	std::atomic<int> done;
+
+	WorkerBatch(int parts) : parts(parts), next(parts), done(parts) {}
+	virtual ~WorkerBatch() {}
+	virtual void run(int part) = 0;
+
+	/** Starts every part. Everything the parts read must be written before this. */
+	void submit() {
+		done.store(0, std::memory_order_relaxed);
+		next.store(0, std::memory_order_release);
+	}
+
+	/** Runs one unclaimed part. False once every part has been claimed. */
+	bool help() {
+		if (next.load(std::memory_order_relaxed) >= parts)
+			return false;
+		int part = next.fetch_add(1, std::memory_order_acq_rel);
+		if (part >= parts)
+			return false;
+		run(part);
+		done.fetch_add(1, std::memory_order_release);
+		return true;
+	}
+
+	/** Runs any parts no worker has started, then spins until the rest are finished. With no workers this just runs the whole batch. */
+	void wait() {
+		while (help()) {}
+		while (done.load(std::memory_order_acquire) < parts)
+			cpuRelax();
+	}
+};
+
+/** A few threads, shared by every module, that spin waiting for WorkerBatches.
+Modules attach a batch while their threaded mode is on; submitting it is then two atomic stores, with no locks or allocation on the engine thread.
+Workers spin for about a block after their last part, so they are awake when the next submission comes, then yield, and only sleep once nothing has been submitted for a while.
+How many there are, which cores they are pinned to and whether they ask for realtime priority come from PluginSettings.
+*/
+struct WorkerPool {
+	static const int MAX_BATCHES = 64;
+	static const int MAX_THREADS = 16;
+	static const int SPIN_SCANS = 1 << 14;
+	static const int YIELD_SCANS = 1 << 20;
+
+	struct Slot {
+		std::atomic<WorkerBatch *> batch{NULL};
+		// Workers looking at this slot, so detach() knows when the batch is no longer in use
+		std::atomic<int> users{0};
+	};
+	Slot slots[MAX_BATCHES];
+	std::atomic<bool> started{false};
+	std::atomic<bool> running{true};
+	std::vector<std::thread> threads;
+
+	static WorkerPool &shared() {
+		static WorkerPool pool;
+		return pool;
+	}
+
+	~WorkerPool() {
+		running = false;
+		for (std::thread &thread : threads)
+			thread.join();
+	}
+
+	/** Starts the workers, once. It creates threads, so call it off the engine thread, e.g. when a module's threaded mode is switched on or loaded. */
+	void start() {
+		bool expected = false;
+		if (!started.compare_exchange_strong(expected, true))
+			return;
+		const PluginSettings &settings = PluginSettings::get();
+		int count = clamp(settings.workerThreads, 0, MAX_THREADS);
+		for (int i = 0; i < count; i++) {
+			threads.emplace_back([this, i, &settings]() {
+				configure(i, settings);
+				work();
+			});
+		}
+		INFO("FrozenWasteland: %d worker threads", count);
+	}
+
+	/** Gives the workers a batch to watch. Returns its slot, or -1 if every slot is taken, in which case WorkerBatch::wait() runs it all on the calling thread. */
+	int attach(WorkerBatch *batch) {
+		for (int i = 0; i < MAX_BATCHES; i++) {
+			WorkerBatch *empty = NULL;
+			if (slots[i].batch.compare_exchange_strong(empty, batch))
+				return i;
+		}
+		return -1;
+	}
+
+	/** Takes a batch back. Once this returns no worker is looking at it, so it can be destroyed. */
+	void detach(int slot) {
+		if (slot < 0)
+			return;
+		slots[slot].batch.store(NULL);
+		while (slots[slot].users.load() > 0)
+			cpuRelax();
+	}
+
+	void configure(int index, const PluginSettings &settings) {
+#if defined(__linux__)
+		pthread_setname_np(pthread_self(), "fw-worker");
+		// CPU_SET has no bounds check, so cores outside the set are left out
+		std::vector<int> cores;
+		for (int core : settings.workerCores) {
+			if (core >= 0 && core < CPU_SETSIZE)
+				cores.push_back(core);
+			else if (index == 0)
+				WARN("FrozenWasteland: ignoring worker core %d", core);
+		}
+		if (!cores.empty()) {
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			CPU_SET(cores[index % cores.size()], &cpus);
+			if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+				WARN("FrozenWasteland: could not pin worker %d", index);
+		}
+		if (settings.workerRealtime) {
+			sched_param param;
+			param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1;
+			if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+				WARN("FrozenWasteland: no realtime priority for worker %d", index);
+		}
+#endif
+	}
+
+	void work() {
+		// Same floating point mode as the engine threads, for the workers' whole life
+		DenormalGuard denormalGuard;
+		int idle = 0;
+		while (running.load(std::memory_order_relaxed)) {
+			bool worked = false;
+			for (Slot &slot : slots) {
+				if (!slot.batch.load(std::memory_order_relaxed))
+					continue;
+				slot.users.fetch_add(1);
+				WorkerBatch *batch = slot.batch.load();
+				if (batch) {
+					while (batch->help())
+						worked = true;
+				}
+				slot.users.fetch_sub(1);
+			}
+
+			if (worked)
+				idle = 0;
+			else if (idle < YIELD_SCANS)
+				idle++;
+			if (idle < SPIN_SCANS)
+				cpuRelax();
+			else if (idle < YIELD_SCANS)
+				std::this_thread::yield();
+			else
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+};
+
+} // namespace frozenwasteland
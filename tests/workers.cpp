@@ -0,0 +1,145 @@
+// Runs a WorkerBatch through the real WorkerPool loop the way Portland Weather runs its taps, and checks it against the same work done inline.
+// Each part keeps its own recursive state from block to block and writes its own buffer. The threaded run submits a block at its end and mixes it, in part order, at the start of the next.
+// Its output has to match the inline run bit for bit, one block later, whichever workers ran which parts, and while another thread attaches and detaches the batch as the menu does.
+// Built and run by `make check-workers`.
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../src/ui/workers.hpp"
+
+using namespace frozenwasteland;
+
+static const int PARTS = 16;
+static const int FRAMES = 32;
+static const int BLOCKS = 20000;
+
+// Stands in for a tap: a saturating resonant filter, ring modulated by its own oscillator
+struct Part {
+	float z1 = 0.0f;
+	float z2 = 0.0f;
+	float phase = 0.0f;
+
+	void run(int part, const float *in, float *out, int frames) {
+		for (int n = 0; n < frames; n++) {
+			phase += 0.0007f * (part + 1);
+			if (phase >= 1.0f)
+				phase -= 1.0f;
+			float y = in[n] * sinf(2.0f * M_PI * phase) + 1.6f * z1 - 0.8f * z2;
+			z2 = z1;
+			z1 = tanhf(y);
+			out[n] = z1 * (part + 1) / PARTS;
+		}
+	}
+};
+
+struct Batch : WorkerBatch {
+	Part parts[PARTS];
+	float in[FRAMES];
+	float wet[PARTS][FRAMES];
+
+	Batch() : WorkerBatch(PARTS) {}
+
+	void run(int part) override {
+		parts[part].run(part, in, wet[part], FRAMES);
+	}
+
+	void input(int block) {
+		for (int n = 0; n < FRAMES; n++) {
+			int t = block * FRAMES + n;
+			in[n] = sinf(t * 0.01f) + 0.3f * sinf(t * 0.173f);
+		}
+	}
+
+	// Always in part order, as mixTaps does
+	void mix(float *out) {
+		for (int n = 0; n < FRAMES; n++)
+			out[n] = 0.0f;
+		for (int part = 0; part < PARTS; part++) {
+			for (int n = 0; n < FRAMES; n++)
+				out[n] += wet[part][n];
+		}
+	}
+};
+
+static void runInline(std::vector<float> &out) {
+	Batch batch;
+	for (int block = 0; block < BLOCKS; block++) {
+		batch.input(block);
+		for (int part = 0; part < PARTS; part++)
+			batch.run(part);
+		batch.mix(&out[block * FRAMES]);
+	}
+}
+
+static void runThreaded(std::vector<float> &out, int workers, bool toggle) {
+	WorkerPool pool;
+	for (int i = 0; i < workers; i++) {
+		pool.threads.emplace_back([&pool]() {
+			pool.work();
+		});
+	}
+
+	Batch batch;
+	std::atomic<bool> done{false};
+	int slot = toggle ? -1 : pool.attach(&batch);
+	std::thread toggler;
+	if (toggle) {
+		toggler = std::thread([&]() {
+			int slot = -1;
+			for (int i = 0; !done; i++) {
+				if (slot < 0)
+					slot = pool.attach(&batch);
+				else {
+					pool.detach(slot);
+					slot = -1;
+				}
+				std::this_thread::sleep_for(std::chrono::microseconds(50 + 37 * (i % 7)));
+			}
+			pool.detach(slot);
+		});
+	}
+
+	for (int block = 0; block < BLOCKS; block++) {
+		batch.wait();
+		if (block > 0)
+			batch.mix(&out[(block - 1) * FRAMES]);
+		batch.input(block);
+		batch.submit();
+	}
+	batch.wait();
+	batch.mix(&out[(BLOCKS - 1) * FRAMES]);
+
+	done = true;
+	if (toggle)
+		toggler.join();
+	pool.detach(slot);
+}
+
+int main() {
+	std::vector<float> expected(BLOCKS * FRAMES);
+	runInline(expected);
+
+	int failures = 0;
+	const int workerCounts[] = {0, 1, 2, 4};
+	for (int workers : workerCounts) {
+		for (int toggle = 0; toggle < 2; toggle++) {
+			std::vector<float> out(BLOCKS * FRAMES);
+			runThreaded(out, workers, toggle);
+			int block = 0;
+			while (block < BLOCKS && memcmp(&out[block * FRAMES], &expected[block * FRAMES], sizeof(float) * FRAMES) == 0)
+				block++;
+			if (block < BLOCKS) {
+				printf("FAIL: %d workers%s: block %d differs from the inline run\n", workers, toggle ? ", attach toggling" : "", block);
+				failures++;
+			}
+			else {
+				printf("ok: %d workers%s: %d blocks match the inline run\n", workers, toggle ? ", attach toggling" : "", BLOCKS);
+			}
+		}
+	}
+	return failures ? 1 : 0;
+}